@@ -24,7 +24,30 @@ ifeq ($(crm_testu), true)
 include $(LOCAL_PATH)/../../../makefiles/crm_clear.mk
 CRM_NAME := test_teljavabridged
 
-CRM_SRC := $(call all-c-files-under, test)
+CRM_SRC := test/test_bridge.c
+
+CRM_SHARED_LIBS := libcrm_utils libtel_java_bridge
+
+CRM_DISABLE_ANDROID_TARGET := true
+CRM_TARGET := $(BUILD_EXECUTABLE)
+include $(LOCAL_PATH)/../../../makefiles/crm_c_make.mk
+
+include $(LOCAL_PATH)/../../../makefiles/crm_clear.mk
+CRM_NAME := test_teljavabridged_load
+
+CRM_SRC := test/load_test.c
+
+CRM_SHARED_LIBS := libcrm_utils libtel_java_bridge
+
+CRM_DISABLE_ANDROID_TARGET := true
+CRM_TARGET := $(BUILD_EXECUTABLE)
+include $(LOCAL_PATH)/../../../makefiles/crm_c_make.mk
+
+include $(LOCAL_PATH)/../../../makefiles/crm_clear.mk
+CRM_NAME := test_teljavabridged_batch
+
+CRM_SRC := test/batch_test.c
+CRM_INCS := $(LOCAL_PATH)/inc
 
 CRM_SHARED_LIBS := libcrm_utils libtel_java_bridge
 
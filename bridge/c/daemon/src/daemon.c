@@ -25,9 +25,12 @@
  */
 
 #include <errno.h>
-#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <sys/epoll.h>
 
 #include <cutils/sockets.h>
 
@@ -35,7 +38,9 @@
 #define CRM_MODULE_TAG "JVBD"
 #include "utils/debug.h"
 #include "utils/common.h"
+#include "utils/keys.h"
 #include "utils/logs.h"
+#include "utils/property.h"
 #include "utils/time.h"
 
 #ifdef HOST_BUILD
@@ -44,13 +49,12 @@
 
 #include "bridge_internal.h"
 
-/* @TODO: remove ... or make it configurable / dynamic ?
- *        Today 3 due to:
- *          = CRM
- *          = RIL (Rapid / AT)
- *          = AT Proxy
+/* The client table grows on demand (several CRM instances, RIL, AT proxy, vendor daemons...).
+ * The limit only protects the daemon against a client leaking connections.
  */
-#define MAX_CLIENTS 3
+#define MAX_CLIENTS 64
+#define CLIENTS_BACKLOG 8
+#define MAX_EVENTS 16
 
 /* To prevent entering an infinite loop in case a client sends a message that generates
  * an exception in the Java application (or makes it crash), limit the number of attempts
@@ -62,6 +66,23 @@
 #define MAX_JAVA_MSG_DURATION 1000
 #define MAX_JAVA_ACK_DURATION 5000 // Very long time-out due to SoFIA's speed :)
 #define MAX_MSG_SIZE 2048
+#define MSG_SLOT_SIZE (3 * sizeof(uint32_t) + MAX_MSG_SIZE)
+
+/* Messages waiting to be sent to the Java application are stored in a preallocated ring per
+ * client. Several messages are written at once to the Java application (batch) and acknowledged
+ * one by one. Batches are filled in round robin between clients, so that a client flooding the
+ * bridge only fills its own queue. The wakelock message, if any, is always the first message of
+ * a batch: a flood of intents delays a wakelock change by one batch at most.
+ * A client whose queue is full is not read anymore until a message of its queue is acknowledged:
+ * messages wait in the socket, nothing is dropped.
+ */
+#define CLIENT_QUEUE_SIZE 16
+#define MAX_BATCH_MSGS 8
+#define MAX_BATCH_SIZE (2 * MSG_SLOT_SIZE)
+
+/* Statistics are published in CRM_KEY_JAVA_BRIDGE_STATS, at most once per period unless a message
+ * is retried or dropped */
+#define STATS_PERIOD 1000
 
 typedef enum msg_state {
     MSG_STATE_NONE,
@@ -69,41 +90,62 @@ typedef enum msg_state {
     MSG_STATE_IN_MSG
 } msg_state_t;
 
-typedef struct client_context {
+typedef enum source_type {
+    SOURCE_C_LISTEN,
+    SOURCE_JAVA_LISTEN,
+    SOURCE_C_CLIENT,
+    SOURCE_JAVA
+} source_type_t;
+
+/* Registered in epoll as event data. Must be the first member of the contexts */
+typedef struct event_source {
+    source_type_t type;
     int fd;
+} event_source_t;
+
+typedef struct msg_slot {
+    char msg[MSG_SLOT_SIZE];
+    int msg_size;
+    int retries;
+} msg_slot_t;
+
+typedef struct client_context {
+    event_source_t src;
 
     msg_state_t msg_state;
 
     uint32_t msg_hdr[2];
-    char *msg_buffer;
+    char msg_buffer[MSG_SLOT_SIZE];
     int data_read;
     int data_to_read;
 
     int wakelock_cnt;
 
     struct timespec msg_read_end;
-} client_context_t;
 
-typedef struct msg_queue {
-    char *msg;
-    int msg_size;
-    int retries;
-    struct msg_queue *next;
-} msg_queue_t;
+    msg_slot_t queue[CLIENT_QUEUE_SIZE];
+    int queue_head;
+    int queue_len;
+    int queue_sent; // messages of the queue part of the current batch
+    bool paused;    // not read while the queue is full
+} client_context_t;
 
 typedef struct java_context {
-    int fd;
+    event_source_t src;
+    uint32_t events;
     uint32_t msg_count;
 
     struct timespec msg_end;
     bool msg_in_progress;
 
-    msg_queue_t *msg_queue;
-    msg_queue_t *msg_queue_tail;
-
-    uint32_t wakelock_msg[3];
+    char batch[MAX_BATCH_SIZE];
+    client_context_t *batch_src[MAX_BATCH_MSGS]; // NULL for the wakelock message
+    int batch_msgs;
+    int batch_acked;
+    bool batch_wakelock;
+    bool batch_wakelock_acquire;
+    struct timespec batch_begin;
 
-    char *msg;
     int data_to_send;
     int data_sent;
 
@@ -114,17 +156,43 @@ typedef struct java_context {
 
     uint32_t ack_reply;
     int ack_reply_pos;
+
+    struct {
+        int queue_max;
+        int dropped;
+        int retries;
+        int paused;
+        int ack_latency_max;
+        struct timespec next_publish;
+    } stats;
 } java_context_t;
 
 typedef struct daemon_context {
-    int c_sock_l;
-    int j_sock_l;
+    int epoll_fd;
+    event_source_t c_sock_l;
+    event_source_t j_sock_l;
     bool wakelock_held;
+    int wakelock_clients;
+
+    client_context_t **clients;
+    int clients_nb;
+    int clients_size;
+    int clients_reading;
+    int clients_closed;
+    int queued_msgs;
+    int rr_next;
 
-    client_context_t client_ctx[MAX_CLIENTS];
     java_context_t java_ctx;
 } daemon_context_t;
 
+static inline uint32_t get_msg_type(const char *msg)
+{
+    uint32_t type;
+
+    memcpy(&type, msg + 2 * sizeof(uint32_t), sizeof(type));
+    return ntohl(type);
+}
+
 static const char *msg_to_string(uint32_t msg)
 {
     switch (msg) {
@@ -188,179 +256,334 @@ static inline int socket_create(const char *socket_name, int max_conn)
     return fd;
 }
 
-static int fill_pollfd(daemon_context_t *ctx, struct pollfd *pfd)
+static void prepare_batch(daemon_context_t *ctx)
+{
+    ASSERT(ctx);
+
+    java_context_t *j_ctx = &ctx->java_ctx;
+
+    j_ctx->msg_in_progress = true;
+    j_ctx->data_sent = 0;
+    j_ctx->data_to_send = 0;
+    j_ctx->batch_msgs = 0;
+    j_ctx->batch_acked = 0;
+    j_ctx->wait_ack_count = j_ctx->msg_count;
+    crm_time_add_ms(&j_ctx->msg_end, MAX_JAVA_MSG_DURATION);
+    crm_time_add_ms(&j_ctx->batch_begin, 0);
+
+    j_ctx->batch_wakelock = j_ctx->wakelock_held != ctx->wakelock_held;
+    if (j_ctx->batch_wakelock) {
+        j_ctx->batch_wakelock_acquire = ctx->wakelock_held;
+        tel_bridge_commands_t cmd_id = ctx->wakelock_held ?
+                                       TEL_BRIDGE_COMMAND_WAKELOCK_ACQUIRE :
+                                       TEL_BRIDGE_COMMAND_WAKELOCK_RELEASE;
+        uint32_t msg[3] = { htonl(j_ctx->msg_count++), htonl(0), htonl(cmd_id) };
+        memcpy(j_ctx->batch, msg, sizeof(msg));
+        j_ctx->data_to_send = sizeof(msg);
+        j_ctx->batch_src[j_ctx->batch_msgs++] = NULL;
+        LOGD("[%2d] Sending message %s", j_ctx->src.fd, msg_to_string(cmd_id));
+    }
+
+    /* One message per client and per round. The next batch starts with the first client not
+     * served by this one */
+    int idle = 0;
+    int i = ctx->clients_nb > 0 ? ctx->rr_next % ctx->clients_nb : 0;
+    while (j_ctx->batch_msgs < MAX_BATCH_MSGS && idle < ctx->clients_nb) {
+        client_context_t *client = ctx->clients[i];
+        if (client->queue_sent < client->queue_len) {
+            msg_slot_t *slot =
+                &client->queue[(client->queue_head + client->queue_sent) % CLIENT_QUEUE_SIZE];
+            if (j_ctx->data_to_send + slot->msg_size > (int)sizeof(j_ctx->batch))
+                break;
+
+            /* message id is set when the message is sent, ACKs are then received in order */
+            uint32_t id = htonl(j_ctx->msg_count++);
+            memcpy(slot->msg, &id, sizeof(id));
+            memcpy(j_ctx->batch + j_ctx->data_to_send, slot->msg, slot->msg_size);
+            j_ctx->data_to_send += slot->msg_size;
+            j_ctx->batch_src[j_ctx->batch_msgs++] = client;
+            client->queue_sent++;
+            idle = 0;
+            LOGD("[%2d] Sending message %s from client %d", j_ctx->src.fd,
+                 msg_to_string(get_msg_type(slot->msg)), client->src.fd);
+        } else {
+            idle++;
+        }
+        i = (i + 1) % ctx->clients_nb;
+    }
+    ctx->rr_next = i;
+}
+
+static void update_java_events(daemon_context_t *ctx)
+{
+    ASSERT(ctx);
+
+    java_context_t *j_ctx = &ctx->java_ctx;
+
+    if (j_ctx->src.fd < 0)
+        return;
+
+    uint32_t events = 0;
+    if (j_ctx->wait_ack) {
+        events = EPOLLIN;
+    } else if (ctx->queued_msgs > 0 || j_ctx->wakelock_held != ctx->wakelock_held ||
+               j_ctx->msg_in_progress) {
+        events = EPOLLOUT;
+        if (!j_ctx->msg_in_progress)
+            prepare_batch(ctx);
+    }
+
+    if (events != j_ctx->events) {
+        struct epoll_event ev = { .events = events, .data.ptr = &j_ctx->src };
+        ASSERT(epoll_ctl(ctx->epoll_fd, EPOLL_CTL_MOD, j_ctx->src.fd, &ev) == 0);
+        j_ctx->events = events;
+    }
+}
+
+static int get_timeout(daemon_context_t *ctx)
 {
     ASSERT(ctx);
-    ASSERT(pfd);
 
     int timeout = -1;
-    size_t i;
-
-    // Client sockets
-    for (i = 0; i < ARRAY_SIZE(ctx->client_ctx); i++) {
-        pfd[i].fd = ctx->client_ctx[i].fd;
-        pfd[i].events = POLLIN;
-        if (ctx->client_ctx[i].fd >= 0 && ctx->client_ctx[i].msg_state != MSG_STATE_NONE) {
-            int to = crm_time_get_remain_ms(&ctx->client_ctx[i].msg_read_end);
+
+    // Client sockets: only scanned if a message is being read
+    for (int i = 0; i < ctx->clients_nb && ctx->clients_reading > 0; i++) {
+        client_context_t *client = ctx->clients[i];
+        if (client->src.fd >= 0 && client->msg_state != MSG_STATE_NONE) {
+            int to = crm_time_get_remain_ms(&client->msg_read_end);
             if (timeout == -1 || to < timeout)
                 timeout = to;
         }
     }
     // Java bridge socket
-    pfd[i].fd = ctx->java_ctx.fd;
-    if (ctx->java_ctx.fd >= 0) {
-        if (ctx->java_ctx.wait_ack) {
-            pfd[i].events = POLLIN;
-        } else if (ctx->java_ctx.msg_queue ||
-                   ctx->java_ctx.wakelock_held != ctx->wakelock_held ||
-                   ctx->java_ctx.msg_in_progress) {
-            pfd[i].events = POLLOUT;
-            if (!ctx->java_ctx.msg_in_progress) {
-                ctx->java_ctx.msg_in_progress = true;
-                ctx->java_ctx.data_sent = 0;
-                crm_time_add_ms(&ctx->java_ctx.msg_end, MAX_JAVA_MSG_DURATION);
-                if (ctx->java_ctx.wakelock_held != ctx->wakelock_held) {
-                    ctx->java_ctx.data_to_send = sizeof(ctx->java_ctx.wakelock_msg);
-                    ctx->java_ctx.msg = (char *)ctx->java_ctx.wakelock_msg;
-                    ctx->java_ctx.wakelock_msg[0] = htonl(ctx->java_ctx.msg_count++);
-                    ctx->java_ctx.wakelock_msg[1] = htonl(0);
-                    tel_bridge_commands_t cmd_id = ctx->wakelock_held ?
-                                                   TEL_BRIDGE_COMMAND_WAKELOCK_ACQUIRE :
-                                                   TEL_BRIDGE_COMMAND_WAKELOCK_RELEASE;
-                    ctx->java_ctx.wakelock_msg[2] = htonl(cmd_id);
-                } else {
-                    ctx->java_ctx.data_to_send = ctx->java_ctx.msg_queue->msg_size;
-                    ctx->java_ctx.msg = ctx->java_ctx.msg_queue->msg;
-                }
-                LOGD("[%2d] Sending message %s", ctx->java_ctx.fd,
-                     msg_to_string(ntohl(((uint32_t *)ctx->java_ctx.msg)[2])));
-            }
-        }
-        if (ctx->java_ctx.msg_in_progress || ctx->java_ctx.wait_ack) {
-            int to = crm_time_get_remain_ms(&ctx->java_ctx.msg_end);
-            if (timeout == -1 || to < timeout)
-                timeout = to;
-        }
+    if (ctx->java_ctx.src.fd >= 0 && (ctx->java_ctx.msg_in_progress || ctx->java_ctx.wait_ack)) {
+        int to = crm_time_get_remain_ms(&ctx->java_ctx.msg_end);
+        if (timeout == -1 || to < timeout)
+            timeout = to;
     }
 
     return timeout;
 }
 
-static void handle_wakelock_change(daemon_context_t *ctx)
+static void register_source(daemon_context_t *ctx, event_source_t *src, uint32_t events)
+{
+    ASSERT(ctx);
+    ASSERT(src);
+
+    struct epoll_event ev = { .events = events, .data.ptr = src };
+    ASSERT(epoll_ctl(ctx->epoll_fd, EPOLL_CTL_ADD, src->fd, &ev) == 0);
+}
+
+static void close_source(daemon_context_t *ctx, event_source_t *src)
+{
+    ASSERT(ctx);
+    ASSERT(src);
+
+    epoll_ctl(ctx->epoll_fd, EPOLL_CTL_DEL, src->fd, NULL);
+    close(src->fd);
+    src->fd = -1;
+}
+
+static void set_client_state(daemon_context_t *ctx, client_context_t *client, msg_state_t state)
+{
+    ASSERT(ctx);
+    ASSERT(client);
+
+    if ((client->msg_state == MSG_STATE_NONE) != (state == MSG_STATE_NONE))
+        ctx->clients_reading += state == MSG_STATE_NONE ? -1 : 1;
+    client->msg_state = state;
+}
+
+static void handle_wakelock_change(daemon_context_t *ctx, client_context_t *client, int cnt)
+{
+    ASSERT(ctx);
+    ASSERT(client);
+
+    if ((client->wakelock_cnt > 0) != (cnt > 0))
+        ctx->wakelock_clients += cnt > 0 ? 1 : -1;
+    client->wakelock_cnt = cnt;
+    ctx->wakelock_held = ctx->wakelock_clients > 0;
+}
+
+static void publish_stats(daemon_context_t *ctx, bool now)
+{
+    ASSERT(ctx);
+
+    java_context_t *j_ctx = &ctx->java_ctx;
+
+    if (!now && crm_time_get_remain_ms(&j_ctx->stats.next_publish) > 0)
+        return;
+
+    char value[CRM_PROPERTY_VALUE_MAX];
+    snprintf(value, sizeof(value), "queue:%d/%d latency_max:%dms retries:%d dropped:%d paused:%d",
+             ctx->queued_msgs, j_ctx->stats.queue_max, j_ctx->stats.ack_latency_max,
+             j_ctx->stats.retries, j_ctx->stats.dropped, j_ctx->stats.paused);
+    crm_property_set(CRM_KEY_JAVA_BRIDGE_STATS, value);
+    crm_time_add_ms(&j_ctx->stats.next_publish, STATS_PERIOD);
+}
+
+static void pause_client(daemon_context_t *ctx, client_context_t *client)
+{
+    ASSERT(ctx);
+    ASSERT(client);
+
+    LOGD("[%2d] queue full, client paused", client->src.fd);
+    epoll_ctl(ctx->epoll_fd, EPOLL_CTL_DEL, client->src.fd, NULL);
+    client->paused = true;
+    ctx->java_ctx.stats.paused++;
+}
+
+static void pop_msg(daemon_context_t *ctx, client_context_t *client)
 {
     ASSERT(ctx);
+    ASSERT(client);
+    ASSERT(client->queue_len > 0);
 
-    bool new_is_held = false;
+    client->queue_head = (client->queue_head + 1) % CLIENT_QUEUE_SIZE;
+    client->queue_len--;
+    ctx->queued_msgs--;
 
-    for (size_t i = 0; i < ARRAY_SIZE(ctx->client_ctx) && !new_is_held; i++)
-        new_is_held = ctx->client_ctx[i].fd != -1 && ctx->client_ctx[i].wakelock_cnt > 0;
-    ctx->wakelock_held = new_is_held;
+    if (client->paused && client->src.fd >= 0) {
+        LOGD("[%2d] client resumed", client->src.fd);
+        register_source(ctx, &client->src, EPOLLIN);
+        client->paused = false;
+    }
 }
 
 static void handle_java_bridge_remove(daemon_context_t *ctx)
 {
     ASSERT(ctx);
 
-    close(ctx->java_ctx.fd);
-    ctx->java_ctx.fd = -1;
+    java_context_t *j_ctx = &ctx->java_ctx;
 
-    if (ctx->java_ctx.msg != (char *)ctx->java_ctx.wakelock_msg) {
-        msg_queue_t *to_free = ctx->java_ctx.msg_queue;
-        ASSERT(to_free);
-        to_free->retries += 1;
-        if (to_free->retries >= MAX_RETRIES) {
+    close_source(ctx, &j_ctx->src);
+
+    if (!j_ctx->msg_in_progress && !j_ctx->wait_ack)
+        return;
+
+    /* Messages not acknowledged are sent again in the next batch */
+    for (int i = j_ctx->batch_acked; i < j_ctx->batch_msgs; i++)
+        if (j_ctx->batch_src[i])
+            j_ctx->batch_src[i]->queue_sent--;
+
+    /* Only the first queued message not acknowledged is blamed for the disconnection */
+    client_context_t *client = j_ctx->batch_acked < j_ctx->batch_msgs ?
+                               j_ctx->batch_src[j_ctx->batch_acked] : NULL;
+    if (client) {
+        msg_slot_t *slot = &client->queue[client->queue_head];
+        ASSERT(client->queue_len > 0);
+        slot->retries += 1;
+        j_ctx->stats.retries++;
+        if (slot->retries >= MAX_RETRIES) {
             LOGE("[  ] Message %s dropped due to max retries",
-                 msg_to_string(ntohl(((uint32_t *)ctx->java_ctx.msg)[2])));
-            ctx->java_ctx.msg_queue = to_free->next;
-            if (ctx->java_ctx.msg_queue == NULL)
-                ctx->java_ctx.msg_queue_tail = NULL;
-            free(to_free->msg);
-            free(to_free);
+                 msg_to_string(get_msg_type(slot->msg)));
+            j_ctx->stats.dropped++;
+            pop_msg(ctx, client);
         }
+        publish_stats(ctx, true);
     }
+    j_ctx->msg_in_progress = false;
+    j_ctx->wait_ack = false;
+}
+
+static void handle_c_client_remove(daemon_context_t *ctx, client_context_t *client)
+{
+    ASSERT(ctx);
+    ASSERT(client);
+
+    /* The context is released once its queued messages are sent to the Java application */
+    close_source(ctx, &client->src);
+    set_client_state(ctx, client, MSG_STATE_NONE);
+    handle_wakelock_change(ctx, client, 0);
+    ctx->clients_closed++;
 }
 
-static void handle_c_client_remove(daemon_context_t *ctx, int client_idx)
+static void release_clients(daemon_context_t *ctx)
 {
     ASSERT(ctx);
 
-    client_context_t *client_ctx = &ctx->client_ctx[client_idx];
+    for (int i = 0; i < ctx->clients_nb && ctx->clients_closed > 0; i++) {
+        client_context_t *client = ctx->clients[i];
+        if (client->src.fd >= 0 || client->queue_len > 0)
+            continue;
 
-    close(client_ctx->fd);
-    client_ctx->fd = -1;
-    free(client_ctx->msg_buffer);
-    if (client_ctx->wakelock_cnt > 0)
-        handle_wakelock_change(ctx);
+        free(client);
+        ctx->clients_closed--;
+        ctx->clients[i--] = ctx->clients[--ctx->clients_nb];
+    }
 }
 
 static void handle_timeout(daemon_context_t *ctx)
 {
     ASSERT(ctx);
 
-    for (size_t i = 0; i < ARRAY_SIZE(ctx->client_ctx); i++) {
-        if (ctx->client_ctx[i].fd >= 0 && ctx->client_ctx[i].msg_state != MSG_STATE_NONE) {
-            int to = crm_time_get_remain_ms(&ctx->client_ctx[i].msg_read_end);
+    for (int i = 0; i < ctx->clients_nb && ctx->clients_reading > 0; i++) {
+        client_context_t *client = ctx->clients[i];
+        if (client->src.fd >= 0 && client->msg_state != MSG_STATE_NONE) {
+            int to = crm_time_get_remain_ms(&client->msg_read_end);
             if (to == 0) {
-                LOGE("[%2d] error reading on socket, client disconnected", ctx->client_ctx[i].fd);
-                handle_c_client_remove(ctx, i);
+                LOGE("[%2d] error reading on socket, client disconnected", client->src.fd);
+                handle_c_client_remove(ctx, client);
             }
         }
     }
-    if (ctx->java_ctx.fd >= 0 && (ctx->java_ctx.msg_in_progress || ctx->java_ctx.wait_ack)) {
+    if (ctx->java_ctx.src.fd >= 0 && (ctx->java_ctx.msg_in_progress || ctx->java_ctx.wait_ack)) {
         int to = crm_time_get_remain_ms(&ctx->java_ctx.msg_end);
         if (to == 0) {
-            LOGE("[%2d] timeout in java bridge communication, disconnected", ctx->java_ctx.fd);
+            LOGE("[%2d] timeout in java bridge communication, disconnected", ctx->java_ctx.src.fd);
             handle_java_bridge_remove(ctx);
         }
     }
 }
 
-static void handle_c_client_conn(daemon_context_t *ctx, struct pollfd *pfd)
+static void handle_c_client_conn(daemon_context_t *ctx, uint32_t events)
 {
     ASSERT(ctx);
-    ASSERT(pfd);
 
-    if (pfd->revents == POLLIN) {
+    if (events == EPOLLIN) {
         /* New client connection on C control socket */
-        int sock = accept(pfd->fd, 0, 0);
-        if (sock >= 0) {
-            for (size_t i = 0; i < ARRAY_SIZE(ctx->client_ctx); i++) {
-                if (ctx->client_ctx[i].fd == -1) {
-                    LOGD("[%2d] client connected", sock);
-                    ctx->client_ctx[i].fd = sock;
-                    ctx->client_ctx[i].msg_state = MSG_STATE_NONE;
-                    ctx->client_ctx[i].wakelock_cnt = 0;
-                    sock = -1;
-                    break;
-                }
-            }
-            if (sock >= 0) {
-                LOGE("Too many clients connected, rejecting connection");
-                close(sock);
-            }
-        } else {
+        int sock = accept(ctx->c_sock_l.fd, 0, 0);
+        if (sock < 0) {
             LOGE("Error accepting connection on C control socket");
+        } else if (ctx->clients_nb == MAX_CLIENTS) {
+            LOGE("Too many clients connected, rejecting connection");
+            close(sock);
+        } else {
+            if (ctx->clients_nb == ctx->clients_size) {
+                ctx->clients_size = ctx->clients_size ? 2 * ctx->clients_size : 4;
+                ctx->clients = realloc(ctx->clients, ctx->clients_size * sizeof(*ctx->clients));
+                ASSERT(ctx->clients);
+            }
+            client_context_t *client = calloc(1, sizeof(*client));
+            ASSERT(client);
+            client->src.type = SOURCE_C_CLIENT;
+            client->src.fd = sock;
+            client->msg_state = MSG_STATE_NONE;
+            ctx->clients[ctx->clients_nb++] = client;
+            register_source(ctx, &client->src, EPOLLIN);
+            LOGD("[%2d] client connected (%d clients)", sock, ctx->clients_nb);
         }
     } else {
         DASSERT(0, "Error on C control socket");
     }
 }
 
-static void handle_java_bridge_conn(daemon_context_t *ctx, struct pollfd *pfd)
+static void handle_java_bridge_conn(daemon_context_t *ctx, uint32_t events)
 {
     ASSERT(ctx);
-    ASSERT(pfd);
 
-    if (pfd->revents == POLLIN) {
+    if (events == EPOLLIN) {
         /* Java bridge connection on Java control socket */
-        int sock = accept(pfd->fd, 0, 0);
+        int sock = accept(ctx->j_sock_l.fd, 0, 0);
         if (sock >= 0) {
-            if (ctx->java_ctx.fd == -1) {
-                ctx->java_ctx.fd = sock;
+            if (ctx->java_ctx.src.fd == -1) {
+                ctx->java_ctx.src.fd = sock;
+                ctx->java_ctx.events = 0;
                 ctx->java_ctx.msg_in_progress = false;
                 ctx->java_ctx.wait_ack = false;
                 ctx->java_ctx.data_sent = 0;
                 ctx->java_ctx.wakelock_held = false;
+                register_source(ctx, &ctx->java_ctx.src, 0);
                 LOGD("[%2d] java bridge connected", sock);
             } else {
                 LOGE("Too many bridges connected, rejecting connection");
@@ -374,192 +597,208 @@ static void handle_java_bridge_conn(daemon_context_t *ctx, struct pollfd *pfd)
     }
 }
 
-static void handle_java_bridge_event(daemon_context_t *ctx, struct pollfd *pfd)
+static void handle_java_bridge_ack(daemon_context_t *ctx)
 {
     ASSERT(ctx);
-    ASSERT(pfd);
+
+    java_context_t *j_ctx = &ctx->java_ctx;
+
+    client_context_t *client = j_ctx->batch_src[j_ctx->batch_acked];
+    if (client) {
+        client->queue_sent--;
+        pop_msg(ctx, client);
+    } else {
+        j_ctx->wakelock_held = j_ctx->batch_wakelock_acquire;
+    }
+
+    j_ctx->ack_reply_pos = 0;
+    j_ctx->wait_ack_count++;
+    if (++j_ctx->batch_acked < j_ctx->batch_msgs) {
+        crm_time_add_ms(&j_ctx->msg_end, MAX_JAVA_ACK_DURATION);
+        return;
+    }
+
+    j_ctx->wait_ack = false;
+    int latency = crm_time_get_elapsed_ms(&j_ctx->batch_begin);
+    j_ctx->stats.ack_latency_max = MAX(j_ctx->stats.ack_latency_max, latency);
+    LOGD("[%2d] ... %d message(s) acked in %dms (max %dms). queue: %d (max %d), "
+         "retries: %d, dropped: %d", j_ctx->src.fd, j_ctx->batch_msgs, latency,
+         j_ctx->stats.ack_latency_max, ctx->queued_msgs, j_ctx->stats.queue_max,
+         j_ctx->stats.retries, j_ctx->stats.dropped);
+    publish_stats(ctx, false);
+}
+
+static void handle_java_bridge_event(daemon_context_t *ctx, uint32_t events)
+{
+    ASSERT(ctx);
+
+    java_context_t *j_ctx = &ctx->java_ctx;
 
     /* Error or data in / out on Java file descriptor */
-    if (pfd->revents & (POLLIN | POLLOUT)) {
-        if (pfd->revents & POLLIN) {
-            ssize_t len = read(ctx->java_ctx.fd,
-                               ((char *)&ctx->java_ctx.ack_reply) + ctx->java_ctx.ack_reply_pos,
-                               sizeof(ctx->java_ctx.ack_reply) - ctx->java_ctx.ack_reply_pos);
+    if (events & (EPOLLIN | EPOLLOUT)) {
+        if (events & EPOLLIN) {
+            ssize_t len = read(j_ctx->src.fd,
+                               ((char *)&j_ctx->ack_reply) + j_ctx->ack_reply_pos,
+                               sizeof(j_ctx->ack_reply) - j_ctx->ack_reply_pos);
             if (len <= 0) {
-                LOGE("[%2d] error reading from java bridge, disconnected", pfd->fd);
+                LOGE("[%2d] error reading from java bridge, disconnected", j_ctx->src.fd);
                 handle_java_bridge_remove(ctx);
             } else {
-                ctx->java_ctx.ack_reply_pos += len;
-                if (ctx->java_ctx.ack_reply_pos == sizeof(ctx->java_ctx.ack_reply)) {
-                    ctx->java_ctx.ack_reply = ntohl(ctx->java_ctx.ack_reply);
-                    if (ctx->java_ctx.ack_reply != ctx->java_ctx.wait_ack_count) {
+                j_ctx->ack_reply_pos += len;
+                if (j_ctx->ack_reply_pos == sizeof(j_ctx->ack_reply)) {
+                    j_ctx->ack_reply = ntohl(j_ctx->ack_reply);
+                    if (j_ctx->ack_reply != j_ctx->wait_ack_count) {
                         LOGE("[%2d] mismatch in ack (%08x instead of %08x), disconnected",
-                             pfd->fd, ctx->java_ctx.ack_reply, ctx->java_ctx.wait_ack_count);
+                             j_ctx->src.fd, j_ctx->ack_reply, j_ctx->wait_ack_count);
                         handle_java_bridge_remove(ctx);
                     } else {
-                        LOGD("[%2d] ... message acked", ctx->java_ctx.fd);
-                        ctx->java_ctx.wait_ack = false;
-                        if (ctx->java_ctx.msg == (char *)ctx->java_ctx.wakelock_msg) {
-                            ctx->java_ctx.wakelock_held =
-                                ntohl(ctx->java_ctx.wakelock_msg[2]) ==
-                                TEL_BRIDGE_COMMAND_WAKELOCK_ACQUIRE;
-                        } else {
-                            msg_queue_t *to_free = ctx->java_ctx.msg_queue;
-                            ASSERT(to_free);
-                            ctx->java_ctx.msg_queue = to_free->next;
-                            if (ctx->java_ctx.msg_queue == NULL)
-                                ctx->java_ctx.msg_queue_tail = NULL;
-                            free(to_free->msg);
-                            free(to_free);
-                        }
+                        handle_java_bridge_ack(ctx);
                     }
                 }
             }
         } else {
-            ssize_t len = write(ctx->java_ctx.fd,
-                                ctx->java_ctx.msg + ctx->java_ctx.data_sent,
-                                ctx->java_ctx.data_to_send - ctx->java_ctx.data_sent);
+            ssize_t len = write(j_ctx->src.fd,
+                                j_ctx->batch + j_ctx->data_sent,
+                                j_ctx->data_to_send - j_ctx->data_sent);
             if (len <= 0) {
-                LOGE("[%2d] error writing to java bridge, disconnected", pfd->fd);
+                LOGE("[%2d] error writing to java bridge, disconnected", j_ctx->src.fd);
                 handle_java_bridge_remove(ctx);
             } else {
-                ctx->java_ctx.data_sent += len;
-                if (ctx->java_ctx.data_sent == ctx->java_ctx.data_to_send) {
-                    ctx->java_ctx.wait_ack = true;
-                    ctx->java_ctx.wait_ack_count = ntohl(*((uint32_t *)ctx->java_ctx.msg));
-                    crm_time_add_ms(&ctx->java_ctx.msg_end, MAX_JAVA_ACK_DURATION);
-                    ctx->java_ctx.ack_reply_pos = 0;
-
-                    ctx->java_ctx.msg_in_progress = false;
-                    LOGD("[%2d] ... message sent, waiting ack %d",
-                         ctx->java_ctx.fd, ctx->java_ctx.wait_ack_count);
+                j_ctx->data_sent += len;
+                if (j_ctx->data_sent == j_ctx->data_to_send) {
+                    j_ctx->wait_ack = true;
+                    crm_time_add_ms(&j_ctx->msg_end, MAX_JAVA_ACK_DURATION);
+                    j_ctx->ack_reply_pos = 0;
+
+                    j_ctx->msg_in_progress = false;
+                    LOGD("[%2d] ... %d message(s) sent, waiting ack %d", j_ctx->src.fd,
+                         j_ctx->batch_msgs, j_ctx->wait_ack_count);
                 }
             }
         }
-    } else if (pfd->revents & (POLLERR | POLLHUP | POLLNVAL)) {
-        LOGE("[%2d] java bridge disconnected", pfd->fd);
+    } else if (events & (EPOLLERR | EPOLLHUP)) {
+        LOGE("[%2d] java bridge disconnected", j_ctx->src.fd);
         handle_java_bridge_remove(ctx);
     }
 }
 
-static void queue_msg(daemon_context_t *ctx, char *msg, int msg_size)
+static void queue_msg(daemon_context_t *ctx, client_context_t *client, const char *msg,
+                      int msg_size)
 {
     ASSERT(ctx);
+    ASSERT(client);
     ASSERT(msg);
+    ASSERT(msg_size <= (int)MSG_SLOT_SIZE);
+    ASSERT(client->queue_len < CLIENT_QUEUE_SIZE);
 
-    msg_queue_t *msg_s = malloc(sizeof(*msg_s));
-    ASSERT(msg_s);
-    msg_s->msg = msg;
-    msg_s->msg_size = msg_size;
-    msg_s->next = NULL;
-    if (ctx->java_ctx.msg_queue == NULL) {
-        ctx->java_ctx.msg_queue = msg_s;
-        ctx->java_ctx.msg_queue_tail = msg_s;
-    } else {
-        ASSERT(ctx->java_ctx.msg_queue_tail && !ctx->java_ctx.msg_queue_tail->next);
-        ctx->java_ctx.msg_queue_tail->next = msg_s;
-        ctx->java_ctx.msg_queue_tail = msg_s;
-    }
-    msg_s->retries = 0;
+    java_context_t *j_ctx = &ctx->java_ctx;
+
+    msg_slot_t *slot =
+        &client->queue[(client->queue_head + client->queue_len) % CLIENT_QUEUE_SIZE];
+    memcpy(slot->msg, msg, msg_size);
+    slot->msg_size = msg_size;
+    slot->retries = 0;
+
+    client->queue_len++;
+    ctx->queued_msgs++;
+    j_ctx->stats.queue_max = MAX(j_ctx->stats.queue_max, ctx->queued_msgs);
 }
 
-static void handle_c_client_event(daemon_context_t *ctx, int client_idx, struct pollfd *pfd)
+static void handle_c_client_event(daemon_context_t *ctx, client_context_t *client,
+                                  uint32_t events)
 {
     ASSERT(ctx);
-    ASSERT(pfd);
+    ASSERT(client);
 
-    client_context_t *client_ctx = &ctx->client_ctx[client_idx];
+    int fd = client->src.fd;
 
     /* Error or data in / out for a client */
-    if (pfd->revents & POLLIN) {
+    if (events & EPOLLIN) {
         char *location;
-        switch (client_ctx->msg_state) {
+        switch (client->msg_state) {
         case MSG_STATE_NONE:
-            client_ctx->data_read = 0;
-            client_ctx->data_to_read = sizeof(client_ctx->msg_hdr);
-            crm_time_add_ms(&client_ctx->msg_read_end, MAX_CLIENT_MSG_DURATION);
-            client_ctx->msg_state = MSG_STATE_IN_HDR;
+            client->data_read = 0;
+            client->data_to_read = sizeof(client->msg_hdr);
+            crm_time_add_ms(&client->msg_read_end, MAX_CLIENT_MSG_DURATION);
+            set_client_state(ctx, client, MSG_STATE_IN_HDR);
         /* FALLTHROUGH */
         case MSG_STATE_IN_HDR:
-            location = (char *)client_ctx->msg_hdr;
+            location = (char *)client->msg_hdr;
             break;
 
         case MSG_STATE_IN_MSG:
-            location = client_ctx->msg_buffer;
+            location = client->msg_buffer;
             break;
 
         default:
             ASSERT(0);
             break;
         }
-        ssize_t len = read(pfd->fd, location + client_ctx->data_read,
-                           client_ctx->data_to_read - client_ctx->data_read);
+        ssize_t len = read(fd, location + client->data_read,
+                           client->data_to_read - client->data_read);
         if (len <= 0) {
-            LOGE("[%2d] error reading on socket, client disconnected", pfd->fd);
-            handle_c_client_remove(ctx, client_idx);
+            LOGE("[%2d] error reading on socket, client disconnected", fd);
+            handle_c_client_remove(ctx, client);
         } else {
-            client_ctx->data_read += len;
-            if (client_ctx->data_read == client_ctx->data_to_read) {
-                if (client_ctx->msg_state == MSG_STATE_IN_HDR) {
-                    uint32_t msg_size = ntohl(client_ctx->msg_hdr[0]);
-                    uint32_t msg_type = ntohl(client_ctx->msg_hdr[1]);
+            client->data_read += len;
+            if (client->data_read == client->data_to_read) {
+                if (client->msg_state == MSG_STATE_IN_HDR) {
+                    uint32_t msg_size = ntohl(client->msg_hdr[0]);
+                    uint32_t msg_type = ntohl(client->msg_hdr[1]);
 
                     if ((msg_type == TEL_BRIDGE_COMMAND_WAKELOCK_ACQUIRE) ||
                         (msg_type == TEL_BRIDGE_COMMAND_WAKELOCK_RELEASE)) {
+                        int cnt = client->wakelock_cnt +
+                                  (msg_type == TEL_BRIDGE_COMMAND_WAKELOCK_ACQUIRE ? 1 : -1);
                         if (msg_size != 0) {
                             LOGE("[%2d] client sending data for wakelock message (%d)"
-                                 ", client disconnected", pfd->fd, msg_size);
-                            handle_c_client_remove(ctx, client_idx);
+                                 ", client disconnected", fd, msg_size);
+                            handle_c_client_remove(ctx, client);
+                        } else if (cnt < 0) {
+                            LOGE("[%2d] client released an unacquired wakelock"
+                                 ", client disconnected", fd);
+                            handle_c_client_remove(ctx, client);
                         } else {
-                            client_ctx->wakelock_cnt +=
-                                msg_type == TEL_BRIDGE_COMMAND_WAKELOCK_ACQUIRE ? 1 : -1;
-                            if (client_ctx->wakelock_cnt < 0) {
-                                LOGE("[%2d] client released an unacquired wakelock"
-                                     ", client disconnected", pfd->fd);
-                                handle_c_client_remove(ctx, client_idx);
-                            } else {
-                                LOGD("[%2d] client msg: %s", pfd->fd, msg_to_string(msg_type));
-                                handle_wakelock_change(ctx);
-                                client_ctx->msg_state = MSG_STATE_NONE;
-                            }
+                            LOGD("[%2d] client msg: %s", fd, msg_to_string(msg_type));
+                            handle_wakelock_change(ctx, client, cnt);
+                            set_client_state(ctx, client, MSG_STATE_NONE);
                         }
                     } else {
                         if ((msg_type >= TEL_BRIDGE_COMMAND_NUM) ||
                             (msg_size >= MAX_MSG_SIZE)) {
                             LOGE("[%2d] client sent an invalid message (%d / %d)"
-                                 ", client disconnected", pfd->fd, msg_size, msg_type);
-                            handle_c_client_remove(ctx, client_idx);
+                                 ", client disconnected", fd, msg_size, msg_type);
+                            handle_c_client_remove(ctx, client);
                         } else {
-                            client_ctx->msg_buffer = malloc(3 * sizeof(uint32_t) + msg_size);
-                            ASSERT(client_ctx->msg_buffer);
-                            *((uint32_t *)client_ctx->msg_buffer) =
-                                htonl(ctx->java_ctx.msg_count++);
-                            memcpy(client_ctx->msg_buffer + sizeof(uint32_t),
-                                   client_ctx->msg_hdr,
-                                   sizeof(client_ctx->msg_hdr));
-                            client_ctx->data_read = 3 * sizeof(uint32_t);
-                            client_ctx->data_to_read = msg_size + 3 * sizeof(uint32_t);
-                            client_ctx->msg_state = MSG_STATE_IN_MSG;
+                            /* message id is set when the message is sent */
+                            memset(client->msg_buffer, 0, sizeof(uint32_t));
+                            memcpy(client->msg_buffer + sizeof(uint32_t), client->msg_hdr,
+                                   sizeof(client->msg_hdr));
+                            client->data_read = 3 * sizeof(uint32_t);
+                            client->data_to_read = msg_size + 3 * sizeof(uint32_t);
+                            set_client_state(ctx, client, MSG_STATE_IN_MSG);
                         }
                     }
                 } else {
-                    uint32_t msg_type = ntohl(client_ctx->msg_hdr[1]);
-                    LOGD("[%2d] client msg: %s", pfd->fd, msg_to_string(msg_type));
-                    queue_msg(ctx, client_ctx->msg_buffer, client_ctx->data_to_read);
-                    client_ctx->msg_state = MSG_STATE_NONE;
-                    client_ctx->msg_buffer = NULL;
+                    uint32_t msg_type = ntohl(client->msg_hdr[1]);
+                    LOGD("[%2d] client msg: %s", fd, msg_to_string(msg_type));
+                    queue_msg(ctx, client, client->msg_buffer, client->data_to_read);
+                    set_client_state(ctx, client, MSG_STATE_NONE);
+                    if (client->queue_len == CLIENT_QUEUE_SIZE)
+                        pause_client(ctx, client);
                 }
             }
         }
-    } else if (pfd->revents & (POLLERR | POLLHUP | POLLNVAL)) {
-        LOGE("[%2d] client disconnected", pfd->fd);
-        handle_c_client_remove(ctx, client_idx);
+    } else if (events & (EPOLLERR | EPOLLHUP)) {
+        LOGE("[%2d] client disconnected", fd);
+        handle_c_client_remove(ctx, client);
     }
 }
 
 int main(void)
 {
-    daemon_context_t ctx;
+    /* static: the context embeds the Java batch buffer */
+    static daemon_context_t ctx;
 
 #ifdef HOST_BUILD
     // When testing on host, need to create the sockets...
@@ -569,24 +808,25 @@ int main(void)
     CRM_TEST_get_control_socket_android(BRIDGE_SOCKET_JAVA);
 #endif
 
+    ctx.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    ASSERT(ctx.epoll_fd >= 0);
+
     // Open the two control sockets
-    ctx.c_sock_l = socket_create(BRIDGE_SOCKET_C, MAX_CLIENTS);
+    ctx.c_sock_l.type = SOURCE_C_LISTEN;
+    ctx.c_sock_l.fd = socket_create(BRIDGE_SOCKET_C, CLIENTS_BACKLOG);
+    ctx.j_sock_l.type = SOURCE_JAVA_LISTEN;
 #ifdef HOST_BUILD
-    ctx.j_sock_l = inet_socket_create(BRIDGE_SOCKET_JAVA, 1);
+    ctx.j_sock_l.fd = inet_socket_create(BRIDGE_SOCKET_JAVA, 1);
 #else
-    ctx.j_sock_l = socket_create(BRIDGE_SOCKET_JAVA, 1);
+    ctx.j_sock_l.fd = socket_create(BRIDGE_SOCKET_JAVA, 1);
 #endif
-
-    // Initialize client contexts
-    for (size_t i = 0; i < ARRAY_SIZE(ctx.client_ctx); i++) {
-        ctx.client_ctx[i].fd = -1;
-        ctx.client_ctx[i].msg_buffer = NULL;
-    }
+    register_source(&ctx, &ctx.c_sock_l, EPOLLIN);
+    register_source(&ctx, &ctx.j_sock_l, EPOLLIN);
 
     // Initialize java context
-    ctx.java_ctx.fd = -1;
+    ctx.java_ctx.src.type = SOURCE_JAVA;
+    ctx.java_ctx.src.fd = -1;
     ctx.java_ctx.msg_count = 0;
-    ctx.java_ctx.msg_queue = NULL;
     ctx.java_ctx.wait_ack = false;
 
     // Initialize wakelock state
@@ -594,30 +834,38 @@ int main(void)
 
     // Main loop
     while (true) {
-        struct pollfd pfd[2 + MAX_CLIENTS + 1] = {
-            { .fd = ctx.c_sock_l, .events = POLLIN },
-            { .fd = ctx.j_sock_l, .events = POLLIN }
-        };
-        int timeout = fill_pollfd(&ctx, &pfd[2]);
-        int ret = poll(pfd, ARRAY_SIZE(pfd), timeout);
-        ASSERT(ret >= 0);
+        struct epoll_event events[MAX_EVENTS];
+
+        update_java_events(&ctx);
+        int ret = epoll_wait(ctx.epoll_fd, events, MAX_EVENTS, get_timeout(&ctx));
+        ASSERT(ret >= 0 || errno == EINTR);
         if (ret == 0) {
             handle_timeout(&ctx);
         } else {
-            for (size_t i = 0; i < ARRAY_SIZE(pfd); i++) {
-                if (pfd[i].revents == 0)
-                    continue;
-
-                if (i == 0)
-                    handle_c_client_conn(&ctx, &pfd[i]);
-                else if (i == 1)
-                    handle_java_bridge_conn(&ctx, &pfd[i]);
-                else if (i == 2 + MAX_CLIENTS)
-                    handle_java_bridge_event(&ctx, &pfd[i]);
+            /* New connections are accepted once the events of the existing ones are handled:
+             * a context closed during this loop can't be reused by a new connection */
+            uint32_t c_conn = 0;
+            uint32_t j_conn = 0;
+            for (int i = 0; i < ret; i++) {
+                event_source_t *src = events[i].data.ptr;
+
+                if (src->type == SOURCE_C_LISTEN)
+                    c_conn = events[i].events;
+                else if (src->type == SOURCE_JAVA_LISTEN)
+                    j_conn = events[i].events;
+                else if (src->fd < 0)
+                    continue; // closed while handling a previous event
+                else if (src->type == SOURCE_JAVA)
+                    handle_java_bridge_event(&ctx, events[i].events);
                 else
-                    handle_c_client_event(&ctx, i - 2, &pfd[i]);
+                    handle_c_client_event(&ctx, (client_context_t *)src, events[i].events);
             }
+            if (c_conn)
+                handle_c_client_conn(&ctx, c_conn);
+            if (j_conn)
+                handle_java_bridge_conn(&ctx, j_conn);
         }
+        release_clients(&ctx);
     }
 
     return 0;
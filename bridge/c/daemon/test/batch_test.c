@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) Intel 2016
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Batching test of the bridge daemon, run on host. The test plays the Java application and checks
+ * that:
+ *  = messages are written in batches, before any ACK is received
+ *  = a client sending more messages than its queue size is not read anymore instead of losing
+ *    messages (backpressure)
+ *  = messages not acknowledged are sent again after a disconnection, and the message blamed for
+ *    the disconnection is dropped after MAX_RETRIES attempts
+ *  = a wakelock change sent after a burst of intents is not lost, even if the client is paused
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+
+#define CRM_MODULE_TAG "JVBB"
+#include "utils/common.h"
+#include "utils/logs.h"
+
+#include "teljavabridge/tel_java_bridge.h"
+#include "bridge_internal.h"
+
+#define QUEUE_SIZE 16 // size of the client queue in the daemon
+#define MAX_BATCH_MSGS 8
+#define MAX_RETRIES 3
+#define NB_MSGS (3 * QUEUE_SIZE)
+#define MSG_TIMEOUT 500
+
+typedef struct java_msg {
+    uint32_t id;
+    uint32_t type;
+    int seq; // sequence number of the intent
+} java_msg_t;
+
+static bool recv_all(int fd, void *data, size_t len)
+{
+    return recv(fd, data, len, MSG_WAITALL) == (ssize_t)len;
+}
+
+static int java_connect(void)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    ASSERT(fd >= 0);
+
+    struct sockaddr_in dest;
+    memset(&dest, 0, sizeof(dest));
+    dest.sin_family = AF_INET;
+    dest.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    dest.sin_port = htons(1703);
+    ASSERT(connect(fd, (struct sockaddr *)&dest, sizeof(struct sockaddr)) == 0);
+
+    int optval = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+
+    return fd;
+}
+
+static void java_disconnect(int fd)
+{
+    close(fd);
+    /* the daemon accepts a new Java connection once this one is seen closed */
+    usleep(100000);
+}
+
+/* Returns false if no message is received before timeout */
+static bool java_recv(int fd, java_msg_t *msg, int timeout)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+    if (poll(&pfd, 1, timeout) <= 0)
+        return false;
+
+    uint32_t hdr[3];
+    char payload[2048];
+    ASSERT(recv_all(fd, hdr, sizeof(hdr)));
+    uint32_t size = ntohl(hdr[1]);
+    ASSERT(size <= sizeof(payload));
+    ASSERT(size == 0 || recv_all(fd, payload, size));
+
+    msg->id = hdr[0];
+    msg->type = ntohl(hdr[2]);
+    msg->seq = -1;
+    if (msg->type == TEL_BRIDGE_COMMAND_BROADCAST_INTENT) {
+        /* first parameter is the intent name, after its size and type */
+        char name[64] = { 0 };
+        ASSERT(size > 2 * sizeof(uint32_t));
+        memcpy(name, payload + 2 * sizeof(uint32_t),
+               MIN(size - 2 * sizeof(uint32_t), sizeof(name) - 1));
+        int scanned = sscanf(name, "test.batch.%d", &msg->seq);
+        ASSERT(scanned == 1);
+    }
+
+    return true;
+}
+
+static void java_ack(int fd, const java_msg_t *msg)
+{
+    ASSERT(send(fd, &msg->id, sizeof(msg->id), 0) == sizeof(msg->id));
+}
+
+/* Reads the current batch without acknowledging it. Returns the number of messages */
+static int java_recv_batch(int fd, java_msg_t *msgs, int nb)
+{
+    int i = 0;
+
+    while (i < nb && java_recv(fd, &msgs[i], i == 0 ? MSG_TIMEOUT : 100))
+        i++;
+
+    return i;
+}
+
+static pid_t start_bridge_daemon()
+{
+    pid_t child = fork();
+
+    ASSERT(child != -1);
+
+    if (0 == child) {
+        const char *app_name = "teljavabridged";
+        int err = execlp(app_name, app_name, NULL);
+        if (err)
+            KLOG("failed to start teljavabridged: %d", err);
+        exit(0);
+    }
+
+    return child;
+}
+
+int main(void)
+{
+    char name[64];
+    java_msg_t batch[2 * MAX_BATCH_MSGS];
+
+    signal(SIGPIPE, SIG_IGN);
+    pid_t pid = start_bridge_daemon();
+    usleep(200000);
+
+    KLOG("A client sends %d messages while the Java application is not connected", NB_MSGS);
+    tel_java_bridge_ctx_t *client = tel_java_bridge_init();
+    ASSERT(client);
+    ASSERT(client->connect(client) == 0);
+    for (int i = 0; i < NB_MSGS; i++) {
+        snprintf(name, sizeof(name), "test.batch.%d", i);
+        ASSERT(client->broadcast_intent(client, name, NULL) == 0);
+    }
+    ASSERT(client->wakelock(client, true) == 0);
+    usleep(200000);
+
+    KLOG("Java application connects without acknowledging messages");
+    for (int retry = 0; retry < MAX_RETRIES; retry++) {
+        int fd = java_connect();
+        int nb = java_recv_batch(fd, batch, ARRAY_SIZE(batch));
+        DASSERT(nb == MAX_BATCH_MSGS, "%d messages received in the batch", nb);
+        for (int i = 0; i < nb; i++)
+            DASSERT(batch[i].seq == i, "message %d received instead of %d", batch[i].seq, i);
+        java_disconnect(fd);
+    }
+
+    KLOG("First message is dropped, the others are received in order");
+    int fd = java_connect();
+    int expected = 1;
+    bool wakelock = false;
+    java_msg_t msg;
+    while (java_recv(fd, &msg, MSG_TIMEOUT)) {
+        if (msg.type == TEL_BRIDGE_COMMAND_WAKELOCK_ACQUIRE) {
+            wakelock = true;
+        } else {
+            DASSERT(msg.seq == expected, "message %d received instead of %d", msg.seq, expected);
+            expected++;
+        }
+        java_ack(fd, &msg);
+    }
+    DASSERT(expected == NB_MSGS, "%d messages received", expected - 1);
+    ASSERT(wakelock);
+
+    java_disconnect(fd);
+    client->dispose(client);
+    kill(pid, SIGKILL);
+
+    KLOG("success");
+    return 0;
+}
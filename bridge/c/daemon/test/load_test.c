@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) Intel 2016
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Load test of the bridge daemon, run on host. The Java application is replaced by a thread
+ * connected to the daemon with a local socket. It acknowledges each message and checks that:
+ *  = more clients than the previous static limit are served
+ *  = clients are served in round robin
+ *  = messages of a client are received in order, without loss
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+
+#define CRM_MODULE_TAG "JVBL"
+#include "utils/common.h"
+#include "utils/logs.h"
+#include "utils/thread.h"
+#include "utils/time.h"
+
+#include "teljavabridge/tel_java_bridge.h"
+
+#define NB_CLIENTS 12
+#define NB_MSGS 16 // size of the client queue in the daemon: no message is dropped
+#define NB_LOAD_MSGS 500
+#define LOAD_WINDOW 8
+#define MAX_WAIT 5000
+
+static struct {
+    pthread_mutex_t lock;
+    int received[NB_CLIENTS];
+    int order[NB_CLIENTS];
+    int nb_intents;
+    int nb_wakelocks;
+    bool first_is_wakelock;
+} g_stats = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static bool recv_all(int fd, void *data, size_t len)
+{
+    return recv(fd, data, len, MSG_WAITALL) == (ssize_t)len;
+}
+
+static void handle_java_msg(uint32_t type, const char *payload, uint32_t size)
+{
+    pthread_mutex_lock(&g_stats.lock);
+    if (type == 0 || type == 1) {
+        if (g_stats.nb_intents == 0 && g_stats.nb_wakelocks == 0)
+            g_stats.first_is_wakelock = true;
+        g_stats.nb_wakelocks++;
+    } else {
+        /* first parameter is the intent name, after its size and type */
+        int client;
+        int seq;
+        char name[64] = { 0 };
+        ASSERT(size > 2 * sizeof(uint32_t));
+        memcpy(name, payload + 2 * sizeof(uint32_t),
+               MIN(size - 2 * sizeof(uint32_t), sizeof(name) - 1));
+        int scanned = sscanf(name, "test.load.%d.%d", &client, &seq);
+        ASSERT(scanned == 2);
+        ASSERT(client >= 0 && client < NB_CLIENTS);
+        DASSERT(seq == g_stats.received[client], "client %d: message %d received instead of %d",
+                client, seq, g_stats.received[client]);
+        if (g_stats.nb_intents < NB_CLIENTS)
+            g_stats.order[g_stats.nb_intents] = client;
+        g_stats.received[client]++;
+        g_stats.nb_intents++;
+    }
+    pthread_mutex_unlock(&g_stats.lock);
+}
+
+static void *fake_java_daemon(crm_thread_ctx_t *thread_ctx, void *args)
+{
+    ASSERT(thread_ctx);
+    (void)args;
+
+    int t_fd = thread_ctx->get_poll_fd(thread_ctx);
+    ASSERT(t_fd >= 0);
+
+    int b_fd = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT(b_fd >= 0);
+
+    struct sockaddr_in dest;
+    memset(&dest, 0, sizeof(dest));
+    dest.sin_family = AF_INET;
+    dest.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    dest.sin_port = htons(1703);
+    ASSERT(connect(b_fd, (struct sockaddr *)&dest, sizeof(struct sockaddr)) == 0);
+
+    /* ACKs are small writes: don't let them wait for the TCP ACK of the previous one */
+    int optval = 1;
+    setsockopt(b_fd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+
+    while (true) {
+        struct pollfd pfd[] = {
+            { .fd = t_fd, .events = POLLIN },
+            { .fd = b_fd, .events = POLLIN },
+        };
+
+        ASSERT(poll(pfd, ARRAY_SIZE(pfd), -1) > 0);
+        if (pfd[0].revents)
+            break;
+
+        uint32_t hdr[3];
+        char payload[2048];
+        ASSERT(recv_all(b_fd, hdr, sizeof(hdr)));
+        uint32_t size = ntohl(hdr[1]);
+        ASSERT(size <= sizeof(payload));
+        ASSERT(size == 0 || recv_all(b_fd, payload, size));
+        handle_java_msg(ntohl(hdr[2]), payload, size);
+        ASSERT(send(b_fd, &hdr[0], sizeof(hdr[0]), 0) == sizeof(hdr[0]));
+    }
+
+    close(b_fd);
+    return NULL;
+}
+
+static pid_t start_bridge_daemon()
+{
+    pid_t child = fork();
+
+    ASSERT(child != -1);
+
+    if (0 == child) {
+        const char *app_name = "teljavabridged";
+        int err = execlp(app_name, app_name, NULL);
+        if (err)
+            KLOG("failed to start teljavabridged: %d", err);
+        exit(0);
+    }
+
+    return child;
+}
+
+static int get_received(int client)
+{
+    pthread_mutex_lock(&g_stats.lock);
+    int received = g_stats.received[client];
+    pthread_mutex_unlock(&g_stats.lock);
+
+    return received;
+}
+
+static void wait_received(int client, int nb)
+{
+    struct timespec end;
+
+    crm_time_add_ms(&end, MAX_WAIT);
+    while (get_received(client) < nb) {
+        DASSERT(crm_time_get_remain_ms(&end) > 0, "client %d: timeout waiting message %d", client,
+                nb);
+        usleep(1000);
+    }
+}
+
+static void *load_client(crm_thread_ctx_t *thread_ctx, void *args)
+{
+    (void)thread_ctx;
+    int client = (int)(intptr_t)args;
+    int base = get_received(client);
+    char name[64];
+
+    tel_java_bridge_ctx_t *ctx = tel_java_bridge_init();
+    ASSERT(ctx);
+    ASSERT(ctx->connect(ctx) == 0);
+
+    for (int i = 0; i < NB_LOAD_MSGS; i++) {
+        /* the window keeps the queue of the client in the daemon from overflowing */
+        if (i >= LOAD_WINDOW)
+            wait_received(client, base + i - LOAD_WINDOW + 1);
+        snprintf(name, sizeof(name), "test.load.%d.%d", client, base + i);
+        int ret = ctx->broadcast_intent(ctx, name, "instId%d", client);
+        ASSERT(ret == 0);
+        if (i % 100 == 0) {
+            ASSERT(ctx->wakelock(ctx, true) == 0);
+            ASSERT(ctx->wakelock(ctx, false) == 0);
+        }
+    }
+    wait_received(client, base + NB_LOAD_MSGS);
+
+    ctx->dispose(ctx);
+    return NULL;
+}
+
+int main(void)
+{
+    tel_java_bridge_ctx_t *clients[NB_CLIENTS];
+    char name[64];
+
+    signal(SIGPIPE, SIG_IGN);
+    pid_t pid = start_bridge_daemon();
+    usleep(200000);
+
+    KLOG("%d clients queue messages while the Java application is not connected", NB_CLIENTS);
+    for (int i = 0; i < NB_CLIENTS; i++) {
+        clients[i] = tel_java_bridge_init();
+        ASSERT(clients[i]);
+        ASSERT(clients[i]->connect(clients[i]) == 0);
+    }
+    ASSERT(clients[NB_CLIENTS - 1]->wakelock(clients[NB_CLIENTS - 1], true) == 0);
+    for (int i = 0; i < NB_CLIENTS; i++) {
+        for (int j = 0; j < NB_MSGS; j++) {
+            snprintf(name, sizeof(name), "test.load.%d.%d", i, j);
+            int ret = clients[i]->broadcast_intent(clients[i], name, "instId%d", i);
+            ASSERT(ret == 0);
+        }
+    }
+    usleep(200000);
+
+    KLOG("Java application connects");
+    crm_thread_ctx_t *java = crm_thread_init(fake_java_daemon, NULL, true, false);
+    ASSERT(java);
+    for (int i = 0; i < NB_CLIENTS; i++)
+        wait_received(i, NB_MSGS);
+
+    ASSERT(g_stats.first_is_wakelock);
+    for (int i = 0; i < NB_CLIENTS; i++) {
+        for (int j = 0; j < i; j++)
+            DASSERT(g_stats.order[i] != g_stats.order[j], "client %d served twice in a round",
+                    g_stats.order[i]);
+    }
+
+    for (int i = 0; i < NB_CLIENTS; i++)
+        clients[i]->dispose(clients[i]);
+
+    KLOG("%d clients send %d messages each", NB_CLIENTS, NB_LOAD_MSGS);
+    struct timespec begin;
+    crm_thread_ctx_t *threads[NB_CLIENTS];
+    crm_time_add_ms(&begin, 0);
+    for (int i = 0; i < NB_CLIENTS; i++) {
+        threads[i] = crm_thread_init(load_client, (void *)(intptr_t)i, false, false);
+        ASSERT(threads[i]);
+    }
+    for (int i = 0; i < NB_CLIENTS; i++)
+        threads[i]->dispose(threads[i], NULL);
+
+    int duration = crm_time_get_elapsed_ms(&begin);
+    KLOG("%d messages received in %dms, %d wakelock messages", g_stats.nb_intents, duration,
+         g_stats.nb_wakelocks);
+    ASSERT(g_stats.nb_intents == NB_CLIENTS * (NB_MSGS + NB_LOAD_MSGS));
+
+    kill(pid, SIGKILL);
+    crm_ipc_msg_t msg = { .scalar = -1 };
+    java->send_msg(java, &msg);
+    java->dispose(java, NULL);
+
+    KLOG("success");
+    return 0;
+}
@@ -17,3 +17,23 @@ CRM_COPY_HEADERS_TO := telephony/teljavabridge
 
 CRM_TARGET := $(BUILD_SHARED_LIBRARY)
 include $(LOCAL_PATH)/../../../makefiles/crm_c_make.mk
+
+##############################################################
+#      TESTU
+##############################################################
+ifeq ($(crm_testu), true)
+
+include $(LOCAL_PATH)/../../../makefiles/crm_clear.mk
+CRM_NAME := test_tel_java_bridge_async
+
+CRM_SRC := test/async_test.c
+CRM_INCS := $(LOCAL_PATH)/../daemon/inc
+
+CRM_SHARED_LIBS := libcrm_utils libtel_java_bridge
+CRM_STATIC_LIBS_HOST_ONLY := libcrm_host_test_utils
+
+CRM_DISABLE_ANDROID_TARGET := true
+CRM_TARGET := $(BUILD_EXECUTABLE)
+include $(LOCAL_PATH)/../../../makefiles/crm_c_make.mk
+
+endif
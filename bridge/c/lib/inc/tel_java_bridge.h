@@ -71,6 +71,20 @@ struct tel_java_bridge_ctx {
      */
     int (*get_poll_fd)(tel_java_bridge_ctx_t *ctx);
 
+    /**
+     * Returns the events to poll on the file descriptor returned by 'get_poll_fd'.
+     * POLLOUT is set if messages queued by 'broadcast_intent_async' are waiting to be sent.
+     * If needed, this function reconnects to the daemon. Thus, it must be called before
+     * 'get_poll_fd'.
+     * If messages are queued and the daemon cannot be reached, 0 is returned: the caller must
+     * call this function again later to retry the connection.
+     *
+     * @param [in] ctx Module context
+     *
+     * @return events to poll
+     */
+    short (*get_poll_events)(tel_java_bridge_ctx_t *ctx);
+
     /**
      * Function to be called in case of an event on the file descriptor returned by a
      * call to 'get_poll_fd' function.
@@ -79,6 +93,9 @@ struct tel_java_bridge_ctx {
      * the client shall consider all its wakelock released (i.e. as if wakelock count
      * is 0).
      *
+     * Messages queued by 'broadcast_intent_async' are sent when POLLOUT is set. In case of
+     * disconnection, they are kept and sent after the next connection.
+     *
      * @param [in] ctx Module context
      * @param [in] revent The 'revent' field of the pollfd structure
      *
@@ -128,13 +145,32 @@ struct tel_java_bridge_ctx {
      * @return 0 in case of success, -1 otherwise
      */
     int (*broadcast_intent)(tel_java_bridge_ctx_t *ctx, const char *name, const char *format, ...);
+
+    /**
+     * Broadcast intent without blocking.
+     *
+     * The intent is serialized in a bounded buffer, sent from the caller's poll loop: see
+     * 'get_poll_events' and 'handle_poll_event'. The connection is established if needed.
+     * Messages sent with 'broadcast_intent' or 'start_service' are sent after the queued ones.
+     *
+     * @see broadcast_intent for format usage
+     *
+     * @param [in] ctx Module context
+     * @param [in] name Intent name
+     * @param [in] format Format string of the intent parameters. Only %d and %s is supported.
+     *
+     * @return 0 if the intent is queued, -1 if the buffer is full
+     */
+    int (*broadcast_intent_async)(tel_java_bridge_ctx_t *ctx, const char *name,
+                                  const char *format, ...);
 };
 
 /**
  * Contextless API
  *
  * @see broadcast_intent for details
- * This function connects to java bridge, broadcasts the intent and disposes the context
+ * This function broadcasts the intent with a connection shared by all contextless calls. This
+ * connection is kept opened and re-established if needed.
  */
 int tel_java_brige_broadcast_intent(const char *name, const char *format, ...)
 #if defined(__GNUC__)
@@ -146,7 +182,8 @@ __attribute__ ((format(printf, 2, 3)))          // Used to have compiler check a
  * Contextless API
  *
  * @see start_service for details
- * This function connects to java bridge, starts the service and disposes the context
+ * This function starts the service with a connection shared by all contextless calls. This
+ * connection is kept opened and re-established if needed.
  */
 int tel_java_brige_start_service(const char *s_package, const char *s_class);
 
@@ -26,8 +26,13 @@
 
 #include <errno.h>
 #include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <sys/socket.h>
 
 #include <cutils/sockets.h>
 
@@ -42,13 +47,25 @@
 #include "tel_java_bridge.h"
 
 #define MAX_SOCKET_TIMEOUT 500
+#define ASYNC_BUFFER_SIZE 4096
 
 typedef struct tel_java_bridge_internal_ctx {
     tel_java_bridge_ctx_t ctx; // Needs to be first
 
     int fd;
+
+    /* messages queued by the asynchronous API. Sent from the caller's poll loop.
+     * The buffer always starts with a complete message. async_sent counts the bytes of the
+     * buffer already sent: it can end in the middle of a message */
+    char async_buf[ASYNC_BUFFER_SIZE];
+    int async_len;
+    int async_sent;
 } tel_java_bridge_internal_ctx_t;
 
+/* Connection used by the contextless API. Kept opened between calls */
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static tel_java_bridge_ctx_t *g_ctx = NULL;
+
 /**
  * Helper function to serialize an uint32_t value in msg.
  */
@@ -76,24 +93,15 @@ static inline void serialize_string(char **msg, const char *param, size_t len_co
 }
 
 /**
- * Helper function to serialize and send a message to the bridge.
+ * Helper function returning the size of a serialized message.
  *
- * To be able to use this function for all APIs, this will always:
- *  = serialize param1 as a string (if not NULL)
- *  = serialize param2 as a string (if not NULL)
- *  = then serialize the ellipsis "params3" according to format
+ * @see serialize_msg for parameters
  */
-static int send_msg(tel_java_bridge_internal_ctx_t *i_ctx, tel_bridge_commands_t cmd,
-                    const char *param1, const char *param2,
-                    const char *format, va_list params3)
+static int get_msg_size(const char *param1, const char *param2, const char *format,
+                        va_list params3)
 {
-    ASSERT(i_ctx);
-
-    if (i_ctx->fd < 0)
-        return -1;
-
-    /* Compute message size */
     int msg_size = 2 * sizeof(uint32_t);
+
     if (param1)
         msg_size += 2 * sizeof(uint32_t) + strlen(param1);
     if (param2)
@@ -121,9 +129,20 @@ static int send_msg(tel_java_bridge_internal_ctx_t *i_ctx, tel_bridge_commands_t
         va_end(c_params);
     }
 
-    /* Serialize message */
-    char *msg = malloc(msg_size);
-    ASSERT(msg);
+    return msg_size;
+}
+
+/**
+ * Helper function to serialize a message in msg. msg_size must be computed with get_msg_size.
+ *
+ * To be able to use this function for all APIs, this will always:
+ *  = serialize param1 as a string (if not NULL)
+ *  = serialize param2 as a string (if not NULL)
+ *  = then serialize the ellipsis "params3" according to format
+ */
+static void serialize_msg(tel_bridge_commands_t cmd, const char *param1, const char *param2,
+                          const char *format, va_list params3, char *msg, int msg_size)
+{
     char *c_msg = msg;
 
     serialize_uint32(&c_msg, msg_size - 2 * sizeof(uint32_t), msg, msg_size);
@@ -152,15 +171,33 @@ static int send_msg(tel_java_bridge_internal_ctx_t *i_ctx, tel_bridge_commands_t
             c_format = sep + 2;
         }
     }
+    ASSERT(c_msg - msg == msg_size);
+}
+
+/**
+ * Helper function to write data to the bridge before timer_end.
+ * MSG_NOSIGNAL is used: the connection is persistent and the daemon can restart meanwhile.
+ *
+ * @param [in] i_ctx         Module context
+ * @param [in] data          data to write
+ * @param [in] size          size of data
+ * @param [in/out] data_sent number of bytes of data already sent
+ * @param [in] timer_end     deadline
+ *
+ * @return 0 in case of success, -1 otherwise
+ */
+static int write_data(tel_java_bridge_internal_ctx_t *i_ctx, const char *data, int size,
+                      int *data_sent, const struct timespec *timer_end)
+{
+    ASSERT(i_ctx);
+    ASSERT(data);
+    ASSERT(data_sent);
+    ASSERT(timer_end);
 
-    /* Send message */
-    struct timespec timer_end;
-    crm_time_add_ms(&timer_end, MAX_SOCKET_TIMEOUT);
-    int data_sent = 0;
     int time_remaining;
     int ret = 0;
-    while ((data_sent < msg_size) &&
-           ((time_remaining = crm_time_get_remain_ms(&timer_end)) > 0) &&
+    while ((*data_sent < size) &&
+           ((time_remaining = crm_time_get_remain_ms(timer_end)) > 0) &&
            (ret == 0)) {
         errno = 0;
         struct pollfd pfd = { .fd = i_ctx->fd, .events = POLLOUT };
@@ -173,17 +210,111 @@ static int send_msg(tel_java_bridge_internal_ctx_t *i_ctx, tel_bridge_commands_t
         }
 
         errno = 0;
-        ssize_t ret = write(i_ctx->fd, &msg[data_sent], msg_size - data_sent);
-        if ((ret < 0) && (errno == EINTR))
+        ssize_t len = send(i_ctx->fd, &data[*data_sent], size - *data_sent, MSG_NOSIGNAL);
+        if ((len < 0) && (errno == EINTR))
             continue;
-        if (ret <= 0) {
+        if (len <= 0) {
             ret = -1;
             continue;
         }
-        data_sent += ret;
+        *data_sent += len;
+    }
+
+    return *data_sent < size ? -1 : 0;
+}
+
+/**
+ * Helper function to drop the asynchronous messages completely sent. The bytes already sent of
+ * a partially sent message are kept in the buffer until the whole message is sent.
+ */
+static void async_consume(tel_java_bridge_internal_ctx_t *i_ctx)
+{
+    ASSERT(i_ctx);
+
+    int consumed = 0;
+    while (consumed < i_ctx->async_len) {
+        uint32_t size;
+        memcpy(&size, &i_ctx->async_buf[consumed], sizeof(size));
+        int next = consumed + 2 * sizeof(uint32_t) + ntohl(size);
+        ASSERT(next > consumed && next <= i_ctx->async_len);
+        if (next > i_ctx->async_sent)
+            break;
+        consumed = next;
+    }
+
+    memmove(i_ctx->async_buf, &i_ctx->async_buf[consumed], i_ctx->async_len - consumed);
+    i_ctx->async_len -= consumed;
+    i_ctx->async_sent -= consumed;
+}
+
+/**
+ * Helper function to close the connection
+ */
+static void close_connection(tel_java_bridge_internal_ctx_t *i_ctx)
+{
+    ASSERT(i_ctx);
+
+    if (i_ctx->fd >= 0) {
+        int fd = i_ctx->fd;
+        i_ctx->fd = -1;
+        close(fd);
     }
-    if (data_sent < msg_size)
-        ret = -1;
+    /* The daemon drops the partial message: it is sent again from its start */
+    i_ctx->async_sent = 0;
+}
+
+/**
+ * Helper function to send a serialized message to the bridge.
+ * Messages queued by the asynchronous API are sent first to keep messages ordered.
+ *
+ * @return 0 in case of success, -1 otherwise
+ */
+static int send_serialized_msg(tel_java_bridge_internal_ctx_t *i_ctx, const char *msg,
+                               int msg_size)
+{
+    ASSERT(i_ctx);
+    ASSERT(msg);
+
+    if (i_ctx->fd < 0)
+        return -1;
+
+    struct timespec timer_end;
+    crm_time_add_ms(&timer_end, MAX_SOCKET_TIMEOUT);
+
+    int data_sent = 0;
+    int ret = write_data(i_ctx, i_ctx->async_buf, i_ctx->async_len, &i_ctx->async_sent,
+                         &timer_end);
+    async_consume(i_ctx);
+    if (!ret)
+        ret = write_data(i_ctx, msg, msg_size, &data_sent, &timer_end);
+
+    /* A message partially sent would corrupt the next ones: the connection is closed */
+    if (ret && (i_ctx->async_sent > 0 || data_sent > 0))
+        close_connection(i_ctx);
+
+    return ret;
+}
+
+/**
+ * Helper function to serialize and send a message to the bridge.
+ *
+ * @see serialize_msg for parameters
+ */
+static int send_msg(tel_java_bridge_internal_ctx_t *i_ctx, tel_bridge_commands_t cmd,
+                    const char *param1, const char *param2,
+                    const char *format, va_list params3)
+{
+    ASSERT(i_ctx);
+
+    if (i_ctx->fd < 0)
+        return -1;
+
+    int msg_size = get_msg_size(param1, param2, format, params3);
+    char *msg = malloc(msg_size);
+    ASSERT(msg);
+    serialize_msg(cmd, param1, param2, format, params3, msg, msg_size);
+
+    int ret = send_serialized_msg(i_ctx, msg, msg_size);
 
     free(msg);
     return ret;
@@ -199,6 +330,8 @@ static void dispose(tel_java_bridge_ctx_t *ctx)
 
     if (i_ctx->fd >= 0)
         close(i_ctx->fd);
+    if (i_ctx->async_len > 0)
+        LOGE("%d bytes of asynchronous messages not sent", i_ctx->async_len);
     free(ctx);
 }
 
@@ -212,6 +345,7 @@ static int bridge_connect(tel_java_bridge_ctx_t *ctx)
 
     i_ctx->fd =
         socket_local_client(BRIDGE_SOCKET_C, ANDROID_SOCKET_NAMESPACE_RESERVED, SOCK_STREAM);
+    i_ctx->async_sent = 0;
     return i_ctx->fd >= 0 ? 0 : -1;
 }
 
@@ -221,13 +355,8 @@ static int bridge_connect(tel_java_bridge_ctx_t *ctx)
 static void bridge_disconnect(tel_java_bridge_ctx_t *ctx)
 {
     ASSERT(ctx);
-    tel_java_bridge_internal_ctx_t *i_ctx = (tel_java_bridge_internal_ctx_t *)ctx;
 
-    if (i_ctx->fd >= 0) {
-        int fd = i_ctx->fd;
-        i_ctx->fd = -1;
-        close(fd);
-    }
+    close_connection((tel_java_bridge_internal_ctx_t *)ctx);
 }
 
 /**
@@ -248,13 +377,55 @@ static int handle_poll_event(tel_java_bridge_ctx_t *ctx, int revent)
     tel_java_bridge_internal_ctx_t *i_ctx = (tel_java_bridge_internal_ctx_t *)ctx;
 
     if (revent & (POLLERR | POLLHUP | POLLNVAL)) {
-        int fd = i_ctx->fd;
-        i_ctx->fd = -1;
-        close(fd);
+        close_connection(i_ctx);
         return -1;
-    } else {
-        return 0;
+    } else if ((revent & POLLOUT) && (i_ctx->async_sent < i_ctx->async_len)) {
+        errno = 0;
+        ssize_t len = send(i_ctx->fd, &i_ctx->async_buf[i_ctx->async_sent],
+                           i_ctx->async_len - i_ctx->async_sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (len < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+            return 0;
+        if (len <= 0) {
+            close_connection(i_ctx);
+            return -1;
+        }
+        i_ctx->async_sent += len;
+        async_consume(i_ctx);
     }
+
+    return 0;
+}
+
+/**
+ * Helper function to connect the context if needed.
+ *
+ * @return 0 if connected, -1 otherwise
+ */
+static int auto_connect(tel_java_bridge_internal_ctx_t *i_ctx)
+{
+    ASSERT(i_ctx);
+
+    if (i_ctx->fd < 0)
+        return bridge_connect(&i_ctx->ctx);
+
+    return 0;
+}
+
+/**
+ * @see tel_java_bridge.h
+ */
+static short get_poll_events(tel_java_bridge_ctx_t *ctx)
+{
+    ASSERT(ctx);
+    tel_java_bridge_internal_ctx_t *i_ctx = (tel_java_bridge_internal_ctx_t *)ctx;
+
+    if (i_ctx->async_len == 0)
+        return POLLIN;
+
+    if (auto_connect(i_ctx))
+        return 0;
+
+    return POLLIN | POLLOUT;
 }
 
 /**
@@ -274,8 +445,12 @@ static int wakelock(tel_java_bridge_ctx_t *ctx, bool acquire)
 static int start_service(tel_java_bridge_ctx_t *ctx, const char *s_package, const char *s_class)
 {
     ASSERT(ctx);
-    return send_msg((tel_java_bridge_internal_ctx_t *)ctx,
-                    TEL_BRIDGE_COMMAND_START_SERVICE, s_package, s_class, NULL, NULL);
+    tel_java_bridge_internal_ctx_t *i_ctx = (tel_java_bridge_internal_ctx_t *)ctx;
+
+    int ret = auto_connect(i_ctx);
+    if (!ret)
+        ret = send_msg(i_ctx, TEL_BRIDGE_COMMAND_START_SERVICE, s_package, s_class, NULL, NULL);
+    return ret;
 }
 
 /**
@@ -284,10 +459,42 @@ static int start_service(tel_java_bridge_ctx_t *ctx, const char *s_package, cons
 static int broadcast_intent(tel_java_bridge_ctx_t *ctx, const char *name, const char *format, ...)
 {
     ASSERT(ctx);
+    tel_java_bridge_internal_ctx_t *i_ctx = (tel_java_bridge_internal_ctx_t *)ctx;
+
+    int ret = auto_connect(i_ctx);
+    if (!ret) {
+        va_list params;
+        va_start(params, format);
+        ret = send_msg(i_ctx, TEL_BRIDGE_COMMAND_BROADCAST_INTENT, name, NULL, format, params);
+        va_end(params);
+    }
+    return ret;
+}
+
+/**
+ * @see tel_java_bridge.h
+ */
+static int broadcast_intent_async(tel_java_bridge_ctx_t *ctx, const char *name,
+                                  const char *format, ...)
+{
+    ASSERT(ctx);
+    tel_java_bridge_internal_ctx_t *i_ctx = (tel_java_bridge_internal_ctx_t *)ctx;
+
     va_list params;
     va_start(params, format);
-    int ret = send_msg((tel_java_bridge_internal_ctx_t *)ctx,
-                       TEL_BRIDGE_COMMAND_BROADCAST_INTENT, name, NULL, format, params);
+
+    int ret = -1;
+    int msg_size = get_msg_size(name, NULL, format, params);
+    if (i_ctx->async_len + msg_size <= (int)sizeof(i_ctx->async_buf)) {
+        serialize_msg(TEL_BRIDGE_COMMAND_BROADCAST_INTENT, name, NULL, format, params,
+                      &i_ctx->async_buf[i_ctx->async_len], msg_size);
+        i_ctx->async_len += msg_size;
+        auto_connect(i_ctx);
+        ret = 0;
+    } else {
+        LOGE("buffer full, intent %s dropped", name);
+    }
+
     va_end(params);
     return ret;
 }
@@ -308,49 +515,70 @@ tel_java_bridge_ctx_t *tel_java_bridge_init(void)
     ctx->ctx.disconnect = bridge_disconnect;
     ctx->ctx.get_poll_fd = get_poll_fd;
     ctx->ctx.handle_poll_event = handle_poll_event;
+    ctx->ctx.get_poll_events = get_poll_events;
     ctx->ctx.wakelock = wakelock;
     ctx->ctx.start_service = start_service;
     ctx->ctx.broadcast_intent = broadcast_intent;
+    ctx->ctx.broadcast_intent_async = broadcast_intent_async;
 
     return &ctx->ctx;
 }
 
 /**
- * @see tel_java_bridge.h
+ * Helper function sending a message with the contextless API connection. In case of failure,
+ * the connection is re-established once: the daemon could have been restarted since last call.
  */
-int tel_java_brige_broadcast_intent(const char *name, const char *format, ...)
+static int send_msg_contextless(tel_bridge_commands_t cmd, const char *param1,
+                                const char *param2, const char *format, va_list params3)
 {
     int ret = -1;
-    tel_java_bridge_ctx_t *ctx = tel_java_bridge_init();
 
-    ASSERT(ctx);
+    int msg_size = get_msg_size(param1, param2, format, params3);
+    char *msg = malloc(msg_size);
+    ASSERT(msg);
+    serialize_msg(cmd, param1, param2, format, params3, msg, msg_size);
 
-    if (!ctx->connect(ctx)) {
-        va_list params;
-        va_start(params, format);
-        ret = send_msg((tel_java_bridge_internal_ctx_t *)ctx, TEL_BRIDGE_COMMAND_BROADCAST_INTENT,
-                       name, NULL, format, params);
-        va_end(params);
+    ASSERT(pthread_mutex_lock(&g_lock) == 0);
+
+    if (!g_ctx)
+        g_ctx = tel_java_bridge_init();
+    ASSERT(g_ctx);
+    tel_java_bridge_internal_ctx_t *i_ctx = (tel_java_bridge_internal_ctx_t *)g_ctx;
+
+    for (int attempt = 0; attempt < 2 && ret; attempt++) {
+        if (auto_connect(i_ctx))
+            break;
+
+        ret = send_serialized_msg(i_ctx, msg, msg_size);
+        if (ret)
+            close_connection(i_ctx);
     }
 
-    ctx->dispose(ctx);
+    ASSERT(pthread_mutex_unlock(&g_lock) == 0);
+
+    free(msg);
     return ret;
 }
 
 /**
  * @see tel_java_bridge.h
  */
-int tel_java_brige_start_service(const char *s_package, const char *s_class)
+int tel_java_brige_broadcast_intent(const char *name, const char *format, ...)
 {
-    int ret = -1;
-    tel_java_bridge_ctx_t *ctx = tel_java_bridge_init();
-
-    ASSERT(ctx);
+    va_list params;
 
-    if (!ctx->connect(ctx))
-        ret = send_msg((tel_java_bridge_internal_ctx_t *)ctx, TEL_BRIDGE_COMMAND_START_SERVICE,
-                       s_package, s_class, NULL, NULL);
+    va_start(params, format);
+    int ret = send_msg_contextless(TEL_BRIDGE_COMMAND_BROADCAST_INTENT, name, NULL, format,
+                                   params);
+    va_end(params);
 
-    ctx->dispose(ctx);
     return ret;
 }
+
+/**
+ * @see tel_java_bridge.h
+ */
+int tel_java_brige_start_service(const char *s_package, const char *s_class)
+{
+    return send_msg_contextless(TEL_BRIDGE_COMMAND_START_SERVICE, s_package, s_class, NULL, NULL);
+}
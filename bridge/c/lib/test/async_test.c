@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) Intel 2016
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test of the asynchronous API of the library, run on host. The daemon is replaced by a local
+ * socket handled by the test. It checks that:
+ *  = intents are queued while the daemon is not reachable
+ *  = a message partially sent before a disconnection is sent again from its start
+ *  = messages are received in order, including the ones sent with the synchronous API
+ */
+
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CRM_MODULE_TAG "JVBA"
+#include "utils/common.h"
+#include "utils/logs.h"
+
+#include "bridge_internal.h"
+#include "teljavabridge/tel_java_bridge.h"
+
+#define NB_INTENTS 6
+#define NAME_SIZE 601
+#define FRAME_SIZE (2 * sizeof(uint32_t) + 2 * sizeof(uint32_t) + NAME_SIZE)
+#define SYNC_INTENT -2
+#define SEND_LIMIT (2 * FRAME_SIZE + 100)
+
+/* Number of bytes that send() accepts before returning EAGAIN. -1: no limit */
+static ssize_t g_send_limit = -1;
+
+/* Replaces the libc function to simulate a congested socket */
+ssize_t send(int fd, const void *buf, size_t len, int flags)
+{
+    if (g_send_limit >= 0) {
+        if (g_send_limit == 0) {
+            errno = EAGAIN;
+            return -1;
+        }
+        len = MIN(len, (size_t)g_send_limit);
+        g_send_limit -= len;
+    }
+
+    return sendto(fd, buf, len, flags, NULL, 0);
+}
+
+static int listen_daemon(void)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "/tmp/%s", BRIDGE_SOCKET_C);
+    unlink(addr.sun_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT(fd >= 0);
+    ASSERT(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    ASSERT(listen(fd, 1) == 0);
+
+    return fd;
+}
+
+static bool recv_all(int fd, void *data, size_t len)
+{
+    return recv(fd, data, len, MSG_WAITALL) == (ssize_t)len;
+}
+
+/* Returns the index of the intent read, SYNC_INTENT for the synchronous one, -1 if closed */
+static int read_intent(int fd)
+{
+    uint32_t header[2];
+
+    if (!recv_all(fd, header, sizeof(header)))
+        return -1;
+    ASSERT(ntohl(header[1]) == TEL_BRIDGE_COMMAND_BROADCAST_INTENT);
+
+    uint32_t size = ntohl(header[0]);
+    DASSERT(size > 2 * sizeof(uint32_t) && size <= 4096, "malformed message: size %u", size);
+    char *payload = malloc(size + 1);
+    ASSERT(payload);
+    ASSERT(recv_all(fd, payload, size));
+    payload[size] = '\0';
+
+    uint32_t ltv[2];
+    memcpy(ltv, payload, sizeof(ltv));
+    ASSERT(ntohl(ltv[1]) == TEL_BRIDGE_DATA_TYPE_STRING);
+    ASSERT(ntohl(ltv[0]) == size - sizeof(ltv));
+
+    int idx = SYNC_INTENT;
+    if (strcmp(payload + sizeof(ltv), "Sync")) {
+        int nb = sscanf(payload + sizeof(ltv), "Intent%d", &idx);
+        ASSERT(nb == 1);
+    }
+    free(payload);
+
+    return idx;
+}
+
+int main(void)
+{
+    tel_java_bridge_ctx_t *ctx = tel_java_bridge_init();
+    char name[NAME_SIZE + 1];
+
+    ASSERT(ctx);
+
+    LOGD("Queuing intents while the daemon is down");
+    int srv_fd = listen_daemon();
+    close(srv_fd);
+    for (int i = 0; i < NB_INTENTS; i++) {
+        int len = snprintf(name, sizeof(name), "Intent%d", i);
+        memset(name + len, 'x', NAME_SIZE - len);
+        name[NAME_SIZE] = '\0';
+        ASSERT(ctx->broadcast_intent_async(ctx, name, NULL) == 0);
+    }
+    ASSERT(ctx->get_poll_events(ctx) == 0);
+    ASSERT(ctx->get_poll_fd(ctx) < 0);
+
+    LOGD("Disconnecting in the middle of a message");
+    srv_fd = listen_daemon();
+    ASSERT(ctx->get_poll_events(ctx) == (POLLIN | POLLOUT));
+    int fd = accept(srv_fd, NULL, NULL);
+    ASSERT(fd >= 0);
+
+    g_send_limit = SEND_LIMIT;
+    for (int i = 0; i < NB_INTENTS; i++)
+        ASSERT(ctx->handle_poll_event(ctx, POLLOUT) == 0);
+    g_send_limit = -1;
+
+    int received;
+    ASSERT(ioctl(fd, FIONREAD, &received) == 0);
+    ASSERT(received == SEND_LIMIT);
+    int first_lost = received / FRAME_SIZE;
+    for (int i = 0; i < first_lost; i++)
+        ASSERT(read_intent(fd) == i);
+    close(fd);
+    ASSERT(ctx->handle_poll_event(ctx, POLLHUP) == -1);
+
+    LOGD("Reconnecting");
+    ASSERT(ctx->get_poll_events(ctx) == (POLLIN | POLLOUT));
+    fd = accept(srv_fd, NULL, NULL);
+    ASSERT(fd >= 0);
+    while (ctx->get_poll_events(ctx) & POLLOUT)
+        ASSERT(ctx->handle_poll_event(ctx, POLLOUT) == 0);
+    ASSERT(ctx->broadcast_intent(ctx, "Sync", NULL) == 0);
+
+    for (int i = first_lost; i < NB_INTENTS; i++) {
+        int idx = read_intent(fd);
+        DASSERT(idx == i, "intent %d received instead of %d", idx, i);
+    }
+    ASSERT(read_intent(fd) == SYNC_INTENT);
+
+    ctx->dispose(ctx);
+    ASSERT(read_intent(fd) == -1);
+    close(fd);
+    close(srv_fd);
+
+    LOGD("success");
+    return 0;
+}
@@ -131,6 +131,19 @@ struct crm_ctrl_ctx {
      */
     void (*notify_fw_upload_status)(crm_ctrl_ctx_t *ctx, int status);
 
+    /**
+     * Notifies the progress of a Firmware Upload. Can be called from any thread.
+     * A progressing upload re-arms the control watchdog.
+     * NB: Synchronous API
+     *
+     * @param [in] ctx    Module context
+     * @param [in] offset Number of bytes accepted by the modem
+     * @param [in] size   Size of the firmware
+     * @param [in] rate   Upload throughput, in KB/s
+     */
+    void (*notify_fw_upload_progress)(crm_ctrl_ctx_t *ctx, size_t offset, size_t size,
+                                      unsigned int rate);
+
     /**
      * Notifies a Firmware customization status
      * NB: Synchronous API
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CRM_MDMCLI_STATE_PAGE_HEADER__
+#define __CRM_MDMCLI_STATE_PAGE_HEADER__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "libmdmcli/mdm_cli.h"
+
+/**
+ * Snapshot of the modem state published by CRM
+ */
+typedef struct crm_mdmcli_state {
+    mdm_cli_event_t state; // MDM_DOWN, MDM_ON, MDM_UP or MDM_OOS
+    uint32_t sequence;     // incremented on each state change. Kept across CRM restarts
+    int64_t timestamp;     // CLOCK_BOOTTIME of the last state change, in ms
+    int64_t crm_start;     // CLOCK_BOOTTIME of CRM start, in ms
+} crm_mdmcli_state_t;
+
+/* While the modem is not down, the writer refreshes the page at this period (in ms). Readers
+ * report MDM_DOWN if the page is not refreshed within the timeout: CRM was killed */
+#define CRM_MDMCLI_STATE_HEARTBEAT_PERIOD 2000
+#define CRM_MDMCLI_STATE_HEARTBEAT_TIMEOUT (3 * CRM_MDMCLI_STATE_HEARTBEAT_PERIOD)
+
+typedef struct crm_mdmcli_state_ctx crm_mdmcli_state_ctx_t;
+
+/**
+ * Initializes the modem state page module.
+ *
+ * The page is a file mapped in memory by CRM (writer) and by clients (readers). Readers map it
+ * read-only. Updates are protected by a sequence lock: the single writer never waits for readers
+ * and readers retry until they get a consistent snapshot.
+ *
+ * @param [in] writer       true for CRM, false for clients
+ * @param [in] instance_id  CRM instance ID
+ *
+ * @return a valid handle. Must be freed by calling the dispose function
+ * @return NULL if the page can't be mapped. For a reader, this is the case until CRM publishes it
+ */
+crm_mdmcli_state_ctx_t *crm_mdmcli_state_init(bool writer, int instance_id);
+
+struct crm_mdmcli_state_ctx {
+    /**
+     * Disposes the module.
+     *
+     * @param [in] ctx Module context
+     */
+    void (*dispose)(crm_mdmcli_state_ctx_t *ctx);
+
+    /**
+     * Publishes a new modem state. Writer only.
+     *
+     * @param [in] ctx   Module context
+     * @param [in] state MDM_DOWN, MDM_ON, MDM_UP or MDM_OOS
+     */
+    void (*publish)(crm_mdmcli_state_ctx_t *ctx, mdm_cli_event_t state);
+
+    /**
+     * Refreshes the heartbeat of the page if needed. Writer only.
+     *
+     * @param [in] ctx Module context
+     *
+     * @return the delay before the next refresh, in ms
+     * @return -1 if no refresh is needed (modem down)
+     */
+    int (*refresh)(crm_mdmcli_state_ctx_t *ctx);
+
+    /**
+     * Reads a consistent snapshot of the page. Lock-free and without any system call. A page not
+     * refreshed by its writer within CRM_MDMCLI_STATE_HEARTBEAT_TIMEOUT reads MDM_DOWN.
+     *
+     * @param [in] ctx    Module context
+     * @param [out] state Snapshot
+     *
+     * @return 0 in case of success
+     * @return -1 if the page is being updated by a writer that stopped in the middle of an update
+     */
+    int (*read)(const crm_mdmcli_state_ctx_t *ctx, crm_mdmcli_state_t *state);
+};
+
+#endif /* __CRM_MDMCLI_STATE_PAGE_HEADER__ */
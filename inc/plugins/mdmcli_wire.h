@@ -31,6 +31,19 @@
 
 #include "libmdmcli/mdm_cli.h"
 
+/* Maximum number of clients connected to a CRM instance */
+#define CRM_MDMCLI_MAX_CLIENTS 16
+
+/* Maximum number of requests with a correlation id pending per client */
+#define CRM_MDMCLI_MAX_PENDING 8
+
+/* Correlation ids are carried in the 16 MSb of the message id */
+#define CRM_MDMCLI_CORR_ID_MAX 0xFFFF
+
+/* Registration flag, carried in the events bitmap above the events bits: the client accepts to
+ * receive only the latest modem state when states change in a row */
+#define CRM_MDMCLI_REGISTER_COALESCE (1 << 30)
+
 /**
  * Direction of the marshalling
  */
@@ -42,7 +55,8 @@ typedef enum crm_mdmcli_wire_direction {
 /**
  * IDs to serialize client requests.
  * Note1: there is no id for the 'disconnect' call as it will simply close the communication socket.
- * Note2: CRM => client messages are directly using mdm_cli_event_t type as an id.
+ * Note2: CRM => client messages are directly using mdm_cli_event_t type as an id, except
+ *        CRM_RSP_DONE.
  */
 typedef enum crm_mdmcli_wire_req_ids {
     CRM_REQ_REGISTER = MDM_NUM_EVENTS,
@@ -55,6 +69,8 @@ typedef enum crm_mdmcli_wire_req_ids {
     CRM_REQ_ACK_COLD_RESET,
     CRM_REQ_ACK_SHUTDOWN,
     CRM_REQ_NOTIFY_DBG,
+    CRM_RSP_DONE, // CRM => client: completion of a request sent with a correlation id
+    CRM_REQ_CANCEL, // client => CRM: deadline of request 'corr_id' reached, no completion expected
 } crm_mdmcli_wire_req_ids_t;
 
 /**
@@ -62,6 +78,8 @@ typedef enum crm_mdmcli_wire_req_ids {
  */
 typedef struct crm_mdmcli_wire_msg {
     int id;                              /* Can be either a crm_mdmcli_ids_t or a mdm_cli_event_t */
+    int corr_id;                         /* Correlation id of the request. 0 if no completion is
+                                          * expected. Up to CRM_MDMCLI_CORR_ID_MAX */
     union {
         const mdm_cli_dbg_info_t *debug; /* If id is MDM_DBG_INFO or CRM_REQ_NOTIFY_DBG */
         struct {
@@ -72,6 +90,10 @@ typedef struct crm_mdmcli_wire_msg {
             int events_bitmap;
             const char *name;
         } register_client; /* If id is MDMCLI_REQ_REGISTER */
+        struct {
+            int status;   /* 0 if request is completed, -1 if rejected or failed */
+            int crm_time; /* in ms, time spent by CRM to complete the request */
+        } response; /* If id is CRM_RSP_DONE */
     } msg;
 } crm_mdmcli_wire_msg_t;
 
@@ -124,13 +146,23 @@ struct crm_mdmcli_wire_ctx {
      *
      * @param [in] ctx Module context
      * @param [in] msg Message to serialize
-     * @param [in] allocate If set to true, returned pointer needs to be freed
+     * @param [in] buf Buffer of get_msg_size_max() bytes owned by the caller. If NULL, the
+     *                 message is serialized in an internal buffer, valid until the next call
      *
      * @return pointer to serialized message in case of success
      * @return NULL in case of error
      */
     void *(*serialize_msg)(crm_mdmcli_wire_ctx_t *ctx, const crm_mdmcli_wire_msg_t *msg,
-                           bool allocate);
+                           void *buf);
+
+    /**
+     * Gets the maximum size of a serialized message.
+     *
+     * @param [in] ctx Module context
+     *
+     * @return size in bytes
+     */
+    size_t (*get_msg_size_max)(crm_mdmcli_wire_ctx_t *ctx);
 
     /**
      * Sends given serialized message on the wire interface socket.
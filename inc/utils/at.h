@@ -27,6 +27,8 @@
 #ifndef __CRM_UTILS_AT_CMD_HEADER__
 #define __CRM_UTILS_AT_CMD_HEADER__
 
+#include <stdbool.h>
+
 /**
  * Sends an AT command and waits for its answer or timeout
  *
@@ -42,4 +44,87 @@
  */
 int crm_send_at(int fd, const char *tag, const char *at_cmd, int timeout, int fd_abort);
 
+typedef struct crm_at_ctx crm_at_ctx_t;
+
+/**
+ * Creates an AT engine on the given file descriptor.
+ *
+ * The engine keeps a persistent read buffer parsed line by line. Commands are queued and up to
+ * 'depth' commands are written to the modem before their final result code is received.
+ * Final result codes (OK, ERROR, +CME ERROR, +CMS ERROR, NO CARRIER, BUSY, NO ANSWER) are
+ * matched in order to the written commands.
+ *
+ * @param [in] fd       Valid file descriptor. Not closed by the engine
+ * @param [in] tag      Log tag. Must stay valid during the engine lifetime
+ * @param [in] depth    Maximum number of commands written without final result code (>= 1)
+ * @param [in] urc          Optional. Called for each line received while no command is in flight
+ *                          and for the lines matching urc_prefixes otherwise
+ * @param [in] urc_data     Data provided to the urc function
+ * @param [in] urc_prefixes Optional. NULL terminated list of URC prefixes (e.g. "+CREG:").
+ *                          Must stay valid during the engine lifetime
+ *
+ * @return a valid handle. Must be freed by calling the dispose function
+ */
+crm_at_ctx_t *crm_at_init(int fd, const char *tag, int depth,
+                          void (*urc)(const char *line, void *urc_data), void *urc_data,
+                          const char *const *urc_prefixes);
+
+struct crm_at_ctx {
+    /**
+     * Disposes the module. Pending commands are discarded without calling their callback.
+     *
+     * @param [in] ctx Module context
+     */
+    void (*dispose)(crm_at_ctx_t *ctx);
+
+    /**
+     * Queues an AT command. The command is written immediately if the pipeline is not full.
+     * If a command fails, commands not written yet are discarded (their callback is called
+     * with an error status).
+     *
+     * @param [in] ctx      Module context
+     * @param [in] at_cmd   AT command to send. Must \0 terminated (without \r\n)
+     * @param [in] callback Optional. Called with the command status (0: OK, -1: error) once the
+     *                      command is completed
+     * @param [in] data     Data provided to the callback
+     *
+     * @return 0 if successful, -1 if the command cannot be written
+     */
+    int (*send)(crm_at_ctx_t *ctx, const char *at_cmd, void (*callback)(int status, void *data),
+                void *data);
+
+    /**
+     * Reads and parses the data available on the file descriptor. To be called when the file
+     * descriptor is readable if the engine is used in an external poll loop.
+     *
+     * @param [in] ctx Module context
+     *
+     * @return 0 if successful, -1 in case of read failure
+     */
+    int (*process)(crm_at_ctx_t *ctx);
+
+    /**
+     * Gets the number of commands not completed yet
+     *
+     * @param [in] ctx Module context
+     *
+     * @return number of pending commands
+     */
+    int (*get_pending)(crm_at_ctx_t *ctx);
+
+    /**
+     * Waits until all pending commands are completed. On timeout or abort, pending commands are
+     * discarded (their callback is called with an error status).
+     *
+     * @param [in] ctx      Module context
+     * @param [in] timeout  Maximum time in milliseconds without any data received
+     * @param [in] fd_abort File descriptor used to abort this function
+     *
+     * @return 0 if all commands completed since last call succeeded
+     * @return -1 in case of error
+     * @return -2 if aborted
+     */
+    int (*wait)(crm_at_ctx_t *ctx, int timeout, int fd_abort);
+};
+
 #endif
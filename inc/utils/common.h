@@ -58,6 +58,7 @@ extern "C" {
 
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof(*a))
 #define MIN(X, Y) ((X) < (Y) ? (X) : (Y))
+#define MAX(X, Y) ((X) > (Y) ? (X) : (Y))
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CRM_UTILS_FAULT_HEADER__
+#define __CRM_UTILS_FAULT_HEADER__
+
+#include <stdbool.h>
+
+/**
+ * Fault injection points.
+ *
+ * Faults are configured with the CRM_KEY_DBG_FAULT_INJECTION property, as a comma-separated list
+ * of <name>[:<skip>[:<count>[:<param>]]] entries where:
+ *  - name:  name of the injection point (see below)
+ *  - skip:  number of hits let through before injecting the fault. Default: 0
+ *  - count: number of faults to inject. -1 means 'forever'. Default: -1
+ *  - param: fault specific parameter (delay in ms). Default: 0
+ *
+ * e.g. "at_timeout:2:1,ipc_delay:0:-1:200"
+ *
+ * Fault injection is never enabled in user builds.
+ */
+typedef enum crm_fault_point {
+    CRM_FAULT_IPC_DROP,     // "ipc_drop":     scalar-only inter-thread message is dropped
+    CRM_FAULT_IPC_DELAY,    // "ipc_delay":    inter-thread message is delayed by param ms
+    CRM_FAULT_FILE_READ,    // "file_read":    crm_file_read fails
+    CRM_FAULT_FILE_WRITE,   // "file_write":   crm_file_write fails
+    CRM_FAULT_SOCKET_STALL, // "socket_stall": crm_socket_write stalls param ms (default: timeout)
+    CRM_FAULT_AT_TIMEOUT,   // "at_timeout":   an AT command is not sent: the AT engine times out
+    CRM_FAULT_DLOPEN,       // "dlopen":       library loading fails in the process factory
+    CRM_FAULT_NUM
+} crm_fault_point_t;
+
+/**
+ * Initializes the fault injection module by reading its configuration.
+ * Shall be called after crm_property_init. Can be called again to reload the configuration, which
+ * also resets the hit counters.
+ */
+void crm_fault_init(void);
+
+/**
+ * Checks if a fault must be injected at the given injection point. Each call counts as a hit.
+ *
+ * @param [in]  point Injection point
+ * @param [out] param Optional. Fault parameter. Only set if a fault must be injected
+ *
+ * @return true if the fault must be injected
+ */
+bool crm_fault_inject(crm_fault_point_t point, int *param);
+
+#endif /* __CRM_UTILS_FAULT_HEADER__ */
@@ -28,6 +28,8 @@
 #define __CRM_UTILS_FILES_HEADER__
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
 
 /**
  *  Writes a string to a file
@@ -75,4 +77,67 @@ bool crm_file_exists(const char *path);
  */
 int crm_file_copy(const char *src, const char *dst, bool in_raw, bool out_raw, mode_t dst_mode);
 
+typedef enum crm_file_stream_method {
+    CRM_FILE_STREAM_AUTO = 0,   // selects the best method for the type of both files
+    CRM_FILE_STREAM_COPY_RANGE, // copy_file_range: between regular files, without any copy if
+                                // the file system supports it
+    CRM_FILE_STREAM_SPLICE,     // splice: pages are moved through a pipe. One syscall per chunk
+                                // if one of the files is a pipe, two otherwise
+    CRM_FILE_STREAM_SENDFILE,   // sendfile: from page cache to any file
+    CRM_FILE_STREAM_READ_WRITE, // copy through a user space buffer. Used as fallback when the
+                                // kernel does not support the selected method for these files
+} crm_file_stream_method_t;
+
+#define CRM_FILE_STREAM_CHUNK_SIZE (256 * 1024)     // default chunk size, in bytes
+#define CRM_FILE_STREAM_PROGRESS_STEP (1024 * 1024) // default progress step, in bytes
+
+typedef struct crm_file_stream {
+    /* Tunables. 0 selects the default value */
+    crm_file_stream_method_t method;
+    size_t chunk_size;    // maximum number of bytes moved by one syscall
+    size_t progress_step; // number of bytes between two progress notifications
+
+    /**
+     * Optional progress callback. Called in the context of the streaming thread every
+     * progress_step bytes and once the stream is complete.
+     *
+     * @param [in] param  progress_param
+     * @param [in] offset number of bytes accepted by the destination
+     * @param [in] size   size of the stream
+     * @param [in] rate   throughput since the start of this call, in KB/s
+     */
+    void (*progress)(void *param, size_t offset, size_t size, unsigned int rate);
+    void *progress_param;
+
+    /* Can be set from any thread with __atomic_store_n to abort the stream after current chunk.
+     * Also checked while waiting for a full non-blocking destination */
+    bool abort;
+
+    /* Offset of the next byte to stream. Set it to resume a stream. Updated with the number of
+     * bytes accepted by the destination, even in case of failure */
+    size_t offset;
+
+    /* Method used for the last chunk. Set by crm_file_stream */
+    crm_file_stream_method_t used;
+} crm_file_stream_t;
+
+/**
+ * Streams data from a file descriptor to another one with the most efficient kernel path.
+ *
+ * Data is read from the current offset of in_fd plus stream->offset. The offset of in_fd is not
+ * modified if it is seekable. Data is written at the current offset of out_fd: when resuming a
+ * stream to a regular file, the caller must seek out_fd to the offset to resume from.
+ * NB: Synchronous API. May block for a long time with slow destinations: call it in a thread.
+ *
+ * @param [in]     in_fd  Source file descriptor
+ * @param [in]     out_fd Destination file descriptor
+ * @param [in]     size   Size of the stream, in bytes
+ * @param [in,out] stream Stream configuration and state
+ *
+ * @return 0 if the whole stream was written
+ * @return 1 if the stream was aborted
+ * @return -1 in case of failure
+ */
+int crm_file_stream(int in_fd, int out_fd, size_t size, crm_file_stream_t *stream);
+
 #endif /* __CRM_UTILS_FILES_HEADER__ */
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CRM_UTILS_INSTANCE_HEADER__
+#define __CRM_UTILS_INSTANCE_HEADER__
+
+/**
+ * Sets the default modem instance ID of the process. Used by threads which do not have their
+ * own instance ID
+ *
+ * @param [in] inst_id Instance ID
+ */
+void crm_instance_init(int inst_id);
+
+/**
+ * Sets the modem instance ID of the calling thread. Threads created with crm_thread_init
+ * inherit the instance ID of their parent.
+ * Used when several modem instances are handled by the same process
+ *
+ * @param [in] inst_id Instance ID
+ */
+void crm_instance_set(int inst_id);
+
+/**
+ * Gets the modem instance ID of the calling thread
+ *
+ * @return instance ID
+ */
+int crm_instance_get(void);
+
+#endif /* __CRM_UTILS_INSTANCE_HEADER__ */
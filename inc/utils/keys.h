@@ -42,6 +42,8 @@
 #define CRM_KEY_DBG_DISABLE_ESCALATION "persist.sys.crm@.escalation_off"
 #define CRM_KEY_DBG_ENABLE_FLASHING_LOG "persist.sys.crm@.flashing_log"
 #define CRM_KEY_DBG_DISABLE_DUMP "persist.sys.crm@.dump_off"
+#define CRM_KEY_DBG_FAULT_INJECTION "sys.crm@.fault"
+#define CRM_KEY_DBG_REBOOT_COUNTER "sys.crm@.reboot_counter"
 
 /* DEBUG KEYS: HOST ONLY */
 #define CRM_KEY_DBG_HOST "crm@.host_test"
@@ -56,11 +58,20 @@
 #define CRM_KEY_CONTENT_SERVICE_RPCD "rpc-daemon"
 
 /* CRM specific keys */
+#define CRM_KEY_FAKE_EVENT "crashreport.events.fake"
+#define CRM_KEY_FIRST_START "sys.crm@.first_start"
+#define CRM_KEY_WAKELOCK_GRACE "persist.sys.crm@.wakelock_grace"
+#define CRM_KEY_JAVA_BRIDGE_STATS "sys.crm.jvb_stats"
+
+/* Legacy CRM keys: values are now in the state store and imported from those keys once */
 #define CRM_KEY_REBOOT_COUNTER "persist.sys.crm@.reboot"
 #define CRM_KEY_BLOB_HASH "persist.sys.crm@.blob_hash"
 #define CRM_KEY_CONFIG_HASH "persist.sys.crm@.config_hash"
-#define CRM_KEY_FAKE_EVENT "crashreport.events.fake"
-#define CRM_KEY_FIRST_START "sys.crm@.first_start"
+
+/* CRM state store keys (see utils/state.h) */
+#define CRM_STATE_KEY_REBOOT_COUNTER "crm@.reboot"
+#define CRM_STATE_KEY_BLOB_HASH "crm@.blob_hash"
+#define CRM_STATE_KEY_CONFIG_HASH "crm@.config_hash"
 
 /* device specific keys */
 #define CRM_KEY_SERVICE_WWAN "sys.wwan0.state"
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CRM_UTILS_MSG_POOL_HEADER__
+#define __CRM_UTILS_MSG_POOL_HEADER__
+
+#include <stddef.h>
+
+/**
+ * Usage statistics of a message pool.
+ *
+ * @var nb_blocks   Number of preallocated blocks
+ * @var in_use      Number of blocks currently allocated (heap fallbacks included)
+ * @var max_in_use  Highest value reached by in_use
+ * @var nb_allocs   Number of allocations served since init
+ * @var nb_failures Number of allocations that could not be served by the pool (heap fallbacks)
+ */
+typedef struct crm_msg_pool_stats {
+    int nb_blocks;
+    int in_use;
+    int max_in_use;
+    int nb_allocs;
+    int nb_failures;
+} crm_msg_pool_stats_t;
+
+typedef struct crm_msg_pool crm_msg_pool_t;
+
+/**
+ * Creates a pool of fixed-size message blocks. All blocks are allocated here, in one chunk, so
+ * that messages exchanged on the hot paths do not go through malloc/free.
+ *
+ * The pool is thread safe: blocks can be allocated by one thread and released by another one.
+ *
+ * @param [in] block_size Size of a block
+ * @param [in] nb_blocks  Number of blocks
+ *
+ * @return a valid handle. Must be freed by calling the dispose function
+ */
+crm_msg_pool_t *crm_msg_pool_init(size_t block_size, int nb_blocks);
+
+struct crm_msg_pool {
+    /**
+     * Disposes the module. Blocks still allocated are released as well, including the ones
+     * allocated from the heap.
+     *
+     * @param [in] ctx Module context
+     */
+    void (*dispose)(crm_msg_pool_t *ctx);
+
+    /**
+     * Allocates a block. If the pool is exhausted, the block is allocated from the heap and
+     * the failure is accounted in the statistics.
+     *
+     * @param [in] ctx Module context
+     *
+     * @return a valid block of block_size bytes. Must be released by calling the free function
+     */
+    void *(*alloc)(crm_msg_pool_t *ctx);
+
+    /**
+     * Releases a block. Blocks that do not belong to the pool are given back to the heap.
+     *
+     * @param [in] ctx Module context
+     * @param [in] block Block to release. Can be NULL
+     */
+    void (*free)(crm_msg_pool_t *ctx, void *block);
+
+    /**
+     * Gets the usage statistics of the pool.
+     *
+     * @param [in] ctx Module context
+     * @param [out] stats Statistics
+     */
+    void (*get_stats)(crm_msg_pool_t *ctx, crm_msg_pool_stats_t *stats);
+};
+
+#endif /* __CRM_UTILS_MSG_POOL_HEADER__ */
@@ -66,6 +66,7 @@ struct crm_process_factory_ctx {
 
     /**
      * Creates a new process
+     * The process runs with the instance ID of the calling thread (see utils/instance.h)
      *
      * @param [in] ctx         Module context
      * @param [in] plugin_name Name of the plugin to be loaded
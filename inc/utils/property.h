@@ -45,7 +45,7 @@
 void crm_property_init(int inst_id);
 
 /**
- * Gets a property value
+ * Gets a property value. Values are cached and read again only if the property changed.
  *
  * @param [in] key           Property key
  * @param [in] value         Value must be CRM_PROPERTY_VALUE_MAX size
@@ -27,6 +27,8 @@
 #ifndef __CRM_UTILS_SOCKET_HEADER__
 #define __CRM_UTILS_SOCKET_HEADER__
 
+#include <stdbool.h>
+
 /**
  * Connects to Android socket with the given name.
  *
@@ -46,6 +48,26 @@ int crm_socket_connect(const char *socket_name);
  */
 int crm_socket_create(const char *socket_name, int max_conn);
 
+/**
+ * Watches the creation of the Android socket with the given name. This is used to detect that a
+ * server has been restarted.
+ *
+ * @param [in] socket_name  name of the socket to watch
+ *
+ * @return file descriptor to be polled (READ), -1 in case of failure
+ */
+int crm_socket_watch_init(const char *socket_name);
+
+/**
+ * Reads pending events on a socket watch file descriptor
+ *
+ * @param [in] fd           file descriptor returned by crm_socket_watch_init
+ * @param [in] socket_name  name of the watched socket
+ *
+ * @return true if the socket has been (re)created
+ */
+bool crm_socket_watch_check(int fd, const char *socket_name);
+
 /**
  * Accepts client connection on given socket
  *
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) Intel 2016
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CRM_UTILS_STATE_HEADER__
+#define __CRM_UTILS_STATE_HEADER__
+
+#include <stdbool.h>
+
+#define CRM_STATE_KEY_MAX 32
+#define CRM_STATE_VALUE_MAX 92
+#define CRM_STATE_UPDATE_MAX 8
+
+#define CRM_STATE_STORE "/data/telephony/crm/crm%d.store"
+
+typedef enum crm_state_mode {
+    CRM_STATE_READ_ONLY, // store of another process. Updates are forbidden
+    CRM_STATE_NO_SYNC,   // updates are written to the file, the kernel flushes them to storage
+    CRM_STATE_SYNC,      // updates are flushed to storage before returning
+} crm_state_mode_t;
+
+/**
+ * Opens the state store of the calling thread instance. The store keeps the operational state of
+ * CRM that must survive a restart (e.g. escalation counter, firmware hashes).
+ * Each instance has its own store: reads and updates go to the store of the calling thread
+ * instance.
+ *
+ * The store is a log of updates, loaded in memory when opened: reads never access the file.
+ * Each update is appended as a single record with a checksum: after a crash, a partially written
+ * update is discarded as a whole. The log is compacted when it grows.
+ *
+ * Until this function is called, the store is kept in memory only.
+ *
+ * @param [in] path Path of the store file
+ * @param [in] mode Access and synchronization mode
+ */
+void crm_state_init(const char *path, crm_state_mode_t mode);
+
+/**
+ * Closes the state store of the calling thread instance. The store is then kept in memory only.
+ */
+void crm_state_dispose(void);
+
+/**
+ * Gets a value
+ *
+ * @param [in] key           Key. If it contains @, it is replaced by the instance id
+ * @param [in] value         Value must be CRM_STATE_VALUE_MAX size
+ * @param [in] default_value used if the key is not in the store, if not NULL
+ *
+ * @return true if the key is in the store
+ */
+bool crm_state_get(const char *key, char *value, const char *default_value);
+
+/**
+ * Sets several values atomically: after a crash, either all or none of them are stored.
+ *
+ * @param [in] nb     Number of values, up to CRM_STATE_UPDATE_MAX
+ * @param [in] keys   Keys. If they contain @, it is replaced by the instance id
+ * @param [in] values Values, shorter than CRM_STATE_VALUE_MAX
+ *
+ * @return 0 if successful. If the update can't be written, the store is not modified
+ */
+int crm_state_set_multi(int nb, const char *const *keys, const char *const *values);
+
+/**
+ * Sets a value
+ *
+ * @see crm_state_set_multi
+ */
+int crm_state_set(const char *key, const char *value);
+
+/**
+ * Imports a value from a legacy property if the key is not in the store yet
+ *
+ * @param [in] key          Key
+ * @param [in] property_key Key of the property where the value used to be stored
+ */
+void crm_state_import_property(const char *key, const char *property_key);
+
+#endif /* __CRM_UTILS_STATE_HEADER__ */
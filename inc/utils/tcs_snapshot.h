@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CRM_UTILS_TCS_SNAPSHOT_HEADER__
+#define __CRM_UTILS_TCS_SNAPSHOT_HEADER__
+
+#include "libtcs2/tcs.h"
+
+/**
+ * Creates a TCS context backed by a configuration snapshot.
+ *
+ * The snapshot is keyed by a hash of the TCS XML files found in xml_folder and in the software
+ * folder (ro.telephony.tcs.sw_folder, relative to xml_folder if not absolute), of the TCS
+ * platform properties and of the configuration name.
+ * If the snapshot matches, it is mapped in memory and values are read from it: XML files are not
+ * parsed. If a value is not found in the snapshot, TCS is initialized and the value is read
+ * from it (the snapshot is then updated).
+ * If the snapshot does not match, TCS is initialized and every value read is recorded. The
+ * snapshot is written when the context is disposed.
+ *
+ * Values returned by this context must be freed exactly like values returned by TCS.
+ *
+ * @param [in] name          Configuration name (given to tcs2_init)
+ * @param [in] xml_folder    Folder containing the TCS XML files
+ * @param [in] snapshot_path Path of the snapshot file
+ *
+ * @return a valid handle. Must be freed by calling the dispose function
+ */
+tcs_ctx_t *crm_tcs_snapshot_init(const char *name, const char *xml_folder,
+                                 const char *snapshot_path);
+
+#endif /* __CRM_UTILS_TCS_SNAPSHOT_HEADER__ */
@@ -46,4 +46,13 @@ void crm_time_add_ms(struct timespec *timer_end, int ms);
  */
 int crm_time_get_remain_ms(const struct timespec *timer_end);
 
+/**
+ * Returns elapsed time between timer_begin and current time
+ *
+ * @param [in] timer_begin
+ *
+ * @return elapsed time in ms. If timer_begin is in the future, returned value is 0
+ */
+int crm_time_get_elapsed_ms(const struct timespec *timer_begin);
+
 #endif /* __CRM_UTILS_TIME_HEADER__ */
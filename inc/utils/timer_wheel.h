@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CRM_UTILS_TIMER_WHEEL_HEADER__
+#define __CRM_UTILS_TIMER_WHEEL_HEADER__
+
+#include <stdbool.h>
+
+typedef struct crm_timer_wheel crm_timer_wheel_t;
+
+/**
+ * Creates a timer service. The service is not thread safe: it must be used by a single thread,
+ * the one polling its file descriptor.
+ *
+ * Timers are stored in a hierarchical timer wheel: arming and canceling a timer are O(1), and a
+ * single timer file descriptor (CLOCK_BOOTTIME) is used whatever the number of timers.
+ * Expiration times are rounded up to the granularity: timers expiring in the same granularity
+ * window are handled by a single wakeup. A timer never expires before its time-out.
+ *
+ * @param [in] nb_timers   Maximum number of timers
+ * @param [in] granularity Granularity of the wheel, in ms
+ *
+ * @return a valid handle. Must be freed by calling the dispose function
+ */
+crm_timer_wheel_t *crm_timer_wheel_init(int nb_timers, int granularity);
+
+struct crm_timer_wheel {
+    /**
+     * Disposes the module.
+     *
+     * @param [in] ctx Module context
+     */
+    void (*dispose)(crm_timer_wheel_t *ctx);
+
+    /**
+     * Creates a timer. The timer is not armed.
+     *
+     * @param [in] ctx Module context
+     * @param [in] callback Function called when the timer expires. The timer is not armed
+     *                      anymore when the callback is called: it can be re-armed from it
+     * @param [in] param Parameter given to the callback
+     *
+     * @return timer id
+     */
+    int (*add)(crm_timer_wheel_t *ctx, void (*callback)(void *param), void *param);
+
+    /**
+     * Arms a timer. If the timer is already armed, it is re-armed with the new time-out.
+     *
+     * @param [in] ctx Module context
+     * @param [in] id Timer id
+     * @param [in] timeout Time-out in ms
+     */
+    void (*arm)(crm_timer_wheel_t *ctx, int id, int timeout);
+
+    /**
+     * Cancels a timer. Does nothing if the timer is not armed.
+     *
+     * @param [in] ctx Module context
+     * @param [in] id Timer id
+     */
+    void (*cancel)(crm_timer_wheel_t *ctx, int id);
+
+    /**
+     * Checks if a timer is armed.
+     *
+     * @param [in] ctx Module context
+     * @param [in] id Timer id
+     *
+     * @return true if the timer is armed
+     */
+    bool (*is_armed)(crm_timer_wheel_t *ctx, int id);
+
+    /**
+     * Gets the file descriptor that needs to be polled (READ). When an event is notified on it,
+     * the process function must be called. Must not be closed.
+     *
+     * @param [in] ctx Module context
+     *
+     * @return file descriptor
+     */
+    int (*get_poll_fd)(crm_timer_wheel_t *ctx);
+
+    /**
+     * Calls the callbacks of all expired timers.
+     *
+     * @param [in] ctx Module context
+     */
+    void (*process)(crm_timer_wheel_t *ctx);
+};
+
+#endif /* __CRM_UTILS_TIMER_WHEEL_HEADER__ */
@@ -35,11 +35,15 @@ enum {
     WAKELOCK_WATCHDOG_PING,
     WAKELOCK_WATCHDOG_REQ,
     WAKELOCK_CLA,
-    WAKELOCK_MDMCLI
+    WAKELOCK_MDMCLI,
+    WAKELOCK_MODULE_NB
 };
 
 #include <stdbool.h>
 
+/* Hold time histogram buckets: < 10ms, < 100ms, < 1s, < 10s, >= 10s */
+#define WAKELOCK_HISTOGRAM_SIZE 5
+
 typedef struct crm_wakelock crm_wakelock_t;
 
 /* Used by crm_plugin_load API */
@@ -93,6 +97,17 @@ struct crm_wakelock {
      * @return true if wakelock is hold
      */
     bool (*is_held)(crm_wakelock_t *ctx);
+
+    /**
+     * Gets the hold time histogram of a module. A hold starts when the module acquires the
+     * wakelock and ends when it has released all its acquisitions
+     *
+     * @param [in] ctx        Module context
+     * @param [in] module_id  Module identifier
+     * @param [out] histogram Number of holds per bucket
+     */
+    void (*get_histogram)(crm_wakelock_t *ctx, int module_id,
+                          unsigned int histogram[WAKELOCK_HISTOGRAM_SIZE]);
 };
 
 #ifdef __cplusplus
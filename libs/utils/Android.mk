@@ -74,6 +74,66 @@ CRM_SHARED_LIBS := libcrm_utils
 CRM_TARGET := $(BUILD_EXECUTABLE)
 include $(LOCAL_PATH)/../../makefiles/crm_c_make.mk
 
+##############################################################
+include $(LOCAL_PATH)/../../makefiles/crm_clear.mk
+CRM_NAME := crm_test_tcs_snapshot
+
+CRM_SRC := test/tcs_snapshot_test.c
+
+CRM_SHARED_LIBS_ANDROID_ONLY := libc
+CRM_SHARED_LIBS := libcrm_utils libtcs2
+
+CRM_TARGET := $(BUILD_EXECUTABLE)
+include $(LOCAL_PATH)/../../makefiles/crm_c_make.mk
+
+##############################################################
+include $(LOCAL_PATH)/../../makefiles/crm_clear.mk
+CRM_NAME := crm_test_msg_pool
+
+CRM_SRC := test/msg_pool_test.c
+
+CRM_SHARED_LIBS_ANDROID_ONLY := libc
+CRM_SHARED_LIBS := libcrm_utils
+
+CRM_TARGET := $(BUILD_EXECUTABLE)
+include $(LOCAL_PATH)/../../makefiles/crm_c_make.mk
+
+##############################################################
+include $(LOCAL_PATH)/../../makefiles/crm_clear.mk
+CRM_NAME := crm_test_timer_wheel
+
+CRM_SRC := test/timer_wheel_test.c
+
+CRM_SHARED_LIBS_ANDROID_ONLY := libc
+CRM_SHARED_LIBS := libcrm_utils
+
+CRM_TARGET := $(BUILD_EXECUTABLE)
+include $(LOCAL_PATH)/../../makefiles/crm_c_make.mk
+
+##############################################################
+include $(LOCAL_PATH)/../../makefiles/crm_clear.mk
+CRM_NAME := crm_test_state
+
+CRM_SRC := test/state_test.c
+
+CRM_SHARED_LIBS_ANDROID_ONLY := libc
+CRM_SHARED_LIBS := libcrm_utils
+
+CRM_TARGET := $(BUILD_EXECUTABLE)
+include $(LOCAL_PATH)/../../makefiles/crm_c_make.mk
+
+##############################################################
+include $(LOCAL_PATH)/../../makefiles/crm_clear.mk
+CRM_NAME := crm_test_file_stream
+
+CRM_SRC := test/file_stream_test.c
+
+CRM_SHARED_LIBS_ANDROID_ONLY := libc
+CRM_SHARED_LIBS := libcrm_utils
+
+CRM_TARGET := $(BUILD_EXECUTABLE)
+include $(LOCAL_PATH)/../../makefiles/crm_c_make.mk
+
 ##############################################################
 include $(LOCAL_PATH)/../../makefiles/crm_clear.mk
 CRM_NAME := crm_test_process
@@ -29,86 +29,385 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #define CRM_MODULE_TAG "UTILS"
 #include "utils/logs.h"
 #include "utils/common.h"
+#include "utils/fault.h"
 #include "utils/at.h"
 
+#define AT_BUFFER_SIZE 2048
+
+typedef struct crm_at_cmd {
+    struct crm_at_cmd *next;
+    void (*callback)(int status, void *data);
+    void *data;
+    size_t len;
+    char cmd[]; // \r\n terminated
+} crm_at_cmd_t;
+
+typedef struct crm_at_ctx_internal {
+    crm_at_ctx_t ctx; // Needs to be first
+
+    /* Configuration */
+    int fd;
+    const char *tag;
+    int depth;
+    void (*urc)(const char *line, void *urc_data);
+    void *urc_data;
+    const char *const *urc_prefixes; // NULL terminated. Lines forwarded while a command is in flight
+
+    /* Command queue: the 'in_flight' first commands are written to the modem */
+    crm_at_cmd_t *head;
+    crm_at_cmd_t *tail;
+    int nb_cmds;
+    int in_flight;
+    bool failure;
+    bool stalled; // a command was not written (fault injection): the modem never answers
+
+    /* Read buffer: [r_idx, w_idx[ contains data not parsed yet */
+    char buffer[AT_BUFFER_SIZE];
+    size_t r_idx;
+    size_t w_idx;
+} crm_at_ctx_internal_t;
+
+static crm_at_cmd_t *get_cmd(crm_at_ctx_internal_t *i_ctx, int idx)
+{
+    crm_at_cmd_t *cmd = i_ctx->head;
+
+    for (int i = 0; i < idx && cmd; i++)
+        cmd = cmd->next;
+    return cmd;
+}
+
+static void pop_cmd(crm_at_ctx_internal_t *i_ctx, int status, bool notify)
+{
+    crm_at_cmd_t *cmd = i_ctx->head;
+
+    ASSERT(cmd != NULL);
+
+    i_ctx->head = cmd->next;
+    if (!i_ctx->head)
+        i_ctx->tail = NULL;
+    i_ctx->nb_cmds--;
+
+    if (notify && cmd->callback)
+        cmd->callback(status, cmd->data);
+    free(cmd);
+}
+
+static void discard_all(crm_at_ctx_internal_t *i_ctx, bool notify)
+{
+    while (i_ctx->head)
+        pop_cmd(i_ctx, -1, notify);
+    i_ctx->in_flight = 0;
+    i_ctx->stalled = false;
+    i_ctx->r_idx = i_ctx->w_idx = 0;
+}
+
+/* Discards the commands not written yet. They are always at the end of the queue */
+static void discard_unsent(crm_at_ctx_internal_t *i_ctx)
+{
+    crm_at_cmd_t *last = get_cmd(i_ctx, i_ctx->in_flight - 1);
+    crm_at_cmd_t *cmd = last ? last->next : i_ctx->head;
+
+    if (last) {
+        last->next = NULL;
+        i_ctx->tail = last;
+    } else {
+        i_ctx->head = i_ctx->tail = NULL;
+    }
+
+    while (cmd) {
+        crm_at_cmd_t *next = cmd->next;
+        LOGD("[AT-%s] discarded: %.*s", i_ctx->tag, (int)cmd->len - 2, cmd->cmd);
+        i_ctx->nb_cmds--;
+        if (cmd->callback)
+            cmd->callback(-1, cmd->data);
+        free(cmd);
+        cmd = next;
+    }
+}
+
+static int write_cmds(crm_at_ctx_internal_t *i_ctx)
+{
+    crm_at_cmd_t *cmd;
+
+    while (!i_ctx->stalled && (i_ctx->in_flight < i_ctx->depth) &&
+           ((cmd = get_cmd(i_ctx, i_ctx->in_flight)) != NULL)) {
+        if (crm_fault_inject(CRM_FAULT_AT_TIMEOUT, NULL)) {
+            LOGD("[AT-%s] not sent (fault): %.*s", i_ctx->tag, (int)cmd->len - 2, cmd->cmd);
+            i_ctx->stalled = true;
+            i_ctx->in_flight++;
+            break;
+        }
+
+        LOGD("[AT-%s]  sending: %.*s", i_ctx->tag, (int)cmd->len - 2, cmd->cmd);
+        ssize_t len = write(i_ctx->fd, cmd->cmd, cmd->len);
+        if (len != (ssize_t)cmd->len) {
+            LOGE("Write failure. %zd/%zu written", len, cmd->len);
+            i_ctx->failure = true;
+            discard_unsent(i_ctx);
+            return -1;
+        }
+        i_ctx->in_flight++;
+    }
+
+    return 0;
+}
+
+static bool is_final_error(const char *line)
+{
+    return !strcmp(line, "ERROR") || !strncmp(line, "+CME ERROR:", 11) ||
+           !strncmp(line, "+CMS ERROR:", 11) || !strcmp(line, "NO CARRIER") ||
+           !strcmp(line, "BUSY") || !strcmp(line, "NO ANSWER");
+}
+
+static bool is_urc(crm_at_ctx_internal_t *i_ctx, const char *line)
+{
+    if (!i_ctx->urc)
+        return false;
+
+    if (i_ctx->in_flight == 0)
+        return true;
+
+    for (const char *const *prefix = i_ctx->urc_prefixes; prefix && *prefix; prefix++)
+        if (!strncmp(line, *prefix, strlen(*prefix)))
+            return true;
+
+    return false;
+}
+
+static void handle_line(crm_at_ctx_internal_t *i_ctx, const char *line)
+{
+    if (line[0] == '\0')
+        return;
+
+    LOGD("[AT-%s] received: %s", i_ctx->tag, line);
+
+    if (is_urc(i_ctx, line)) {
+        i_ctx->urc(line, i_ctx->urc_data);
+        return;
+    }
+
+    if (i_ctx->in_flight == 0)
+        return;
+
+    int status;
+    if (!strcmp(line, "OK"))
+        status = 0;
+    else if (is_final_error(line))
+        status = -1;
+    else
+        return; // echo or intermediate response
+
+    i_ctx->in_flight--;
+    pop_cmd(i_ctx, status, true);
+
+    if (status) {
+        i_ctx->failure = true;
+        discard_unsent(i_ctx);
+    } else {
+        write_cmds(i_ctx);
+    }
+}
+
 /**
  * @see at.h
  */
-int crm_send_at(int fd, const char *tag, const char *at_cmd, int timeout, int fd_abort)
+static int process(crm_at_ctx_t *ctx)
 {
-    char buffer[2048];
+    crm_at_ctx_internal_t *i_ctx = (crm_at_ctx_internal_t *)ctx;
 
-    ASSERT(at_cmd != NULL);
-    ASSERT(fd >= 0);
+    ASSERT(i_ctx != NULL);
 
-    struct pollfd pfd[] = {
-        { .fd = fd, .events = POLLIN },
-        { .fd = fd_abort, .events = POLLIN }
-    };
+    if (i_ctx->w_idx >= sizeof(i_ctx->buffer) - 1) {
+        if (i_ctx->r_idx == 0) {
+            LOGE("[AT-%s] line too long. discarded", i_ctx->tag);
+            i_ctx->w_idx = 0;
+        } else {
+            i_ctx->w_idx -= i_ctx->r_idx;
+            memmove(i_ctx->buffer, &i_ctx->buffer[i_ctx->r_idx], i_ctx->w_idx);
+            i_ctx->r_idx = 0;
+        }
+    }
 
+    ssize_t len = read(i_ctx->fd, &i_ctx->buffer[i_ctx->w_idx],
+                       sizeof(i_ctx->buffer) - i_ctx->w_idx - 1);
+    if (len <= 0) {
+        LOGE("failed to read answer. errno: %d/%s", errno, strerror(errno));
+        return -1;
+    }
 
-    LOGD("[AT-%s]  sending: %s", tag, at_cmd);
-    int lenb = snprintf(buffer, sizeof(buffer), "%s\r\n", at_cmd);
-    DASSERT(lenb < (int)sizeof(buffer), "internal buffer too small");
+    /* Only the new data is scanned: previous data does not contain any line ending */
+    char *scan = &i_ctx->buffer[i_ctx->w_idx];
+    i_ctx->w_idx += len;
 
-    ssize_t len = write(fd, buffer, lenb);
-    if (len != lenb) {
-        LOGE("Write failure. %zd/%d written", len, lenb);
-        return -1;
+    char *end = &i_ctx->buffer[i_ctx->w_idx];
+    char *eol;
+    while ((eol = memchr(scan, '\n', end - scan)) != NULL) {
+        char *line = &i_ctx->buffer[i_ctx->r_idx];
+        *eol = '\0';
+        if ((eol > line) && (eol[-1] == '\r'))
+            eol[-1] = '\0';
+
+        handle_line(i_ctx, line);
+
+        scan = eol + 1;
+        i_ctx->r_idx = scan - i_ctx->buffer;
     }
 
-    size_t idx = 0;
+    if (i_ctx->r_idx == i_ctx->w_idx)
+        i_ctx->r_idx = i_ctx->w_idx = 0;
+
+    return 0;
+}
+
+/**
+ * @see at.h
+ */
+static int send_cmd(crm_at_ctx_t *ctx, const char *at_cmd,
+                    void (*callback)(int status, void *data), void *data)
+{
+    crm_at_ctx_internal_t *i_ctx = (crm_at_ctx_internal_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+    ASSERT(at_cmd != NULL);
+
+    size_t len = strlen(at_cmd) + 2;
+    crm_at_cmd_t *cmd = malloc(sizeof(*cmd) + len + 1);
+    ASSERT(cmd != NULL);
+
+    cmd->next = NULL;
+    cmd->callback = callback;
+    cmd->data = data;
+    cmd->len = len;
+    snprintf(cmd->cmd, len + 1, "%s\r\n", at_cmd);
+
+    if (i_ctx->tail)
+        i_ctx->tail->next = cmd;
+    else
+        i_ctx->head = cmd;
+    i_ctx->tail = cmd;
+    i_ctx->nb_cmds++;
+
+    return write_cmds(i_ctx);
+}
+
+/**
+ * @see at.h
+ */
+static int get_pending(crm_at_ctx_t *ctx)
+{
+    crm_at_ctx_internal_t *i_ctx = (crm_at_ctx_internal_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
 
-    int ret = 1;
-    while (ret > 0) {
+    return i_ctx->nb_cmds;
+}
+
+/**
+ * @see at.h
+ */
+static int wait_cmds(crm_at_ctx_t *ctx, int timeout, int fd_abort)
+{
+    crm_at_ctx_internal_t *i_ctx = (crm_at_ctx_internal_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+
+    struct pollfd pfd[] = {
+        { .fd = i_ctx->fd, .events = POLLIN },
+        { .fd = fd_abort, .events = POLLIN }
+    };
+
+    int ret = 0;
+    while (i_ctx->nb_cmds > 0) {
+        /* A stalled engine only waits for the timeout */
+        pfd[0].fd = i_ctx->stalled ? -1 : i_ctx->fd;
         int err = poll(pfd, ARRAY_SIZE(pfd), timeout);
 
         if ((err == 0) || (pfd[0].revents & (POLLERR | POLLHUP | POLLNVAL))) {
-            LOGE("[AT-%s] no answer from modem. timeout: %dms", tag, timeout);
+            LOGE("[AT-%s] no answer from modem. timeout: %dms", i_ctx->tag, timeout);
             ret = -1;
             break;
         } else if (pfd[1].revents) {
-            LOGD("[AT-%s] aborted", tag);
+            LOGD("[AT-%s] aborted", i_ctx->tag);
             ret = -2;
             break;
         }
 
-        if (pfd[0].revents & POLLIN) {
-            int len = read(fd, &buffer[idx], sizeof(buffer) - idx);
-            if (len <= 0) {
-                LOGE("failed to read answer. errno: %d/%s", errno, strerror(errno));
-                ret = -1;
-                break;
-            }
-
-            idx += len;
-            DASSERT(idx < sizeof(buffer), "internal buffer too small. idx:%zd", idx);
-            buffer[idx] = '\0';
-
-            char *cr;
-            while ((cr = strstr(buffer, "\r\n")) != NULL) {
-                *cr = '\0';
-                if (buffer[0] != '\0')
-                    LOGD("[AT-%s] received: %s", tag, buffer);
-
-                if (strcmp(buffer, "OK") == 0) {
-                    ret = 0;
-                    break;
-                } else if (strcmp(buffer, "ERROR") == 0) {
-                    ret = -1;
-                    break;
-                }
-
-                cr += 2; // skipping \r\n
-                idx = &buffer[idx] - cr;
-                memmove(buffer, cr, idx);
-            }
+        if ((pfd[0].revents & POLLIN) && process(ctx)) {
+            ret = -1;
+            break;
         }
     }
 
+    if (ret)
+        discard_all(i_ctx, true);
+    else if (i_ctx->failure)
+        ret = -1;
+    i_ctx->failure = false;
+
+    return ret;
+}
+
+/**
+ * @see at.h
+ */
+static void dispose(crm_at_ctx_t *ctx)
+{
+    crm_at_ctx_internal_t *i_ctx = (crm_at_ctx_internal_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+
+    discard_all(i_ctx, false);
+    free(i_ctx);
+}
+
+/**
+ * @see at.h
+ */
+crm_at_ctx_t *crm_at_init(int fd, const char *tag, int depth,
+                          void (*urc)(const char *line, void *urc_data), void *urc_data,
+                          const char *const *urc_prefixes)
+{
+    ASSERT(fd >= 0);
+    ASSERT(tag != NULL);
+    ASSERT(depth > 0);
+
+    crm_at_ctx_internal_t *i_ctx = calloc(1, sizeof(*i_ctx));
+    ASSERT(i_ctx != NULL);
+
+    i_ctx->fd = fd;
+    i_ctx->tag = tag;
+    i_ctx->depth = depth;
+    i_ctx->urc = urc;
+    i_ctx->urc_data = urc_data;
+    i_ctx->urc_prefixes = urc_prefixes;
+
+    i_ctx->ctx.dispose = dispose;
+    i_ctx->ctx.send = send_cmd;
+    i_ctx->ctx.process = process;
+    i_ctx->ctx.get_pending = get_pending;
+    i_ctx->ctx.wait = wait_cmds;
+
+    return &i_ctx->ctx;
+}
+
+/**
+ * @see at.h
+ */
+int crm_send_at(int fd, const char *tag, const char *at_cmd, int timeout, int fd_abort)
+{
+    ASSERT(at_cmd != NULL);
+    ASSERT(fd >= 0);
+
+    crm_at_ctx_t *at = crm_at_init(fd, tag, 1, NULL, NULL, NULL);
+    int ret = at->send(at, at_cmd, NULL, NULL);
+    if (!ret)
+        ret = at->wait(at, timeout, fd_abort);
+    at->dispose(at);
+
     return ret;
 }
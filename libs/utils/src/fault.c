@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#define CRM_MODULE_TAG "UTILS"
+#include "utils/common.h"
+#include "utils/logs.h"
+#include "utils/keys.h"
+#include "utils/property.h"
+#include "utils/time.h"
+#include "utils/fault.h"
+
+typedef struct crm_fault_cfg {
+    bool enabled;
+    int skip;
+    int count;
+    int param;
+    int hits;
+} crm_fault_cfg_t;
+
+static bool g_fault_enabled = false;
+static crm_fault_cfg_t g_faults[CRM_FAULT_NUM];
+
+static const char *get_fault_txt(int point)
+{
+    switch (point) {
+    case CRM_FAULT_IPC_DROP:     return "ipc_drop";
+    case CRM_FAULT_IPC_DELAY:    return "ipc_delay";
+    case CRM_FAULT_FILE_READ:    return "file_read";
+    case CRM_FAULT_FILE_WRITE:   return "file_write";
+    case CRM_FAULT_SOCKET_STALL: return "socket_stall";
+    case CRM_FAULT_AT_TIMEOUT:   return "at_timeout";
+    case CRM_FAULT_DLOPEN:       return "dlopen";
+    default: ASSERT(0);
+    }
+}
+
+static void parse_entry(const char *entry)
+{
+    char name[CRM_PROPERTY_VALUE_MAX];
+    crm_fault_cfg_t cfg = { .enabled = true, .skip = 0, .count = -1, .param = 0, .hits = 0 };
+
+    int nb = sscanf(entry, "%[^:]:%d:%d:%d", name, &cfg.skip, &cfg.count, &cfg.param);
+    if (nb < 1 || cfg.skip < 0 || cfg.count < -1 || cfg.param < 0) {
+        LOGE("malformed fault entry (%s)", entry);
+        return;
+    }
+
+    for (int i = 0; i < CRM_FAULT_NUM; i++) {
+        if (!strcmp(name, get_fault_txt(i))) {
+            g_faults[i] = cfg;
+            g_fault_enabled = true;
+            LOGV("fault %-12s armed. skip: %d count: %d param: %d", name, cfg.skip, cfg.count,
+                 cfg.param);
+            return;
+        }
+    }
+
+    LOGE("unknown fault (%s)", name);
+}
+
+/**
+ * @see fault.h
+ */
+void crm_fault_init(void)
+{
+    char value[CRM_PROPERTY_VALUE_MAX];
+
+    g_fault_enabled = false;
+    memset(g_faults, 0, sizeof(g_faults));
+
+    crm_property_get(CRM_KEY_BUILD_TYPE, value, "");
+    if (!strcmp(value, "user"))
+        return;
+
+    crm_property_get(CRM_KEY_DBG_FAULT_INJECTION, value, "");
+
+    char *save_ptr = NULL;
+    for (char *entry = strtok_r(value, ",", &save_ptr); entry != NULL;
+         entry = strtok_r(NULL, ",", &save_ptr))
+        parse_entry(entry);
+}
+
+/**
+ * @see fault.h
+ */
+bool crm_fault_inject(crm_fault_point_t point, int *param)
+{
+    ASSERT(point >= 0 && point < CRM_FAULT_NUM);
+
+    if (likely(!g_fault_enabled))
+        return false;
+
+    crm_fault_cfg_t *cfg = &g_faults[point];
+    if (!cfg->enabled)
+        return false;
+
+    /* hit counter is shared by all threads of the process */
+    int hit = __sync_fetch_and_add(&cfg->hits, 1);
+    if ((hit < cfg->skip) || ((cfg->count != -1) && (hit >= cfg->skip + cfg->count)))
+        return false;
+
+    /* Timestamp is provided to compute recovery latencies from the logs */
+    struct timespec now;
+    ASSERT(clock_gettime(CLOCK_BOOTTIME, &now) == 0);
+    LOGD("fault %s injected (hit: %d) at %ld.%03ld", get_fault_txt(point), hit,
+         (long)now.tv_sec, now.tv_nsec / 1000000);
+
+    if (param)
+        *param = cfg->param;
+
+    return true;
+}
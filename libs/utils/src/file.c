@@ -24,19 +24,27 @@
  * limitations under the License.
  */
 
+#define _GNU_SOURCE // splice
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <poll.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/sendfile.h>
+#include <sys/syscall.h>
 
 #define CRM_MODULE_TAG "UTILS"
 #include "utils/common.h"
+#include "utils/fault.h"
 #include "utils/file.h"
 #include "utils/logs.h"
+#include "utils/time.h"
+
+#define STREAM_POLL_PERIOD 100 // in ms. Abort is checked at this period while out_fd is full
 
 /**
  * @see file.h
@@ -48,6 +56,11 @@ int crm_file_write(const char *path, const char *value)
     ASSERT(path != NULL);
     ASSERT(value != NULL);
 
+    if (crm_fault_inject(CRM_FAULT_FILE_WRITE, NULL)) {
+        LOGE("Failed to write (%s) file. (fault injection)", path);
+        return -1;
+    }
+
     errno = 0;
     int fd = open(path, O_WRONLY);
     if (fd < 0) {
@@ -76,6 +89,11 @@ int crm_file_read(const char *path, char *value, size_t size)
     ASSERT(path != NULL);
     ASSERT(value != NULL);
 
+    if (crm_fault_inject(CRM_FAULT_FILE_READ, NULL)) {
+        LOGE("Failed to read (%s) file. (fault injection)", path);
+        return -1;
+    }
+
     errno = 0;
     int fd = open(path, O_RDONLY);
     if (fd < 0) {
@@ -162,12 +180,9 @@ int crm_file_copy(const char *src, const char *dst, bool in_raw, bool out_raw, m
             LOGE("Failed to write the size, errno = %d [%s]", errno, strerror(errno));
             goto out;
         }
-        ssize_t w_size;
-        if ((w_size = sendfile(out_fd, in_fd, NULL, size)) == -1) {
-            LOGE("Copying file failed, errno = %d [%s]", errno, strerror(errno));
-            goto out;
-        } else if ((size_t)w_size != size) {
-            LOGE("Did not copy the whole data (sent %zd bytes of %u)", w_size, size);
+        crm_file_stream_t stream = { .method = CRM_FILE_STREAM_AUTO };
+        if (crm_file_stream(in_fd, out_fd, size, &stream)) {
+            LOGE("Did not copy the whole data (sent %zu bytes of %u)", stream.offset, size);
             goto out;
         }
     }
@@ -187,3 +202,294 @@ out:
 
     return ret;
 }
+
+/* Errors returned when the kernel does not support a method for the given files */
+static inline bool is_unsupported(int err)
+{
+    return err == EINVAL || err == ENOSYS || err == EXDEV || err == EOPNOTSUPP;
+}
+
+static crm_file_stream_method_t select_method(int in_fd, int out_fd)
+{
+    struct stat in_st, out_st;
+
+    if (fstat(in_fd, &in_st) || fstat(out_fd, &out_st))
+        return CRM_FILE_STREAM_READ_WRITE;
+
+    if (S_ISFIFO(in_st.st_mode) || S_ISFIFO(out_st.st_mode))
+        return CRM_FILE_STREAM_SPLICE;
+    else if (S_ISREG(in_st.st_mode) && S_ISREG(out_st.st_mode))
+        return CRM_FILE_STREAM_COPY_RANGE;
+    else
+        return CRM_FILE_STREAM_SENDFILE;
+}
+
+static inline crm_file_stream_method_t get_fallback(crm_file_stream_method_t method)
+{
+    /* sendfile relies on the same file operations than splice. No need to try both */
+    return method == CRM_FILE_STREAM_COPY_RANGE ? CRM_FILE_STREAM_SENDFILE :
+           CRM_FILE_STREAM_READ_WRITE;
+}
+
+typedef struct stream_io {
+    int in_fd;
+    int out_fd;
+    loff_t *in_pos; // NULL if in_fd is not seekable
+    int pipe_fds[2]; // intermediate pipe used by splice if none of the files is a pipe
+    bool direct_splice;
+    char *buffer;    // used by read/write method
+    const bool *abort;
+} stream_io_t;
+
+/* Waits until out_fd can be written. Returns false with errno set to EINTR if the stream is
+ * aborted meanwhile */
+static bool wait_writable(stream_io_t *io)
+{
+    struct pollfd pfd = { .fd = io->out_fd, .events = POLLOUT };
+
+    while (poll(&pfd, 1, STREAM_POLL_PERIOD) == 0) {
+        if (__atomic_load_n(io->abort, __ATOMIC_RELAXED)) {
+            errno = EINTR;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static ssize_t copy_range(stream_io_t *io, size_t len)
+{
+#ifdef __NR_copy_file_range
+    return syscall(__NR_copy_file_range, io->in_fd, io->in_pos, io->out_fd, NULL, len, 0);
+#else
+    (void)io;  // UNUSED
+    (void)len; // UNUSED
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static ssize_t splice_through_pipe(stream_io_t *io, size_t len)
+{
+    const unsigned int flags = SPLICE_F_MOVE | SPLICE_F_MORE;
+
+    if (io->direct_splice)
+        return splice(io->in_fd, io->in_pos, io->out_fd, NULL, len, flags);
+
+    ssize_t in = splice(io->in_fd, io->in_pos, io->pipe_fds[1], NULL, len, flags);
+    if (in <= 0)
+        return in;
+
+    ssize_t out = 0;
+    while (out < in) {
+        ssize_t ret = splice(io->pipe_fds[0], NULL, io->out_fd, NULL, in - out, flags);
+        if (ret > 0) {
+            out += ret;
+        } else if (ret < 0 && errno == EINTR) {
+            continue;
+        } else if (ret < 0 && errno == EAGAIN && wait_writable(io)) {
+            continue;
+        } else {
+            /* Pages left in the pipe are dropped: the input is rewound to read them again */
+            int err = ret == 0 ? EIO : errno;
+            close(io->pipe_fds[0]);
+            close(io->pipe_fds[1]);
+            ASSERT(pipe(io->pipe_fds) == 0);
+            if (io->in_pos == NULL) {
+                LOGE("data spliced from an unseekable file is lost");
+                errno = EIO;
+                return -1;
+            }
+            *io->in_pos -= in - out;
+            if (out > 0)
+                return out;
+            errno = err;
+            return -1;
+        }
+    }
+
+    return out;
+}
+
+static ssize_t send_file(stream_io_t *io, size_t len)
+{
+    off_t pos = *io->in_pos;
+    ssize_t ret = sendfile(io->out_fd, io->in_fd, &pos, len);
+
+    *io->in_pos = pos;
+    return ret;
+}
+
+static ssize_t read_write(stream_io_t *io, size_t len)
+{
+    ssize_t in;
+
+    if (io->in_pos)
+        in = pread(io->in_fd, io->buffer, len, *io->in_pos);
+    else
+        in = read(io->in_fd, io->buffer, len);
+    if (in <= 0)
+        return in;
+
+    ssize_t out = 0;
+    while (out < in) {
+        ssize_t ret = write(io->out_fd, io->buffer + out, in - out);
+        if (ret > 0) {
+            out += ret;
+        } else if (ret < 0 && errno == EINTR) {
+            continue;
+        } else if (ret < 0 && errno == EAGAIN && wait_writable(io)) {
+            continue;
+        } else {
+            if (io->in_pos == NULL) {
+                LOGE("data read from an unseekable file is lost");
+                errno = EIO;
+                return -1;
+            }
+            if (out > 0)
+                break;
+            if (ret == 0)
+                errno = EIO;
+            return -1;
+        }
+    }
+
+    if (io->in_pos)
+        *io->in_pos += out;
+    return out;
+}
+
+static int prepare_method(stream_io_t *io, crm_file_stream_method_t method, size_t chunk_size)
+{
+    if (method == CRM_FILE_STREAM_SPLICE && !io->direct_splice && io->pipe_fds[0] < 0) {
+        if (pipe(io->pipe_fds)) {
+            LOGE("failed to create pipe (%s)", strerror(errno));
+            return -1;
+        }
+        /* A pipe holds 64 KB by default: make it as large as a chunk if allowed */
+        fcntl(io->pipe_fds[1], F_SETPIPE_SZ, chunk_size);
+    } else if (method == CRM_FILE_STREAM_READ_WRITE && io->buffer == NULL) {
+        io->buffer = malloc(chunk_size);
+        ASSERT(io->buffer != NULL);
+    }
+
+    return 0;
+}
+
+static inline const char *get_method_txt(crm_file_stream_method_t method)
+{
+    switch (method) {
+    case CRM_FILE_STREAM_COPY_RANGE: return "copy_file_range";
+    case CRM_FILE_STREAM_SPLICE:     return "splice";
+    case CRM_FILE_STREAM_SENDFILE:   return "sendfile";
+    case CRM_FILE_STREAM_READ_WRITE: return "read/write";
+    default: ASSERT(0);
+    }
+}
+
+static void notify_progress(crm_file_stream_t *stream, size_t size, size_t start,
+                            const struct timespec *begin)
+{
+    if (stream->progress == NULL)
+        return;
+
+    int elapsed = crm_time_get_elapsed_ms(begin);
+    unsigned int rate = (stream->offset - start) / 1024 * 1000 / (elapsed > 0 ? elapsed : 1);
+    stream->progress(stream->progress_param, stream->offset, size, rate);
+}
+
+/**
+ * @see file.h
+ */
+int crm_file_stream(int in_fd, int out_fd, size_t size, crm_file_stream_t *stream)
+{
+    ASSERT(in_fd >= 0);
+    ASSERT(out_fd >= 0);
+    ASSERT(stream != NULL);
+    ASSERT(stream->offset <= size);
+
+    size_t chunk_size = stream->chunk_size ? stream->chunk_size : CRM_FILE_STREAM_CHUNK_SIZE;
+    size_t progress_step = stream->progress_step ? stream->progress_step :
+                           CRM_FILE_STREAM_PROGRESS_STEP;
+
+    crm_file_stream_method_t method = stream->method;
+    if (method == CRM_FILE_STREAM_AUTO)
+        method = select_method(in_fd, out_fd);
+
+    stream_io_t io = { .in_fd = in_fd, .out_fd = out_fd, .pipe_fds = { -1, -1 },
+                       .abort = &stream->abort };
+    loff_t in_pos = lseek(in_fd, 0, SEEK_CUR);
+    if (in_pos >= 0) {
+        in_pos += stream->offset;
+        io.in_pos = &in_pos;
+    } else if (stream->offset > 0) {
+        LOGD("resuming a stream from an unseekable file at %zu", stream->offset);
+    }
+
+    struct stat st;
+    io.direct_splice = (!fstat(in_fd, &st) && S_ISFIFO(st.st_mode)) ||
+                       (!fstat(out_fd, &st) && S_ISFIFO(st.st_mode));
+
+    /* copy_file_range and sendfile require a seekable source */
+    if (io.in_pos == NULL && method != CRM_FILE_STREAM_SPLICE)
+        method = CRM_FILE_STREAM_READ_WRITE;
+
+    struct timespec begin;
+    crm_time_add_ms(&begin, 0);
+    size_t start = stream->offset;
+    size_t notified = stream->offset;
+
+    int ret = prepare_method(&io, method, chunk_size);
+    while (!ret && stream->offset < size) {
+        if (__atomic_load_n(&stream->abort, __ATOMIC_RELAXED)) {
+            LOGD("stream aborted at %zu/%zu", stream->offset, size);
+            ret = 1;
+            break;
+        }
+
+        size_t len = MIN(chunk_size, size - stream->offset);
+        ssize_t done;
+        switch (method) {
+        case CRM_FILE_STREAM_COPY_RANGE: done = copy_range(&io, len); break;
+        case CRM_FILE_STREAM_SPLICE:     done = splice_through_pipe(&io, len); break;
+        case CRM_FILE_STREAM_SENDFILE:   done = send_file(&io, len); break;
+        case CRM_FILE_STREAM_READ_WRITE: done = read_write(&io, len); break;
+        default: ASSERT(0);
+        }
+
+        if (done > 0) {
+            stream->offset += done;
+            if (stream->offset - notified >= progress_step) {
+                notified = stream->offset;
+                notify_progress(stream, size, start, &begin);
+            }
+        } else if (done == 0) {
+            LOGE("end of file reached at %zu/%zu", stream->offset, size);
+            ret = -1;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN) {
+            wait_writable(&io); // abort is checked by the loop
+        } else if (is_unsupported(errno) && method != CRM_FILE_STREAM_READ_WRITE) {
+            LOGD("%s not supported (%s). falling back", get_method_txt(method), strerror(errno));
+            method = get_fallback(method);
+            ret = prepare_method(&io, method, chunk_size);
+        } else {
+            LOGE("%s failed at %zu/%zu (%s)", get_method_txt(method), stream->offset, size,
+                 strerror(errno));
+            ret = -1;
+        }
+    }
+
+    stream->used = method;
+    if (!ret && notified != stream->offset)
+        notify_progress(stream, size, start, &begin);
+
+    if (io.pipe_fds[0] >= 0) {
+        close(io.pipe_fds[0]);
+        close(io.pipe_fds[1]);
+    }
+    free(io.buffer);
+
+    return ret;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define CRM_MODULE_TAG "UTILS"
+#include "utils/common.h"
+#include "utils/instance.h"
+
+static int g_inst_id = 0;
+static __thread int g_thread_inst_id = -1;
+
+/**
+ * @see instance.h
+ */
+void crm_instance_init(int inst_id)
+{
+    ASSERT(inst_id >= 0 && inst_id <= 9);
+    g_inst_id = inst_id;
+}
+
+/**
+ * @see instance.h
+ */
+void crm_instance_set(int inst_id)
+{
+    ASSERT(inst_id >= 0 && inst_id <= 9);
+    g_thread_inst_id = inst_id;
+}
+
+/**
+ * @see instance.h
+ */
+int crm_instance_get(void)
+{
+    return (g_thread_inst_id >= 0) ? g_thread_inst_id : g_inst_id;
+}
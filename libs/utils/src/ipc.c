@@ -32,6 +32,7 @@
 
 #define CRM_MODULE_TAG "IPC"
 #include "utils/common.h"
+#include "utils/fault.h"
 #include "utils/ipc.h"
 
 #define MSG_QUEUE_SIZE 8
@@ -173,6 +174,14 @@ static bool send_msg_thread(crm_ipc_ctx_t *ctx, const crm_ipc_msg_t *msg)
 
     bool ret = false;
 
+    int delay;
+    if (crm_fault_inject(CRM_FAULT_IPC_DELAY, &delay))
+        usleep(delay * 1000);
+
+    /* Only scalar messages are dropped: the ownership of data is given to the receiver */
+    if ((msg->data_size == 0) && crm_fault_inject(CRM_FAULT_IPC_DROP, NULL))
+        return true;
+
     ASSERT(pthread_mutex_lock(&i_ctx->lock) == 0);
     if ((i_ctx->num_msgs_in_queue < MSG_QUEUE_SIZE) && (i_ctx->w_fd != -1)) {
         ret = true;
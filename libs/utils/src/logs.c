@@ -30,12 +30,11 @@
 
 #include "utils/logs.h"
 #include "utils/common.h"
+#include "utils/instance.h"
 
 #define TAG_LEN 10
 #define LOG_LEN 1024
 
-static int g_inst_id = 0;
-
 /* OS specific macros: */
 
 #ifndef HOST_BUILD
@@ -91,7 +90,8 @@ static void crm_log(int level, const char *tag, const char *format, va_list args
 
     // Spaces at the end of the format string is to add padding at the end of log tag to force
     // a size of TAG_LEN bytes
-    snprintf(plugin_tag, sizeof(plugin_tag), "%s%s%d     ", CRM_MODULE_TAG, tag, g_inst_id);
+    snprintf(plugin_tag, sizeof(plugin_tag), "%s%s%d     ", CRM_MODULE_TAG, tag,
+             crm_instance_get());
 
     vsnprintf(log, sizeof(log), format, args);
 
@@ -145,5 +145,5 @@ void crm_logs_error(const char *tag, const char *format, ...)
 
 void crm_logs_init(int id)
 {
-    g_inst_id = id;
+    crm_instance_init(id);
 }
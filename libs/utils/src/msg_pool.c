@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define CRM_MODULE_TAG "POOL"
+#include "utils/common.h"
+#include "utils/logs.h"
+#include "utils/msg_pool.h"
+
+/* Blocks are aligned so that any structure can be stored in them */
+#define BLOCK_ALIGNMENT 16
+
+typedef struct free_block {
+    struct free_block *next;
+} free_block_t;
+
+/* Blocks allocated from the heap are linked through a header, so that dispose can release them */
+typedef struct heap_block {
+    struct heap_block *prev;
+    struct heap_block *next;
+} heap_block_t;
+
+#define HEAP_HEADER_SIZE BLOCK_ALIGNMENT
+
+typedef struct crm_msg_pool_internal {
+    crm_msg_pool_t ctx; // Needs to be first
+
+    pthread_mutex_t lock;
+    size_t block_size;
+    unsigned char *storage;
+    unsigned char *storage_end;
+    free_block_t *free_list;
+    heap_block_t heap_list; // circular list of blocks allocated from the heap
+    crm_msg_pool_stats_t stats;
+} crm_msg_pool_internal_t;
+
+/**
+ * @see msg_pool.h
+ */
+static void dispose(crm_msg_pool_t *ctx)
+{
+    crm_msg_pool_internal_t *i_ctx = (crm_msg_pool_internal_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+
+    LOGD("blocks: %d, max in use: %d, allocations: %d, failures: %d", i_ctx->stats.nb_blocks,
+         i_ctx->stats.max_in_use, i_ctx->stats.nb_allocs, i_ctx->stats.nb_failures);
+
+    while (i_ctx->heap_list.next != &i_ctx->heap_list) {
+        heap_block_t *header = i_ctx->heap_list.next;
+        i_ctx->heap_list.next = header->next;
+        free(header);
+    }
+
+    pthread_mutex_destroy(&i_ctx->lock);
+    free(i_ctx->storage);
+    free(i_ctx);
+}
+
+/**
+ * @see msg_pool.h
+ */
+static void *pool_alloc(crm_msg_pool_t *ctx)
+{
+    crm_msg_pool_internal_t *i_ctx = (crm_msg_pool_internal_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+
+    heap_block_t *header = NULL;
+    free_block_t *block = NULL;
+
+    ASSERT(pthread_mutex_lock(&i_ctx->lock) == 0);
+    if (i_ctx->free_list) {
+        block = i_ctx->free_list;
+        i_ctx->free_list = block->next;
+    } else {
+        i_ctx->stats.nb_failures += 1;
+    }
+    i_ctx->stats.nb_allocs += 1;
+    i_ctx->stats.in_use += 1;
+    if (i_ctx->stats.in_use > i_ctx->stats.max_in_use)
+        i_ctx->stats.max_in_use = i_ctx->stats.in_use;
+    int nb_failures = i_ctx->stats.nb_failures;
+    ASSERT(pthread_mutex_unlock(&i_ctx->lock) == 0);
+
+    if (!block) {
+        /* Only the first failure is logged: the statistics give the full picture */
+        if (nb_failures == 1)
+            LOGE("pool of %d blocks exhausted, falling back to heap", i_ctx->stats.nb_blocks);
+        ASSERT(posix_memalign((void **)&header, BLOCK_ALIGNMENT,
+                              HEAP_HEADER_SIZE + i_ctx->block_size) == 0);
+
+        ASSERT(pthread_mutex_lock(&i_ctx->lock) == 0);
+        header->prev = &i_ctx->heap_list;
+        header->next = i_ctx->heap_list.next;
+        header->next->prev = header;
+        i_ctx->heap_list.next = header;
+        ASSERT(pthread_mutex_unlock(&i_ctx->lock) == 0);
+
+        block = (free_block_t *)((unsigned char *)header + HEAP_HEADER_SIZE);
+    }
+
+    return block;
+}
+
+/**
+ * @see msg_pool.h
+ */
+static void pool_free(crm_msg_pool_t *ctx, void *block)
+{
+    crm_msg_pool_internal_t *i_ctx = (crm_msg_pool_internal_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+
+    if (!block)
+        return;
+
+    unsigned char *ptr = block;
+    bool in_pool = (ptr >= i_ctx->storage) && (ptr < i_ctx->storage_end);
+    DASSERT(!in_pool || ((size_t)(ptr - i_ctx->storage) & (i_ctx->block_size - 1)) == 0,
+            "%p is not a block of the pool", block);
+
+    heap_block_t *header = NULL;
+
+    ASSERT(pthread_mutex_lock(&i_ctx->lock) == 0);
+    if (in_pool) {
+        free_block_t *free_block = block;
+        free_block->next = i_ctx->free_list;
+        i_ctx->free_list = free_block;
+    } else {
+        header = (heap_block_t *)(ptr - HEAP_HEADER_SIZE);
+        header->prev->next = header->next;
+        header->next->prev = header->prev;
+    }
+    DASSERT(i_ctx->stats.in_use > 0, "pool underflow");
+    i_ctx->stats.in_use -= 1;
+    ASSERT(pthread_mutex_unlock(&i_ctx->lock) == 0);
+
+    free(header);
+}
+
+/**
+ * @see msg_pool.h
+ */
+static void get_stats(crm_msg_pool_t *ctx, crm_msg_pool_stats_t *stats)
+{
+    crm_msg_pool_internal_t *i_ctx = (crm_msg_pool_internal_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+    ASSERT(stats != NULL);
+
+    ASSERT(pthread_mutex_lock(&i_ctx->lock) == 0);
+    *stats = i_ctx->stats;
+    ASSERT(pthread_mutex_unlock(&i_ctx->lock) == 0);
+}
+
+/**
+ * @see msg_pool.h
+ */
+crm_msg_pool_t *crm_msg_pool_init(size_t block_size, int nb_blocks)
+{
+    crm_msg_pool_internal_t *i_ctx = calloc(1, sizeof(*i_ctx));
+
+    ASSERT(i_ctx != NULL);
+    ASSERT(block_size > 0);
+    ASSERT(nb_blocks >= 0);
+
+    if (block_size < sizeof(free_block_t))
+        block_size = sizeof(free_block_t);
+    /* Rounding to a power of two keeps blocks aligned and makes the ownership check cheap */
+    i_ctx->block_size = BLOCK_ALIGNMENT;
+    while (i_ctx->block_size < block_size)
+        i_ctx->block_size <<= 1;
+
+    ASSERT(pthread_mutex_init(&i_ctx->lock, NULL) == 0);
+    i_ctx->heap_list.prev = &i_ctx->heap_list;
+    i_ctx->heap_list.next = &i_ctx->heap_list;
+    if (nb_blocks > 0) {
+        ASSERT(posix_memalign((void **)&i_ctx->storage, BLOCK_ALIGNMENT,
+                              i_ctx->block_size * nb_blocks) == 0);
+        i_ctx->storage_end = i_ctx->storage + i_ctx->block_size * nb_blocks;
+
+        /* Free list is built backward so that blocks are handed out in address order */
+        for (int i = nb_blocks - 1; i >= 0; i--) {
+            free_block_t *block = (free_block_t *)(i_ctx->storage + i_ctx->block_size * i);
+            block->next = i_ctx->free_list;
+            i_ctx->free_list = block;
+        }
+    }
+    i_ctx->stats.nb_blocks = nb_blocks;
+
+    i_ctx->ctx.dispose = dispose;
+    i_ctx->ctx.alloc = pool_alloc;
+    i_ctx->ctx.free = pool_free;
+    i_ctx->ctx.get_stats = get_stats;
+
+    return &i_ctx->ctx;
+}
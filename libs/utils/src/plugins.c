@@ -26,11 +26,13 @@
 
 #include <dlfcn.h>
 #include <string.h>
+#include <time.h>
 
 #define CRM_MODULE_TAG "UTILS"
 #include "utils/common.h"
 #include "utils/logs.h"
 #include "utils/plugins.h"
+#include "utils/time.h"
 
 int crm_plugin_load(tcs_ctx_t *tcs, const char *plugin_name, const char *init_name,
                     crm_plugin_t *plugin)
@@ -45,6 +47,9 @@ int crm_plugin_load(tcs_ctx_t *tcs, const char *plugin_name, const char *init_na
 
     filename = tcs->get_string(tcs, plugin_name);
     if (filename) {
+        struct timespec start;
+        clock_gettime(CLOCK_BOOTTIME, &start);
+
         dlerror(); // clear previous errors
         plugin->handle = dlopen(filename, RTLD_LAZY);
         DASSERT(plugin->handle != NULL, "Failed to load %s: %s", plugin_name, dlerror());
@@ -52,7 +57,8 @@ int crm_plugin_load(tcs_ctx_t *tcs, const char *plugin_name, const char *init_na
         plugin->init = dlsym(plugin->handle, init_name);
         DASSERT(dlerror() == NULL && plugin->init != NULL, "Symbol (%s) not found in library (%s)",
                 init_name, filename);
-        LOGV("<Plugin: %-15s> - <Implementation: %-30s>", plugin_name, filename);
+        LOGV("<Plugin: %-15s> - <Implementation: %-30s> - loaded in %dms", plugin_name, filename,
+             crm_time_get_elapsed_ms(&start));
         free(filename);
     } else {
         LOGD("no library for plugin (%s)", plugin_name);
@@ -40,6 +40,8 @@
 
 #define CRM_MODULE_TAG "FACT"
 #include "utils/common.h"
+#include "utils/fault.h"
+#include "utils/instance.h"
 #include "utils/process_factory.h"
 
 typedef enum factory_events {
@@ -183,6 +185,9 @@ static int forked_create_process(crm_process_factory_ctx_internal_t *factory, cr
     crm_process_t *process = &factory->processes[idx];
     ASSERT(process);
 
+    /* Checked before forking to keep the hit counter in the factory process */
+    bool load_failure = crm_fault_inject(CRM_FAULT_DLOPEN, NULL);
+
     process->pid = fork();
     process->events = 0;
     ASSERT(process->pid >= 0);
@@ -193,6 +198,11 @@ static int forked_create_process(crm_process_factory_ctx_internal_t *factory, cr
         ASSERT(find);
         *find = '\0';
 
+        DASSERT(!load_failure, "Failed to load %s: fault injection", lib_name);
+
+        /* The factory is shared by all instances: use the one of the requester */
+        crm_instance_set(get_id(msg->scalar));
+
         dlerror(); // clear previous errors
         void *handle = dlopen(lib_name, RTLD_LAZY);
         DASSERT(handle != NULL, "Failed to load %s: %s", lib_name, dlerror());
@@ -374,7 +384,7 @@ static int create(crm_process_factory_ctx_t *ctx, const char *plugin_name, void
     memcpy(buffer + len + 1, data, data_len);
     buffer[len] = ';';
 
-    crm_ipc_msg_t msg = { gen_scalar(CREATE, 0), buffer_size, buffer };
+    crm_ipc_msg_t msg = { gen_scalar(CREATE, crm_instance_get()), buffer_size, buffer };
     ASSERT(factory->ipc_ctrl->send_msg(factory->ipc_ctrl, &msg));
     free(buffer);
 
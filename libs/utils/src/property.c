@@ -27,13 +27,44 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <stdbool.h>
+#include <pthread.h>
 
 #define CRM_MODULE_TAG "UTILS"
 #include "utils/common.h"
+#include "utils/instance.h"
 #include "utils/logs.h"
 #include "utils/property.h"
 
-static int g_inst_id = 0;
+#ifndef HOST_BUILD
+#define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
+#include <sys/_system_properties.h>
+#endif
+
+/* Properties read by CRM are cached. An entry is checked against the serial of the property area,
+ * updated by the property service on each property change: reading an unchanged property costs a
+ * lookup in the cache instead of an access to the property service. Keys not fitting in the cache
+ * are read directly.
+ */
+#define CACHE_SIZE 32
+
+typedef struct prop_entry {
+    char key[CRM_PROPERTY_KEY_MAX];
+    char value[CRM_PROPERTY_VALUE_MAX];
+    bool found;
+    bool valid;
+    unsigned int area_serial;
+#ifndef HOST_BUILD
+    const prop_info *pi;
+    unsigned int serial;
+#endif
+} prop_entry_t;
+
+static struct {
+    pthread_mutex_t lock;
+    prop_entry_t entries[CACHE_SIZE];
+    int nb;
+} g_cache = { .lock = PTHREAD_MUTEX_INITIALIZER };
 
 #ifdef HOST_BUILD
 
@@ -45,6 +76,22 @@ static int g_inst_id = 0;
 
 static int prop_pipe = -1;
 
+/* On host, properties are environment variables of the process: they only change through 'set' */
+static unsigned int g_host_serial = 1;
+
+static inline unsigned int get_area_serial(void)
+{
+    return g_host_serial;
+}
+
+static inline void read_entry(prop_entry_t *entry)
+{
+    char *tmp = getenv(entry->key);
+
+    entry->found = tmp != NULL;
+    snprintf(entry->value, sizeof(entry->value), "%s", tmp ? tmp : "");
+}
+
 /**
  * @see proprety.h
  */
@@ -67,6 +114,7 @@ static inline void set(const char *key, const char *value)
 {
     errno = 0;
     DASSERT(setenv(key, value, 1) == 0, "Failed to set environment variable (%s)", strerror(errno));
+    __sync_add_and_fetch(&g_host_serial, 1);
     if (prop_pipe != -1) {
         char buf[CRM_PROPERTY_VALUE_MAX + CRM_PROPERTY_KEY_MAX + 2];
         ASSERT((strlen(key) + strlen(value) + 2) < sizeof(buf));
@@ -78,6 +126,30 @@ static inline void set(const char *key, const char *value)
 
 #else /* HOST_BUILD */
 
+static inline unsigned int get_area_serial(void)
+{
+    return __system_property_area_serial();
+}
+
+static inline void read_entry(prop_entry_t *entry)
+{
+    /* The property may be created after the first read */
+    if (!entry->pi)
+        entry->pi = __system_property_find(entry->key);
+
+    if (!entry->pi) {
+        entry->found = false;
+        entry->value[0] = '\0';
+    } else {
+        /* serial read first: a change during the read is seen at the next check */
+        unsigned int serial = __system_property_serial(entry->pi);
+        if (!entry->valid || serial != entry->serial) {
+            entry->serial = serial;
+            entry->found = __system_property_read(entry->pi, NULL, entry->value) > 0;
+        }
+    }
+}
+
 /**
  * @see proprety.h
  */
@@ -105,11 +177,40 @@ static inline const char *compute_key(const char *key, char *ikey)
         return key;
     } else {
         snprintf(ikey, CRM_PROPERTY_VALUE_MAX, "%s", key);
-        ikey[find - key] = '0' + g_inst_id;
+        ikey[find - key] = '0' + crm_instance_get();
         return ikey;
     }
 }
 
+/* Must be called with the cache locked. Returns NULL if the cache is full */
+static prop_entry_t *get_entry(const char *key)
+{
+    for (int i = 0; i < g_cache.nb; i++)
+        if (!strcmp(g_cache.entries[i].key, key))
+            return &g_cache.entries[i];
+
+    if (g_cache.nb == CACHE_SIZE || strlen(key) >= CRM_PROPERTY_KEY_MAX)
+        return NULL;
+
+    prop_entry_t *entry = &g_cache.entries[g_cache.nb++];
+    memset(entry, 0, sizeof(*entry));
+    snprintf(entry->key, sizeof(entry->key), "%s", key);
+    return entry;
+}
+
+/* Must be called with the cache locked */
+static void refresh_entry(prop_entry_t *entry)
+{
+    unsigned int area_serial = get_area_serial();
+
+    if (entry->valid && entry->area_serial == area_serial)
+        return;
+
+    read_entry(entry);
+    entry->area_serial = area_serial;
+    entry->valid = true;
+}
+
 void crm_property_get(const char *key, char *value, const char *default_value)
 {
     char ikey[CRM_PROPERTY_VALUE_MAX];
@@ -117,7 +218,21 @@ void crm_property_get(const char *key, char *value, const char *default_value)
     ASSERT(key != NULL);
     ASSERT(value != NULL);
 
-    get(compute_key(key, ikey), value, default_value);
+    key = compute_key(key, ikey);
+
+    ASSERT(pthread_mutex_lock(&g_cache.lock) == 0);
+    prop_entry_t *entry = get_entry(key);
+    if (entry) {
+        refresh_entry(entry);
+        if (entry->found)
+            snprintf(value, CRM_PROPERTY_VALUE_MAX, "%s", entry->value);
+        else
+            snprintf(value, CRM_PROPERTY_VALUE_MAX, "%s", default_value ? default_value : "");
+    }
+    ASSERT(pthread_mutex_unlock(&g_cache.lock) == 0);
+
+    if (!entry)
+        get(key, value, default_value);
 }
 
 void crm_property_set(const char *key, const char *value)
@@ -127,13 +242,19 @@ void crm_property_set(const char *key, const char *value)
     ASSERT(key != NULL);
     ASSERT(value != NULL);
 
-    set(compute_key(key, ikey), value);
+    key = compute_key(key, ikey);
+
+    ASSERT(pthread_mutex_lock(&g_cache.lock) == 0);
+    prop_entry_t *entry = get_entry(key);
+    set(key, value);
+    if (entry)
+        entry->valid = false;
+    ASSERT(pthread_mutex_unlock(&g_cache.lock) == 0);
 }
 
 void crm_property_init(int id)
 {
-    g_inst_id = id;
-    ASSERT(id >= 0 && id <= 9);
+    crm_instance_init(id);
 
 #ifdef HOST_BUILD
     /* Note: no assert here to be able to use 'crm_property_init' in the test itself.
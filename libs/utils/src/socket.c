@@ -25,17 +25,26 @@
  */
 
 #include <poll.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/inotify.h>
 
 #include <cutils/sockets.h>
 
 #define CRM_MODULE_TAG "UTILS"
 #include "utils/debug.h"
 #include "utils/common.h"
+#include "utils/fault.h"
 #include "utils/logs.h"
 #include "utils/time.h"
 #include "utils/socket.h"
 
+#ifdef HOST_BUILD
+#define SOCKET_DIR "/tmp"
+#else
+#define SOCKET_DIR ANDROID_SOCKET_DIR
+#endif
+
 /**
  * @see socket.h
  */
@@ -65,6 +74,51 @@ int crm_socket_create(const char *socket_name, int max_conn)
     return fd;
 }
 
+/**
+ * @see socket.h
+ */
+int crm_socket_watch_init(const char *socket_name)
+{
+    ASSERT(socket_name != NULL);
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    /* Sockets are created by init in the sockets folder. The folder is watched because socket is
+     * deleted and created again when the server restarts */
+    if (inotify_add_watch(fd, SOCKET_DIR, IN_CREATE | IN_ATTRIB | IN_MOVED_TO) < 0) {
+        close(fd);
+        fd = -1;
+    }
+
+    return fd;
+}
+
+/**
+ * @see socket.h
+ */
+bool crm_socket_watch_check(int fd, const char *socket_name)
+{
+    ASSERT(fd >= 0);
+    ASSERT(socket_name != NULL);
+
+    char buffer[1024] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    bool created = false;
+    ssize_t len;
+
+    while ((len = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (char *ptr = buffer; ptr < buffer + len; ) {
+            const struct inotify_event *evt = (const struct inotify_event *)ptr;
+            if (evt->len && !strcmp(evt->name, socket_name))
+                created = true;
+            ptr += sizeof(struct inotify_event) + evt->len;
+        }
+    }
+
+    return created;
+}
+
 /**
  * @see socket.h
  */
@@ -92,6 +146,11 @@ int crm_socket_write(int fd, int timeout, const void *data, size_t data_size)
     int time_remaining;
 
     crm_time_add_ms(&timer_end, timeout);
+
+    int stall;
+    if (crm_fault_inject(CRM_FAULT_SOCKET_STALL, &stall))
+        usleep((stall > 0 ? stall : timeout) * 1000);
+
     while ((data_sent < data_size) &&
            ((time_remaining = crm_time_get_remain_ms(&timer_end)) > 0)) {
         errno = 0;
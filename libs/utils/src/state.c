@@ -0,0 +1,497 @@
+/*
+ * Copyright (C) Intel 2016
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define CRM_MODULE_TAG "STATE"
+#include "utils/common.h"
+#include "utils/instance.h"
+#include "utils/logs.h"
+#include "utils/property.h"
+#include "utils/state.h"
+
+/* Values are kept in an open addressing hash table: reads cost a hash and a few comparisons */
+#define TABLE_SIZE 64
+#define MAX_KEYS (TABLE_SIZE * 3 / 4)
+
+/* File format: a sequence of records, one per update. A record is a header followed by a
+ * payload made of (key size, value size, key, value) tuples. A record whose checksum doesn't
+ * match was being written when the process or the platform went down: it is discarded with the
+ * end of the file.
+ */
+#define RECORD_MAGIC 0x4352534c // "CRSL"
+#define TUPLE_SIZE(key, value) (2 + strlen(key) + strlen(value))
+
+/* The log is rewritten as a single record once it is at least COMPACT_RATIO times bigger than
+ * the values it holds */
+#define COMPACT_MIN_SIZE 4096
+#define COMPACT_RATIO 4
+
+typedef struct record_hdr {
+    uint32_t magic;
+    uint32_t size;
+    uint32_t crc;
+} record_hdr_t;
+
+typedef struct state_entry {
+    char key[CRM_STATE_KEY_MAX];
+    char value[CRM_STATE_VALUE_MAX];
+} state_entry_t;
+
+/* Instance IDs are single digits (see compute_key) */
+#define MAX_STORES 10
+
+typedef struct state_store {
+    bool initialized;
+    state_entry_t entries[TABLE_SIZE];
+    int nb;
+    int data_size; // size of the values, as serialized in a record
+    crm_state_mode_t mode;
+    int fd;
+    char path[256];
+    off_t log_size;
+} state_store_t;
+
+/* Each instance has its own store: its file can follow the instance from a process to another */
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static state_store_t g_stores[MAX_STORES];
+
+static uint32_t compute_crc(const char *data, size_t size)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (size_t i = 0; i < size; i++) {
+        crc ^= (uint8_t)data[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+
+    return ~crc;
+}
+
+static uint32_t compute_hash(const char *key)
+{
+    uint32_t hash = 2166136261u;
+
+    for (; *key != '\0'; key++)
+        hash = (hash ^ (uint8_t)*key) * 16777619u;
+
+    return hash;
+}
+
+static const char *compute_key(const char *key, char *ikey)
+{
+    ASSERT(key != NULL);
+    DASSERT(strlen(key) < CRM_STATE_KEY_MAX, "key too long (%s)", key);
+
+    char *find = strstr(key, "@");
+    if (!find)
+        return key;
+
+    snprintf(ikey, CRM_STATE_KEY_MAX, "%s", key);
+    ikey[find - key] = '0' + crm_instance_get();
+    return ikey;
+}
+
+/* Returns the store of the calling thread instance. Must be called with the lock held */
+static state_store_t *get_store(void)
+{
+    int inst_id = crm_instance_get();
+
+    ASSERT(inst_id >= 0 && inst_id < MAX_STORES);
+    state_store_t *store = &g_stores[inst_id];
+    if (!store->initialized) {
+        store->initialized = true;
+        store->mode = CRM_STATE_NO_SYNC;
+        store->fd = -1;
+    }
+
+    return store;
+}
+
+/* Returns the entry of the key, or the free entry where it must be inserted. Must be called
+ * with the lock held */
+static state_entry_t *find_entry(state_store_t *store, const char *key)
+{
+    uint32_t idx = compute_hash(key) % TABLE_SIZE;
+
+    while (store->entries[idx].key[0] != '\0' && strcmp(store->entries[idx].key, key))
+        idx = (idx + 1) % TABLE_SIZE;
+
+    return &store->entries[idx];
+}
+
+static void apply_value(state_store_t *store, const char *key, const char *value)
+{
+    state_entry_t *entry = find_entry(store, key);
+
+    if (entry->key[0] == '\0') {
+        ASSERT(store->nb < MAX_KEYS);
+        snprintf(entry->key, sizeof(entry->key), "%s", key);
+        store->nb++;
+    } else {
+        store->data_size -= TUPLE_SIZE(entry->key, entry->value);
+    }
+    snprintf(entry->value, sizeof(entry->value), "%s", value);
+    store->data_size += TUPLE_SIZE(entry->key, entry->value);
+}
+
+static void serialize_tuple(char **data, const char *key, const char *value)
+{
+    size_t key_size = strlen(key);
+    size_t value_size = strlen(value);
+
+    *(*data)++ = key_size;
+    *(*data)++ = value_size;
+    memcpy(*data, key, key_size);
+    *data += key_size;
+    memcpy(*data, value, value_size);
+    *data += value_size;
+}
+
+/* Parses a payload. If apply is false, the payload is only checked */
+static bool parse_payload(state_store_t *store, const char *data, size_t size, bool apply)
+{
+    size_t pos = 0;
+
+    while (pos + 2 <= size) {
+        size_t key_size = (uint8_t)data[pos];
+        size_t value_size = (uint8_t)data[pos + 1];
+        if (key_size == 0 || key_size >= CRM_STATE_KEY_MAX || value_size >= CRM_STATE_VALUE_MAX ||
+            pos + 2 + key_size + value_size > size)
+            return false;
+
+        if (apply) {
+            char key[CRM_STATE_KEY_MAX];
+            char value[CRM_STATE_VALUE_MAX];
+            memcpy(key, data + pos + 2, key_size);
+            key[key_size] = '\0';
+            memcpy(value, data + pos + 2 + key_size, value_size);
+            value[value_size] = '\0';
+            apply_value(store, key, value);
+        }
+        pos += 2 + key_size + value_size;
+    }
+
+    return pos == size;
+}
+
+static int write_all(int fd, const char *data, size_t size)
+{
+    while (size > 0) {
+        ssize_t len = write(fd, data, size);
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len <= 0)
+            return -1;
+        data += len;
+        size -= len;
+    }
+
+    return 0;
+}
+
+/* Writes a record made of a header and a payload. The payload must be preceded by room for the
+ * header */
+static int write_record(int fd, char *record, size_t payload_size, bool sync)
+{
+    record_hdr_t hdr = {
+        .magic = RECORD_MAGIC,
+        .size = payload_size,
+        .crc = compute_crc(record + sizeof(hdr), payload_size)
+    };
+
+    memcpy(record, &hdr, sizeof(hdr));
+    if (write_all(fd, record, sizeof(hdr) + payload_size))
+        return -1;
+
+    return sync ? fsync(fd) : 0;
+}
+
+/* Must be called with the lock held */
+static void load(state_store_t *store)
+{
+    int fd = open(store->path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        if (errno != ENOENT)
+            LOGE("failed to open (%s): %s", store->path, strerror(errno));
+        return;
+    }
+
+    struct stat st;
+    char *data = NULL;
+    ssize_t size = 0;
+    if (!fstat(fd, &st) && st.st_size > 0) {
+        data = malloc(st.st_size);
+        ASSERT(data);
+        size = read(fd, data, st.st_size);
+    }
+    close(fd);
+
+    ssize_t pos = 0;
+    int nb_records = 0;
+    while (pos + (ssize_t)sizeof(record_hdr_t) <= size) {
+        record_hdr_t hdr;
+        memcpy(&hdr, data + pos, sizeof(hdr));
+        const char *payload = data + pos + sizeof(hdr);
+        if (hdr.magic != RECORD_MAGIC || hdr.size > (uint32_t)(size - pos - sizeof(hdr)) ||
+            hdr.crc != compute_crc(payload, hdr.size) ||
+            !parse_payload(store, payload, hdr.size, false))
+            break;
+
+        parse_payload(store, payload, hdr.size, true);
+        pos += sizeof(hdr) + hdr.size;
+        nb_records++;
+    }
+    free(data);
+
+    if (pos < size) {
+        LOGE("(%s): %zd bytes of incomplete update discarded", store->path, size - pos);
+        if (store->mode != CRM_STATE_READ_ONLY && truncate(store->path, pos))
+            LOGE("failed to truncate (%s): %s", store->path, strerror(errno));
+    }
+    store->log_size = pos;
+    LOGD("(%s) loaded: %d values, %d updates", store->path, store->nb, nb_records);
+}
+
+/* Must be called with the lock held */
+static void compact(state_store_t *store)
+{
+    char tmp_path[sizeof(store->path) + 4];
+    char *record = malloc(sizeof(record_hdr_t) + store->data_size);
+    char *data = record + sizeof(record_hdr_t);
+
+    ASSERT(record);
+    for (int i = 0; i < TABLE_SIZE; i++)
+        if (store->entries[i].key[0] != '\0')
+            serialize_tuple(&data, store->entries[i].key, store->entries[i].value);
+    ASSERT(data - record == (ssize_t)(sizeof(record_hdr_t) + store->data_size));
+
+    /* The new log replaces the old one once it is on storage */
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", store->path);
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0660);
+    if (fd < 0 || write_record(fd, record, store->data_size, true) ||
+        rename(tmp_path, store->path)) {
+        LOGE("failed to compact (%s): %s", store->path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        unlink(tmp_path);
+    } else {
+        char dir_path[sizeof(store->path)];
+        snprintf(dir_path, sizeof(dir_path), "%s", store->path);
+        int dir_fd = open(dirname(dir_path), O_RDONLY | O_CLOEXEC);
+        if (dir_fd >= 0) {
+            fsync(dir_fd);
+            close(dir_fd);
+        }
+
+        LOGD("(%s) compacted: %lld -> %zu bytes", store->path, (long long)store->log_size,
+             sizeof(record_hdr_t) + store->data_size);
+        close(store->fd);
+        store->fd = fd;
+        store->log_size = sizeof(record_hdr_t) + store->data_size;
+    }
+    free(record);
+}
+
+/**
+ * @see state.h
+ */
+void crm_state_init(const char *path, crm_state_mode_t mode)
+{
+    ASSERT(path != NULL);
+    ASSERT(strlen(path) < sizeof(g_stores[0].path));
+
+    crm_state_dispose();
+
+    ASSERT(pthread_mutex_lock(&g_lock) == 0);
+    state_store_t *store = get_store();
+    memset(store->entries, 0, sizeof(store->entries));
+    store->nb = 0;
+    store->data_size = 0;
+    store->mode = mode;
+    snprintf(store->path, sizeof(store->path), "%s", path);
+
+    load(store);
+
+    if (mode != CRM_STATE_READ_ONLY) {
+        store->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0660);
+        if (store->fd < 0)
+            LOGE("failed to open (%s): %s. State not persistent", path, strerror(errno));
+        else if (store->log_size > COMPACT_MIN_SIZE &&
+                 store->log_size > COMPACT_RATIO * (off_t)(sizeof(record_hdr_t) +
+                                                            store->data_size))
+            compact(store);
+    }
+    ASSERT(pthread_mutex_unlock(&g_lock) == 0);
+}
+
+/**
+ * @see state.h
+ */
+void crm_state_dispose(void)
+{
+    ASSERT(pthread_mutex_lock(&g_lock) == 0);
+    state_store_t *store = get_store();
+    if (store->fd >= 0) {
+        close(store->fd);
+        store->fd = -1;
+    }
+    store->mode = CRM_STATE_NO_SYNC;
+    ASSERT(pthread_mutex_unlock(&g_lock) == 0);
+}
+
+/**
+ * @see state.h
+ */
+bool crm_state_get(const char *key, char *value, const char *default_value)
+{
+    char ikey[CRM_STATE_KEY_MAX];
+
+    ASSERT(value != NULL);
+
+    key = compute_key(key, ikey);
+
+    ASSERT(pthread_mutex_lock(&g_lock) == 0);
+    state_store_t *store = get_store();
+    state_entry_t *entry = find_entry(store, key);
+    bool found = entry->key[0] != '\0';
+    if (found)
+        snprintf(value, CRM_STATE_VALUE_MAX, "%s", entry->value);
+    else
+        snprintf(value, CRM_STATE_VALUE_MAX, "%s", default_value ? default_value : "");
+    ASSERT(pthread_mutex_unlock(&g_lock) == 0);
+
+    return found;
+}
+
+/**
+ * @see state.h
+ */
+int crm_state_set_multi(int nb, const char *const *keys, const char *const *values)
+{
+    char ikeys[CRM_STATE_UPDATE_MAX][CRM_STATE_KEY_MAX];
+    const char *r_keys[CRM_STATE_UPDATE_MAX];
+    size_t payload_size = 0;
+    int ret = 0;
+
+    ASSERT(nb > 0 && nb <= CRM_STATE_UPDATE_MAX);
+    ASSERT(keys != NULL);
+    ASSERT(values != NULL);
+
+    for (int i = 0; i < nb; i++) {
+        ASSERT(values[i] != NULL);
+        DASSERT(strlen(values[i]) < CRM_STATE_VALUE_MAX, "value too long (%s)", values[i]);
+        r_keys[i] = compute_key(keys[i], ikeys[i]);
+        payload_size += TUPLE_SIZE(r_keys[i], values[i]);
+    }
+
+    ASSERT(pthread_mutex_lock(&g_lock) == 0);
+    state_store_t *store = get_store();
+    DASSERT(store->mode != CRM_STATE_READ_ONLY, "state store opened in read-only mode");
+
+    /* A key updated several times in the same batch is counted once */
+    int nb_new = 0;
+    for (int i = 0; i < nb; i++) {
+        bool duplicate = false;
+        for (int j = 0; j < i && !duplicate; j++)
+            duplicate = !strcmp(r_keys[i], r_keys[j]);
+        if (!duplicate)
+            nb_new += find_entry(store, r_keys[i])->key[0] == '\0';
+    }
+    if (store->nb + nb_new > MAX_KEYS) {
+        LOGE("state store full, update rejected");
+        ret = -1;
+    } else if (store->fd >= 0) {
+        char *record = malloc(sizeof(record_hdr_t) + payload_size);
+        char *data = record + sizeof(record_hdr_t);
+        ASSERT(record);
+        for (int i = 0; i < nb; i++)
+            serialize_tuple(&data, r_keys[i], values[i]);
+
+        ret = write_record(store->fd, record, payload_size, store->mode == CRM_STATE_SYNC);
+        if (ret) {
+            /* the partial record would hide the next updates: remove it */
+            LOGE("failed to write (%s): %s", store->path, strerror(errno));
+            if (ftruncate(store->fd, store->log_size))
+                LOGE("failed to truncate (%s): %s", store->path, strerror(errno));
+        } else {
+            store->log_size += sizeof(record_hdr_t) + payload_size;
+        }
+        free(record);
+    }
+
+    if (!ret) {
+        for (int i = 0; i < nb; i++)
+            apply_value(store, r_keys[i], values[i]);
+
+        if (store->fd >= 0 && store->log_size > COMPACT_MIN_SIZE &&
+            store->log_size > COMPACT_RATIO * (off_t)(sizeof(record_hdr_t) + store->data_size))
+            compact(store);
+    }
+    ASSERT(pthread_mutex_unlock(&g_lock) == 0);
+
+    return ret;
+}
+
+/**
+ * @see state.h
+ */
+int crm_state_set(const char *key, const char *value)
+{
+    return crm_state_set_multi(1, &key, &value);
+}
+
+/**
+ * @see state.h
+ */
+void crm_state_import_property(const char *key, const char *property_key)
+{
+    char value[CRM_PROPERTY_VALUE_MAX];
+
+    ASSERT(property_key != NULL);
+
+    if (crm_state_get(key, value, NULL))
+        return;
+
+    crm_property_get(property_key, value, "");
+    if (value[0] != '\0') {
+        LOGD("importing %s from property %s: %s", key, property_key, value);
+        crm_state_set(key, value);
+    }
+}
@@ -58,6 +58,8 @@ const char *crm_mdmcli_wire_req_to_string(int req_id)
     case CRM_REQ_ACK_COLD_RESET: return "ACK_COLD_RESET";
     case CRM_REQ_ACK_SHUTDOWN: return "ACK_SHUTDOWN";
     case CRM_REQ_NOTIFY_DBG: return "NOTIFY_DBG";
+    case CRM_RSP_DONE: return "DONE";
+    case CRM_REQ_CANCEL: return "CANCEL";
     default: ASSERT(0);
     }
 }
@@ -0,0 +1,687 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CRM_MODULE_TAG "UTILS"
+#include "utils/common.h"
+#include "utils/logs.h"
+#include "utils/property.h"
+#include "utils/tcs_snapshot.h"
+
+#define SNAPSHOT_MAGIC 0x534D5243 // CRMS
+#define SNAPSHOT_VERSION 2
+#define NO_STRING 0xFFFFFFFF
+#define MAX_ADDED_GROUPS 16
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+typedef enum entry_type {
+    SELECT_GROUP,
+    ADD_GROUP,
+    GET_STRING,
+    GET_INT,
+    GET_BOOL,
+    GET_STRING_ARRAY,
+} entry_type_t;
+
+/* Snapshot file: header, entries table, then strings pool. Strings are stored as offsets in the
+ * pool. Entries are sorted by type, group and key */
+typedef struct snapshot_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t hash;
+    uint32_t nb_entries;
+    uint32_t pool_size;
+} snapshot_header_t;
+
+typedef struct snapshot_entry {
+    uint32_t type;
+    uint32_t group;
+    uint32_t key;   // NO_STRING for group operations
+    int32_t ret;    // returned value
+    int32_t value;  // int/bool value or number of strings
+    uint32_t str;   // first string. Arrays are stored as consecutive strings
+} snapshot_entry_t;
+
+typedef struct crm_tcs_snapshot_ctx_internal {
+    tcs_ctx_t ctx; // Needs to be first
+
+    char *name;
+    char *path;
+    uint64_t hash;
+
+    tcs_ctx_t *tcs; // NULL until XML files are parsed
+
+    /* mapped snapshot */
+    void *map;
+    size_t map_size;
+
+    /* entries and pool point to the mapped snapshot until a new value is recorded */
+    snapshot_entry_t *entries;
+    size_t nb_entries;
+    size_t entries_max; // 0 if entries are not allocated
+    char *pool;
+    size_t pool_size;
+    size_t pool_max;    // 0 if pool is not allocated
+    bool dirty;
+
+    char *group;
+    char *added[MAX_ADDED_GROUPS];
+    int nb_added;
+} crm_tcs_snapshot_ctx_internal_t;
+
+static uint64_t hash_data(uint64_t hash, const void *data, size_t len)
+{
+    const unsigned char *ptr = data;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= ptr[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t hash_file(const char *path)
+{
+    uint64_t hash = hash_data(FNV_OFFSET, path, strlen(path));
+    char buffer[4096];
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return hash;
+
+    ssize_t len;
+    while ((len = read(fd, buffer, sizeof(buffer))) > 0)
+        hash = hash_data(hash, buffer, len);
+    close(fd);
+
+    return hash;
+}
+
+/* files are combined with a XOR: result does not depend on the directory order */
+static uint64_t hash_folder(const char *folder)
+{
+    uint64_t hash = 0;
+
+    DIR *dir = opendir(folder);
+    if (!dir)
+        return hash;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", folder, entry->d_name);
+
+        struct stat st;
+        if (stat(path, &st))
+            continue;
+
+        size_t len = strlen(entry->d_name);
+        if (S_ISDIR(st.st_mode))
+            hash ^= hash_folder(path);
+        else if (len > 4 && !strcmp(&entry->d_name[len - 4], ".xml"))
+            hash ^= hash_file(path);
+    }
+    closedir(dir);
+
+    return hash;
+}
+
+static uint64_t compute_hash(const char *name, const char *xml_folder)
+{
+    static const char *const props[] = { "ro.telephony.tcs.hw_name",
+                                         "ro.telephony.tcs.sw_folder",
+                                         "tcs.dbg.host.hw_folder" };
+    uint64_t hash = hash_data(FNV_OFFSET, name, strlen(name));
+
+#ifdef GIT_COMMIT_ID
+    hash = hash_data(hash, GIT_COMMIT_ID, strlen(GIT_COMMIT_ID));
+#endif
+
+    for (size_t i = 0; i < ARRAY_SIZE(props); i++) {
+        char value[CRM_PROPERTY_VALUE_MAX];
+        crm_property_get(props[i], value, "");
+        hash = hash_data(hash, value, strlen(value) + 1);
+    }
+
+    uint64_t files = hash_folder(xml_folder);
+    hash = hash_data(hash, &files, sizeof(files));
+
+    /* the software folder can be changed at boot (see persist.config.specific): its files are
+     * hashed on their own, even if it is a sub-folder of xml_folder */
+    char sw_folder[CRM_PROPERTY_VALUE_MAX];
+    crm_property_get("ro.telephony.tcs.sw_folder", sw_folder, "");
+    if (sw_folder[0] != '\0') {
+        char path[512];
+        if (sw_folder[0] == '/')
+            snprintf(path, sizeof(path), "%s", sw_folder);
+        else
+            snprintf(path, sizeof(path), "%s/%s", xml_folder, sw_folder);
+        files = hash_folder(path);
+        hash = hash_data(hash, &files, sizeof(files));
+    }
+
+    return hash;
+}
+
+static bool load_snapshot(crm_tcs_snapshot_ctx_internal_t *i_ctx)
+{
+    int fd = open(i_ctx->path, O_RDONLY);
+
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) || (st.st_size < (off_t)sizeof(snapshot_header_t))) {
+        close(fd);
+        return false;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    const snapshot_header_t *hdr = map;
+    size_t entries_size = (size_t)hdr->nb_entries * sizeof(snapshot_entry_t);
+    bool valid = (hdr->magic == SNAPSHOT_MAGIC) && (hdr->version == SNAPSHOT_VERSION) &&
+                 (hdr->hash == i_ctx->hash) && (hdr->pool_size > 0) &&
+                 ((size_t)st.st_size == sizeof(*hdr) + entries_size + hdr->pool_size);
+
+    snapshot_entry_t *entries = (snapshot_entry_t *)(hdr + 1);
+    char *pool = (char *)(entries + hdr->nb_entries);
+    if (valid)
+        valid = (pool[hdr->pool_size - 1] == '\0');
+    for (size_t i = 0; valid && (i < hdr->nb_entries); i++) {
+        valid = (entries[i].group < hdr->pool_size) &&
+                ((entries[i].key == NO_STRING) || (entries[i].key < hdr->pool_size)) &&
+                ((entries[i].str == NO_STRING) || (entries[i].str < hdr->pool_size));
+    }
+
+    if (!valid) {
+        LOGD("snapshot (%s) outdated", i_ctx->path);
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    i_ctx->map = map;
+    i_ctx->map_size = st.st_size;
+    i_ctx->entries = entries;
+    i_ctx->nb_entries = hdr->nb_entries;
+    i_ctx->pool = pool;
+    i_ctx->pool_size = hdr->pool_size;
+
+    return true;
+}
+
+static int write_snapshot(crm_tcs_snapshot_ctx_internal_t *i_ctx)
+{
+    char tmp[512];
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", i_ctx->path);
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        LOGE("failed to create snapshot (%s). errno: %d/%s", tmp, errno, strerror(errno));
+        return -1;
+    }
+
+    snapshot_header_t hdr = { SNAPSHOT_MAGIC, SNAPSHOT_VERSION, i_ctx->hash, i_ctx->nb_entries,
+                              i_ctx->pool_size };
+    size_t entries_size = i_ctx->nb_entries * sizeof(snapshot_entry_t);
+    bool ok = (write(fd, &hdr, sizeof(hdr)) == sizeof(hdr)) &&
+              (write(fd, i_ctx->entries, entries_size) == (ssize_t)entries_size) &&
+              (write(fd, i_ctx->pool, i_ctx->pool_size) == (ssize_t)i_ctx->pool_size);
+
+    if ((close(fd) != 0) || !ok || rename(tmp, i_ctx->path)) {
+        LOGE("failed to write snapshot (%s). errno: %d/%s", i_ctx->path, errno, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+
+    LOGD("snapshot (%s) written. %zu entries", i_ctx->path, i_ctx->nb_entries);
+    return 0;
+}
+
+static uint32_t add_string(crm_tcs_snapshot_ctx_internal_t *i_ctx, const char *str)
+{
+    if (!str)
+        return NO_STRING;
+
+    size_t len = strlen(str) + 1;
+    if (i_ctx->pool_size + len > i_ctx->pool_max) {
+        size_t max = 2 * i_ctx->pool_max + len + 1024;
+        char *pool = malloc(max);
+        ASSERT(pool != NULL);
+        if (i_ctx->pool_size > 0)
+            memcpy(pool, i_ctx->pool, i_ctx->pool_size);
+        if (i_ctx->pool_max)
+            free(i_ctx->pool);
+        i_ctx->pool = pool;
+        i_ctx->pool_max = max;
+    }
+
+    uint32_t offset = i_ctx->pool_size;
+    memcpy(&i_ctx->pool[offset], str, len);
+    i_ctx->pool_size += len;
+
+    return offset;
+}
+
+/* Entries are ordered by type, group and key. Group operations (no key) come first */
+static int compare_entry(crm_tcs_snapshot_ctx_internal_t *i_ctx, const snapshot_entry_t *entry,
+                         entry_type_t type, const char *group, const char *key)
+{
+    if (entry->type != type)
+        return entry->type < type ? -1 : 1;
+
+    int ret = strcmp(&i_ctx->pool[entry->group], group);
+    if (ret)
+        return ret;
+
+    if (entry->key == NO_STRING || !key)
+        return (entry->key != NO_STRING) - (key != NULL);
+
+    return strcmp(&i_ctx->pool[entry->key], key);
+}
+
+/* Returns the index of the first entry not lower than (type, group, key) */
+static size_t lower_bound(crm_tcs_snapshot_ctx_internal_t *i_ctx, entry_type_t type,
+                          const char *group, const char *key)
+{
+    size_t low = 0;
+    size_t high = i_ctx->nb_entries;
+
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (compare_entry(i_ctx, &i_ctx->entries[mid], type, group, key) < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+static snapshot_entry_t *add_entry(crm_tcs_snapshot_ctx_internal_t *i_ctx, entry_type_t type,
+                                   const char *group, const char *key)
+{
+    if (i_ctx->nb_entries >= i_ctx->entries_max) {
+        size_t max = 2 * i_ctx->entries_max + 64;
+        snapshot_entry_t *entries = malloc(max * sizeof(snapshot_entry_t));
+        ASSERT(entries != NULL);
+        if (i_ctx->nb_entries > 0)
+            memcpy(entries, i_ctx->entries, i_ctx->nb_entries * sizeof(snapshot_entry_t));
+        if (i_ctx->entries_max)
+            free(i_ctx->entries);
+        i_ctx->entries = entries;
+        i_ctx->entries_max = max;
+    }
+
+    /* strings are added before the search: the pool can be reallocated */
+    uint32_t group_str = add_string(i_ctx, group);
+    uint32_t key_str = add_string(i_ctx, key);
+
+    size_t idx = lower_bound(i_ctx, type, group, key);
+    memmove(&i_ctx->entries[idx + 1], &i_ctx->entries[idx],
+            (i_ctx->nb_entries - idx) * sizeof(snapshot_entry_t));
+    i_ctx->nb_entries++;
+
+    snapshot_entry_t *entry = &i_ctx->entries[idx];
+    entry->type = type;
+    entry->group = group_str;
+    entry->key = key_str;
+    entry->ret = -1;
+    entry->value = 0;
+    entry->str = NO_STRING;
+    i_ctx->dirty = true;
+
+    return entry;
+}
+
+static const snapshot_entry_t *find_entry(crm_tcs_snapshot_ctx_internal_t *i_ctx,
+                                          entry_type_t type, const char *group, const char *key)
+{
+    size_t idx = lower_bound(i_ctx, type, group, key);
+
+    if (idx < i_ctx->nb_entries &&
+        !compare_entry(i_ctx, &i_ctx->entries[idx], type, group, key))
+        return &i_ctx->entries[idx];
+
+    return NULL;
+}
+
+/* Parses the XML files if not done yet. TCS is put in the same state as this context */
+static tcs_ctx_t *get_tcs(crm_tcs_snapshot_ctx_internal_t *i_ctx)
+{
+    if (!i_ctx->tcs) {
+        LOGD("parsing TCS configuration");
+        i_ctx->tcs = tcs2_init(i_ctx->name);
+        ASSERT(i_ctx->tcs);
+        for (int i = 0; i < i_ctx->nb_added; i++)
+            i_ctx->tcs->add_group(i_ctx->tcs, i_ctx->added[i], false);
+        if (i_ctx->group)
+            i_ctx->tcs->select_group(i_ctx->tcs, i_ctx->group);
+    }
+
+    return i_ctx->tcs;
+}
+
+static const char *get_group(crm_tcs_snapshot_ctx_internal_t *i_ctx)
+{
+    return i_ctx->group ? i_ctx->group : "";
+}
+
+/**
+ * @see tcs.h
+ */
+static int select_group(tcs_ctx_t *ctx, const char *group)
+{
+    crm_tcs_snapshot_ctx_internal_t *i_ctx = (crm_tcs_snapshot_ctx_internal_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+    ASSERT(group != NULL);
+
+    free(i_ctx->group);
+    i_ctx->group = strdup(group);
+    ASSERT(i_ctx->group);
+
+    const snapshot_entry_t *entry = find_entry(i_ctx, SELECT_GROUP, group, NULL);
+    if (entry) {
+        if (i_ctx->tcs)
+            i_ctx->tcs->select_group(i_ctx->tcs, group);
+        return entry->ret;
+    }
+
+    tcs_ctx_t *tcs = get_tcs(i_ctx);
+    int ret = tcs->select_group(tcs, group);
+    add_entry(i_ctx, SELECT_GROUP, group, NULL)->ret = ret;
+
+    return ret;
+}
+
+/**
+ * @see tcs.h
+ */
+static int add_group(tcs_ctx_t *ctx, const char *group, bool print)
+{
+    crm_tcs_snapshot_ctx_internal_t *i_ctx = (crm_tcs_snapshot_ctx_internal_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+    ASSERT(group != NULL);
+    ASSERT(i_ctx->nb_added < MAX_ADDED_GROUPS);
+
+    i_ctx->added[i_ctx->nb_added] = strdup(group);
+    ASSERT(i_ctx->added[i_ctx->nb_added]);
+    i_ctx->nb_added++;
+
+    const snapshot_entry_t *entry = find_entry(i_ctx, ADD_GROUP, group, NULL);
+    if (entry) {
+        if (i_ctx->tcs)
+            i_ctx->tcs->add_group(i_ctx->tcs, group, print);
+        return entry->ret;
+    }
+
+    /* get_tcs adds the group if TCS is not initialized yet */
+    bool initialized = i_ctx->tcs != NULL;
+    tcs_ctx_t *tcs = get_tcs(i_ctx);
+    int ret = initialized ? tcs->add_group(tcs, group, print) : 0;
+    add_entry(i_ctx, ADD_GROUP, group, NULL)->ret = ret;
+
+    return ret;
+}
+
+/**
+ * @see tcs.h
+ */
+static char *get_string(tcs_ctx_t *ctx, const char *key)
+{
+    crm_tcs_snapshot_ctx_internal_t *i_ctx = (crm_tcs_snapshot_ctx_internal_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+    ASSERT(key != NULL);
+
+    const snapshot_entry_t *entry = find_entry(i_ctx, GET_STRING, get_group(i_ctx), key);
+    if (!entry) {
+        tcs_ctx_t *tcs = get_tcs(i_ctx);
+        char *value = tcs->get_string(tcs, key);
+        uint32_t str = add_string(i_ctx, value);
+        add_entry(i_ctx, GET_STRING, get_group(i_ctx), key)->str = str;
+        return value;
+    }
+
+    char *value = NULL;
+    if (entry->str != NO_STRING) {
+        value = strdup(&i_ctx->pool[entry->str]);
+        ASSERT(value);
+    }
+
+    return value;
+}
+
+static int get_value(crm_tcs_snapshot_ctx_internal_t *i_ctx, entry_type_t type, const char *key,
+                     int *value)
+{
+    const snapshot_entry_t *entry = find_entry(i_ctx, type, get_group(i_ctx), key);
+
+    if (!entry) {
+        tcs_ctx_t *tcs = get_tcs(i_ctx);
+        int ret;
+        if (type == GET_INT) {
+            ret = tcs->get_int(tcs, key, value);
+        } else {
+            bool tmp = false;
+            ret = tcs->get_bool(tcs, key, &tmp);
+            if (!ret)
+                *value = tmp;
+        }
+
+        snapshot_entry_t *new_entry = add_entry(i_ctx, type, get_group(i_ctx), key);
+        new_entry->ret = ret;
+        new_entry->value = ret ? 0 : *value;
+        return ret;
+    }
+
+    if (!entry->ret)
+        *value = entry->value;
+
+    return entry->ret;
+}
+
+/**
+ * @see tcs.h
+ */
+static int get_int(tcs_ctx_t *ctx, const char *key, int *value)
+{
+    crm_tcs_snapshot_ctx_internal_t *i_ctx = (crm_tcs_snapshot_ctx_internal_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+    ASSERT(key != NULL);
+    ASSERT(value != NULL);
+
+    return get_value(i_ctx, GET_INT, key, value);
+}
+
+/**
+ * @see tcs.h
+ */
+static int get_bool(tcs_ctx_t *ctx, const char *key, bool *value)
+{
+    crm_tcs_snapshot_ctx_internal_t *i_ctx = (crm_tcs_snapshot_ctx_internal_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+    ASSERT(key != NULL);
+    ASSERT(value != NULL);
+
+    int tmp = 0;
+    int ret = get_value(i_ctx, GET_BOOL, key, &tmp);
+    if (!ret)
+        *value = tmp;
+
+    return ret;
+}
+
+/**
+ * @see tcs.h
+ */
+static char **get_string_array(tcs_ctx_t *ctx, const char *key, int *nb)
+{
+    crm_tcs_snapshot_ctx_internal_t *i_ctx = (crm_tcs_snapshot_ctx_internal_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+    ASSERT(key != NULL);
+    ASSERT(nb != NULL);
+
+    const snapshot_entry_t *entry = find_entry(i_ctx, GET_STRING_ARRAY, get_group(i_ctx), key);
+    if (!entry) {
+        tcs_ctx_t *tcs = get_tcs(i_ctx);
+        char **array = tcs->get_string_array(tcs, key, nb);
+
+        /* strings are added first: they must be consecutive in the pool */
+        uint32_t str = NO_STRING;
+        for (int i = 0; array && (i < *nb); i++) {
+            uint32_t offset = add_string(i_ctx, array[i]);
+            if (i == 0)
+                str = offset;
+        }
+
+        snapshot_entry_t *new_entry = add_entry(i_ctx, GET_STRING_ARRAY, get_group(i_ctx), key);
+        new_entry->value = array ? *nb : 0;
+        new_entry->str = str;
+        return array;
+    }
+
+    *nb = entry->value;
+    if (entry->str == NO_STRING)
+        return NULL;
+
+    char **array = malloc(entry->value * sizeof(char *));
+    ASSERT(array);
+
+    const char *str = &i_ctx->pool[entry->str];
+    for (int i = 0; i < entry->value; i++) {
+        ASSERT(str < &i_ctx->pool[i_ctx->pool_size]);
+        array[i] = strdup(str);
+        ASSERT(array[i]);
+        str += strlen(str) + 1;
+    }
+
+    return array;
+}
+
+/**
+ * @see tcs.h
+ */
+static void print(tcs_ctx_t *ctx)
+{
+    crm_tcs_snapshot_ctx_internal_t *i_ctx = (crm_tcs_snapshot_ctx_internal_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+
+    if (i_ctx->tcs)
+        i_ctx->tcs->print(i_ctx->tcs);
+    else
+        LOGV("configuration (%s) loaded from snapshot (%s). %zu entries", i_ctx->name,
+             i_ctx->path, i_ctx->nb_entries);
+}
+
+/**
+ * @see tcs.h
+ */
+static void dispose(tcs_ctx_t *ctx)
+{
+    crm_tcs_snapshot_ctx_internal_t *i_ctx = (crm_tcs_snapshot_ctx_internal_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+
+    if (i_ctx->dirty)
+        write_snapshot(i_ctx);
+
+    if (i_ctx->tcs)
+        i_ctx->tcs->dispose(i_ctx->tcs);
+    if (i_ctx->map)
+        munmap(i_ctx->map, i_ctx->map_size);
+    if (i_ctx->entries_max)
+        free(i_ctx->entries);
+    if (i_ctx->pool_max)
+        free(i_ctx->pool);
+    for (int i = 0; i < i_ctx->nb_added; i++)
+        free(i_ctx->added[i]);
+    free(i_ctx->group);
+    free(i_ctx->name);
+    free(i_ctx->path);
+    free(i_ctx);
+}
+
+/**
+ * @see tcs_snapshot.h
+ */
+tcs_ctx_t *crm_tcs_snapshot_init(const char *name, const char *xml_folder,
+                                 const char *snapshot_path)
+{
+    ASSERT(name != NULL);
+    ASSERT(xml_folder != NULL);
+    ASSERT(snapshot_path != NULL);
+
+    crm_tcs_snapshot_ctx_internal_t *i_ctx = calloc(1, sizeof(*i_ctx));
+    ASSERT(i_ctx != NULL);
+
+    i_ctx->ctx.dispose = dispose;
+    i_ctx->ctx.print = print;
+    i_ctx->ctx.select_group = select_group;
+    i_ctx->ctx.add_group = add_group;
+    i_ctx->ctx.get_string = get_string;
+    i_ctx->ctx.get_int = get_int;
+    i_ctx->ctx.get_bool = get_bool;
+    i_ctx->ctx.get_string_array = get_string_array;
+
+    i_ctx->name = strdup(name);
+    i_ctx->path = strdup(snapshot_path);
+    ASSERT(i_ctx->name && i_ctx->path);
+
+    i_ctx->hash = compute_hash(name, xml_folder);
+    if (!load_snapshot(i_ctx)) {
+        /* configuration is recorded from scratch */
+        get_tcs(i_ctx);
+        i_ctx->dirty = true;
+    }
+
+    return &i_ctx->ctx;
+}
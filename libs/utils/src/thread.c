@@ -31,6 +31,7 @@
 
 #define CRM_MODULE_TAG "THD"
 #include "utils/common.h"
+#include "utils/instance.h"
 #include "utils/thread.h"
 #include "utils/ipc.h"
 
@@ -42,6 +43,7 @@ typedef struct crm_thread_ctx_internal {
     pthread_t thread;
     pthread_t parent;
     bool detached;
+    int inst_id;
 
     void *(*start_routine)(crm_thread_ctx_t *, void *);
     void *arg;
@@ -57,6 +59,7 @@ static void *internal_start_routine(void *arg)
 {
     crm_thread_ctx_internal_t *i_ctx = arg;
 
+    crm_instance_set(i_ctx->inst_id);
     return i_ctx->start_routine(&i_ctx->ctx, i_ctx->arg);
 }
 
@@ -173,6 +176,7 @@ crm_thread_ctx_t *crm_thread_init(void *(*start_routine)(crm_thread_ctx_t *, voi
     ASSERT(pthread_mutex_init(&i_ctx->lock, NULL) == 0);
 
     i_ctx->parent = pthread_self();
+    i_ctx->inst_id = crm_instance_get();
 
     if (create_ipc)
         for (size_t i = 0; i < ARRAY_SIZE(i_ctx->ipc); i++)
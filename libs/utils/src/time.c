@@ -59,3 +59,20 @@ int crm_time_get_remain_ms(const struct timespec *timer_end)
         return ((timer_end->tv_sec - current.tv_sec) * 1000) +
                ((timer_end->tv_nsec - current.tv_nsec) / 1000000);
 }
+
+/**
+ * @see time.h
+ */
+int crm_time_get_elapsed_ms(const struct timespec *timer_begin)
+{
+    struct timespec current;
+
+    ASSERT(clock_gettime(CLOCK_BOOTTIME, &current) == 0);
+
+    if (current.tv_sec < timer_begin->tv_sec ||
+        (current.tv_sec == timer_begin->tv_sec && current.tv_nsec < timer_begin->tv_nsec))
+        return 0;
+    else
+        return ((current.tv_sec - timer_begin->tv_sec) * 1000) +
+               ((current.tv_nsec - timer_begin->tv_nsec) / 1000000);
+}
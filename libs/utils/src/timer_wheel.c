@@ -0,0 +1,386 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#define CRM_MODULE_TAG "TIMER"
+#include "utils/common.h"
+#include "utils/logs.h"
+#include "utils/timer_wheel.h"
+
+/* The wheel has WHEEL_LEVELS levels of WHEEL_SLOTS slots. Level N slots cover
+ * WHEEL_SLOTS^N ticks: with 4 levels of 64 slots, timers up to 2^24 ticks are stored without
+ * being clamped. Timers of upper levels are cascaded to the lower levels when their slot is
+ * reached */
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
+#define LEVEL_SHIFT(l) (WHEEL_BITS * (l))
+#define MAX_DELTA ((1ULL << LEVEL_SHIFT(WHEEL_LEVELS)) - 1)
+
+#define NS_PER_SEC 1000000000LL
+#define NS_PER_MS 1000000LL
+
+#define NO_TICK UINT64_MAX
+#define NO_TIMER -1
+
+typedef struct wheel_timer {
+    void (*callback)(void *param);
+    void *param;
+    uint64_t expires; // in ticks
+    int slot;         // NO_TIMER if not armed
+    int prev;
+    int next;
+} wheel_timer_t;
+
+typedef struct crm_timer_wheel_internal {
+    crm_timer_wheel_t ctx; // Needs to be first
+
+    int fd;
+    uint64_t granularity; // in ns
+    struct timespec base;
+    uint64_t now_tick;
+    uint64_t programmed_tick; // tick programmed in the timer fd
+    int nb_armed;
+
+    int slots[WHEEL_LEVELS * WHEEL_SLOTS];
+    uint64_t bitmap[WHEEL_LEVELS];
+
+    int nb_timers;
+    int nb_added;
+    wheel_timer_t *timers;
+} crm_timer_wheel_internal_t;
+
+/* Returns the time elapsed since the wheel creation, in ns */
+static uint64_t get_current_ns(crm_timer_wheel_internal_t *i_ctx)
+{
+    struct timespec now;
+
+    ASSERT(clock_gettime(CLOCK_BOOTTIME, &now) == 0);
+    return (int64_t)(now.tv_sec - i_ctx->base.tv_sec) * NS_PER_SEC +
+           (now.tv_nsec - i_ctx->base.tv_nsec);
+}
+
+static void link_timer(crm_timer_wheel_internal_t *i_ctx, int id)
+{
+    wheel_timer_t *timer = &i_ctx->timers[id];
+
+    uint64_t delta = timer->expires > i_ctx->now_tick ? timer->expires - i_ctx->now_tick : 0;
+    if (delta > MAX_DELTA)
+        delta = MAX_DELTA;
+    uint64_t pos = i_ctx->now_tick + delta;
+
+    int level = 0;
+    while ((level < WHEEL_LEVELS - 1) && (delta >> LEVEL_SHIFT(level + 1)))
+        level++;
+    int idx = (pos >> LEVEL_SHIFT(level)) & WHEEL_MASK;
+
+    timer->slot = level * WHEEL_SLOTS + idx;
+    timer->prev = NO_TIMER;
+    timer->next = i_ctx->slots[timer->slot];
+    if (timer->next != NO_TIMER)
+        i_ctx->timers[timer->next].prev = id;
+    i_ctx->slots[timer->slot] = id;
+    i_ctx->bitmap[level] |= 1ULL << idx;
+}
+
+static void unlink_timer(crm_timer_wheel_internal_t *i_ctx, int id)
+{
+    wheel_timer_t *timer = &i_ctx->timers[id];
+
+    if (timer->prev != NO_TIMER)
+        i_ctx->timers[timer->prev].next = timer->next;
+    else
+        i_ctx->slots[timer->slot] = timer->next;
+    if (timer->next != NO_TIMER)
+        i_ctx->timers[timer->next].prev = timer->prev;
+
+    if (i_ctx->slots[timer->slot] == NO_TIMER)
+        i_ctx->bitmap[timer->slot / WHEEL_SLOTS] &= ~(1ULL << (timer->slot & WHEEL_MASK));
+    timer->slot = NO_TIMER;
+}
+
+/* Returns the next tick where a slot must be handled: level 0 slots expire, upper level slots
+ * are cascaded */
+static uint64_t get_next_tick(crm_timer_wheel_internal_t *i_ctx)
+{
+    uint64_t next = NO_TICK;
+
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        uint64_t bitmap = i_ctx->bitmap[level];
+        if (!bitmap)
+            continue;
+
+        uint64_t cur = i_ctx->now_tick >> LEVEL_SHIFT(level);
+        unsigned int start = (cur + 1) & WHEEL_MASK;
+        if (start)
+            bitmap = (bitmap >> start) | (bitmap << (WHEEL_SLOTS - start));
+        uint64_t tick = (cur + 1 + __builtin_ctzll(bitmap)) << LEVEL_SHIFT(level);
+        if (tick < next)
+            next = tick;
+    }
+
+    return next;
+}
+
+static void program_fd(crm_timer_wheel_internal_t *i_ctx, uint64_t tick)
+{
+    struct itimerspec value = { { 0, 0 }, { 0, 0 } };
+
+    if (tick == i_ctx->programmed_tick)
+        return;
+
+    if (tick != NO_TICK) {
+        uint64_t ns = tick * i_ctx->granularity;
+        value.it_value.tv_sec = i_ctx->base.tv_sec + ns / NS_PER_SEC;
+        value.it_value.tv_nsec = i_ctx->base.tv_nsec + ns % NS_PER_SEC;
+        if (value.it_value.tv_nsec >= NS_PER_SEC) {
+            value.it_value.tv_sec += 1;
+            value.it_value.tv_nsec -= NS_PER_SEC;
+        }
+    }
+    ASSERT(timerfd_settime(i_ctx->fd, TFD_TIMER_ABSTIME, &value, NULL) == 0);
+    i_ctx->programmed_tick = tick;
+}
+
+static void cascade(crm_timer_wheel_internal_t *i_ctx, int level)
+{
+    int slot = level * WHEEL_SLOTS + ((i_ctx->now_tick >> LEVEL_SHIFT(level)) & WHEEL_MASK);
+    int id = i_ctx->slots[slot];
+
+    i_ctx->slots[slot] = NO_TIMER;
+    i_ctx->bitmap[level] &= ~(1ULL << (slot & WHEEL_MASK));
+    while (id != NO_TIMER) {
+        int next = i_ctx->timers[id].next;
+        link_timer(i_ctx, id);
+        id = next;
+    }
+}
+
+static void expire(crm_timer_wheel_internal_t *i_ctx)
+{
+    int slot = i_ctx->now_tick & WHEEL_MASK;
+
+    /* Callbacks can arm or cancel timers: the slot is re-read after each one */
+    while (i_ctx->slots[slot] != NO_TIMER) {
+        int id = i_ctx->slots[slot];
+        wheel_timer_t *timer = &i_ctx->timers[id];
+        ASSERT(timer->expires <= i_ctx->now_tick);
+
+        unlink_timer(i_ctx, id);
+        i_ctx->nb_armed -= 1;
+        timer->callback(timer->param);
+    }
+}
+
+/* Moves the wheel up to the given tick. Ticks without slot to handle are skipped */
+static void advance(crm_timer_wheel_internal_t *i_ctx, uint64_t target)
+{
+    while (i_ctx->now_tick < target) {
+        uint64_t next = get_next_tick(i_ctx);
+        if (next > target) {
+            i_ctx->now_tick = target;
+            break;
+        }
+
+        i_ctx->now_tick = next;
+        /* Upper levels first: cascaded timers can land in the slots cascaded just after */
+        for (int level = WHEEL_LEVELS - 1; level > 0; level--) {
+            if ((next & ((1ULL << LEVEL_SHIFT(level)) - 1)) == 0)
+                cascade(i_ctx, level);
+        }
+        expire(i_ctx);
+    }
+}
+
+/**
+ * @see timer_wheel.h
+ */
+static void dispose(crm_timer_wheel_t *ctx)
+{
+    crm_timer_wheel_internal_t *i_ctx = (crm_timer_wheel_internal_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+
+    close(i_ctx->fd);
+    free(i_ctx->timers);
+    free(i_ctx);
+}
+
+/**
+ * @see timer_wheel.h
+ */
+static int add(crm_timer_wheel_t *ctx, void (*callback)(void *param), void *param)
+{
+    crm_timer_wheel_internal_t *i_ctx = (crm_timer_wheel_internal_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+    ASSERT(callback != NULL);
+    DASSERT(i_ctx->nb_added < i_ctx->nb_timers, "too many timers (%d)", i_ctx->nb_timers);
+
+    int id = i_ctx->nb_added++;
+    i_ctx->timers[id].callback = callback;
+    i_ctx->timers[id].param = param;
+    i_ctx->timers[id].slot = NO_TIMER;
+
+    return id;
+}
+
+/**
+ * @see timer_wheel.h
+ */
+static void arm(crm_timer_wheel_t *ctx, int id, int timeout)
+{
+    crm_timer_wheel_internal_t *i_ctx = (crm_timer_wheel_internal_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+    ASSERT(id >= 0 && id < i_ctx->nb_added);
+    ASSERT(timeout >= 0);
+
+    wheel_timer_t *timer = &i_ctx->timers[id];
+    if (timer->slot != NO_TIMER) {
+        unlink_timer(i_ctx, id);
+        i_ctx->nb_armed -= 1;
+    }
+
+    uint64_t now = get_current_ns(i_ctx);
+    /* An empty wheel can jump to the current time: no slot has to be handled in between */
+    if (i_ctx->nb_armed == 0)
+        i_ctx->now_tick = now / i_ctx->granularity;
+
+    /* Rounded up: timers never expire early */
+    timer->expires = (now + timeout * NS_PER_MS + i_ctx->granularity - 1) / i_ctx->granularity;
+    if (timer->expires <= i_ctx->now_tick)
+        timer->expires = i_ctx->now_tick + 1;
+    link_timer(i_ctx, id);
+    i_ctx->nb_armed += 1;
+
+    uint64_t next = get_next_tick(i_ctx);
+    if (next < i_ctx->programmed_tick)
+        program_fd(i_ctx, next);
+}
+
+/**
+ * @see timer_wheel.h
+ */
+static void cancel(crm_timer_wheel_t *ctx, int id)
+{
+    crm_timer_wheel_internal_t *i_ctx = (crm_timer_wheel_internal_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+    ASSERT(id >= 0 && id < i_ctx->nb_added);
+
+    /* Timer fd is not re-programmed: an early wakeup is cheaper than a system call for each
+     * cancel, as most timers are cancelled before they expire */
+    if (i_ctx->timers[id].slot != NO_TIMER) {
+        unlink_timer(i_ctx, id);
+        i_ctx->nb_armed -= 1;
+    }
+}
+
+/**
+ * @see timer_wheel.h
+ */
+static bool is_armed(crm_timer_wheel_t *ctx, int id)
+{
+    crm_timer_wheel_internal_t *i_ctx = (crm_timer_wheel_internal_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+    ASSERT(id >= 0 && id < i_ctx->nb_added);
+
+    return i_ctx->timers[id].slot != NO_TIMER;
+}
+
+/**
+ * @see timer_wheel.h
+ */
+static int get_poll_fd(crm_timer_wheel_t *ctx)
+{
+    crm_timer_wheel_internal_t *i_ctx = (crm_timer_wheel_internal_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+
+    return i_ctx->fd;
+}
+
+/**
+ * @see timer_wheel.h
+ */
+static void process(crm_timer_wheel_t *ctx)
+{
+    crm_timer_wheel_internal_t *i_ctx = (crm_timer_wheel_internal_t *)ctx;
+    uint64_t expirations;
+
+    ASSERT(i_ctx != NULL);
+
+    if (read(i_ctx->fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+        i_ctx->programmed_tick = NO_TICK; // one-shot timer fd is disarmed once expired
+
+    advance(i_ctx, get_current_ns(i_ctx) / i_ctx->granularity);
+    program_fd(i_ctx, get_next_tick(i_ctx));
+}
+
+/**
+ * @see timer_wheel.h
+ */
+crm_timer_wheel_t *crm_timer_wheel_init(int nb_timers, int granularity)
+{
+    crm_timer_wheel_internal_t *i_ctx = calloc(1, sizeof(*i_ctx));
+
+    ASSERT(i_ctx != NULL);
+    ASSERT(nb_timers > 0);
+    ASSERT(granularity > 0);
+
+    i_ctx->timers = calloc(nb_timers, sizeof(*i_ctx->timers));
+    ASSERT(i_ctx->timers != NULL);
+    i_ctx->nb_timers = nb_timers;
+    i_ctx->granularity = granularity * NS_PER_MS;
+
+    i_ctx->fd = timerfd_create(CLOCK_BOOTTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    DASSERT(i_ctx->fd >= 0, "failed to create timer fd (%s)", strerror(errno));
+    ASSERT(clock_gettime(CLOCK_BOOTTIME, &i_ctx->base) == 0);
+    i_ctx->programmed_tick = NO_TICK;
+    for (size_t i = 0; i < ARRAY_SIZE(i_ctx->slots); i++)
+        i_ctx->slots[i] = NO_TIMER;
+
+    i_ctx->ctx.dispose = dispose;
+    i_ctx->ctx.add = add;
+    i_ctx->ctx.arm = arm;
+    i_ctx->ctx.cancel = cancel;
+    i_ctx->ctx.is_armed = is_armed;
+    i_ctx->ctx.get_poll_fd = get_poll_fd;
+    i_ctx->ctx.process = process;
+
+    return &i_ctx->ctx;
+}
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) Intel 2016
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CRM_MODULE_TAG "FILET"
+#include "utils/common.h"
+#include "utils/file.h"
+#include "utils/logs.h"
+#include "utils/time.h"
+
+#define SRC "/tmp/crm_test_stream.src"
+#define DST "/tmp/crm_test_stream.dst"
+#define SIZE (1024 * 1024 + 123)
+#define CHUNK (64 * 1024)
+
+typedef struct progress {
+    size_t size;
+    int calls;
+    size_t last;
+    size_t abort_at;
+    crm_file_stream_t *stream;
+} progress_t;
+
+static void *abort_later(void *param)
+{
+    crm_file_stream_t *stream = param;
+
+    usleep(200000);
+    __atomic_store_n(&stream->abort, true, __ATOMIC_RELAXED);
+
+    return NULL;
+}
+
+static void on_progress(void *param, size_t offset, size_t size, unsigned int rate)
+{
+    progress_t *p = param;
+
+    (void)rate; // UNUSED
+    ASSERT(size == p->size);
+    ASSERT(offset > p->last);
+    p->calls++;
+    p->last = offset;
+
+    if (p->abort_at && offset >= p->abort_at)
+        __atomic_store_n(&p->stream->abort, true, __ATOMIC_RELAXED);
+}
+
+static void check_dst(const char *data, size_t size)
+{
+    char *copy = malloc(size + 1);
+
+    ASSERT(copy != NULL);
+    int fd = open(DST, O_RDONLY);
+    ASSERT(fd >= 0);
+    ASSERT(read(fd, copy, size + 1) == (ssize_t)size);
+    close(fd);
+    ASSERT(!memcmp(copy, data, size));
+    free(copy);
+}
+
+static void stream_file(crm_file_stream_method_t method, crm_file_stream_method_t expected,
+                        const char *data)
+{
+    int in_fd = open(SRC, O_RDONLY);
+    int out_fd = open(DST, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+    ASSERT(in_fd >= 0 && out_fd >= 0);
+
+    crm_file_stream_t stream = { .method = method, .chunk_size = CHUNK };
+    progress_t p = { .size = SIZE, .stream = &stream };
+    stream.progress = on_progress;
+    stream.progress_param = &p;
+    ASSERT(crm_file_stream(in_fd, out_fd, SIZE, &stream) == 0);
+    DASSERT(stream.used == expected, "method %d used instead of %d", stream.used, expected);
+    ASSERT(stream.offset == SIZE);
+    ASSERT(p.last == SIZE);
+    ASSERT(p.calls == 2); // one at 1 MB, one at the end
+
+    close(in_fd);
+    close(out_fd);
+    check_dst(data, SIZE);
+}
+
+int main(void)
+{
+    char *data = malloc(SIZE);
+
+    ASSERT(data != NULL);
+    for (size_t i = 0; i < SIZE; i++)
+        data[i] = rand();
+
+    int fd = open(SRC, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    ASSERT(fd >= 0);
+    ASSERT(write(fd, data, SIZE) == SIZE);
+    close(fd);
+
+    LOGD("Testing all methods");
+    stream_file(CRM_FILE_STREAM_AUTO, CRM_FILE_STREAM_COPY_RANGE, data);
+    stream_file(CRM_FILE_STREAM_SPLICE, CRM_FILE_STREAM_SPLICE, data);
+    stream_file(CRM_FILE_STREAM_SENDFILE, CRM_FILE_STREAM_SENDFILE, data);
+    stream_file(CRM_FILE_STREAM_READ_WRITE, CRM_FILE_STREAM_READ_WRITE, data);
+
+    LOGD("Testing copy");
+    ASSERT(crm_file_copy(SRC, DST, false, false, 0600) == 0);
+    check_dst(data, SIZE);
+
+    LOGD("Testing abort and resume");
+    int in_fd = open(SRC, O_RDONLY);
+    int out_fd = open(DST, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    ASSERT(in_fd >= 0 && out_fd >= 0);
+    ASSERT(lseek(in_fd, 100, SEEK_SET) == 100);
+
+    crm_file_stream_t stream = { .chunk_size = CHUNK, .progress_step = CHUNK };
+    progress_t p = { .size = SIZE - 100, .stream = &stream, .abort_at = 3 * CHUNK };
+    stream.progress = on_progress;
+    stream.progress_param = &p;
+    ASSERT(crm_file_stream(in_fd, out_fd, SIZE - 100, &stream) == 1);
+    ASSERT(stream.offset == 3 * CHUNK);
+    ASSERT(lseek(in_fd, 0, SEEK_CUR) == 100);
+    close(out_fd);
+
+    /* Destination is reopened like a device would be after an error */
+    out_fd = open(DST, O_WRONLY);
+    ASSERT(out_fd >= 0);
+    ASSERT(lseek(out_fd, stream.offset, SEEK_SET) == (off_t)stream.offset);
+    stream.abort = false;
+    p.abort_at = 0;
+    ASSERT(crm_file_stream(in_fd, out_fd, SIZE - 100, &stream) == 0);
+    ASSERT(stream.offset == SIZE - 100);
+    ASSERT(p.last == SIZE - 100);
+    close(in_fd);
+    close(out_fd);
+    check_dst(data + 100, SIZE - 100);
+
+    LOGD("Testing pipes and fallback");
+    int pipe_fds[2];
+    ASSERT(pipe(pipe_fds) == 0);
+    in_fd = open(SRC, O_RDONLY);
+    ASSERT(in_fd >= 0);
+    /* copy_file_range does not support pipes */
+    crm_file_stream_t to_pipe = { .method = CRM_FILE_STREAM_COPY_RANGE };
+    ASSERT(crm_file_stream(in_fd, pipe_fds[1], 4096, &to_pipe) == 0);
+    ASSERT(to_pipe.used == CRM_FILE_STREAM_SENDFILE);
+    close(pipe_fds[1]);
+
+    out_fd = open(DST, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    ASSERT(out_fd >= 0);
+    crm_file_stream_t from_pipe = { .method = CRM_FILE_STREAM_AUTO };
+    ASSERT(crm_file_stream(pipe_fds[0], out_fd, 4096, &from_pipe) == 0);
+    ASSERT(from_pipe.used == CRM_FILE_STREAM_SPLICE);
+    close(out_fd);
+    check_dst(data, 4096);
+
+    /* A full non-blocking destination does not prevent the abort */
+    int full_fds[2];
+    ASSERT(pipe(full_fds) == 0);
+    ASSERT(fcntl(full_fds[1], F_SETFL, O_NONBLOCK) == 0);
+    ASSERT(lseek(in_fd, 0, SEEK_SET) == 0);
+    crm_file_stream_t stalled = { .method = CRM_FILE_STREAM_READ_WRITE, .chunk_size = CHUNK };
+    pthread_t thread;
+    ASSERT(pthread_create(&thread, NULL, abort_later, &stalled) == 0);
+    struct timespec start;
+    crm_time_add_ms(&start, 0);
+    ASSERT(crm_file_stream(in_fd, full_fds[1], SIZE, &stalled) == 1);
+    int elapsed = crm_time_get_elapsed_ms(&start);
+    DASSERT(elapsed < 1000, "abort detected after %dms", elapsed);
+    ASSERT(pthread_join(thread, NULL) == 0);
+    close(full_fds[0]);
+    close(full_fds[1]);
+
+    /* Source shorter than announced */
+    out_fd = open(DST, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    ASSERT(out_fd >= 0);
+    crm_file_stream_t short_src = { .method = CRM_FILE_STREAM_AUTO };
+    ASSERT(crm_file_stream(pipe_fds[0], out_fd, 10, &short_src) == -1);
+    ASSERT(short_src.offset == 0);
+    close(pipe_fds[0]);
+    close(in_fd);
+    close(out_fd);
+
+    unlink(SRC);
+    unlink(DST);
+    free(data);
+
+    LOGD("success");
+    return 0;
+}
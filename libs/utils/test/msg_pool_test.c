@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CRM_MODULE_TAG "POOLT"
+#include "utils/common.h"
+#include "utils/logs.h"
+#include "utils/msg_pool.h"
+
+#define NB_BLOCKS 8
+#define BLOCK_SIZE 100
+#define NB_LOOPS 10000
+/* Blocks in flight between threads. Less than NB_BLOCKS as the consumer may hold one more */
+#define NB_SLOTS 4
+
+/* Releases every block received from the main thread */
+static void *release_thread(void *args)
+{
+    void **ctx = args;
+    crm_msg_pool_t *pool = ctx[0];
+    void **blocks = ctx[1];
+
+    for (int i = 0; i < NB_LOOPS; i++) {
+        void *block;
+        while ((block = __atomic_exchange_n(&blocks[i & (NB_SLOTS - 1)], NULL,
+                                            __ATOMIC_ACQUIRE)) == NULL)
+            sched_yield();
+        pool->free(pool, block);
+    }
+
+    return NULL;
+}
+
+int main(void)
+{
+    crm_msg_pool_t *pool = crm_msg_pool_init(BLOCK_SIZE, NB_BLOCKS);
+    crm_msg_pool_stats_t stats;
+    void *blocks[NB_BLOCKS + 1];
+
+    ASSERT(pool != NULL);
+
+    LOGD("Testing allocation of all blocks");
+    for (int i = 0; i < NB_BLOCKS; i++) {
+        blocks[i] = pool->alloc(pool);
+        ASSERT(blocks[i] != NULL);
+        ASSERT(((uintptr_t)blocks[i] & 0xF) == 0);
+        memset(blocks[i], i, BLOCK_SIZE);
+        for (int j = 0; j < i; j++)
+            ASSERT(blocks[i] != blocks[j]);
+    }
+    for (int i = 0; i < NB_BLOCKS; i++)
+        ASSERT(((unsigned char *)blocks[i])[BLOCK_SIZE - 1] == i);
+
+    pool->get_stats(pool, &stats);
+    ASSERT(stats.nb_blocks == NB_BLOCKS);
+    ASSERT(stats.in_use == NB_BLOCKS);
+    ASSERT(stats.nb_failures == 0);
+
+    LOGD("Testing pool exhaustion");
+    blocks[NB_BLOCKS] = pool->alloc(pool);
+    ASSERT(blocks[NB_BLOCKS] != NULL);
+    memset(blocks[NB_BLOCKS], 0, BLOCK_SIZE);
+    pool->get_stats(pool, &stats);
+    ASSERT(stats.in_use == NB_BLOCKS + 1);
+    ASSERT(stats.max_in_use == NB_BLOCKS + 1);
+    ASSERT(stats.nb_allocs == NB_BLOCKS + 1);
+    ASSERT(stats.nb_failures == 1);
+
+    for (int i = 0; i <= NB_BLOCKS; i++)
+        pool->free(pool, blocks[i]);
+    pool->free(pool, NULL);
+    pool->get_stats(pool, &stats);
+    ASSERT(stats.in_use == 0);
+    ASSERT(stats.max_in_use == NB_BLOCKS + 1);
+
+    LOGD("Testing blocks are reused once released");
+    void *block = pool->alloc(pool);
+    ASSERT(block == blocks[NB_BLOCKS - 1]);
+    pool->free(pool, block);
+
+    LOGD("Testing allocation and release from different threads");
+    void *shared[NB_SLOTS] = { NULL };
+    void *args[2] = { pool, shared };
+    pthread_t t;
+    ASSERT(pthread_create(&t, NULL, release_thread, args) == 0);
+    for (int i = 0; i < NB_LOOPS; i++) {
+        while (__atomic_load_n(&shared[i & (NB_SLOTS - 1)], __ATOMIC_ACQUIRE) != NULL)
+            sched_yield();
+        __atomic_store_n(&shared[i & (NB_SLOTS - 1)], pool->alloc(pool), __ATOMIC_RELEASE);
+    }
+    pthread_join(t, NULL);
+
+    pool->get_stats(pool, &stats);
+    ASSERT(stats.in_use == 0);
+    ASSERT(stats.nb_allocs == NB_BLOCKS + 2 + NB_LOOPS);
+    ASSERT(stats.nb_failures == 1);
+
+    pool->dispose(pool);
+
+    LOGD("Testing pool without blocks");
+    pool = crm_msg_pool_init(BLOCK_SIZE, 0);
+    block = pool->alloc(pool);
+    ASSERT(block != NULL);
+    pool->free(pool, block);
+    pool->get_stats(pool, &stats);
+    ASSERT(stats.nb_failures == 1);
+    ASSERT(stats.in_use == 0);
+
+    LOGD("Testing heap blocks still allocated are released by dispose");
+    for (int i = 0; i < 3; i++) {
+        blocks[i] = pool->alloc(pool);
+        ASSERT(((uintptr_t)blocks[i] & 0xF) == 0);
+        memset(blocks[i], i, BLOCK_SIZE);
+    }
+    pool->free(pool, blocks[1]);
+    pool->dispose(pool);
+
+    LOGD("success");
+
+    return 0;
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) Intel 2016
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define CRM_MODULE_TAG "STATET"
+#include "utils/common.h"
+#include "utils/instance.h"
+#include "utils/logs.h"
+#include "utils/property.h"
+#include "utils/state.h"
+
+#define STORE "/tmp/crm_test.store"
+#define STORE1 "/tmp/crm_test1.store"
+#define STORE_CAPACITY 48
+
+static off_t get_size(void)
+{
+    struct stat st;
+
+    ASSERT(stat(STORE, &st) == 0);
+    return st.st_size;
+}
+
+static void check(const char *key, const char *expected)
+{
+    char value[CRM_STATE_VALUE_MAX];
+
+    if (expected) {
+        ASSERT(crm_state_get(key, value, NULL));
+        DASSERT(!strcmp(value, expected), "%s: %s instead of %s", key, value, expected);
+    } else {
+        ASSERT(!crm_state_get(key, value, "default"));
+        ASSERT(!strcmp(value, "default"));
+    }
+}
+
+int main(void)
+{
+    crm_property_init(0);
+    unlink(STORE);
+
+    LOGD("Testing memory only store");
+    ASSERT(crm_state_set("memory", "1") == 0);
+    check("memory", "1");
+
+    LOGD("Testing persistence");
+    crm_state_init(STORE, CRM_STATE_SYNC);
+    check("memory", NULL);
+    ASSERT(crm_state_set("counter", "1") == 0);
+    ASSERT(crm_state_set("counter", "2") == 0);
+    const char *keys[] = { "hash_@_a", "hash_@_b" };
+    const char *values[] = { "aaaa", "bbbb" };
+    ASSERT(crm_state_set_multi(ARRAY_SIZE(keys), keys, values) == 0);
+    check("hash_0_a", "aaaa");
+    crm_state_init(STORE, CRM_STATE_NO_SYNC);
+    check("counter", "2");
+    check("hash_0_a", "aaaa");
+    check("hash_0_b", "bbbb");
+
+    LOGD("Testing recovery of an interrupted update");
+    off_t size = get_size();
+    values[0] = "cccc";
+    values[1] = "dddd";
+    ASSERT(crm_state_set_multi(ARRAY_SIZE(keys), keys, values) == 0);
+    /* the update is cut in the middle of its second value */
+    ASSERT(truncate(STORE, get_size() - 2) == 0);
+    crm_state_init(STORE, CRM_STATE_READ_ONLY);
+    check("hash_0_a", "aaaa");
+    check("hash_0_b", "bbbb");
+    ASSERT(get_size() > size);
+    crm_state_init(STORE, CRM_STATE_NO_SYNC);
+    ASSERT(get_size() == size);
+    ASSERT(crm_state_set("counter", "3") == 0);
+    crm_state_init(STORE, CRM_STATE_NO_SYNC);
+    check("counter", "3");
+    check("hash_0_a", "aaaa");
+
+    LOGD("Testing compaction");
+    for (int i = 0; i < 1000; i++) {
+        char value[CRM_STATE_VALUE_MAX];
+        snprintf(value, sizeof(value), "%d", i);
+        ASSERT(crm_state_set("counter", value) == 0);
+    }
+    LOGD("store size: %lld bytes", (long long)get_size());
+    ASSERT(get_size() < 4 * 4096);
+    crm_state_init(STORE, CRM_STATE_NO_SYNC);
+    check("counter", "999");
+    check("hash_0_b", "bbbb");
+    ASSERT(access(STORE ".tmp", F_OK) != 0);
+
+    LOGD("Testing instances and legacy properties");
+    crm_instance_set(1);
+    check("hash_@_a", NULL);
+    crm_property_set("legacy_@_key", "42");
+    crm_state_import_property("imported_@", "legacy_@_key");
+    crm_property_set("legacy_@_key", "43");
+    crm_state_import_property("imported_@", "legacy_@_key");
+    check("imported_1", "42");
+    crm_instance_set(0);
+    check("hash_@_a", "aaaa");
+    check("imported_1", NULL);
+
+    LOGD("Testing one store per instance");
+    unlink(STORE1);
+    crm_instance_set(1);
+    crm_state_init(STORE1, CRM_STATE_NO_SYNC);
+    ASSERT(crm_state_set("counter_@", "7") == 0);
+    crm_instance_set(0);
+    check("counter_1", NULL);
+    crm_state_init(STORE, CRM_STATE_NO_SYNC);
+    check("counter_1", NULL);
+    crm_instance_set(1);
+    crm_state_init(STORE1, CRM_STATE_NO_SYNC);
+    check("counter_1", "7");
+    crm_state_dispose();
+    unlink(STORE1);
+    crm_instance_set(0);
+
+    LOGD("Testing a full store");
+    crm_state_dispose();
+    unlink(STORE);
+    crm_state_init(STORE, CRM_STATE_NO_SYNC);
+    for (int i = 0; i < STORE_CAPACITY - 1; i++) {
+        char key[CRM_STATE_KEY_MAX];
+        snprintf(key, sizeof(key), "key%d", i);
+        ASSERT(crm_state_set(key, "1") == 0);
+    }
+    const char *dup_keys[] = { "dup", "dup" };
+    const char *dup_values[] = { "1", "2" };
+    ASSERT(crm_state_set_multi(ARRAY_SIZE(dup_keys), dup_keys, dup_values) == 0);
+    check("dup", "2");
+    ASSERT(crm_state_set("new", "1") == -1);
+    check("new", NULL);
+
+    crm_state_dispose();
+    unlink(STORE);
+
+    LOGD("success");
+
+    return 0;
+}
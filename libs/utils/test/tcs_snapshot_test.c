@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define CRM_MODULE_TAG "TCST"
+#include "utils/common.h"
+#include "utils/logs.h"
+#include "utils/property.h"
+#include "utils/tcs_snapshot.h"
+#include "utils/time.h"
+
+#define SNAPSHOT "/tmp/crm_test_snapshot.cfg"
+#define SW_FOLDER "/tmp/crm_test_sw_folder"
+#ifndef HOST_BUILD
+#define TCS_XML_FOLDER "/system/vendor/etc/telephony/tcs"
+#endif
+
+typedef struct config {
+    char *control;
+    int missing_ret;
+    int missing;
+} config_t;
+
+/* Reads the configuration like the daemon does at boot. Returns the cold start time in ms */
+static int read_config(const char *folder, config_t *cfg)
+{
+    struct timespec start;
+
+    clock_gettime(CLOCK_BOOTTIME, &start);
+
+    tcs_ctx_t *tcs = crm_tcs_snapshot_init("crm0", folder, SNAPSHOT);
+    ASSERT(tcs);
+    ASSERT(tcs->select_group(tcs, ".main") == 0);
+    cfg->control = tcs->get_string(tcs, "control");
+    cfg->missing_ret = tcs->get_int(tcs, "not_a_key", &cfg->missing);
+    tcs->dispose(tcs);
+
+    return crm_time_get_elapsed_ms(&start);
+}
+
+static void write_sw_file(const char *content)
+{
+    FILE *fp = fopen(SW_FOLDER "/sw.xml", "w");
+
+    ASSERT(fp != NULL);
+    ASSERT(fputs(content, fp) >= 0);
+    ASSERT(fclose(fp) == 0);
+}
+
+/* The snapshot is written with a rename: a new inode means it was recorded again */
+static ino_t get_snapshot_inode(void)
+{
+    struct stat st;
+
+    ASSERT(stat(SNAPSHOT, &st) == 0);
+    return st.st_ino;
+}
+
+/* A change of a XML file of the software folder must invalidate the snapshot */
+static void test_sw_folder(const char *folder)
+{
+    config_t cfg;
+    char sw_folder[CRM_PROPERTY_VALUE_MAX];
+
+    crm_property_get("ro.telephony.tcs.sw_folder", sw_folder, "");
+    mkdir(SW_FOLDER, 0700);
+    write_sw_file("<a/>");
+    crm_property_set("ro.telephony.tcs.sw_folder", SW_FOLDER);
+
+    read_config(folder, &cfg);
+    free(cfg.control);
+    ino_t recorded = get_snapshot_inode();
+
+    read_config(folder, &cfg);
+    free(cfg.control);
+    ASSERT(get_snapshot_inode() == recorded);
+
+    write_sw_file("<b/>");
+    read_config(folder, &cfg);
+    free(cfg.control);
+    ASSERT(get_snapshot_inode() != recorded);
+
+    crm_property_set("ro.telephony.tcs.sw_folder", sw_folder);
+    unlink(SW_FOLDER "/sw.xml");
+    rmdir(SW_FOLDER);
+}
+
+int main()
+{
+    config_t ref, cfg;
+
+#ifdef HOST_BUILD
+    char folder[CRM_PROPERTY_VALUE_MAX];
+    crm_property_get("tcs.dbg.host.hw_folder", folder, "");
+#else
+    const char *folder = TCS_XML_FOLDER;
+#endif
+
+    unlink(SNAPSHOT);
+    int record = read_config(folder, &ref);
+    ASSERT(ref.control != NULL);
+    ASSERT(ref.missing_ret != 0);
+    ASSERT(access(SNAPSHOT, R_OK) == 0);
+
+    int replay = read_config(folder, &cfg);
+    ASSERT(cfg.control && !strcmp(cfg.control, ref.control));
+    ASSERT(cfg.missing_ret == ref.missing_ret);
+    free(cfg.control);
+    LOGD("cold start: %dms with XML parsing, %dms with snapshot", record, replay);
+
+    /* a corrupted snapshot must be ignored */
+    int fd = open(SNAPSHOT, O_WRONLY | O_TRUNC);
+    ASSERT(fd >= 0);
+    ASSERT(write(fd, "CRMS", 4) == 4);
+    close(fd);
+    read_config(folder, &cfg);
+    ASSERT(cfg.control && !strcmp(cfg.control, ref.control));
+    free(cfg.control);
+    free(ref.control);
+
+    test_sw_folder(folder);
+    unlink(SNAPSHOT);
+
+    LOGD("\n");
+    LOGD("done");
+    return 0;
+}
@@ -24,13 +24,23 @@
  * limitations under the License.
  */
 
+#include <poll.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
 
 #define CRM_MODULE_TAG "UTILST"
+#include "utils/at.h"
 #include "utils/common.h"
+#include "utils/fault.h"
+#include "utils/file.h"
+#include "utils/instance.h"
+#include "utils/keys.h"
 #include "utils/logs.h"
 #include "utils/property.h"
+#include "utils/thread.h"
 
 static void test_properties()
 {
@@ -64,6 +74,20 @@ static void test_properties()
             free(key);
         }
     }
+
+#ifdef HOST_BUILD
+    /* a write not done through the cache is seen once the property serial changes */
+    const char *key = "cached_key";
+    char read[CRM_PROPERTY_VALUE_MAX];
+    crm_property_set(key, "2");
+    crm_property_get(key, read, NULL);
+    setenv(key, "3", 1);
+    crm_property_get(key, read, NULL);
+    ASSERT(!strcmp(read, "2"));
+    crm_property_set("other_key", "");
+    crm_property_get(key, read, NULL);
+    ASSERT(!strcmp(read, "3"));
+#endif
 }
 
 static void test_log()
@@ -79,10 +103,155 @@ static void test_log()
     LOGD("DEBUG: LONG TEST a = %d, b = %d, c = %d, str = %s", a, b, c, "hello world!");
 }
 
+static void test_fault_injection()
+{
+    const char *path = "/tmp/crm_test_fault";
+
+    FILE *fp = fopen(path, "w");
+    ASSERT(fp != NULL);
+    fclose(fp);
+
+    crm_property_init(0);
+
+    /* first write succeeds, the two next ones fail, then writes succeed again */
+    crm_property_set(CRM_KEY_DBG_FAULT_INJECTION, "file_write:1:2,unknown_fault");
+    crm_fault_init();
+    int expected[] = { 0, -1, -1, 0, 0 };
+    for (size_t i = 0; i < ARRAY_SIZE(expected); i++)
+        ASSERT(crm_file_write(path, "test") == expected[i]);
+
+    int param = 0;
+    crm_property_set(CRM_KEY_DBG_FAULT_INJECTION, "ipc_delay:0:-1:200");
+    crm_fault_init();
+    ASSERT(crm_fault_inject(CRM_FAULT_IPC_DELAY, &param) && param == 200);
+    ASSERT(!crm_fault_inject(CRM_FAULT_FILE_WRITE, NULL));
+
+    crm_property_set(CRM_KEY_DBG_FAULT_INJECTION, "");
+    crm_fault_init();
+    ASSERT(!crm_fault_inject(CRM_FAULT_IPC_DELAY, NULL));
+
+    unlink(path);
+}
+
+static void at_cb(int status, void *data)
+{
+    *(int *)data = status;
+}
+
+static void at_urc(const char *line, void *data)
+{
+    int *nb_urc = (int *)data;
+
+    ASSERT(!strcmp(line, "+CREG: 1") || !strcmp(line, "RING"));
+    (*nb_urc)++;
+}
+
+static void test_at_pipeline()
+{
+    int fds[2];
+
+    ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+    /* answers are received in chunks split in the middle of a line. Second command fails:
+     * third command is already written but the fourth one is discarded */
+    int status[4] = { 1, 1, 1, 1 };
+    crm_at_ctx_t *at = crm_at_init(fds[0], "TEST", 2, NULL, NULL, NULL);
+    for (size_t i = 0; i < ARRAY_SIZE(status); i++)
+        ASSERT(at->send(at, "AT", at_cb, &status[i]) == 0);
+    ASSERT(at->get_pending(at) == 4);
+
+    ASSERT(write(fds[1], "AT\r\r\nOK\r\n\r\nER", 13) == 13);
+    ASSERT(write(fds[1], "ROR\r\nOK\r\n", 9) == 9);
+    ASSERT(at->wait(at, 1000, -1) == -1);
+    ASSERT(status[0] == 0 && status[1] == -1 && status[2] == 0 && status[3] == -1);
+    ASSERT(at->get_pending(at) == 0);
+
+    char buffer[64];
+    ASSERT(read(fds[1], buffer, sizeof(buffer)) == 12);
+
+    /* the error is only reported once */
+    status[0] = 1;
+    ASSERT(at->send(at, "AT", at_cb, &status[0]) == 0);
+    ASSERT(write(fds[1], "OK\r\n", 4) == 4);
+    ASSERT(at->wait(at, 1000, -1) == 0);
+    ASSERT(read(fds[1], buffer, sizeof(buffer)) == 4);
+    ASSERT(status[0] == 0);
+    at->dispose(at);
+
+    /* no answer */
+    ASSERT(crm_send_at(fds[0], "TEST", "AT", 100, -1) == -1);
+    ASSERT(read(fds[1], buffer, sizeof(buffer)) == 4);
+
+    /* URCs matching a prefix are forwarded while a command is in flight, any line otherwise */
+    const char *const urc_prefixes[] = { "+CREG:", NULL };
+    int nb_urc = 0;
+    at = crm_at_init(fds[0], "TEST", 1, at_urc, &nb_urc, urc_prefixes);
+    ASSERT(at->send(at, "ATD", at_cb, &status[0]) == 0);
+    ASSERT(write(fds[1], "+CREG: 1\r\nCONNECTING\r\nNO CARRIER\r\n", 34) == 34);
+    ASSERT(at->wait(at, 1000, -1) == -1);
+    ASSERT(status[0] == -1 && nb_urc == 1);
+    ASSERT(write(fds[1], "RING\r\n", 6) == 6);
+    ASSERT(at->process(at) == 0);
+    ASSERT(nb_urc == 2);
+    at->dispose(at);
+    ASSERT(read(fds[1], buffer, sizeof(buffer)) == 5);
+
+    /* injected timeout: the command is never written, even if the modem talks */
+    crm_property_set(CRM_KEY_DBG_FAULT_INJECTION, "at_timeout:0:1");
+    crm_fault_init();
+    at = crm_at_init(fds[0], "TEST", 1, NULL, NULL, NULL);
+    status[0] = 1;
+    ASSERT(at->send(at, "AT", at_cb, &status[0]) == 0);
+    ASSERT(write(fds[1], "OK\r\n", 4) == 4);
+    ASSERT(at->wait(at, 100, -1) == -1);
+    ASSERT(status[0] == -1);
+    struct pollfd pfd = { .fd = fds[1], .events = POLLIN };
+    ASSERT(poll(&pfd, 1, 0) == 0);
+    at->dispose(at);
+    crm_property_set(CRM_KEY_DBG_FAULT_INJECTION, "");
+    crm_fault_init();
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void *instance_thread(crm_thread_ctx_t *thread_ctx, void *arg)
+{
+    (void)thread_ctx; // UNUSED
+    (void)arg;        // UNUSED
+
+    /* instance ID is inherited from parent thread */
+    ASSERT(crm_instance_get() == 2);
+    crm_property_set("test_@_instance", "2");
+
+    return NULL;
+}
+
+static void test_instances()
+{
+    char value[CRM_PROPERTY_VALUE_MAX];
+
+    crm_property_init(1);
+    crm_instance_set(2);
+
+    crm_thread_ctx_t *thread = crm_thread_init(instance_thread, NULL, false, false);
+    thread->dispose(thread, NULL);
+
+    crm_property_get("test_2_instance", value, "");
+    ASSERT(!strcmp(value, "2"));
+    crm_property_get("test_1_instance", value, "");
+    ASSERT(value[0] == '\0');
+
+    crm_instance_set(1);
+}
+
 int main()
 {
     test_log();
     test_properties();
+    test_fault_injection();
+    test_at_pipeline();
+    test_instances();
 
     LOGD("success");
     int a = 0;
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <poll.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define CRM_MODULE_TAG "TIMERT"
+#include "utils/common.h"
+#include "utils/logs.h"
+#include "utils/time.h"
+#include "utils/timer_wheel.h"
+
+#define GRANULARITY 5
+#define LATENCY_MAX 30
+#define NB_PERIODIC 5
+
+typedef struct test_timer {
+    int id;
+    int timeout;
+    int nb_expirations;
+    int elapsed;
+    int wakeup;
+} test_timer_t;
+
+static crm_timer_wheel_t *g_wheel;
+static struct timespec g_start;
+static int g_wakeup;
+
+static void expired(void *param)
+{
+    test_timer_t *timer = param;
+
+    timer->nb_expirations += 1;
+    timer->elapsed = crm_time_get_elapsed_ms(&g_start);
+    timer->wakeup = g_wakeup;
+    LOGD("timer %d expired after %dms (%dms)", timer->id, timer->elapsed, timer->timeout);
+}
+
+static void periodic(void *param)
+{
+    test_timer_t *timer = param;
+
+    expired(param);
+    if (timer->nb_expirations < NB_PERIODIC)
+        g_wheel->arm(g_wheel, timer->id, timer->timeout);
+}
+
+/* Runs the wheel until the given time is elapsed */
+static void run(int duration)
+{
+    struct pollfd pfd = { .fd = g_wheel->get_poll_fd(g_wheel), .events = POLLIN };
+
+    while (crm_time_get_elapsed_ms(&g_start) < duration) {
+        if (poll(&pfd, 1, duration - crm_time_get_elapsed_ms(&g_start)) > 0) {
+            ASSERT(pfd.revents == POLLIN);
+            g_wakeup += 1;
+            g_wheel->process(g_wheel);
+        }
+    }
+}
+
+static void check(const test_timer_t *timer)
+{
+    ASSERT(timer->nb_expirations == 1);
+    ASSERT(timer->elapsed >= timer->timeout);
+    ASSERT(timer->elapsed <= timer->timeout + LATENCY_MAX);
+}
+
+int main(void)
+{
+    /* Timeouts cover the first three levels of the wheel */
+    test_timer_t timers[] = {
+        { .timeout = 0 }, { .timeout = 20 }, { .timeout = 21 }, { .timeout = 22 },
+        { .timeout = 100 }, { .timeout = 330 }, { .timeout = 1000 }, { .timeout = 25000 },
+    };
+    test_timer_t cancelled = { .timeout = 50 };
+    test_timer_t rearmed = { .timeout = 60 };
+    test_timer_t tick = { .timeout = 30 };
+
+    g_wheel = crm_timer_wheel_init(ARRAY_SIZE(timers) + 3, GRANULARITY);
+    ASSERT(g_wheel != NULL);
+
+    for (size_t i = 0; i < ARRAY_SIZE(timers); i++)
+        timers[i].id = g_wheel->add(g_wheel, expired, &timers[i]);
+    cancelled.id = g_wheel->add(g_wheel, expired, &cancelled);
+    rearmed.id = g_wheel->add(g_wheel, expired, &rearmed);
+    tick.id = g_wheel->add(g_wheel, periodic, &tick);
+
+    LOGD("Testing expiration of timers");
+    ASSERT(clock_gettime(CLOCK_BOOTTIME, &g_start) == 0);
+    for (size_t i = 0; i < ARRAY_SIZE(timers) - 1; i++) {
+        g_wheel->arm(g_wheel, timers[i].id, timers[i].timeout);
+        ASSERT(g_wheel->is_armed(g_wheel, timers[i].id));
+    }
+    g_wheel->arm(g_wheel, cancelled.id, cancelled.timeout);
+    g_wheel->arm(g_wheel, rearmed.id, 10);
+    g_wheel->arm(g_wheel, rearmed.id, rearmed.timeout);
+    g_wheel->arm(g_wheel, tick.id, tick.timeout);
+    g_wheel->cancel(g_wheel, cancelled.id);
+    ASSERT(!g_wheel->is_armed(g_wheel, cancelled.id));
+
+    run(1100);
+
+    for (size_t i = 0; i < ARRAY_SIZE(timers) - 1; i++) {
+        check(&timers[i]);
+        ASSERT(!g_wheel->is_armed(g_wheel, timers[i].id));
+    }
+    check(&rearmed);
+    ASSERT(cancelled.nb_expirations == 0);
+
+    LOGD("Testing coalescing of timers expiring in the same window");
+    /* Three timers within 2ms span at most two windows of GRANULARITY ms */
+    ASSERT(timers[1].wakeup == timers[2].wakeup || timers[2].wakeup == timers[3].wakeup);
+
+    LOGD("Testing re-arm from callback");
+    ASSERT(tick.nb_expirations == NB_PERIODIC);
+    ASSERT(tick.elapsed >= NB_PERIODIC * tick.timeout);
+
+    LOGD("Testing cancel of a long timer");
+    test_timer_t *longest = &timers[ARRAY_SIZE(timers) - 1];
+    g_wheel->arm(g_wheel, longest->id, longest->timeout);
+    g_wheel->arm(g_wheel, timers[0].id, 50);
+    g_wheel->cancel(g_wheel, longest->id);
+    timers[0].nb_expirations = 0;
+    ASSERT(clock_gettime(CLOCK_BOOTTIME, &g_start) == 0);
+    run(100);
+    ASSERT(timers[0].nb_expirations == 1);
+    ASSERT(longest->nb_expirations == 0);
+
+    g_wheel->dispose(g_wheel);
+
+    LOGD("success");
+
+    return 0;
+}
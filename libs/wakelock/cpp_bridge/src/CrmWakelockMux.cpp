@@ -24,8 +24,11 @@
  * limitations under the License.
  */
 
+#include <time.h>
+
 #define CRM_MODULE_TAG "WAKE"
 #include "utils/common.h"
+#include "utils/logs.h"
 
 #include "CrmWakelockMux.hpp"
 
@@ -33,8 +36,33 @@
 #include "CrmWakelockServiceAndroid.hpp"
 #endif
 
-CrmWakelockMux::CrmWakelockMux(const char  *name)
+static int64_t getTimeMs()
+{
+    struct timespec ts;
+
+    ASSERT(clock_gettime(CLOCK_BOOTTIME, &ts) == 0);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int getHistogramBucket(int64_t duration)
+{
+    int bucket = 0;
+
+    for (int64_t limit = 10; bucket < CrmWakelockMux::HISTOGRAM_SIZE - 1 && duration >= limit;
+         limit *= 10)
+        bucket++;
+
+    return bucket;
+}
+
+CrmWakelockMux::CrmWakelockMux(const char *name, int nbModules)
+    : _nbModules(nbModules),
+      _modules(new Module[nbModules]()),
+      _total(0),
+      _serviceHeld(false)
 {
+    ASSERT(nbModules > 0);
+
 #ifdef STUB_BUILD
     (void)name;
     _wakelock = new CrmWakelockServiceBase();
@@ -45,85 +73,96 @@ CrmWakelockMux::CrmWakelockMux(const char  *name)
 
 CrmWakelockMux::~CrmWakelockMux()
 {
-    _counterMap.clear();
+    logHistograms();
     delete _wakelock;
 }
 
 bool CrmWakelockMux::isHeld(int moduleId) const
 {
-    bool hold = false;
-    ASSERT(moduleId >= 0);
-
-    CounterMap::const_iterator it = _counterMap.find(moduleId);
-    if (it != _counterMap.end()) {
-        hold = (it->second > 0);
-    }
+    ASSERT(moduleId >= 0 && moduleId < _nbModules);
 
-    return hold;
+    return (_modules[moduleId].state.load() & COUNTER_MASK) > 0;
 }
 
 bool CrmWakelockMux::isHeld() const
 {
-    bool hold = false;
-
-    for (CounterMap::const_iterator it = _counterMap.begin(); it != _counterMap.end(); it++) {
-        if (it->second > 0) {
-            hold = true;
-            break;
-        }
-    }
-
-    return hold;
+    return _total.load() > 0;
 }
 
-void CrmWakelockMux::increaseCounter(int moduleId)
+void CrmWakelockMux::getHistogram(int moduleId, unsigned int histogram[HISTOGRAM_SIZE]) const
 {
-    CounterMap::iterator it = _counterMap.find(moduleId);
+    ASSERT(moduleId >= 0 && moduleId < _nbModules);
+    ASSERT(histogram != NULL);
 
-    if (it != _counterMap.end()) {
-        it->second++;
-    } else {
-        _counterMap.insert(std::pair<int, int>(moduleId, 1));
-    }
+    for (int i = 0; i < HISTOGRAM_SIZE; i++)
+        histogram[i] = _modules[moduleId].histogram[i].load(std::memory_order_relaxed);
 }
 
-void CrmWakelockMux::decreaseCounter(int moduleId)
+void CrmWakelockMux::logHistograms() const
 {
-    CounterMap::iterator it = _counterMap.find(moduleId);
-
-    if (it != _counterMap.end()) {
-        it->second--;
-        ASSERT(it->second >= 0);
-    } else {
-        ASSERT(0);
+    for (int id = 0; id < _nbModules; id++) {
+        unsigned int h[HISTOGRAM_SIZE];
+        getHistogram(id, h);
+        LOGD("module %d hold time: <10ms: %u, <100ms: %u, <1s: %u, <10s: %u, >=10s: %u",
+             id, h[0], h[1], h[2], h[3], h[4]);
     }
 }
 
-void CrmWakelockMux::acquire(int moduleId)
+/**
+ * Aligns the state of the wakelock service with the aggregated counter.
+ * Called by the thread doing a 0 <-> 1 transition of the aggregated counter. As the service state
+ * is only updated with the lock held and according to the current counter value, the last caller
+ * always leaves the service in the right state, whatever the order of the concurrent transitions
+ */
+void CrmWakelockMux::updateService()
 {
-    ASSERT(moduleId >= 0);
+    std::lock_guard<std::mutex> lock(_mutex);
 
-    _mutex.lock();
+    bool toHold = isHeld();
 
-    if (!isHeld()) {
-        _wakelock->acquire();
+    if (toHold != _serviceHeld) {
+        if (toHold)
+            _wakelock->acquire();
+        else
+            _wakelock->release();
+        _serviceHeld = toHold;
     }
+}
 
-    increaseCounter(moduleId);
-
-    _mutex.unlock();
+void CrmWakelockMux::acquire(int moduleId)
+{
+    ASSERT(moduleId >= 0 && moduleId < _nbModules);
+    Module &module = _modules[moduleId];
+
+    /* The hold begin is published with the 0 -> 1 transition of the counter */
+    uint64_t state = module.state.load();
+    uint64_t next;
+    do {
+        uint64_t counter = state & COUNTER_MASK;
+        ASSERT(counter < COUNTER_MASK);
+        if (counter == 0)
+            next = ((uint64_t)getTimeMs() << COUNTER_BITS) | 1;
+        else
+            next = state + 1;
+    } while (!module.state.compare_exchange_weak(state, next));
+
+    if (_total.fetch_add(1) == 0)
+        updateService();
 }
 
 void CrmWakelockMux::release(int moduleId)
 {
-    _mutex.lock();
+    ASSERT(moduleId >= 0 && moduleId < _nbModules);
+    Module &module = _modules[moduleId];
 
-    ASSERT(moduleId >= 0);
-    decreaseCounter(moduleId);
+    uint64_t previous = module.state.fetch_sub(1);
+    ASSERT((previous & COUNTER_MASK) > 0);
 
-    if (!isHeld()) {
-        _wakelock->release();
+    if ((previous & COUNTER_MASK) == 1) {
+        int64_t duration = getTimeMs() - (int64_t)(previous >> COUNTER_BITS);
+        module.histogram[getHistogramBucket(duration)].fetch_add(1, std::memory_order_relaxed);
     }
 
-    _mutex.unlock();
+    if (_total.fetch_sub(1) == 1)
+        updateService();
 }
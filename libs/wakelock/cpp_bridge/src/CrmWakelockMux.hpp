@@ -28,37 +28,45 @@
 #define __CRM_WAKELOCK_CLASS_HEADER__
 
 #include "CrmWakelockServiceBase.hpp"
+#include "utils/wakelock.h"
 
-#include <map>
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <mutex>
 
-typedef std::map<int, int> CounterMap;
-
 class CrmWakelockMux
 {
 public:
+    static const int HISTOGRAM_SIZE = WAKELOCK_HISTOGRAM_SIZE;
 
-    CrmWakelockMux(const char *name);
+    /**
+     * @param [in] name      name of the wakelock
+     * @param [in] nbModules number of modules. Module identifiers are in [0, nbModules[
+     */
+    CrmWakelockMux(const char *name, int nbModules);
     virtual ~CrmWakelockMux();
 
     /**
      * Acquires the wakelock
+     * Lock-free unless the wakelock is not held by any module yet
      *
-     * @param [in] moduleId module identifier (>= 0)
+     * @param [in] moduleId module identifier
      */
     void acquire(int moduleId);
 
     /**
      * Releases the wakelock if all modules have released the wakelock
+     * Wait-free unless this is the last release
      *
-     * @param [in] moduleId module identifier (>= 0)
+     * @param [in] moduleId module identifier
      */
     void release(int moduleId);
 
     /**
      * Checks if wakelock is hold by the module
      *
-     * @param [in] moduleId module identifier (>= 0)
+     * @param [in] moduleId module identifier
      *
      * @return true if wakelock is hold
      */
@@ -71,13 +79,36 @@ public:
      */
     bool isHeld() const;
 
+    /**
+     * Gets the hold time histogram of a module. A hold starts when the module acquires the
+     * wakelock and ends when it has released all its acquisitions
+     *
+     * @param [in] moduleId   module identifier
+     * @param [out] histogram number of holds per bucket
+     */
+    void getHistogram(int moduleId, unsigned int histogram[HISTOGRAM_SIZE]) const;
+
 private:
-    CounterMap  _counterMap;
-    CrmWakelockServiceBase *_wakelock;
+    /* The module counter and the beginning of its current hold are packed in a single atomic
+     * word so that a release always reads the hold begin stored by the 0 -> 1 transition */
+    static const int COUNTER_BITS = 16;
+    static const uint64_t COUNTER_MASK = (1ull << COUNTER_BITS) - 1;
+
+    struct Module {
+        std::atomic<uint64_t> state;
+        std::atomic<unsigned int> histogram[HISTOGRAM_SIZE];
+    };
 
+    int _nbModules;
+    std::unique_ptr<Module[]> _modules;
+    std::atomic<int> _total;
+
+    /* Protects the wakelock service. Only taken when the aggregated state changes */
     std::mutex _mutex;
+    bool _serviceHeld;
+    CrmWakelockServiceBase *_wakelock;
 
-    void increaseCounter(int moduleId);
-    void decreaseCounter(int moduleId);
+    void updateService();
+    void logHistograms() const;
 };
 #endif /** __CRM_WAKELOCK_CLASS_HEADER__ */
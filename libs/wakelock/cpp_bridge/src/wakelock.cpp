@@ -97,6 +97,19 @@ static bool is_held(crm_wakelock_t *ctx)
     return i_ctx->lock->isHeld();
 }
 
+/**
+ * @see wakelock.h
+ */
+static void get_histogram(crm_wakelock_t *ctx, int module_id,
+                          unsigned int histogram[WAKELOCK_HISTOGRAM_SIZE])
+{
+    crm_fw_upload_internal_ctx_t *i_ctx = (crm_fw_upload_internal_ctx_t *)ctx;
+    ASSERT(i_ctx != NULL);
+    ASSERT(i_ctx->lock != NULL);
+
+    i_ctx->lock->getHistogram(module_id, histogram);
+}
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -111,7 +124,7 @@ crm_wakelock_t *crm_wakelock_init(const char *name)
 
     ASSERT(i_ctx != NULL);
 
-    i_ctx->lock = new CrmWakelockMux(name);
+    i_ctx->lock = new CrmWakelockMux(name, WAKELOCK_MODULE_NB);
     ASSERT(i_ctx->lock != NULL);
 
     i_ctx->ctx.dispose = dispose;
@@ -119,6 +132,7 @@ crm_wakelock_t *crm_wakelock_init(const char *name)
     i_ctx->ctx.release = release;
     i_ctx->ctx.is_held = is_held;
     i_ctx->ctx.is_held_by_module = is_held_by_module;
+    i_ctx->ctx.get_histogram = get_histogram;
 
     return &i_ctx->ctx;
 }
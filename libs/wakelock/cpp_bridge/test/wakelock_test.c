@@ -33,6 +33,40 @@
 #include "utils/logs.h"
 
 #include <unistd.h>
+#include <pthread.h>
+
+#define NB_LOOPS 1000
+
+typedef struct {
+    crm_wakelock_t *wakelock;
+    int module_id;
+} module_args_t;
+
+static unsigned int get_holds(crm_wakelock_t *wakelock, int module_id)
+{
+    unsigned int histogram[WAKELOCK_HISTOGRAM_SIZE];
+    unsigned int holds = 0;
+
+    wakelock->get_histogram(wakelock, module_id, histogram);
+    for (int i = 0; i < WAKELOCK_HISTOGRAM_SIZE; i++)
+        holds += histogram[i];
+
+    return holds;
+}
+
+static void *module_thread(void *args)
+{
+    module_args_t *m = (module_args_t *)args;
+
+    for (int i = 0; i < NB_LOOPS; i++) {
+        m->wakelock->acquire(m->wakelock, m->module_id);
+        ASSERT(m->wakelock->is_held_by_module(m->wakelock, m->module_id) == true);
+        ASSERT(m->wakelock->is_held(m->wakelock) == true);
+        m->wakelock->release(m->wakelock, m->module_id);
+    }
+
+    return NULL;
+}
 
 int main()
 {
@@ -68,6 +102,13 @@ int main()
     ASSERT(wakelock->is_held_by_module(wakelock, 1) == false);
     ASSERT(wakelock->is_held(wakelock) == false);
 
+    KLOG("Checking hold time histogram...");
+    unsigned int histogram[WAKELOCK_HISTOGRAM_SIZE];
+    wakelock->get_histogram(wakelock, 0, histogram);
+    ASSERT(histogram[0] == 1);
+    ASSERT(get_holds(wakelock, 0) == 1);
+    ASSERT(get_holds(wakelock, 1) == 0);
+
     KLOG("wakelock acquired by two modules");
     wakelock->acquire(wakelock, 0);
     wakelock->acquire(wakelock, 1);
@@ -81,6 +122,32 @@ int main()
     ASSERT(wakelock->is_held_by_module(wakelock, 1) == true);
     ASSERT(wakelock->is_held(wakelock) == true);
 
+    KLOG("wakelock released by second module");
+    wakelock->release(wakelock, 1);
+    ASSERT(wakelock->is_held(wakelock) == false);
+
+    KLOG("concurrent acquisitions");
+    {
+        pthread_t threads[WAKELOCK_MODULE_NB];
+        module_args_t args[WAKELOCK_MODULE_NB];
+
+        for (int i = 0; i < WAKELOCK_MODULE_NB; i++) {
+            args[i].wakelock = wakelock;
+            args[i].module_id = i;
+            ASSERT(pthread_create(&threads[i], NULL, module_thread, &args[i]) == 0);
+        }
+        for (int i = 0; i < WAKELOCK_MODULE_NB; i++)
+            ASSERT(pthread_join(threads[i], NULL) == 0);
+
+        for (int i = 0; i < WAKELOCK_MODULE_NB; i++)
+            ASSERT(wakelock->is_held_by_module(wakelock, i) == false);
+        ASSERT(wakelock->is_held(wakelock) == false);
+
+        /* Module 0 was held twice before and module 1 once */
+        for (int i = 0; i < WAKELOCK_MODULE_NB; i++)
+            ASSERT(get_holds(wakelock, i) == NB_LOOPS + (i == 0 ? 2 : i == 1 ? 1 : 0));
+    }
+
     KLOG("disposing...");
     wakelock->acquire(wakelock, 0);
     wakelock->acquire(wakelock, 1);
@@ -26,12 +26,16 @@
 
 #include <pthread.h>
 #include <poll.h>
+#include <string.h>
 #include <unistd.h>
 
 #define CRM_MODULE_TAG "WAKE"
 #include "utils/common.h"
 #include "utils/thread.h"
 #include "utils/wakelock.h"
+#include "utils/keys.h"
+#include "utils/property.h"
+#include "utils/time.h"
 
 #include "teljavabridge/tel_java_bridge.h"
 
@@ -45,7 +49,23 @@ typedef struct crm_wakelock_internal_ctx {
     crm_thread_ctx_t *wakelock_thread;
 
     int count[MAX_MODULE];
+    int total;
     pthread_mutex_t lock;
+
+    /* hold time histograms. See get_histogram */
+    struct timespec hold_begin[MAX_MODULE];
+    unsigned int histogram[MAX_MODULE][WAKELOCK_HISTOGRAM_SIZE];
+
+    /* time during which the system wakelock is kept after the last release. 0 to disable */
+    int grace_ms;
+    struct timespec last_release;
+
+    struct {
+        int acquisitions;
+        int bridge_msgs;
+        int saved_msgs;
+        long long held_ms;
+    } stats;
 } crm_fw_upload_internal_ctx_t;
 
 /**
@@ -87,6 +107,34 @@ static bool is_held(crm_wakelock_t *ctx)
     return held;
 }
 
+static int get_histogram_bucket(int duration)
+{
+    int bucket = 0;
+
+    for (int limit = 10; bucket < WAKELOCK_HISTOGRAM_SIZE - 1 && duration >= limit;
+         limit *= 10)
+        bucket++;
+
+    return bucket;
+}
+
+/**
+ * @see wakelock.h
+ */
+static void get_histogram(crm_wakelock_t *ctx, int module_id,
+                          unsigned int histogram[WAKELOCK_HISTOGRAM_SIZE])
+{
+    crm_fw_upload_internal_ctx_t *i_ctx = (crm_fw_upload_internal_ctx_t *)ctx;
+
+    ASSERT(i_ctx);
+    ASSERT(module_id >= 0 && module_id < (int)ARRAY_SIZE(i_ctx->count));
+    ASSERT(histogram);
+
+    ASSERT(pthread_mutex_lock(&i_ctx->lock) == 0);
+    memcpy(histogram, i_ctx->histogram[module_id], sizeof(i_ctx->histogram[module_id]));
+    ASSERT(pthread_mutex_unlock(&i_ctx->lock) == 0);
+}
+
 /**
  * @see wakelock.h
  */
@@ -98,11 +146,18 @@ static void acquire(crm_wakelock_t *ctx, int module_id)
     ASSERT(module_id >= 0 && module_id < (int)ARRAY_SIZE(i_ctx->count));
 
     ASSERT(pthread_mutex_lock(&i_ctx->lock) == 0);
-    i_ctx->count[module_id]++;
+    if (i_ctx->count[module_id]++ == 0)
+        crm_time_add_ms(&i_ctx->hold_begin[module_id], 0);
+    bool notify = ++i_ctx->total == 1;
+    if (notify)
+        i_ctx->stats.acquisitions++;
     ASSERT(pthread_mutex_unlock(&i_ctx->lock) == 0);
 
-    crm_ipc_msg_t msg = { .scalar = 1 };
-    i_ctx->ipc->send_msg(i_ctx->ipc, &msg);
+    /* Only global state changes are of interest for the bridge thread */
+    if (notify) {
+        crm_ipc_msg_t msg = { .scalar = 1 };
+        i_ctx->ipc->send_msg(i_ctx->ipc, &msg);
+    }
 }
 
 /**
@@ -115,13 +170,65 @@ static void release(crm_wakelock_t *ctx, int module_id)
     ASSERT(i_ctx);
     ASSERT(module_id >= 0 && module_id < (int)ARRAY_SIZE(i_ctx->count));
 
+    bool notify = false;
     ASSERT(pthread_mutex_lock(&i_ctx->lock) == 0);
-    if (i_ctx->count[module_id] > 0)
-        i_ctx->count[module_id]--;
+    if (i_ctx->count[module_id] > 0) {
+        if (--i_ctx->count[module_id] == 0) {
+            int duration = crm_time_get_elapsed_ms(&i_ctx->hold_begin[module_id]);
+            i_ctx->histogram[module_id][get_histogram_bucket(duration)]++;
+        }
+        notify = --i_ctx->total == 0;
+        if (notify)
+            crm_time_add_ms(&i_ctx->last_release, 0);
+    }
     ASSERT(pthread_mutex_unlock(&i_ctx->lock) == 0);
 
-    crm_ipc_msg_t msg = { .scalar = 1 };
-    i_ctx->ipc->send_msg(i_ctx->ipc, &msg);
+    if (notify) {
+        crm_ipc_msg_t msg = { .scalar = 1 };
+        i_ctx->ipc->send_msg(i_ctx->ipc, &msg);
+    }
+}
+
+static void log_stats(crm_fw_upload_internal_ctx_t *i_ctx)
+{
+    ASSERT(i_ctx);
+
+    ASSERT(pthread_mutex_lock(&i_ctx->lock) == 0);
+    int acquisitions = i_ctx->stats.acquisitions;
+    ASSERT(pthread_mutex_unlock(&i_ctx->lock) == 0);
+
+    LOGD("[WAKELOCK] stats: %d acquisitions, held %lldms, %d bridge messages, %d saved",
+         acquisitions, i_ctx->stats.held_ms, i_ctx->stats.bridge_msgs, i_ctx->stats.saved_msgs);
+}
+
+/**
+ * Called each time the system wakelock is released (explicitly or by a bridge disconnection)
+ */
+static void system_wakelock_released(crm_fw_upload_internal_ctx_t *i_ctx,
+                                     const struct timespec *held_begin)
+{
+    ASSERT(i_ctx);
+    ASSERT(held_begin);
+
+    i_ctx->stats.held_ms += crm_time_get_elapsed_ms(held_begin);
+    log_stats(i_ctx);
+}
+
+/**
+ * Returns the remaining time of the grace period started by the last release and the number of
+ * acquisitions done so far (if acquisitions is not NULL)
+ */
+static int get_grace_remain_ms(crm_fw_upload_internal_ctx_t *i_ctx, int *acquisitions)
+{
+    ASSERT(i_ctx);
+
+    ASSERT(pthread_mutex_lock(&i_ctx->lock) == 0);
+    int remain = i_ctx->grace_ms - crm_time_get_elapsed_ms(&i_ctx->last_release);
+    if (acquisitions)
+        *acquisitions = i_ctx->stats.acquisitions;
+    ASSERT(pthread_mutex_unlock(&i_ctx->lock) == 0);
+
+    return MAX(remain, 0);
 }
 
 static void *wakelock_thread(crm_thread_ctx_t *thread_ctx, void *args)
@@ -136,9 +243,18 @@ static void *wakelock_thread(crm_thread_ctx_t *thread_ctx, void *args)
     bool wakelock_acquired = false;
     bool to_update = false;
 
+    /* The grace timer relies on CLOCK_BOOTTIME: if the system manages to suspend anyway, the
+     * timer is expired at resume and the wakelock is not held longer than needed */
+    bool grace_pending = false;
+    int grace_acquisitions = 0;
+    struct timespec held_begin;
+
     while (true) {
         if (b_fd < 0) {
+            if (wakelock_acquired)
+                system_wakelock_released(i_ctx, &held_begin);
             wakelock_acquired = false;
+            grace_pending = false;
             if (!i_ctx->bridge->connect(i_ctx->bridge)) {
                 b_fd = i_ctx->bridge->get_poll_fd(i_ctx->bridge);
                 to_update = true;
@@ -149,10 +265,30 @@ static void *wakelock_thread(crm_thread_ctx_t *thread_ctx, void *args)
             to_update = false;
 
             bool acquire = is_held((crm_wakelock_t *)i_ctx);
+            if (wakelock_acquired && i_ctx->grace_ms > 0) {
+                int acquisitions;
+                int remain = get_grace_remain_ms(i_ctx, &acquisitions);
+
+                /* each release/acquire cycle done during the grace period saves two bridge
+                 * messages */
+                if (grace_pending)
+                    i_ctx->stats.saved_msgs += 2 * (acquisitions - grace_acquisitions);
+                grace_acquisitions = acquisitions;
+
+                grace_pending = !acquire && (remain > 0);
+                if (grace_pending)
+                    acquire = true;
+            }
+
             if (acquire != wakelock_acquired) {
                 if (!i_ctx->bridge->wakelock(i_ctx->bridge, acquire)) {
                     LOGV("[WAKELOCK] %s", acquire ? "acquired" : "released");
+                    i_ctx->stats.bridge_msgs++;
                     wakelock_acquired = acquire;
+                    if (acquire)
+                        crm_time_add_ms(&held_begin, 0);
+                    else
+                        system_wakelock_released(i_ctx, &held_begin);
                 } else {
                     i_ctx->bridge->disconnect(i_ctx->bridge);
                     b_fd = -1;
@@ -165,8 +301,16 @@ static void *wakelock_thread(crm_thread_ctx_t *thread_ctx, void *args)
             { .fd = b_fd, .events = POLLIN },
         };
 
-        if (!poll(pfd, ARRAY_SIZE(pfd), (b_fd < 0) ? 500 : -1))
+        int timeout = -1;
+        if (b_fd < 0)
+            timeout = 500;
+        else if (grace_pending)
+            timeout = get_grace_remain_ms(i_ctx, NULL);
+
+        if (!poll(pfd, ARRAY_SIZE(pfd), timeout)) {
+            to_update = grace_pending;
             continue;
+        }
 
         if (pfd[0].revents) {
             crm_ipc_msg_t msg;
@@ -185,6 +329,9 @@ static void *wakelock_thread(crm_thread_ctx_t *thread_ctx, void *args)
         }
     }
 
+    if (wakelock_acquired)
+        system_wakelock_released(i_ctx, &held_begin);
+
     return NULL;
 }
 
@@ -226,9 +373,18 @@ crm_wakelock_t *crm_wakelock_init(const char *name)
     i_ctx->ctx.release = release;
     i_ctx->ctx.is_held = is_held;
     i_ctx->ctx.is_held_by_module = is_held_by_module;
+    i_ctx->ctx.get_histogram = get_histogram;
 
     ASSERT(pthread_mutex_init(&i_ctx->lock, NULL) == 0);
 
+    char value[CRM_PROPERTY_VALUE_MAX];
+    crm_property_get(CRM_KEY_WAKELOCK_GRACE, value, "0");
+    i_ctx->grace_ms = atoi(value);
+    if (i_ctx->grace_ms < 0)
+        i_ctx->grace_ms = 0;
+    if (i_ctx->grace_ms)
+        LOGD("[WAKELOCK] grace period: %dms", i_ctx->grace_ms);
+
     i_ctx->bridge = tel_java_bridge_init();
     i_ctx->ipc = crm_ipc_init(CRM_IPC_THREAD);
     ASSERT(i_ctx->bridge);
@@ -42,6 +42,8 @@
 #include "utils/logs.h"
 #include "utils/thread.h"
 #include "utils/wakelock.h"
+#include "utils/keys.h"
+#include "utils/property.h"
 
 enum {
     EV_CONNECTED = 1,
@@ -149,6 +151,13 @@ static void check_evt(crm_thread_ctx_t *daemon, int evt)
     DASSERT(msg.scalar == evt, "event %lld received while expecting %d", msg.scalar, evt);
 }
 
+static void check_no_evt(crm_thread_ctx_t *daemon, int timeout)
+{
+    struct pollfd pfd = { .fd = daemon->get_poll_fd(daemon), .events = POLLIN };
+
+    ASSERT(poll(&pfd, 1, timeout) == 0);
+}
+
 int main()
 {
     crm_thread_ctx_t *daemon = crm_thread_init(fake_java_daemon, NULL, true, false);
@@ -259,6 +268,30 @@ int main()
     wakelock->dispose(wakelock);
 
     check_evt(daemon, EV_RELEASED);
+
+    KLOG("grace period test");
+    {
+        crm_property_set(CRM_KEY_WAKELOCK_GRACE, "300");
+        wakelock = crm_wakelock_init("test app");
+
+        wakelock->acquire(wakelock, 0);
+        check_evt(daemon, EV_ACQUIRED);
+        for (int i = 0; i < 10; i++) {
+            wakelock->release(wakelock, 0);
+            usleep(10000);
+            wakelock->acquire(wakelock, 0);
+        }
+        wakelock->release(wakelock, 0);
+        ASSERT(wakelock->is_held(wakelock) == false);
+
+        /* released by the bridge only at the end of the grace period */
+        check_no_evt(daemon, 200);
+        check_evt(daemon, EV_RELEASED);
+
+        wakelock->dispose(wakelock);
+        crm_property_set(CRM_KEY_WAKELOCK_GRACE, "0");
+    }
+
     kill(pid, SIGKILL);
     check_evt(daemon, EV_DISCONNECTED);
 
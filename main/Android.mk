@@ -10,6 +10,7 @@ CRM_SRC := $(call all-c-files-under, src)
 
 CRM_SHARED_LIBS_ANDROID_ONLY := libc libdl
 CRM_SHARED_LIBS := libcrm_utils libtcs2
+CRM_STATIC_LIBS := libcrm_mdmcli_wire
 
 CRM_XML_FOLDER := $(LOCAL_PATH)/xml
 
@@ -30,21 +30,43 @@
 #include <string.h>
 #include <signal.h>
 #include <stdio.h>
+#include <poll.h>
 
 #define CRM_MODULE_TAG "MAIN"
 #include "utils/common.h"
+#include "utils/fault.h"
+#include "utils/instance.h"
 #include "utils/logs.h"
 #include "utils/keys.h"
 #include "utils/plugins.h"
 #include "utils/property.h"
+#include "utils/socket.h"
+#include "utils/state.h"
 #include "utils/process_factory.h"
+#include "utils/tcs_snapshot.h"
+#include "utils/thread.h"
 #include "plugins/control.h"
+#include "plugins/mdmcli_wire.h"
 
 #include "libmdmcli/mdm_cli.h"
 #include "libtcs2/tcs.h"
 
+#define MAX_INSTANCES 10
+
+#ifdef HOST_BUILD
+#define TCS_SNAPSHOT "/tmp/crm%d.cfg"
+#else
+#define TCS_XML_FOLDER "/system/vendor/etc/telephony/tcs"
+#define TCS_SNAPSHOT "/data/telephony/crm/crm%d.cfg"
+#endif
+
 crm_process_factory_ctx_t *g_factory = NULL;
 
+typedef struct crm_instance {
+    int inst_id;
+    crm_ctrl_ctx_t *control;
+} crm_instance_t;
+
 static void usage()
 {
     LOGV("CRM Daemon");
@@ -52,6 +74,7 @@ static void usage()
     LOGV("\t-h: Shows this message");
     LOGV("\t-v: Print CRM version");
     LOGV("\t-i: <instance number> Sets the intance number. default: %d", MDM_CLI_DEFAULT_INSTANCE);
+    LOGV("\t-m: <instance number>,<instance number>... Handles several modems in this process");
     exit(-1);
 }
 
@@ -63,9 +86,149 @@ static void sig_handler(int sig)
     exit(-1);
 }
 
+/**
+ * Starts listening on the clients socket of the instance. This is done before loading the
+ * configuration and the plugins: clients can connect while CRM is starting. Their requests are
+ * handled as soon as the client abstraction plugin is started.
+ */
+static void listen_clients(int inst_id)
+{
+    crm_mdmcli_wire_ctx_t *wire = crm_mdmcli_wire_init(CRM_SERVER_TO_CLIENT, inst_id);
+
+    ASSERT(wire);
+
+    const char *socket_name = wire->get_socket_name(wire);
+    errno = 0;
+    if (crm_socket_create(socket_name, CRM_MDMCLI_MAX_CLIENTS) < 0)
+        LOGE("failed to listen on socket (%s) (%s)", socket_name, strerror(errno));
+
+    wire->dispose(wire);
+}
+
+/**
+ * Opens the configuration of the instance. XML files are parsed only if the configuration snapshot
+ * is outdated.
+ */
+static tcs_ctx_t *open_configuration(int inst_id)
+{
+    char name[5];
+    char snapshot[64];
+
+    snprintf(name, sizeof(name), "crm%d", inst_id);
+    snprintf(snapshot, sizeof(snapshot), TCS_SNAPSHOT, inst_id);
+
+#ifdef HOST_BUILD
+    char folder[CRM_PROPERTY_VALUE_MAX];
+    crm_property_get("tcs.dbg.host.hw_folder", folder, "");
+#else
+    const char *folder = TCS_XML_FOLDER;
+#endif
+
+    tcs_ctx_t *tcs = crm_tcs_snapshot_init(name, folder, snapshot);
+    ASSERT(tcs);
+    tcs->print(tcs);
+
+    ASSERT(tcs->select_group(tcs, ".main") == 0);
+
+    return tcs;
+}
+
+/* Must be called once the process factory is started: the store file must not be inherited by
+ * the factory */
+static void open_state_store(int inst_id)
+{
+#ifndef HOST_BUILD
+    /* On host, the state is kept in memory like properties */
+    char state_store[64];
+    snprintf(state_store, sizeof(state_store), CRM_STATE_STORE, inst_id);
+    crm_state_init(state_store, CRM_STATE_SYNC);
+#else
+    (void)inst_id; // UNUSED
+#endif
+}
+
+static crm_ctrl_ctx_t *create_instance(int inst_id, crm_plugin_t *ctrl_plugin,
+                                       crm_process_factory_ctx_t *factory)
+{
+    tcs_ctx_t *tcs = open_configuration(inst_id);
+
+    /* plugin is loaded only once. Its code is shared by all instances */
+    if (!ctrl_plugin->handle)
+        crm_plugin_load(tcs, "control", CRM_CTRL_INIT, ctrl_plugin);
+
+    crm_ctrl_ctx_t *control = ((crm_ctrl_init_t)ctrl_plugin->init)(inst_id, tcs, factory);
+
+    tcs->dispose(tcs);
+
+    return control;
+}
+
+static void *run_instance(crm_thread_ctx_t *thread_ctx, void *arg)
+{
+    crm_instance_t *instance = arg;
+
+    ASSERT(thread_ctx != NULL);
+    ASSERT(instance != NULL);
+
+    /* properties, logs and threads created by this instance use its ID */
+    crm_instance_set(instance->inst_id);
+    instance->control->event_loop(instance->control);
+
+    LOGV("An error happened in instance %d", instance->inst_id);
+    crm_ipc_msg_t msg = { .scalar = instance->inst_id };
+    thread_ctx->send_msg(thread_ctx, &msg);
+
+    return NULL;
+}
+
+/**
+ * Runs several modem instances in this process. Each instance has its own control context (and
+ * thus its own plugin contexts, FSMs, sockets and properties) running in its own thread.
+ * Process factory, plugin code and logging are shared.
+ * If one instance fails, the whole process is stopped to let the system restart it.
+ */
+static void run_instances(const int *inst_ids, int nb)
+{
+    crm_instance_t instances[MAX_INSTANCES];
+    crm_thread_ctx_t *threads[MAX_INSTANCES];
+    struct pollfd pfd[MAX_INSTANCES];
+    crm_plugin_t ctrl_plugin;
+
+    ASSERT(nb > 0 && nb <= MAX_INSTANCES);
+
+    memset(&ctrl_plugin, 0, sizeof(ctrl_plugin));
+
+    crm_process_factory_ctx_t *factory = crm_process_factory_init(nb);
+    ASSERT(factory);
+    g_factory = factory;
+
+    for (int i = 0; i < nb; i++)
+        listen_clients(inst_ids[i]);
+
+    /* contexts are created sequentially: TCS and plugin loading are not thread safe */
+    for (int i = 0; i < nb; i++) {
+        crm_instance_set(inst_ids[i]);
+        open_state_store(inst_ids[i]);
+        instances[i].inst_id = inst_ids[i];
+        instances[i].control = create_instance(inst_ids[i], &ctrl_plugin, factory);
+    }
+
+    for (int i = 0; i < nb; i++) {
+        threads[i] = crm_thread_init(run_instance, &instances[i], true, false);
+        pfd[i] = (struct pollfd){ .fd = threads[i]->get_poll_fd(threads[i]), .events = POLLIN };
+    }
+
+    poll(pfd, nb, -1);
+
+    LOGV("Stopping CRM");
+    factory->dispose(factory);
+}
+
 int main(int argc, char *argv[])
 {
     int inst_id = MDM_CLI_DEFAULT_INSTANCE;
+    int inst_ids[MAX_INSTANCES];
+    int nb_instances = 0;
 
     struct sigaction sa;
 
@@ -86,7 +249,7 @@ int main(int argc, char *argv[])
 
     // End HACK
 
-    while (-1 != (cmd = getopt(argc, argv, "hvi:"))) {
+    while (-1 != (cmd = getopt(argc, argv, "hvi:m:"))) {
         switch (cmd) {
         case 'h':
             usage();
@@ -103,6 +266,19 @@ int main(int argc, char *argv[])
             ASSERT(errno == 0 && end_ptr != optarg);
             break;
         }
+        case 'm': {
+            char *end_ptr = optarg;
+            do {
+                const char *str = (*end_ptr == ',') ? end_ptr + 1 : end_ptr;
+                ASSERT(nb_instances < MAX_INSTANCES);
+                errno = 0;
+                inst_ids[nb_instances++] = strtol(str, &end_ptr, 10);
+                ASSERT(errno == 0 && end_ptr != str);
+            } while (*end_ptr == ',');
+            ASSERT(*end_ptr == '\0');
+            inst_id = inst_ids[0];
+            break;
+        }
         default:
             usage();
         }
@@ -110,22 +286,25 @@ int main(int argc, char *argv[])
 
     crm_logs_init(inst_id);
     crm_property_init(inst_id);
+    crm_fault_init();
 
     LOGD("last commit: \"%s\"", GIT_COMMIT_ID);
 
+    if (nb_instances > 0) {
+        run_instances(inst_ids, nb_instances);
+        return 0;
+    }
+
     /* Process factory MUST be started at the earliest to reduce its memory footprint and
      * avoid file descriptor duplication, etc. */
     crm_process_factory_ctx_t *factory = crm_process_factory_init(1);
     ASSERT(factory);
     g_factory = factory;
 
-    char name[5];
-    snprintf(name, sizeof(name), "crm%d", inst_id);
-    tcs_ctx_t *tcs = tcs2_init(name);
-    ASSERT(tcs);
-    tcs->print(tcs);
+    listen_clients(inst_id);
+    open_state_store(inst_id);
 
-    ASSERT(tcs->select_group(tcs, ".main") == 0);
+    tcs_ctx_t *tcs = open_configuration(inst_id);
 
     crm_plugin_t ctrl_plugin;
     crm_plugin_load(tcs, "control", CRM_CTRL_INIT, &ctrl_plugin);
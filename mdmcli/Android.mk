@@ -15,6 +15,10 @@ CRM_SHARED_LIBS := libcrm_utils
 CRM_STATIC_LIBS := libcrm_mdmcli_wire
 CRM_SHARED_LIBS_HOST_ONLY := libcrm_wakelock_stub
 
+CRM_COPY_HEADERS_TO := telephony/libcrm/mdmcli
+CRM_COPY_HEADERS := inc/mdm_cli_stats.h inc/mdm_cli_batch.h inc/mdm_cli_sync.h \
+                    inc/mdm_cli_state.h inc/mdm_cli_options.h
+
 CRM_TARGET := $(BUILD_SHARED_LIBRARY)
 include $(LOCAL_PATH)/../makefiles/crm_c_make.mk
 
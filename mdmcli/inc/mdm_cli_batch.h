@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CRM_MDMCLI_BATCH_HEADER__
+#define __CRM_MDMCLI_BATCH_HEADER__
+
+#include "libmdmcli/mdm_cli.h"
+#include "mdm_cli_options.h"
+
+/* Maximum number of events provided in a single batch callback invocation */
+#define MDM_CLI_BATCH_MAX 16
+
+/**
+ * Callback used to notify several events at once.
+ * Important note: evts array is only valid during the callback invocation.
+ *
+ * @param [in] evts    Events, in reception order. context is the one provided at registration
+ * @param [in] nb_evts Number of events
+ * @param [in] context Context provided to mdm_cli_connect_batch
+ */
+typedef void (*mdm_cli_batch_callback_t)(const mdm_cli_callback_data_t *evts, int nb_evts,
+                                         void *context);
+
+/**
+ * Connects to CRM in batch mode. Same as mdm_cli_connect except that events queued by CRM are
+ * provided to the client in a single invocation of the batch callback. This reduces the per event
+ * cost for clients receiving a high rate of events.
+ *
+ * MDM_COLD_RESET, MDM_SHUTDOWN and MDM_DBG_INFO events are not batched: they are provided through
+ * the callback given at registration, in the same order as other events. For other events, the
+ * registration callback is not used and can be NULL.
+ *
+ * @param [in] client_name Name of the client
+ * @param [in] inst_id     CRM instance
+ * @param [in] nb_evts     Number of events in evts array
+ * @param [in] evts        Events to register
+ * @param [in] options     Bitmap of MDM_CLI_OPT_* values. See mdm_cli_options.h
+ * @param [in] callback    Batch callback
+ * @param [in] context     Context provided to the batch callback
+ *
+ * @return a valid handle in case of success. Must be freed by calling mdm_cli_disconnect
+ * @return NULL in case of error
+ */
+mdm_cli_hdle_t *mdm_cli_connect_batch(const char *client_name, int inst_id,
+                                      int nb_evts, const mdm_cli_register_t evts[],
+                                      unsigned int options, mdm_cli_batch_callback_t callback,
+                                      void *context);
+
+#endif /* __CRM_MDMCLI_BATCH_HEADER__ */
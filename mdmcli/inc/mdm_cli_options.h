@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CRM_MDMCLI_OPTIONS_HEADER__
+#define __CRM_MDMCLI_OPTIONS_HEADER__
+
+#include "libmdmcli/mdm_cli.h"
+
+/* Connection options */
+
+/* The client accepts modem state coalescing: when modem states change in a row (e.g. during a
+ * recovery), CRM can skip the transient states and only notify the latest one. Events requiring
+ * an ACK and debug events are always notified */
+#define MDM_CLI_OPT_COALESCE (1u << 0)
+
+/**
+ * Connects to CRM with options. Same as mdm_cli_connect otherwise.
+ *
+ * @param [in] client_name Name of the client
+ * @param [in] inst_id     CRM instance
+ * @param [in] nb_evts     Number of events in evts array
+ * @param [in] evts        Events to register
+ * @param [in] options     Bitmap of MDM_CLI_OPT_* values
+ *
+ * @return a valid handle in case of success. Must be freed by calling mdm_cli_disconnect
+ * @return NULL in case of error
+ */
+mdm_cli_hdle_t *mdm_cli_connect_opt(const char *client_name, int inst_id,
+                                    int nb_evts, const mdm_cli_register_t evts[],
+                                    unsigned int options);
+
+#endif /* __CRM_MDMCLI_OPTIONS_HEADER__ */
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CRM_MDMCLI_STATE_HEADER__
+#define __CRM_MDMCLI_STATE_HEADER__
+
+#include <stdint.h>
+
+#include "libmdmcli/mdm_cli.h"
+
+typedef void mdm_cli_state_hdle_t;
+
+/**
+ * Modem state published by CRM in a shared memory page. This is the state notified to clients by
+ * MDM_DOWN, MDM_ON, MDM_UP and MDM_OOS events.
+ */
+typedef struct mdm_cli_state {
+    mdm_cli_event_t state; // MDM_DOWN, MDM_ON, MDM_UP or MDM_OOS
+    uint32_t sequence;     // incremented on each state change and on each CRM start
+    int64_t timestamp;     // CLOCK_BOOTTIME of the last state change, in ms
+    int64_t crm_start;     // CLOCK_BOOTTIME of CRM start, in ms
+} mdm_cli_state_t;
+
+/**
+ * Maps the modem state page of a CRM instance. No connection with CRM is needed.
+ * The page stays valid across CRM restarts.
+ *
+ * @param [in] inst_id Instance ID of CRM
+ *
+ * @return a valid handle. Must be freed by calling mdm_cli_state_close
+ * @return NULL if CRM did not publish the page yet
+ */
+mdm_cli_state_hdle_t *mdm_cli_state_open(int inst_id);
+
+/**
+ * Reads the current modem state. This function is lock-free, does not do any system call and can
+ * be called from any thread, including mdmcli callbacks.
+ *
+ * Note: if CRM is killed, MDM_DOWN is reported once CRM misses its heartbeat (a few seconds).
+ *
+ * @param [in] hdle   Handle provided by mdm_cli_state_open
+ * @param [out] state Current modem state
+ *
+ * @return 0 in case of success
+ * @return -1 if the page is being updated. The call can be retried
+ */
+int mdm_cli_get_state(const mdm_cli_state_hdle_t *hdle, mdm_cli_state_t *state);
+
+/**
+ * Unmaps the modem state page.
+ *
+ * @param [in] hdle Handle provided by mdm_cli_state_open
+ */
+void mdm_cli_state_close(mdm_cli_state_hdle_t *hdle);
+
+#endif /* __CRM_MDMCLI_STATE_HEADER__ */
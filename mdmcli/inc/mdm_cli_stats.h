@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CRM_MDMCLI_STATS_HEADER__
+#define __CRM_MDMCLI_STATS_HEADER__
+
+#include "libmdmcli/mdm_cli.h"
+
+typedef struct mdm_cli_reconnect_stats {
+    int nb_disconnections;   // number of times the connection with CRM was lost
+    int nb_reconnections;    // number of successful reconnections
+    int nb_attempts;         // number of connection attempts
+    int last_latency;        // in ms, time between the last disconnection and the reconnection
+    int max_latency;         // in ms
+    long long total_latency; // in ms, sum of all reconnection latencies
+} mdm_cli_reconnect_stats_t;
+
+/**
+ * Gets the reconnection statistics of the client.
+ *
+ * When the connection with CRM is lost (e.g. CRM restart), the library reconnects as soon as the
+ * CRM socket is created again. If the connection fails, it is retried with an exponential backoff.
+ *
+ * @param [in] hdle   Handle provided by mdm_cli_connect
+ * @param [out] stats Reconnection statistics
+ *
+ * @return 0 in case of success
+ */
+int mdm_cli_get_reconnect_stats(mdm_cli_hdle_t *hdle, mdm_cli_reconnect_stats_t *stats);
+
+#endif /* __CRM_MDMCLI_STATS_HEADER__ */
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CRM_MDMCLI_SYNC_HEADER__
+#define __CRM_MDMCLI_SYNC_HEADER__
+
+#include "libmdmcli/mdm_cli.h"
+
+/**
+ * Completion of a request.
+ *
+ * A request is completed by CRM once its effect is visible to the clients:
+ *  - acquire: modem is up
+ *  - release: modem is off or still used by other clients
+ *  - restart / nvm_bckup: modem is up again
+ *  - shutdown: modem is off
+ */
+typedef struct mdm_cli_req_result {
+    int status;     // 0 if request is completed. -1 if rejected by CRM, failed or connection lost
+    int crm_time;   // in ms, time spent by CRM to complete the request. -1 if connection lost
+    int total_time; // in ms, time between the request sending and its completion
+} mdm_cli_req_result_t;
+
+/**
+ * Callback used to notify the completion of a request.
+ * It is called from the mdmcli thread, like event callbacks.
+ *
+ * @param [in] result  Completion of the request
+ * @param [in] context Context provided with the request
+ */
+typedef void (*mdm_cli_req_callback_t)(const mdm_cli_req_result_t *result, void *context);
+
+/**
+ * Blocking variants of the requests. The function returns when CRM completes the request or when
+ * the deadline is reached. These functions must not be called from an mdmcli callback.
+ *
+ * @param [in] hdle    Handle provided by mdm_cli_connect
+ * @param [in] timeout Deadline, in ms
+ * @param [out] result Completion of the request. Can be NULL
+ *
+ * @return 0 if request is completed. result->status must be checked
+ * @return -1 if request can't be sent or if deadline is reached (errno is set to ETIMEDOUT). If the
+ *         deadline is reached, CRM still handles the request
+ */
+int mdm_cli_acquire_sync(mdm_cli_hdle_t *hdle, int timeout, mdm_cli_req_result_t *result);
+int mdm_cli_release_sync(mdm_cli_hdle_t *hdle, int timeout, mdm_cli_req_result_t *result);
+int mdm_cli_restart_sync(mdm_cli_hdle_t *hdle, mdm_cli_restart_cause_t cause,
+                         const mdm_cli_dbg_info_t *data, int timeout,
+                         mdm_cli_req_result_t *result);
+int mdm_cli_shutdown_sync(mdm_cli_hdle_t *hdle, int timeout, mdm_cli_req_result_t *result);
+int mdm_cli_nvm_bckup_sync(mdm_cli_hdle_t *hdle, int timeout, mdm_cli_req_result_t *result);
+
+/**
+ * Asynchronous variants of the requests. The callback is called when CRM completes the request or
+ * when the connection with CRM is lost.
+ *
+ * @param [in] hdle     Handle provided by mdm_cli_connect
+ * @param [in] callback Completion callback
+ * @param [in] context  Context provided to the callback
+ *
+ * @return 0 if request is sent. The callback will be called
+ * @return -1 if request can't be sent
+ */
+int mdm_cli_acquire_async(mdm_cli_hdle_t *hdle, mdm_cli_req_callback_t callback, void *context);
+int mdm_cli_release_async(mdm_cli_hdle_t *hdle, mdm_cli_req_callback_t callback, void *context);
+int mdm_cli_restart_async(mdm_cli_hdle_t *hdle, mdm_cli_restart_cause_t cause,
+                          const mdm_cli_dbg_info_t *data, mdm_cli_req_callback_t callback,
+                          void *context);
+int mdm_cli_shutdown_async(mdm_cli_hdle_t *hdle, mdm_cli_req_callback_t callback, void *context);
+int mdm_cli_nvm_bckup_async(mdm_cli_hdle_t *hdle, mdm_cli_req_callback_t callback, void *context);
+
+#endif /* __CRM_MDMCLI_SYNC_HEADER__ */
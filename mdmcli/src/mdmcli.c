@@ -31,10 +31,17 @@
 #include <unistd.h>
 #include <poll.h>
 #include <pthread.h>
+#include <stdint.h>
+#include <time.h>
 
 #include <utils/Log.h>
 
 #include "libmdmcli/mdm_cli.h"
+#include "mdm_cli_stats.h"
+#include "mdm_cli_batch.h"
+#include "mdm_cli_options.h"
+#include "mdm_cli_sync.h"
+#include "mdm_cli_state.h"
 
 #define CRM_MODULE_TAG "CLI"
 #include "utils/debug.h"
@@ -46,8 +53,15 @@
 #include "utils/time.h"
 #include "utils/property.h"
 #include "utils/socket.h"
+#include "plugins/mdmcli_state.h"
 #include "plugins/mdmcli_wire.h"
 
+/* Reconnection backoff, in ms. Used if CRM socket creation is not detected or if CRM does not
+ * accept connections yet */
+#define RECONNECT_MIN 20
+#define RECONNECT_MAX 1000
+#define RECONNECT_MAX_SANITY 10000 // Sanity tests take some time. Don't need to retry too often...
+
 #define CLIENT_FORMAT "%-16s"
 #define MSG_EVT_FORMAT "%-15s"
 
@@ -56,11 +70,31 @@
 #define CLOGV(ctx, format, ...) LOGV("[" CLIENT_FORMAT "] " format, ctx->name, ## __VA_ARGS__)
 #define CLOGI(ctx, format, ...) LOGI("[" CLIENT_FORMAT "] " format, ctx->name, ## __VA_ARGS__)
 
+typedef struct sync_waiter {
+    bool done;
+    mdm_cli_req_result_t result;
+} sync_waiter_t;
+
+/* How the completion of a request is reported: either by a callback or by waking up a waiter */
+typedef struct req_completion {
+    mdm_cli_req_callback_t callback;
+    void *context;
+    sync_waiter_t *waiter;
+} req_completion_t;
+
+typedef struct pending_req {
+    int corr_id; // 0 if slot is free
+    struct timespec start;
+    req_completion_t completion;
+} pending_req_t;
+
 typedef struct crm_mdm_cli_ctx {
-    int nb_evts;
-    mdm_cli_register_t *evts;
+    mdm_cli_register_t evts[MDM_NUM_EVENTS]; // indexed by event id. callback is NULL if not registered
     int events_bitmap;
 
+    mdm_cli_batch_callback_t batch_callback;
+    void *batch_context;
+
     crm_mdmcli_wire_ctx_t *wire;
     crm_ipc_ctx_t *ipc;
     crm_thread_ctx_t *thread;
@@ -68,6 +102,7 @@ typedef struct crm_mdm_cli_ctx {
     int sock_fd;
 
     pthread_mutex_t lock;
+    pthread_cond_t cond; // signaled when a blocking request is completed
 
     char *name;
 
@@ -75,6 +110,18 @@ typedef struct crm_mdm_cli_ctx {
     bool disconnect;
     bool acquired;
     int register_id;
+
+    /* reconnection */
+    int watch_fd;
+    int backoff;
+    unsigned int seed;
+    struct timespec retry_end;
+    struct timespec disconnect_time;
+    mdm_cli_reconnect_stats_t stats;
+
+    /* requests waiting for completion */
+    int last_corr_id;
+    pending_req_t pending[CRM_MDMCLI_MAX_PENDING];
 } crm_mdm_cli_ctx_t;
 
 static void dispose(crm_mdm_cli_ctx_t *ctx)
@@ -84,24 +131,166 @@ static void dispose(crm_mdm_cli_ctx_t *ctx)
     if (ctx->ipc)
         ctx->ipc->dispose(ctx->ipc, NULL);
     pthread_mutex_destroy(&ctx->lock);
+    pthread_cond_destroy(&ctx->cond);
     ctx->wire->dispose(ctx->wire);
     if (ctx->sock_fd >= 0)
         close(ctx->sock_fd);
+    if (ctx->watch_fd >= 0)
+        close(ctx->watch_fd);
     free(ctx->name);
-    free(ctx->evts);
     free(ctx);
 }
 
+static bool is_sanity_client(crm_mdm_cli_ctx_t *ctx)
+{
+    return crm_is_in_sanity_test_mode() && ctx->register_id == CRM_REQ_REGISTER;
+}
+
+/* Schedules next connection attempt. A random jitter is added to avoid all clients connecting at
+ * the same time */
+static void schedule_reconnect(crm_mdm_cli_ctx_t *ctx)
+{
+    int delay = ctx->backoff / 2 + rand_r(&ctx->seed) % (ctx->backoff / 2 + 1);
+
+    crm_time_add_ms(&ctx->retry_end, delay);
+    ctx->backoff = MIN(2 * ctx->backoff, is_sanity_client(ctx) ? RECONNECT_MAX_SANITY :
+                       RECONNECT_MAX);
+}
+
+/* Events needing an acknowledgment are never batched as the callback return value is needed. Debug
+ * events are not batched either as their data is only valid until next message reception */
+static bool is_batchable(int id)
+{
+    return id != MDM_COLD_RESET && id != MDM_SHUTDOWN && id != MDM_DBG_INFO;
+}
+
+static bool is_registered(crm_mdm_cli_ctx_t *ctx, int id)
+{
+    return id >= 0 && id < MDM_NUM_EVENTS && (ctx->events_bitmap & (1 << id));
+}
+
+static int notify_event(crm_mdm_cli_ctx_t *ctx, int id, const mdm_cli_dbg_info_t *debug)
+{
+    mdm_cli_callback_data_t data = { .id = id, .context = ctx->evts[id].context };
+
+    if (debug) {
+        data.data_size = sizeof(*debug);
+        data.data = (void *)debug;
+    }
+
+    if (ctx->batch_callback && is_batchable(id)) {
+        ctx->batch_callback(&data, 1, ctx->batch_context);
+        return 0;
+    } else {
+        return ctx->evts[id].callback(&data);
+    }
+}
+
+/* Sends a request. If completion is provided, a correlation id is given to the request so that CRM
+ * reports its completion. Must be called with lock held */
+static int send_request(crm_mdm_cli_ctx_t *ctx, crm_mdmcli_wire_msg_t *msg,
+                        const req_completion_t *completion)
+{
+    pending_req_t *req = NULL;
+
+    if (completion) {
+        for (int i = 0; i < CRM_MDMCLI_MAX_PENDING && !req; i++)
+            if (ctx->pending[i].corr_id == 0)
+                req = &ctx->pending[i];
+        if (!req) {
+            CLOGE(ctx, "too many requests waiting for completion");
+            return -1;
+        }
+
+        if (++ctx->last_corr_id > CRM_MDMCLI_CORR_ID_MAX)
+            ctx->last_corr_id = 1;
+        msg->corr_id = ctx->last_corr_id;
+        req->corr_id = msg->corr_id;
+        req->completion = *completion;
+        clock_gettime(CLOCK_BOOTTIME, &req->start);
+    }
+
+    int ret = ctx->wire->send_msg(ctx->wire, msg, ctx->sock_fd);
+    if (ret) {
+        CLOGE(ctx, "failed to send message");
+        if (req)
+            req->corr_id = 0;
+    }
+
+    return ret;
+}
+
+/* Must be called with lock held. Returns the callback to call once the lock is released */
+static req_completion_t complete_request(crm_mdm_cli_ctx_t *ctx, pending_req_t *req,
+                                         mdm_cli_req_result_t *result)
+{
+    req_completion_t completion = req->completion;
+
+    result->total_time = crm_time_get_elapsed_ms(&req->start);
+    req->corr_id = 0;
+    if (completion.waiter) {
+        completion.waiter->result = *result;
+        completion.waiter->done = true;
+        ASSERT(pthread_cond_broadcast(&ctx->cond) == 0);
+        completion.callback = NULL;
+    }
+
+    return completion;
+}
+
+static void handle_response(crm_mdm_cli_ctx_t *ctx, const crm_mdmcli_wire_msg_t *msg)
+{
+    mdm_cli_req_result_t result = { .status = msg->msg.response.status,
+                                    .crm_time = msg->msg.response.crm_time };
+    req_completion_t completion = { .callback = NULL };
+    bool found = false;
+
+    ASSERT(pthread_mutex_lock(&ctx->lock) == 0);
+    for (int i = 0; i < CRM_MDMCLI_MAX_PENDING; i++) {
+        if (ctx->pending[i].corr_id == msg->corr_id) {
+            completion = complete_request(ctx, &ctx->pending[i], &result);
+            found = true;
+            break;
+        }
+    }
+    ASSERT(pthread_mutex_unlock(&ctx->lock) == 0);
+
+    if (!found)
+        CLOGD(ctx, "completion of request #%d ignored (deadline reached)", msg->corr_id);
+    else if (completion.callback)
+        completion.callback(&result, completion.context);
+}
+
+/* Connection with CRM is lost: pending requests won't be completed */
+static void fail_pending_requests(crm_mdm_cli_ctx_t *ctx)
+{
+    for (int i = 0; i < CRM_MDMCLI_MAX_PENDING; i++) {
+        mdm_cli_req_result_t result = { .status = -1, .crm_time = -1 };
+        req_completion_t completion = { .callback = NULL };
+
+        ASSERT(pthread_mutex_lock(&ctx->lock) == 0);
+        if (ctx->pending[i].corr_id != 0)
+            completion = complete_request(ctx, &ctx->pending[i], &result);
+        ASSERT(pthread_mutex_unlock(&ctx->lock) == 0);
+
+        if (completion.callback)
+            completion.callback(&result, completion.context);
+    }
+}
+
 static void reconnect(crm_mdm_cli_ctx_t *ctx)
 {
     ASSERT(ctx != NULL);
     ASSERT(ctx->reconnect);
 
+    ASSERT(pthread_mutex_lock(&ctx->lock) == 0);
+    ctx->stats.nb_attempts++;
+    ASSERT(pthread_mutex_unlock(&ctx->lock) == 0);
+
     ctx->sock_fd = crm_socket_connect(ctx->wire->get_socket_name(ctx->wire));
     if (ctx->sock_fd >= 0) {
         ASSERT(pthread_mutex_lock(&ctx->lock) == 0);
-        crm_mdmcli_wire_msg_t msg;
-        msg.id = ctx->register_id;
+        crm_mdmcli_wire_msg_t msg = { .id = ctx->register_id };
         msg.msg.register_client.events_bitmap = ctx->events_bitmap;
         msg.msg.register_client.name = ctx->name;
         CLOGD(ctx, "=> " MSG_EVT_FORMAT "(0x%08x,'%s')", "REGISTER*", ctx->events_bitmap,
@@ -127,10 +316,22 @@ error:
             close(ctx->sock_fd);
             ctx->sock_fd = -1;
         } else {
-            CLOGD(ctx, "reconnected to CRM server");
+            int latency = crm_time_get_elapsed_ms(&ctx->disconnect_time);
+            ctx->stats.nb_reconnections++;
+            ctx->stats.last_latency = latency;
+            ctx->stats.max_latency = MAX(ctx->stats.max_latency, latency);
+            ctx->stats.total_latency += latency;
+            CLOGD(ctx, "reconnected to CRM server in %dms", latency);
         }
         ASSERT(pthread_mutex_unlock(&ctx->lock) == 0);
     }
+
+    if (ctx->reconnect) {
+        schedule_reconnect(ctx);
+    } else if (ctx->watch_fd >= 0) {
+        close(ctx->watch_fd);
+        ctx->watch_fd = -1;
+    }
 }
 
 static void handle_error(crm_mdm_cli_ctx_t *ctx)
@@ -141,32 +342,36 @@ static void handle_error(crm_mdm_cli_ctx_t *ctx)
     close(ctx->sock_fd);
     ctx->sock_fd = -1;
     ctx->reconnect = true;
+    ctx->stats.nb_disconnections++;
     ASSERT(pthread_mutex_unlock(&ctx->lock) == 0);
 
-    for (int i = 0; i < ctx->nb_evts; i++) {
-        if (ctx->evts[i].id == MDM_DOWN) {
-            CLOGD(ctx, "<= " MSG_EVT_FORMAT "()", "MDM_DOWN*");
-            mdm_cli_callback_data_t data = { .id = MDM_DOWN,
-                                             .context = ctx->evts[i].context };
-            ctx->evts[i].callback(&data);
-            break;
-        }
+    /* Reconnection is done as soon as CRM socket is created again. The backoff timer is only a
+     * fallback */
+    clock_gettime(CLOCK_BOOTTIME, &ctx->disconnect_time);
+    ctx->backoff = is_sanity_client(ctx) ? RECONNECT_MAX_SANITY : RECONNECT_MIN;
+    if (ctx->watch_fd < 0)
+        ctx->watch_fd = crm_socket_watch_init(ctx->wire->get_socket_name(ctx->wire));
+    if (ctx->watch_fd < 0)
+        CLOGE(ctx, "failed to watch CRM socket. Reconnection relies on timer only");
+    schedule_reconnect(ctx);
+
+    fail_pending_requests(ctx);
+
+    if (is_registered(ctx, MDM_DOWN)) {
+        CLOGD(ctx, "<= " MSG_EVT_FORMAT "()", "MDM_DOWN*");
+        notify_event(ctx, MDM_DOWN, NULL);
     }
-    for (int i = 0; i < ctx->nb_evts; i++) {
-        if (ctx->evts[i].id == MDM_COLD_RESET) {
-            CLOGD(ctx, "<= " MSG_EVT_FORMAT "()", "MDM_COLD_RESET*");
-            mdm_cli_callback_data_t data = { .id = MDM_COLD_RESET,
-                                             .context = ctx->evts[i].context };
-            ctx->evts[i].callback(&data);
-            break;
-        }
+    if (is_registered(ctx, MDM_COLD_RESET)) {
+        CLOGD(ctx, "<= " MSG_EVT_FORMAT "()", "MDM_COLD_RESET*");
+        notify_event(ctx, MDM_COLD_RESET, NULL);
     }
 
     if (!crm_is_in_sanity_test_mode() || ctx->register_id == CRM_REQ_REGISTER_DBG)
         reconnect(ctx);
 }
 
-static int mdm_cli_send_simple_msg(mdm_cli_hdle_t *hdle, int message)
+static int mdm_cli_send_simple_msg(mdm_cli_hdle_t *hdle, int message,
+                                   const req_completion_t *completion)
 {
     crm_mdm_cli_ctx_t *ctx = hdle;
 
@@ -178,15 +383,193 @@ static int mdm_cli_send_simple_msg(mdm_cli_hdle_t *hdle, int message)
     CLOGD(ctx, "=> " MSG_EVT_FORMAT "()%s", crm_mdmcli_wire_req_to_string(msg.id),
           ctx->reconnect ? " [ignored]" : "");
     int ret;
-    if (ctx->reconnect) {
+    if (ctx->reconnect)
         ret = -1;
+    else
+        ret = send_request(ctx, &msg, completion);
+    ASSERT(pthread_mutex_unlock(&ctx->lock) == 0);
+
+    return ret;
+}
+
+static int mdm_cli_send_acquire(mdm_cli_hdle_t *hdle, bool acquire,
+                                const req_completion_t *completion)
+{
+    crm_mdm_cli_ctx_t *ctx = hdle;
+
+    ASSERT(ctx != NULL);
+    ASSERT(ctx->wire != NULL);
+
+    ASSERT(pthread_mutex_lock(&ctx->lock) == 0);
+    crm_mdmcli_wire_msg_t msg = { .id = acquire ? CRM_REQ_ACQUIRE : CRM_REQ_RELEASE };
+    CLOGD(ctx, "=> " MSG_EVT_FORMAT "()", crm_mdmcli_wire_req_to_string(msg.id));
+    int ret;
+    /* Without completion, the request is sent again at reconnection */
+    if (ctx->reconnect)
+        ret = completion ? -1 : 0;
+    else
+        ret = send_request(ctx, &msg, completion);
+    if (ret == 0)
+        ctx->acquired = acquire;
+    ASSERT(pthread_mutex_unlock(&ctx->lock) == 0);
+
+    return ret;
+}
+
+static int mdm_cli_send_restart(mdm_cli_hdle_t *hdle, mdm_cli_restart_cause_t cause,
+                                const mdm_cli_dbg_info_t *data, const req_completion_t *completion)
+{
+    crm_mdm_cli_ctx_t *ctx = hdle;
+
+    ASSERT(ctx != NULL);
+    ASSERT(ctx->wire != NULL);
+
+    ASSERT(pthread_mutex_lock(&ctx->lock) == 0);
+    crm_mdmcli_wire_msg_t msg = { .id = CRM_REQ_RESTART };
+    msg.msg.restart.cause = cause;
+    msg.msg.restart.debug = data;
+    if (data) {
+        CLOGD(ctx, "=> " MSG_EVT_FORMAT "(%s,%s,ApLogsSize:%dMB,BpLogsSize:%dMB"
+              ",BpLogsTime:%ds,%zd)",
+              crm_mdmcli_wire_req_to_string(msg.id), crm_mdmcli_restart_cause_to_string(cause),
+              crm_mdmcli_dbg_type_to_string(data->type), data->ap_logs_size, data->bp_logs_size,
+              data->bp_logs_time, data->nb_data);
     } else {
-        ret = ctx->wire->send_msg(ctx->wire, &msg, ctx->sock_fd);
-        if (ret)
-            CLOGE(ctx, "failed to send message");
+        CLOGD(ctx, "=> " MSG_EVT_FORMAT "(%s,<nil>)", crm_mdmcli_wire_req_to_string(msg.id),
+              crm_mdmcli_restart_cause_to_string(cause));
+    }
+    int ret;
+    if (ctx->reconnect)
+        ret = -1;
+    else
+        ret = send_request(ctx, &msg, completion);
+    ASSERT(pthread_mutex_unlock(&ctx->lock) == 0);
+
+    return ret;
+}
+
+/* Waits for the completion of a blocking request */
+static int wait_completion(mdm_cli_hdle_t *hdle, sync_waiter_t *waiter, int timeout,
+                           mdm_cli_req_result_t *result)
+{
+    crm_mdm_cli_ctx_t *ctx = hdle;
+    struct timespec end;
+
+    crm_time_add_ms(&end, timeout);
+
+    ASSERT(pthread_mutex_lock(&ctx->lock) == 0);
+    while (!waiter->done) {
+        int remain = crm_time_get_remain_ms(&end);
+        if (remain == 0)
+            break;
+
+        /* The condition uses the monotonic clock. Deadline is computed on the boot time clock */
+        struct timespec abs_time;
+        ASSERT(clock_gettime(CLOCK_MONOTONIC, &abs_time) == 0);
+        abs_time.tv_sec += remain / 1000;
+        abs_time.tv_nsec += (remain % 1000) * 1000000;
+        if (abs_time.tv_nsec >= 1000000000) {
+            abs_time.tv_sec += 1;
+            abs_time.tv_nsec -= 1000000000;
+        }
+        int err = pthread_cond_timedwait(&ctx->cond, &ctx->lock, &abs_time);
+        ASSERT(err == 0 || err == ETIMEDOUT);
+    }
+
+    if (!waiter->done) {
+        for (int i = 0; i < CRM_MDMCLI_MAX_PENDING; i++) {
+            if (ctx->pending[i].corr_id != 0 && ctx->pending[i].completion.waiter == waiter) {
+                CLOGE(ctx, "request #%d not completed in %dms", ctx->pending[i].corr_id,
+                      timeout);
+                /* CRM forgets the request too: its pending slot is freed */
+                crm_mdmcli_wire_msg_t msg = { .id = CRM_REQ_CANCEL,
+                                              .corr_id = ctx->pending[i].corr_id };
+                if (!ctx->reconnect && ctx->wire->send_msg(ctx->wire, &msg, ctx->sock_fd))
+                    CLOGE(ctx, "failed to send message");
+                ctx->pending[i].corr_id = 0;
+            }
+        }
     }
     ASSERT(pthread_mutex_unlock(&ctx->lock) == 0);
 
+    if (!waiter->done) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+
+    if (result)
+        *result = waiter->result;
+    return 0;
+}
+
+static bool has_pending_msg(crm_mdm_cli_ctx_t *ctx)
+{
+    struct pollfd pfd = { .fd = ctx->sock_fd, .events = POLLIN };
+
+    return poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN);
+}
+
+/* Reads and dispatches messages received on the server socket. In batch mode, all messages already
+ * queued on the socket are read and consecutive batchable events are provided to the client in a
+ * single callback invocation.
+ *
+ * @return false in case of socket error */
+static bool handle_server_msgs(crm_mdm_cli_ctx_t *ctx)
+{
+    mdm_cli_callback_data_t batch[MDM_CLI_BATCH_MAX];
+    int nb_batch = 0;
+    bool ret = true;
+
+    do {
+        crm_mdmcli_wire_msg_t *msg = ctx->wire->recv_msg(ctx->wire, ctx->sock_fd);
+        if (msg == NULL) {
+            CLOGE(ctx, "error retrieving message from server socket");
+            ret = false;
+            break;
+        }
+
+        if (msg->id == MDM_DBG_INFO) {
+            CLOGD(ctx, "<= " MSG_EVT_FORMAT "(%s,ApLogsSize:%dMB,BpLogsSize:%dMB,"
+                  "BpLogsTime:%ds,%zd)", crm_mdmcli_wire_req_to_string(msg->id),
+                  crm_mdmcli_dbg_type_to_string(msg->msg.debug->type),
+                  msg->msg.debug->ap_logs_size, msg->msg.debug->bp_logs_size,
+                  msg->msg.debug->bp_logs_time, msg->msg.debug->nb_data);
+        } else if (msg->id != CRM_RSP_DONE) {
+            CLOGD(ctx, "<= " MSG_EVT_FORMAT "()", crm_mdmcli_wire_req_to_string(msg->id));
+        }
+        if (msg->id == CRM_RSP_DONE) {
+            CLOGD(ctx, "<= " MSG_EVT_FORMAT "(#%d,%d,%dms)", crm_mdmcli_wire_req_to_string(msg->id),
+                  msg->corr_id, msg->msg.response.status, msg->msg.response.crm_time);
+            handle_response(ctx, msg);
+            continue;
+        }
+        ASSERT(is_registered(ctx, msg->id));
+
+        if (ctx->batch_callback && is_batchable(msg->id)) {
+            batch[nb_batch].id = msg->id;
+            batch[nb_batch].context = ctx->evts[msg->id].context;
+            batch[nb_batch].data_size = 0;
+            batch[nb_batch].data = NULL;
+            nb_batch++;
+        } else {
+            /* Order of events is kept: pending batch is flushed first */
+            if (nb_batch > 0) {
+                ctx->batch_callback(batch, nb_batch, ctx->batch_context);
+                nb_batch = 0;
+            }
+
+            int id = msg->id;
+            int cb_ret = notify_event(ctx, id, id == MDM_DBG_INFO ? msg->msg.debug : NULL);
+            if (id == MDM_COLD_RESET && cb_ret == 0)
+                mdm_cli_send_simple_msg(ctx, CRM_REQ_ACK_COLD_RESET, NULL);
+            else if (id == MDM_SHUTDOWN && cb_ret == 0)
+                mdm_cli_send_simple_msg(ctx, CRM_REQ_ACK_SHUTDOWN, NULL);
+        }
+    } while (ctx->batch_callback && nb_batch < MDM_CLI_BATCH_MAX && has_pending_msg(ctx));
+
+    if (nb_batch > 0)
+        ctx->batch_callback(batch, nb_batch, ctx->batch_context);
+
     return ret;
 }
 
@@ -200,26 +583,15 @@ static void *mdmcli_event_loop(crm_thread_ctx_t *thread_ctx, void *ctx_)
     int thread_fd = ctx->ipc->get_poll_fd(ctx->ipc);
 
     while (true) {
+        /* While reconnecting, the CRM socket watch is polled instead of the server socket */
         struct pollfd pfd[2] = { { .fd = thread_fd, .events = POLLIN },
-                                 { .fd = ctx->sock_fd, .events = POLLIN } };
-        int timeout = -1;
-        int num_fds = 2;
+                                 { .fd = ctx->reconnect ? ctx->watch_fd : ctx->sock_fd,
+                                   .events = POLLIN } };
 
-        if (ctx->reconnect) {
-            if (crm_is_in_sanity_test_mode() && ctx->register_id == CRM_REQ_REGISTER)
-                timeout = 10000; // Sanity tests take some time. Don't need to retry too often...
-            else
-                timeout = 1000;
-            num_fds = 1;
-        }
-
-        struct timespec timer_end;
-        if (timeout > 0)
-            crm_time_add_ms(&timer_end, timeout);
         errno = 0;
         int ret = 0;
         do
-            ret = poll(pfd, num_fds, timeout > 0 ? crm_time_get_remain_ms(&timer_end) : -1);
+            ret = poll(pfd, 2, ctx->reconnect ? crm_time_get_remain_ms(&ctx->retry_end) : -1);
         while ((ret < 0) && (errno == EINTR));
 
         if (ret < 0) {
@@ -241,50 +613,21 @@ static void *mdmcli_event_loop(crm_thread_ctx_t *thread_ctx, void *ctx_)
             } else if (pfd[0].revents & POLLIN) {
                 break;
             }
-            /* Handle events on server socket */
-            if (pfd[1].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+            if (ctx->reconnect) {
+                /* Handle events on CRM socket watch */
+                if ((pfd[1].revents & POLLIN) &&
+                    crm_socket_watch_check(ctx->watch_fd, ctx->wire->get_socket_name(ctx->wire))) {
+                    CLOGD(ctx, "CRM socket created");
+                    ctx->backoff = RECONNECT_MIN;
+                    reconnect(ctx);
+                }
+            } else if (pfd[1].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                /* Handle events on server socket */
                 CLOGE(ctx, "error on server communication socket");
                 handle_error(ctx);
             } else if (pfd[1].revents & POLLIN) {
-                crm_mdmcli_wire_msg_t *msg;
-
-                msg = ctx->wire->recv_msg(ctx->wire, ctx->sock_fd);
-                if (msg == NULL) {
-                    CLOGE(ctx, "error retrieving message from server socket");
+                if (!handle_server_msgs(ctx))
                     handle_error(ctx);
-                } else {
-                    int i;
-                    if (msg->id == MDM_DBG_INFO) {
-                        CLOGD(ctx, "<= " MSG_EVT_FORMAT "(%s,ApLogsSize:%dMB,BpLogsSize:%dMB,"
-                              "BpLogsTime:%ds,%zd)", crm_mdmcli_wire_req_to_string(msg->id),
-                              crm_mdmcli_dbg_type_to_string(msg->msg.debug->type),
-                              msg->msg.debug->ap_logs_size, msg->msg.debug->bp_logs_size,
-                              msg->msg.debug->bp_logs_time, msg->msg.debug->nb_data);
-                    } else {
-                        CLOGD(ctx, "<= " MSG_EVT_FORMAT "()",
-                              crm_mdmcli_wire_req_to_string(msg->id));
-                    }
-                    for (i = 0; i < ctx->nb_evts; i++) {
-                        /**
-                         * @TODO: understand why I need this (int) cast !
-                         */
-                        if ((int)ctx->evts[i].id == msg->id) {
-                            mdm_cli_callback_data_t data = { .id = msg->id,
-                                                             .context = ctx->evts[i].context };
-                            if (msg->id == MDM_DBG_INFO) {
-                                data.data_size = sizeof(*msg->msg.debug);
-                                data.data = (void *)msg->msg.debug;
-                            }
-                            int ret = ctx->evts[i].callback(&data);
-                            if (msg->id == MDM_COLD_RESET && ret == 0)
-                                mdm_cli_send_simple_msg(ctx, CRM_REQ_ACK_COLD_RESET);
-                            else if (msg->id == MDM_SHUTDOWN && ret == 0)
-                                mdm_cli_send_simple_msg(ctx, CRM_REQ_ACK_SHUTDOWN);
-                            break;
-                        }
-                    }
-                    ASSERT(i < ctx->nb_evts);
-                }
             }
         }
     }
@@ -294,7 +637,8 @@ static void *mdmcli_event_loop(crm_thread_ctx_t *thread_ctx, void *ctx_)
 
 static mdm_cli_hdle_t *crm_connect(const char *client_name, int inst_id,
                                    int nb_evts, const mdm_cli_register_t evts[],
-                                   crm_mdmcli_wire_req_ids_t request)
+                                   crm_mdmcli_wire_req_ids_t request, unsigned int options,
+                                   mdm_cli_batch_callback_t batch_callback, void *batch_context)
 {
     crm_mdm_cli_ctx_t *ctx = NULL;
     mdm_cli_hdle_t *ret = NULL;
@@ -303,12 +647,20 @@ static mdm_cli_hdle_t *crm_connect(const char *client_name, int inst_id,
     ASSERT(nb_evts <= MDM_NUM_EVENTS && nb_evts >= 0);
     ASSERT(nb_evts == 0 || evts != NULL);
     ASSERT(request == CRM_REQ_REGISTER || request == CRM_REQ_REGISTER_DBG);
+    ASSERT((options & ~MDM_CLI_OPT_COALESCE) == 0);
 
     ctx = calloc(1, sizeof(*ctx));
     ASSERT(ctx != NULL);
     ctx->sock_fd = -1;
+    ctx->watch_fd = -1;
+    ctx->seed = getpid() ^ (unsigned int)(uintptr_t)ctx;
 
     ASSERT(pthread_mutex_init(&ctx->lock, NULL) == 0);
+    pthread_condattr_t attr;
+    ASSERT(pthread_condattr_init(&attr) == 0);
+    ASSERT(pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) == 0);
+    ASSERT(pthread_cond_init(&ctx->cond, &attr) == 0);
+    pthread_condattr_destroy(&attr);
     ctx->name = strdup(client_name);
     ASSERT(ctx->name != NULL);
 
@@ -318,20 +670,21 @@ static mdm_cli_hdle_t *crm_connect(const char *client_name, int inst_id,
     ASSERT(ctx->wire);
 
     ctx->register_id = request;
+    ctx->batch_callback = batch_callback;
+    ctx->batch_context = batch_context;
 
+    /* Callbacks are stored in a table indexed by event id to get them directly at dispatch time */
     int events_bitmap = 0;
-    ctx->nb_evts = nb_evts;
-    if (nb_evts > 0) {
-        ctx->evts = malloc(nb_evts * sizeof(ctx->evts[0]));
-        ASSERT(ctx->evts != NULL);
-        for (int i = 0; i < nb_evts; i++) {
-            int event_bit = 1 << evts[i].id;
-            ASSERT((event_bit & events_bitmap) == 0);
-            ASSERT(evts[i].callback != NULL);
-            ctx->evts[i] = evts[i];
-            events_bitmap |= event_bit;
-        }
+    for (int i = 0; i < nb_evts; i++) {
+        ASSERT((int)evts[i].id >= 0 && evts[i].id < MDM_NUM_EVENTS);
+        int event_bit = 1 << evts[i].id;
+        ASSERT((event_bit & events_bitmap) == 0);
+        ASSERT(evts[i].callback != NULL || (batch_callback && is_batchable(evts[i].id)));
+        ctx->evts[evts[i].id] = evts[i];
+        events_bitmap |= event_bit;
     }
+    if (options & MDM_CLI_OPT_COALESCE)
+        events_bitmap |= CRM_MDMCLI_REGISTER_COALESCE;
     ctx->events_bitmap = events_bitmap;
 
     ctx->sock_fd = crm_socket_connect(ctx->wire->get_socket_name(ctx->wire));
@@ -345,8 +698,7 @@ static mdm_cli_hdle_t *crm_connect(const char *client_name, int inst_id,
     ctx->thread = crm_thread_init(mdmcli_event_loop, ctx, false, false);
     ASSERT(ctx->thread != NULL);
 
-    crm_mdmcli_wire_msg_t msg;
-    msg.id = request;
+    crm_mdmcli_wire_msg_t msg = { .id = request };
     msg.msg.register_client.events_bitmap = events_bitmap;
     msg.msg.register_client.name = client_name;
     CLOGD(ctx, "=> " MSG_EVT_FORMAT "(0x%08x,'%s')",
@@ -369,7 +721,32 @@ exit:
 mdm_cli_hdle_t *mdm_cli_connect(const char *client_name, int inst_id,
                                 int nb_evts, const mdm_cli_register_t evts[])
 {
-    return crm_connect(client_name, inst_id, nb_evts, evts, CRM_REQ_REGISTER);
+    return crm_connect(client_name, inst_id, nb_evts, evts, CRM_REQ_REGISTER, 0, NULL, NULL);
+}
+
+/*
+ * @see mdm_cli_options.h
+ */
+mdm_cli_hdle_t *mdm_cli_connect_opt(const char *client_name, int inst_id,
+                                    int nb_evts, const mdm_cli_register_t evts[],
+                                    unsigned int options)
+{
+    return crm_connect(client_name, inst_id, nb_evts, evts, CRM_REQ_REGISTER, options, NULL,
+                       NULL);
+}
+
+/*
+ * @see mdm_cli_batch.h
+ */
+mdm_cli_hdle_t *mdm_cli_connect_batch(const char *client_name, int inst_id,
+                                      int nb_evts, const mdm_cli_register_t evts[],
+                                      unsigned int options, mdm_cli_batch_callback_t callback,
+                                      void *context)
+{
+    ASSERT(callback != NULL);
+
+    return crm_connect(client_name, inst_id, nb_evts, evts, CRM_REQ_REGISTER, options, callback,
+                       context);
 }
 
 /**
@@ -382,7 +759,7 @@ mdm_cli_hdle_t *mdm_cli_connect(const char *client_name, int inst_id,
 mdm_cli_hdle_t *mdm_cli_connect_dbg(const char *client_name, int inst_id,
                                     int nb_evts, const mdm_cli_register_t evts[])
 {
-    return crm_connect(client_name, inst_id, nb_evts, evts, CRM_REQ_REGISTER_DBG);
+    return crm_connect(client_name, inst_id, nb_evts, evts, CRM_REQ_REGISTER_DBG, 0, NULL, NULL);
 }
 
 /*
@@ -412,26 +789,7 @@ int mdm_cli_disconnect(mdm_cli_hdle_t *hdle)
  */
 int mdm_cli_acquire(mdm_cli_hdle_t *hdle)
 {
-    crm_mdm_cli_ctx_t *ctx = hdle;
-
-    ASSERT(ctx != NULL);
-    ASSERT(ctx->wire != NULL);
-
-    ASSERT(pthread_mutex_lock(&ctx->lock) == 0);
-    crm_mdmcli_wire_msg_t msg = { .id = CRM_REQ_ACQUIRE };
-    CLOGD(ctx, "=> " MSG_EVT_FORMAT "()", crm_mdmcli_wire_req_to_string(msg.id));
-    int ret;
-    if (ctx->reconnect)
-        ret = 0;
-    else
-        ret = ctx->wire->send_msg(ctx->wire, &msg, ctx->sock_fd);
-    if (ret == 0)
-        ctx->acquired = true;
-    else
-        CLOGE(ctx, "failed to send message");
-    ASSERT(pthread_mutex_unlock(&ctx->lock) == 0);
-
-    return ret;
+    return mdm_cli_send_acquire(hdle, true, NULL);
 }
 
 /*
@@ -439,26 +797,7 @@ int mdm_cli_acquire(mdm_cli_hdle_t *hdle)
  */
 int mdm_cli_release(mdm_cli_hdle_t *hdle)
 {
-    crm_mdm_cli_ctx_t *ctx = hdle;
-
-    ASSERT(ctx != NULL);
-    ASSERT(ctx->wire != NULL);
-
-    ASSERT(pthread_mutex_lock(&ctx->lock) == 0);
-    crm_mdmcli_wire_msg_t msg = { .id = CRM_REQ_RELEASE };
-    CLOGD(ctx, "=> " MSG_EVT_FORMAT "()", crm_mdmcli_wire_req_to_string(msg.id));
-    int ret;
-    if (ctx->reconnect)
-        ret = 0;
-    else
-        ret = ctx->wire->send_msg(ctx->wire, &msg, ctx->sock_fd);
-    if (ret == 0)
-        ctx->acquired = false;
-    else
-        CLOGE(ctx, "failed to send message");
-    ASSERT(pthread_mutex_unlock(&ctx->lock) == 0);
-
-    return ret;
+    return mdm_cli_send_acquire(hdle, false, NULL);
 }
 
 /*
@@ -467,37 +806,7 @@ int mdm_cli_release(mdm_cli_hdle_t *hdle)
 int mdm_cli_restart(mdm_cli_hdle_t *hdle, mdm_cli_restart_cause_t cause,
                     const mdm_cli_dbg_info_t *data)
 {
-    crm_mdm_cli_ctx_t *ctx = hdle;
-
-    ASSERT(ctx != NULL);
-    ASSERT(ctx->wire != NULL);
-
-    ASSERT(pthread_mutex_lock(&ctx->lock) == 0);
-    crm_mdmcli_wire_msg_t msg;
-    msg.id = CRM_REQ_RESTART;
-    msg.msg.restart.cause = cause;
-    msg.msg.restart.debug = data;
-    if (data) {
-        CLOGD(ctx, "=> " MSG_EVT_FORMAT "(%s,%s,ApLogsSize:%dMB,BpLogsSize:%dMB"
-              ",BpLogsTime:%ds,%zd)",
-              crm_mdmcli_wire_req_to_string(msg.id), crm_mdmcli_restart_cause_to_string(cause),
-              crm_mdmcli_dbg_type_to_string(data->type), data->ap_logs_size, data->bp_logs_size,
-              data->bp_logs_time, data->nb_data);
-    } else {
-        CLOGD(ctx, "=> " MSG_EVT_FORMAT "(%s,<nil>)", crm_mdmcli_wire_req_to_string(msg.id),
-              crm_mdmcli_restart_cause_to_string(cause));
-    }
-    int ret;
-    if (ctx->reconnect) {
-        ret = -1;
-    } else {
-        ret = ctx->wire->send_msg(ctx->wire, &msg, ctx->sock_fd);
-        if (ret)
-            CLOGE(ctx, "failed to send message");
-    }
-    ASSERT(pthread_mutex_unlock(&ctx->lock) == 0);
-
-    return ret;
+    return mdm_cli_send_restart(hdle, cause, data, NULL);
 }
 
 /*
@@ -505,7 +814,7 @@ int mdm_cli_restart(mdm_cli_hdle_t *hdle, mdm_cli_restart_cause_t cause,
  */
 int mdm_cli_shutdown(mdm_cli_hdle_t *hdle)
 {
-    return mdm_cli_send_simple_msg(hdle, CRM_REQ_SHUTDOWN);
+    return mdm_cli_send_simple_msg(hdle, CRM_REQ_SHUTDOWN, NULL);
 }
 
 /*
@@ -513,7 +822,7 @@ int mdm_cli_shutdown(mdm_cli_hdle_t *hdle)
  */
 int mdm_cli_nvm_bckup(mdm_cli_hdle_t *hdle)
 {
-    return mdm_cli_send_simple_msg(hdle, CRM_REQ_NVM_BACKUP);
+    return mdm_cli_send_simple_msg(hdle, CRM_REQ_NVM_BACKUP, NULL);
 }
 
 /*
@@ -521,7 +830,7 @@ int mdm_cli_nvm_bckup(mdm_cli_hdle_t *hdle)
  */
 int mdm_cli_ack_cold_reset(mdm_cli_hdle_t *hdle)
 {
-    return mdm_cli_send_simple_msg(hdle, CRM_REQ_ACK_COLD_RESET);
+    return mdm_cli_send_simple_msg(hdle, CRM_REQ_ACK_COLD_RESET, NULL);
 }
 
 /*
@@ -529,7 +838,7 @@ int mdm_cli_ack_cold_reset(mdm_cli_hdle_t *hdle)
  */
 int mdm_cli_ack_shutdown(mdm_cli_hdle_t *hdle)
 {
-    return mdm_cli_send_simple_msg(hdle, CRM_REQ_ACK_SHUTDOWN);
+    return mdm_cli_send_simple_msg(hdle, CRM_REQ_ACK_SHUTDOWN, NULL);
 }
 
 /*
@@ -543,8 +852,7 @@ int mdm_cli_notify_dbg(mdm_cli_hdle_t *hdle, const mdm_cli_dbg_info_t *data)
     ASSERT(ctx->wire != NULL);
 
     ASSERT(pthread_mutex_lock(&ctx->lock) == 0);
-    crm_mdmcli_wire_msg_t msg;
-    msg.id = CRM_REQ_NOTIFY_DBG;
+    crm_mdmcli_wire_msg_t msg = { .id = CRM_REQ_NOTIFY_DBG };
     msg.msg.debug = data;
     if (data)
         CLOGD(ctx, "=> " MSG_EVT_FORMAT "(%s,ApLogsSize:%dMB,BpLogsSize:%dMB,BpLogsTime:%ds,%zd)",
@@ -554,14 +862,193 @@ int mdm_cli_notify_dbg(mdm_cli_hdle_t *hdle, const mdm_cli_dbg_info_t *data)
         CLOGD(ctx, "=> " MSG_EVT_FORMAT "(<nil>)", crm_mdmcli_wire_req_to_string(msg.id));
 
     int ret;
-    if (ctx->reconnect) {
+    if (ctx->reconnect)
         ret = -1;
-    } else {
-        ret = ctx->wire->send_msg(ctx->wire, &msg, ctx->sock_fd);
-        if (ret)
-            CLOGE(ctx, "failed to send message");
-    }
+    else
+        ret = send_request(ctx, &msg, NULL);
     ASSERT(pthread_mutex_unlock(&ctx->lock) == 0);
 
     return ret;
 }
+
+/*
+ * @see mdm_cli_stats.h
+ */
+int mdm_cli_get_reconnect_stats(mdm_cli_hdle_t *hdle, mdm_cli_reconnect_stats_t *stats)
+{
+    crm_mdm_cli_ctx_t *ctx = hdle;
+
+    ASSERT(ctx != NULL);
+    ASSERT(stats != NULL);
+
+    ASSERT(pthread_mutex_lock(&ctx->lock) == 0);
+    *stats = ctx->stats;
+    ASSERT(pthread_mutex_unlock(&ctx->lock) == 0);
+
+    return 0;
+}
+
+/*
+ * @see mdm_cli_sync.h
+ */
+int mdm_cli_acquire_sync(mdm_cli_hdle_t *hdle, int timeout, mdm_cli_req_result_t *result)
+{
+    sync_waiter_t waiter = { .done = false };
+    req_completion_t completion = { .waiter = &waiter };
+
+    if (mdm_cli_send_acquire(hdle, true, &completion))
+        return -1;
+    return wait_completion(hdle, &waiter, timeout, result);
+}
+
+/*
+ * @see mdm_cli_sync.h
+ */
+int mdm_cli_release_sync(mdm_cli_hdle_t *hdle, int timeout, mdm_cli_req_result_t *result)
+{
+    sync_waiter_t waiter = { .done = false };
+    req_completion_t completion = { .waiter = &waiter };
+
+    if (mdm_cli_send_acquire(hdle, false, &completion))
+        return -1;
+    return wait_completion(hdle, &waiter, timeout, result);
+}
+
+/*
+ * @see mdm_cli_sync.h
+ */
+int mdm_cli_restart_sync(mdm_cli_hdle_t *hdle, mdm_cli_restart_cause_t cause,
+                         const mdm_cli_dbg_info_t *data, int timeout,
+                         mdm_cli_req_result_t *result)
+{
+    sync_waiter_t waiter = { .done = false };
+    req_completion_t completion = { .waiter = &waiter };
+
+    if (mdm_cli_send_restart(hdle, cause, data, &completion))
+        return -1;
+    return wait_completion(hdle, &waiter, timeout, result);
+}
+
+/*
+ * @see mdm_cli_sync.h
+ */
+int mdm_cli_shutdown_sync(mdm_cli_hdle_t *hdle, int timeout, mdm_cli_req_result_t *result)
+{
+    sync_waiter_t waiter = { .done = false };
+    req_completion_t completion = { .waiter = &waiter };
+
+    if (mdm_cli_send_simple_msg(hdle, CRM_REQ_SHUTDOWN, &completion))
+        return -1;
+    return wait_completion(hdle, &waiter, timeout, result);
+}
+
+/*
+ * @see mdm_cli_sync.h
+ */
+int mdm_cli_nvm_bckup_sync(mdm_cli_hdle_t *hdle, int timeout, mdm_cli_req_result_t *result)
+{
+    sync_waiter_t waiter = { .done = false };
+    req_completion_t completion = { .waiter = &waiter };
+
+    if (mdm_cli_send_simple_msg(hdle, CRM_REQ_NVM_BACKUP, &completion))
+        return -1;
+    return wait_completion(hdle, &waiter, timeout, result);
+}
+
+/*
+ * @see mdm_cli_sync.h
+ */
+int mdm_cli_acquire_async(mdm_cli_hdle_t *hdle, mdm_cli_req_callback_t callback, void *context)
+{
+    ASSERT(callback != NULL);
+    req_completion_t completion = { .callback = callback, .context = context };
+
+    return mdm_cli_send_acquire(hdle, true, &completion);
+}
+
+/*
+ * @see mdm_cli_sync.h
+ */
+int mdm_cli_release_async(mdm_cli_hdle_t *hdle, mdm_cli_req_callback_t callback, void *context)
+{
+    ASSERT(callback != NULL);
+    req_completion_t completion = { .callback = callback, .context = context };
+
+    return mdm_cli_send_acquire(hdle, false, &completion);
+}
+
+/*
+ * @see mdm_cli_sync.h
+ */
+int mdm_cli_restart_async(mdm_cli_hdle_t *hdle, mdm_cli_restart_cause_t cause,
+                          const mdm_cli_dbg_info_t *data, mdm_cli_req_callback_t callback,
+                          void *context)
+{
+    ASSERT(callback != NULL);
+    req_completion_t completion = { .callback = callback, .context = context };
+
+    return mdm_cli_send_restart(hdle, cause, data, &completion);
+}
+
+/*
+ * @see mdm_cli_sync.h
+ */
+int mdm_cli_shutdown_async(mdm_cli_hdle_t *hdle, mdm_cli_req_callback_t callback, void *context)
+{
+    ASSERT(callback != NULL);
+    req_completion_t completion = { .callback = callback, .context = context };
+
+    return mdm_cli_send_simple_msg(hdle, CRM_REQ_SHUTDOWN, &completion);
+}
+
+/*
+ * @see mdm_cli_sync.h
+ */
+int mdm_cli_nvm_bckup_async(mdm_cli_hdle_t *hdle, mdm_cli_req_callback_t callback, void *context)
+{
+    ASSERT(callback != NULL);
+    req_completion_t completion = { .callback = callback, .context = context };
+
+    return mdm_cli_send_simple_msg(hdle, CRM_REQ_NVM_BACKUP, &completion);
+}
+
+/*
+ * @see mdm_cli_state.h
+ */
+mdm_cli_state_hdle_t *mdm_cli_state_open(int inst_id)
+{
+    return crm_mdmcli_state_init(false, inst_id);
+}
+
+/*
+ * @see mdm_cli_state.h
+ */
+int mdm_cli_get_state(const mdm_cli_state_hdle_t *hdle, mdm_cli_state_t *state)
+{
+    const crm_mdmcli_state_ctx_t *state_ctx = hdle;
+    crm_mdmcli_state_t page;
+
+    ASSERT(state_ctx != NULL);
+    ASSERT(state != NULL);
+
+    if (state_ctx->read(state_ctx, &page))
+        return -1;
+
+    state->state = page.state;
+    state->sequence = page.sequence;
+    state->timestamp = page.timestamp;
+    state->crm_start = page.crm_start;
+
+    return 0;
+}
+
+/*
+ * @see mdm_cli_state.h
+ */
+void mdm_cli_state_close(mdm_cli_state_hdle_t *hdle)
+{
+    crm_mdmcli_state_ctx_t *state_ctx = hdle;
+
+    ASSERT(state_ctx != NULL);
+    state_ctx->dispose(state_ctx);
+}
@@ -33,12 +33,19 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <poll.h>
+#include <pthread.h>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
 #include "libmdmcli/mdm_cli.h"
+#include "mdm_cli_stats.h"
+#include "mdm_cli_batch.h"
+#include "mdm_cli_sync.h"
+#include "mdm_cli_state.h"
+#include "mdm_cli_options.h"
 
 #define CRM_MODULE_TAG "TEST_CLIENT"
 #include "utils/common.h"
@@ -47,6 +54,7 @@
 #include "utils/property.h"
 #include "utils/thread.h"
 #include "utils/time.h"
+#include "plugins/mdmcli_state.h"
 #include "plugins/mdmcli_wire.h"
 
 /* Note: this is needed as long as we do not use the "real" client library that loads the server
@@ -340,8 +348,8 @@ void *server_thread_stress(crm_thread_ctx_t *ctx, void *data)
         }
     }
 
-    close(client_fd);
     close(sock_fd);
+    close(client_fd);
     wire_ctx->dispose(wire_ctx);
 
     return NULL;
@@ -400,13 +408,117 @@ void *server_thread(crm_thread_ctx_t *ctx, void *data)
         }
     }
 
+    /* Listening socket is closed first so that the client can't reconnect to this server */
+    close(sock_fd);
+    close(client_fd);
+    wire_ctx->dispose(wire_ctx);
+
+    return NULL;
+}
+
+/* Events sent in a row by the batch server. MDM_COLD_RESET is not batched */
+static const int batch_evts[] = { MDM_DOWN, MDM_ON, MDM_COLD_RESET, MDM_UP, MDM_OOS, MDM_UP };
+#define NB_BATCH_EVTS ((int)ARRAY_SIZE(batch_evts))
+
+int batch_received[NB_BATCH_EVTS];
+int nb_batch_received;
+int nb_batch_calls;
+
+void *server_thread_batch(crm_thread_ctx_t *ctx, void *data)
+{
+    int sock_fd = *(int *)data;
+
+    free(data);
+    int client_fd = accept(sock_fd, 0, 0);
+
+    for (int i = 0; i < NB_BATCH_EVTS; i++) {
+        crm_mdmcli_wire_msg_t w_msg = { .id = batch_evts[i] };
+        ASSERT(wire_ctx->send_msg(wire_ctx, &w_msg, client_fd) == 0);
+    }
+
+    while (1) {
+        struct pollfd pfd[2] = { { .fd = ctx->get_poll_fd(ctx), .events = POLLIN },
+                                 { .fd = client_fd, .events = POLLIN } };
+
+        ASSERT(poll(pfd, 2, 15000) > 0);
+        if (pfd[0].revents)
+            break;
+        if (pfd[1].revents & (POLLERR | POLLHUP | POLLNVAL))
+            break;
+        if (pfd[1].revents & POLLIN) {
+            crm_mdmcli_wire_msg_t *msg = wire_ctx->recv_msg(wire_ctx, client_fd);
+            if (msg == NULL)
+                break;
+            LOGD("message received [batch]: %-15s()", crm_mdmcli_wire_req_to_string(msg->id));
+        }
+    }
+
+    close(sock_fd);
     close(client_fd);
+    wire_ctx->dispose(wire_ctx);
+
+    return NULL;
+}
+
+static int cancelled_corr_id = 0;
+static int registered_bitmap = 0;
+
+/* Completes requests in 5ms of 'CRM time'. Shutdown requests are never completed */
+void *server_thread_sync(crm_thread_ctx_t *ctx, void *data)
+{
+    int sock_fd = *(int *)data;
+
+    free(data);
+    int client_fd = accept(sock_fd, 0, 0);
+
+    while (1) {
+        struct pollfd pfd[2] = { { .fd = ctx->get_poll_fd(ctx), .events = POLLIN },
+                                 { .fd = client_fd, .events = POLLIN } };
+
+        ASSERT(poll(pfd, 2, 15000) > 0);
+        if (pfd[0].revents)
+            break;
+        if (pfd[1].revents & (POLLERR | POLLHUP | POLLNVAL))
+            break;
+        if (pfd[1].revents & POLLIN) {
+            crm_mdmcli_wire_msg_t *msg = wire_ctx->recv_msg(wire_ctx, client_fd);
+            if (msg == NULL)
+                break;
+            LOGD("message received [sync]: %-15s(#%d)", crm_mdmcli_wire_req_to_string(msg->id),
+                 msg->corr_id);
+            if (msg->id == CRM_REQ_REGISTER) {
+                registered_bitmap = msg->msg.register_client.events_bitmap;
+            } else if (msg->id == CRM_REQ_CANCEL) {
+                cancelled_corr_id = msg->corr_id;
+            } else if (msg->corr_id != 0 && msg->id != CRM_REQ_SHUTDOWN) {
+                crm_mdmcli_wire_msg_t rsp = { .id = CRM_RSP_DONE, .corr_id = msg->corr_id };
+                rsp.msg.response.status = msg->id == CRM_REQ_RESTART ? -1 : 0;
+                rsp.msg.response.crm_time = 5;
+                ASSERT(wire_ctx->send_msg(wire_ctx, &rsp, client_fd) == 0);
+            }
+        }
+    }
+
     close(sock_fd);
+    close(client_fd);
     wire_ctx->dispose(wire_ctx);
 
     return NULL;
 }
 
+#define NB_STATE_UPDATES 200000
+
+/* Alternates MDM_ON and MDM_UP: an odd number of updates means MDM_ON */
+void *state_writer(void *data)
+{
+    crm_mdmcli_state_ctx_t *state_ctx = data;
+
+    for (int i = 0; i < NB_STATE_UPDATES; i++)
+        state_ctx->publish(state_ctx, i % 2 ? MDM_UP : MDM_ON);
+
+    return NULL;
+}
+
 void start_server(void *(*server_func)(crm_thread_ctx_t *, void *))
 {
     int sock_fd = socket(AF_UNIX, SOCK_STREAM, 0);
@@ -570,6 +682,52 @@ int dbg_callback_dbg(const mdm_cli_callback_data_t *cb_data)
     return 0;
 }
 
+static void batch_event_received(int id)
+{
+    ASSERT(nb_batch_received < NB_BATCH_EVTS);
+    batch_received[nb_batch_received++] = id;
+    if (nb_batch_received == NB_BATCH_EVTS) {
+        crm_ipc_msg_t msg = { .scalar = nb_batch_calls };
+        ipc_ctx->send_msg(ipc_ctx, &msg);
+    }
+}
+
+void dbg_callback_batch(const mdm_cli_callback_data_t *evts, int nb_evts, void *context)
+{
+    ASSERT(context == (void *)0xba7c);
+    ASSERT(nb_evts > 0 && nb_evts <= MDM_CLI_BATCH_MAX);
+    LOGD("batch of %d event(s) received", nb_evts);
+
+    /* Slows down first invocation so that following events are queued */
+    if (nb_batch_calls++ == 0)
+        usleep(250000);
+
+    for (int i = 0; i < nb_evts; i++) {
+        ASSERT(evts[i].context == (void *)(uintptr_t)evts[i].id);
+        ASSERT(evts[i].data_size == 0);
+        ASSERT(evts[i].data == NULL);
+        batch_event_received(evts[i].id);
+    }
+}
+
+int dbg_callback_batch_ack(const mdm_cli_callback_data_t *cb_data)
+{
+    ASSERT(cb_data->id == MDM_COLD_RESET);
+    ASSERT(cb_data->context == (void *)(uintptr_t)MDM_COLD_RESET);
+    nb_batch_calls++;
+    batch_event_received(cb_data->id);
+    return 0;
+}
+
+void req_callback(const mdm_cli_req_result_t *result, void *context)
+{
+    crm_ipc_msg_t msg = { .scalar = result->status };
+
+    ASSERT(context == (void *)0xacac);
+    ASSERT(result->status == 0 ? result->crm_time == 5 : result->crm_time == -1);
+    ipc_ctx->send_msg(ipc_ctx, &msg);
+}
+
 int dbg_callback_stress(const mdm_cli_callback_data_t *cb_data)
 {
     LOGD("modem status received: %-15s()", crm_mdmcli_wire_req_to_string(cb_data->id));
@@ -713,6 +871,14 @@ int main(void)
     ASSERT(ipc_ctx->get_msg(ipc_ctx, &msg));
     ASSERT(msg.scalar == -11);
 
+    /* Client reconnects as soon as the server socket is created */
+    mdm_cli_reconnect_stats_t stats;
+    ASSERT(mdm_cli_get_reconnect_stats(ctx, &stats) == 0);
+    LOGD("reconnected in %dms after %d attempt(s)", stats.last_latency, stats.nb_attempts);
+    ASSERT(stats.nb_disconnections == 1);
+    ASSERT(stats.nb_reconnections == 1);
+    ASSERT(stats.last_latency < 2500);
+
     send_and_check(MDM_UP);
 
     mdm_cli_release(ctx);
@@ -766,8 +932,131 @@ int main(void)
     ASSERT(msg.scalar == -18);
 
     thread_ctx->dispose(thread_ctx, NULL);
+
+    LOGD("Batch mode test");
+    start_server(server_thread_batch);
+    mdm_cli_register_t callbacks_batch[] = {
+        { .id = MDM_DOWN, .callback = NULL, (void *)(uintptr_t)MDM_DOWN },
+        { .id = MDM_ON, .callback = NULL, (void *)(uintptr_t)MDM_ON },
+        { .id = MDM_UP, .callback = NULL, (void *)(uintptr_t)MDM_UP },
+        { .id = MDM_OOS, .callback = NULL, (void *)(uintptr_t)MDM_OOS },
+        { .id = MDM_COLD_RESET, .callback = dbg_callback_batch_ack,
+          (void *)(uintptr_t)MDM_COLD_RESET },
+    };
+    ctx = mdm_cli_connect_batch("test batch", 0, ARRAY_SIZE(callbacks_batch), callbacks_batch,
+                                MDM_CLI_OPT_COALESCE, dbg_callback_batch, (void *)0xba7c);
+    ASSERT(ctx != NULL);
+    ASSERT(poll(&pfd, 1, 5000) == 1);
+    ASSERT(ipc_ctx->get_msg(ipc_ctx, &msg));
+    /* Events are received in order. Those queued during first invocation are provided at once */
+    ASSERT(memcmp(batch_received, batch_evts, sizeof(batch_evts)) == 0);
+    LOGD("%d events received in %d callback invocation(s)", NB_BATCH_EVTS, (int)msg.scalar);
+    ASSERT(msg.scalar <= 4);
+    mdm_cli_disconnect(ctx);
+    thread_ctx->dispose(thread_ctx, NULL);
+
+    LOGD("Blocking and asynchronous requests test");
+    start_server(server_thread_sync);
+    ctx = mdm_cli_connect_opt("test sync", 0, 0, NULL, MDM_CLI_OPT_COALESCE);
+    ASSERT(ctx != NULL);
+    mdm_cli_req_result_t result;
+    ASSERT(mdm_cli_acquire_sync(ctx, 1000, &result) == 0);
+    ASSERT(result.status == 0);
+    ASSERT(result.crm_time == 5);
+    ASSERT(result.total_time >= 0 && result.total_time < 1000);
+    ASSERT(mdm_cli_restart_sync(ctx, RESTART_MDM_ERR, NULL, 1000, &result) == 0);
+    ASSERT(result.status == -1);
+
+    ASSERT(mdm_cli_release_async(ctx, req_callback, (void *)0xacac) == 0);
+    ASSERT(poll(&pfd, 1, 1000) == 1);
+    ASSERT(ipc_ctx->get_msg(ipc_ctx, &msg));
+    ASSERT(msg.scalar == 0);
+
+    /* Deadline reached: the request is cancelled on CRM side */
+    errno = 0;
+    ASSERT(mdm_cli_shutdown_sync(ctx, 100, &result) == -1);
+    ASSERT(errno == ETIMEDOUT);
+    usleep(100000);
+    ASSERT(cancelled_corr_id == 4);
+    /* Coalescing is requested without batch mode */
+    ASSERT(registered_bitmap == (int)CRM_MDMCLI_REGISTER_COALESCE);
+
+    /* Connection lost: pending requests are failed */
+    ASSERT(mdm_cli_shutdown_async(ctx, req_callback, (void *)0xacac) == 0);
+    usleep(100000);
+    thread_ctx->dispose(thread_ctx, NULL);
+    ASSERT(poll(&pfd, 1, 1000) == 1);
+    ASSERT(ipc_ctx->get_msg(ipc_ctx, &msg));
+    ASSERT(msg.scalar == -1);
+    mdm_cli_disconnect(ctx);
     ipc_ctx->dispose(ipc_ctx, NULL);
 
+    LOGD("Modem state page test");
+    char state_page[64];
+    snprintf(state_page, sizeof(state_page), "/tmp/crm%d.state", instance_id);
+    unlink(state_page);
+    ASSERT(mdm_cli_state_open(instance_id) == NULL);
+
+    crm_mdmcli_state_ctx_t *state_ctx = crm_mdmcli_state_init(true, instance_id);
+    ASSERT(state_ctx != NULL);
+    mdm_cli_state_hdle_t *state_hdle = mdm_cli_state_open(instance_id);
+    ASSERT(state_hdle != NULL);
+    mdm_cli_state_t state;
+    ASSERT(mdm_cli_get_state(state_hdle, &state) == 0);
+    ASSERT(state.state == MDM_DOWN);
+    ASSERT(state.crm_start > 0 && state.timestamp == state.crm_start);
+    uint32_t sequence = state.sequence;
+
+    state_ctx->publish(state_ctx, MDM_UP);
+    state_ctx->publish(state_ctx, MDM_UP);
+    ASSERT(mdm_cli_get_state(state_hdle, &state) == 0);
+    ASSERT(state.state == MDM_UP);
+    ASSERT(state.sequence == sequence + 1);
+    sequence = state.sequence;
+
+    /* Readers never see a torn snapshot while the page is updated */
+    pthread_t writer;
+    int nb_reads = 0;
+    ASSERT(pthread_create(&writer, NULL, state_writer, state_ctx) == 0);
+    do {
+        if (mdm_cli_get_state(state_hdle, &state) == 0) {
+            ASSERT(state.state == ((state.sequence - sequence) & 1 ? MDM_ON : MDM_UP));
+            nb_reads++;
+        }
+    } while (state.sequence != sequence + NB_STATE_UPDATES);
+    ASSERT(pthread_join(writer, NULL) == 0);
+    LOGD("%d consistent snapshots read", nb_reads);
+
+    /* The page stays mapped when CRM stops and restarts */
+    state_ctx->dispose(state_ctx);
+    ASSERT(mdm_cli_get_state(state_hdle, &state) == 0);
+    ASSERT(state.state == MDM_DOWN);
+    state_ctx = crm_mdmcli_state_init(true, instance_id);
+    ASSERT(state_ctx != NULL);
+    ASSERT(mdm_cli_get_state(state_hdle, &state) == 0);
+    ASSERT(state.sequence == sequence + NB_STATE_UPDATES + 2);
+    ASSERT(state_ctx->refresh(state_ctx) == -1);
+
+    /* A page left by a killed CRM is detected as stale once its heartbeat is missed */
+    state_ctx->publish(state_ctx, MDM_UP);
+    int refresh = state_ctx->refresh(state_ctx);
+    ASSERT(refresh > 0 && refresh <= CRM_MDMCLI_STATE_HEARTBEAT_PERIOD);
+    state_ctx->dispose(state_ctx);
+    pid_t crm = fork();
+    ASSERT(crm >= 0);
+    if (crm == 0) {
+        state_ctx = crm_mdmcli_state_init(true, instance_id);
+        state_ctx->publish(state_ctx, MDM_UP);
+        _exit(0);
+    }
+    ASSERT(waitpid(crm, NULL, 0) == crm);
+    ASSERT(mdm_cli_get_state(state_hdle, &state) == 0);
+    ASSERT(state.state == MDM_UP);
+    usleep((CRM_MDMCLI_STATE_HEARTBEAT_TIMEOUT + 100) * 1000);
+    ASSERT(mdm_cli_get_state(state_hdle, &state) == 0);
+    ASSERT(state.state == MDM_DOWN);
+    mdm_cli_state_close(state_hdle);
+
     LOGD("Starting signal stress test for 10 seconds");
 
     start_server(server_thread_stress);
@@ -42,6 +42,7 @@
 #include "utils/debug.h"
 #include "utils/fsm.h"
 #include "utils/ipc.h"
+#include "utils/msg_pool.h"
 #include "utils/thread.h"
 #include "utils/time.h"
 #include "utils/string_helpers.h"
@@ -49,12 +50,20 @@
 #include "utils/wakelock.h"
 #include "plugins/client_abstraction.h"
 #include "plugins/control.h"
+#include "plugins/mdmcli_state.h"
 #include "plugins/mdmcli_wire.h"
 
 /**
  * @TODO (?) remove this define and make it dynamic ?
  */
-#define MAX_CLIENTS 16
+#define MAX_CLIENTS CRM_MDMCLI_MAX_CLIENTS
+
+/* Request sent with a correlation id: its completion is reported to the client */
+typedef struct crm_pending_req {
+    int id;
+    int corr_id;
+    struct timespec start;
+} crm_pending_req_t;
 
 typedef struct crm_client {
     bool registered;
@@ -63,6 +72,10 @@ typedef struct crm_client {
     bool acquired;
     bool waiting_cold_reset_ack;
     bool waiting_shutdown_ack;
+    int nb_pending;
+    crm_pending_req_t pending[CRM_MDMCLI_MAX_PENDING];
+    bool has_held_state; // latest modem state not notified yet to a coalescing client
+    mdm_cli_event_t held_state;
 } crm_client_t;
 
 typedef struct crm_cli_abs_internal_ctx {
@@ -73,11 +86,14 @@ typedef struct crm_cli_abs_internal_ctx {
     crm_ipc_ctx_t *ipc_ctx;
     crm_thread_ctx_t *thread_ctx;
     crm_mdmcli_wire_ctx_t *wire_ctx;
+    crm_mdmcli_state_ctx_t *state_ctx; // NULL if the state page could not be published
     crm_fsm_ctx_t *fsm_ctx;
     crm_wakelock_t *wakelock;
+    crm_msg_pool_t *msg_pool; // serialized notifications sent by control to the CLA thread
 
     /* Configuration */
     bool enable_fmmo;
+    int coalescing_window;
 
     /* Clients management */
     bool sanity_test_mode;
@@ -107,6 +123,8 @@ typedef struct crm_cli_abs_internal_ctx {
     struct timespec timer_ack_end;
     struct timespec timer_boot_end;
     bool timer_boot_armed;
+    struct timespec timer_coalesce_end;
+    bool timer_coalesce_armed;
 } crm_cli_abs_internal_ctx_t;
 
 
@@ -143,6 +161,7 @@ enum crm_cli_abs_msg_type {
 
 #define TIMEOUT_ACK_IDX (1u << 0)
 #define TIMEOUT_BOOT_IDX (1u << 1)
+#define TIMEOUT_COALESCE_IDX (1u << 2)
 
 static mdm_cli_event_t map_modem_state_to_cli_event(crm_cli_abs_mdm_state_t mdm_state)
 {
@@ -289,14 +308,153 @@ static void notify_cli_event_single(crm_cli_abs_internal_ctx_t *i_ctx, int clien
     }
 }
 
+static bool is_coalescing(const crm_client_t *client)
+{
+    return (client->events_bitmap & CRM_MDMCLI_REGISTER_COALESCE) != 0;
+}
+
+static void flush_held_state(crm_cli_abs_internal_ctx_t *i_ctx, int client_idx)
+{
+    crm_client_t *client = &i_ctx->clients[client_idx];
+
+    if (client->has_held_state) {
+        client->has_held_state = false;
+        notify_cli_event_single(i_ctx, client_idx, client->held_state, NULL);
+    }
+}
+
+/* Flushes the states held during the coalescing window. The window is re-opened if a state was
+ * flushed: during a burst, coalescing clients receive at most one state per window */
+static void handle_coalescing_timeout(crm_cli_abs_internal_ctx_t *i_ctx)
+{
+    bool flushed = false;
+
+    i_ctx->timer_coalesce_armed = false;
+    for (int client_idx = 0; client_idx < i_ctx->num_clients; client_idx++) {
+        if ((i_ctx->to_clean & (1u << client_idx)) == 0 &&
+            i_ctx->clients[client_idx].has_held_state) {
+            flush_held_state(i_ctx, client_idx);
+            flushed = true;
+        }
+    }
+
+    if (flushed) {
+        i_ctx->timer_coalesce_armed = true;
+        ASSERT(clock_gettime(CLOCK_BOOTTIME, &i_ctx->timer_coalesce_end) == 0);
+        crm_time_add_ms(&i_ctx->timer_coalesce_end, i_ctx->coalescing_window);
+    }
+}
+
 static void notify_cli_event_all(crm_cli_abs_internal_ctx_t *i_ctx, mdm_cli_event_t event,
                                  void *serialized_msg)
 {
+    bool state_evt = event == MDM_DOWN || event == MDM_ON || event == MDM_UP || event == MDM_OOS;
+    bool coalescing_clients = false;
+
     LOGV("notifying event %d [%s] to up to %d client(s)", event,
          crm_mdmcli_wire_req_to_string(event), i_ctx->num_clients);
-    for (int client_idx = 0; client_idx < i_ctx->num_clients; client_idx++)
+    /* Page is updated first: a client receiving the event reads the same state from the page */
+    if (i_ctx->state_ctx && state_evt)
+        i_ctx->state_ctx->publish(i_ctx->state_ctx, event);
+    for (int client_idx = 0; client_idx < i_ctx->num_clients; client_idx++) {
+        crm_client_t *client = &i_ctx->clients[client_idx];
+
+        if ((i_ctx->to_clean & (1u << client_idx)) || !((1u << event) & client->events_bitmap))
+            continue;
+
+        coalescing_clients |= is_coalescing(client);
+        if (state_evt && is_coalescing(client) && i_ctx->timer_coalesce_armed) {
+            if (client->has_held_state)
+                CLOGV(i_ctx, client_idx, "state %s coalesced",
+                      crm_mdmcli_wire_req_to_string(client->held_state));
+            client->has_held_state = true;
+            client->held_state = event;
+            continue;
+        }
+
+        /* Held state is notified first to keep events order */
+        flush_held_state(i_ctx, client_idx);
         if ((i_ctx->to_clean & (1u << client_idx)) == 0)
             notify_cli_event_single(i_ctx, client_idx, event, serialized_msg);
+    }
+
+    if (state_evt && coalescing_clients && i_ctx->coalescing_window > 0 &&
+        !i_ctx->timer_coalesce_armed) {
+        i_ctx->timer_coalesce_armed = true;
+        ASSERT(clock_gettime(CLOCK_BOOTTIME, &i_ctx->timer_coalesce_end) == 0);
+        crm_time_add_ms(&i_ctx->timer_coalesce_end, i_ctx->coalescing_window);
+        if (!i_ctx->wakelock->is_held_by_module(i_ctx->wakelock, WAKELOCK_CLA))
+            i_ctx->wakelock->acquire(i_ctx->wakelock, WAKELOCK_CLA);
+    }
+}
+
+static void send_completion(crm_cli_abs_internal_ctx_t *i_ctx, int client_idx,
+                            const crm_pending_req_t *req, int status)
+{
+    ASSERT((i_ctx->to_clean & (1u << client_idx)) == 0);
+
+    crm_mdmcli_wire_msg_t msg = { .id = CRM_RSP_DONE, .corr_id = req->corr_id };
+    msg.msg.response.status = status;
+    msg.msg.response.crm_time = crm_time_get_elapsed_ms(&req->start);
+    CLOGD(i_ctx, client_idx, "=> " MSG_EVT_FORMAT "(#%d,%s,%s,%dms)",
+          crm_mdmcli_wire_req_to_string(msg.id), req->corr_id,
+          crm_mdmcli_wire_req_to_string(req->id), status ? "failure" : "success",
+          msg.msg.response.crm_time);
+    if (i_ctx->wire_ctx->send_msg(i_ctx->wire_ctx, &msg, i_ctx->pfd[2 + client_idx].fd)) {
+        CLOGE(i_ctx, client_idx, "failure to send message to client");
+        handle_client_unregister(i_ctx, client_idx);
+    }
+}
+
+/* Returns 0 if the request is not completed yet, 1 if completed and -1 in case of failure */
+static int get_completion(crm_cli_abs_internal_ctx_t *i_ctx, const crm_client_t *client,
+                          const crm_pending_req_t *req)
+{
+    bool stable = !i_ctx->fake_modem_state && !i_ctx->request_in_progress;
+    bool mdm_up = stable && i_ctx->modem_state == MDM_STATE_READY;
+    bool mdm_off = stable && i_ctx->modem_state == MDM_STATE_OFF;
+
+    if (i_ctx->modem_state == MDM_STATE_UNRESP)
+        return -1;
+
+    switch (req->id) {
+    case CRM_REQ_ACQUIRE:
+        if (!client->acquired)
+            return -1;
+        return mdm_up ? 1 : 0;
+    case CRM_REQ_RELEASE:
+        if (client->acquired || i_ctx->num_acquired > 0)
+            return 1;
+        return mdm_off ? 1 : 0;
+    case CRM_REQ_RESTART:
+    case CRM_REQ_NVM_BACKUP:
+        return (mdm_up && i_ctx->restart_type == 0) ? 1 : 0;
+    case CRM_REQ_SHUTDOWN:
+        return mdm_off ? 1 : 0;
+    default:
+        return 1;
+    }
+}
+
+/* Reports the completion of requests sent with a correlation id */
+static void check_pending_requests(crm_cli_abs_internal_ctx_t *i_ctx)
+{
+    for (int client_idx = 0; client_idx < i_ctx->num_clients; client_idx++) {
+        crm_client_t *client = &i_ctx->clients[client_idx];
+        int i = 0;
+
+        while (i < client->nb_pending && (i_ctx->to_clean & (1u << client_idx)) == 0) {
+            int completion = get_completion(i_ctx, client, &client->pending[i]);
+            if (completion != 0) {
+                send_completion(i_ctx, client_idx, &client->pending[i], completion > 0 ? 0 : -1);
+                client->nb_pending -= 1;
+                memmove(&client->pending[i], &client->pending[i + 1],
+                        sizeof(client->pending[0]) * (client->nb_pending - i));
+            } else {
+                i++;
+            }
+        }
+    }
 }
 
 static int failsafe(void *fsm_param, void *evt_param)
@@ -358,21 +516,31 @@ static int get_timeout(crm_cli_abs_internal_ctx_t *i_ctx, int *idx)
         }
     }
 
+    if (i_ctx->timer_coalesce_armed) {
+        int tmp = crm_time_get_remain_ms(&i_ctx->timer_coalesce_end);
+        if (timeout == tmp) {
+            *idx |= TIMEOUT_COALESCE_IDX;
+        } else if ((timeout < 0) || ((timeout > 0) && (tmp < timeout))) {
+            timeout = tmp;
+            *idx = TIMEOUT_COALESCE_IDX;
+        }
+    }
+
     return timeout;
 }
 
 static int start_shutdown_procedure(crm_cli_abs_internal_ctx_t *i_ctx)
 {
-    crm_mdmcli_wire_msg_t msg;
+    crm_mdmcli_wire_msg_t msg = { .corr_id = 0 };
     void *serialized_msg;
 
     msg.id = MDM_SHUTDOWN;
-    serialized_msg = i_ctx->wire_ctx->serialize_msg(i_ctx->wire_ctx, &msg, false);
+    serialized_msg = i_ctx->wire_ctx->serialize_msg(i_ctx->wire_ctx, &msg, NULL);
     notify_cli_event_all(i_ctx, MDM_SHUTDOWN, serialized_msg);
 
     if (!i_ctx->fake_modem_state) {
         msg.id = MDM_DOWN;
-        serialized_msg = i_ctx->wire_ctx->serialize_msg(i_ctx->wire_ctx, &msg, false);
+        serialized_msg = i_ctx->wire_ctx->serialize_msg(i_ctx->wire_ctx, &msg, NULL);
         notify_cli_event_all(i_ctx, MDM_DOWN, serialized_msg);
     }
 
@@ -392,12 +560,12 @@ static int start_shutdown_procedure(crm_cli_abs_internal_ctx_t *i_ctx)
 
 static int start_restart_procedure(crm_cli_abs_internal_ctx_t *i_ctx)
 {
-    crm_mdmcli_wire_msg_t msg;
+    crm_mdmcli_wire_msg_t msg = { .corr_id = 0 };
     void *serialized_msg;
 
     if (i_ctx->modem_state != MDM_STATE_BUSY) {
         msg.id = MDM_DOWN;
-        serialized_msg = i_ctx->wire_ctx->serialize_msg(i_ctx->wire_ctx, &msg, false);
+        serialized_msg = i_ctx->wire_ctx->serialize_msg(i_ctx->wire_ctx, &msg, NULL);
         notify_cli_event_all(i_ctx, MDM_DOWN, serialized_msg);
 
         ASSERT(!i_ctx->fake_modem_state);
@@ -406,7 +574,7 @@ static int start_restart_procedure(crm_cli_abs_internal_ctx_t *i_ctx)
     }
 
     msg.id = MDM_COLD_RESET;
-    serialized_msg = i_ctx->wire_ctx->serialize_msg(i_ctx->wire_ctx, &msg, false);
+    serialized_msg = i_ctx->wire_ctx->serialize_msg(i_ctx->wire_ctx, &msg, NULL);
     notify_cli_event_all(i_ctx, MDM_COLD_RESET, serialized_msg);
 
     if (i_ctx->num_waiting_cold_reset_ack == 0) {
@@ -613,7 +781,10 @@ static void dispose(crm_cli_abs_ctx_t *ctx)
      */
     i_ctx->thread_ctx->dispose(i_ctx->thread_ctx, NULL);
     ipc_ctx->dispose(ipc_ctx, NULL);
+    i_ctx->msg_pool->dispose(i_ctx->msg_pool);
     i_ctx->wire_ctx->dispose(i_ctx->wire_ctx);
+    if (i_ctx->state_ctx)
+        i_ctx->state_ctx->dispose(i_ctx->state_ctx);
     i_ctx->fsm_ctx->dispose(i_ctx->fsm_ctx);
     free(i_ctx);
 }
@@ -636,7 +807,8 @@ static void notify_client(crm_cli_abs_ctx_t *ctx, mdm_cli_event_t evt_id, size_t
                           .data = NULL };
     crm_mdmcli_wire_msg_t s_msg = { .id = evt_id,
                                     .msg.debug = data };
-    msg.data = i_ctx->wire_ctx->serialize_msg(i_ctx->wire_ctx, &s_msg, true);
+    msg.data = i_ctx->wire_ctx->serialize_msg(i_ctx->wire_ctx, &s_msg,
+                                              i_ctx->msg_pool->alloc(i_ctx->msg_pool));
     ASSERT(i_ctx->ipc_ctx->send_msg(i_ctx->ipc_ctx, &msg));
 }
 
@@ -689,7 +861,7 @@ static bool handle_control_msg(crm_cli_abs_internal_ctx_t *i_ctx, crm_ipc_msg_t
         LOGD("->notify_client(%d [%s])", payload, crm_mdmcli_wire_req_to_string(payload));
         ASSERT(msg->data != NULL);
         notify_cli_event_all(i_ctx, payload, msg->data);
-        free(msg->data);
+        i_ctx->msg_pool->free(i_ctx->msg_pool, msg->data);
         break;
 
     case CLI_ABS_MSG_NOTIFY_MODEM_STATE: {
@@ -750,7 +922,7 @@ static bool handle_control_msg(crm_cli_abs_internal_ctx_t *i_ctx, crm_ipc_msg_t
                  * the modem state was previously unknown.
                  */
                 crm_mdmcli_wire_msg_t msg = { .id = cli_evt };
-                void *serialized_msg = i_ctx->wire_ctx->serialize_msg(i_ctx->wire_ctx, &msg, false);
+                void *serialized_msg = i_ctx->wire_ctx->serialize_msg(i_ctx->wire_ctx, &msg, NULL);
                 notify_cli_event_all(i_ctx, cli_evt, serialized_msg);
             }
 
@@ -771,6 +943,10 @@ static void handle_client_msg(crm_cli_abs_internal_ctx_t *i_ctx, int client_idx,
     ASSERT(i_ctx != NULL);
     ASSERT(msg != NULL);
 
+    crm_pending_req_t req = { .id = msg->id, .corr_id = msg->corr_id };
+    bool rejected = false;
+    clock_gettime(CLOCK_BOOTTIME, &req.start);
+
     if (i_ctx->to_clean & (1u << client_idx)) {
         // Filter out messages on clients that were disconnected
         CLOGD(i_ctx, client_idx, "<= " MSG_EVT_FORMAT "() ignored due to client disconnection",
@@ -825,6 +1001,7 @@ static void handle_client_msg(crm_cli_abs_internal_ctx_t *i_ctx, int client_idx,
         break;
 
     case CRM_REQ_ACQUIRE:
+        rejected = i_ctx->reject_requests;
         if (!i_ctx->reject_requests) {
             if (i_ctx->clients[client_idx].acquired) {
                 CLOGE(i_ctx, client_idx, "client has already acquired the modem");
@@ -836,6 +1013,7 @@ static void handle_client_msg(crm_cli_abs_internal_ctx_t *i_ctx, int client_idx,
         break;
 
     case CRM_REQ_RELEASE:
+        rejected = i_ctx->reject_requests;
         if (!i_ctx->reject_requests) {
             if (!i_ctx->clients[client_idx].acquired) {
                 CLOGE(i_ctx, client_idx, "client did not previously acquire the modem");
@@ -873,6 +1051,7 @@ static void handle_client_msg(crm_cli_abs_internal_ctx_t *i_ctx, int client_idx,
                   crm_mdmcli_wire_req_to_string(msg->id),
                   crm_mdmcli_restart_cause_to_string(msg->msg.restart.cause), ignored);
         }
+        rejected = ignore;
         if (!ignore) {
             i_ctx->restart_type = get_restart_type(msg->msg.restart.cause);
             if (msg->msg.restart.debug) {
@@ -904,6 +1083,20 @@ static void handle_client_msg(crm_cli_abs_internal_ctx_t *i_ctx, int client_idx,
         i_ctx->fsm_ctx->notify_event(i_ctx->fsm_ctx, EV_CLI_RESTART, NULL);
         break;
 
+    case CRM_REQ_CANCEL: {
+        /* The client gave up waiting for the completion: corr_id is the one of the request */
+        crm_client_t *client = &i_ctx->clients[client_idx];
+        for (int i = 0; i < client->nb_pending; i++) {
+            if (client->pending[i].corr_id == msg->corr_id) {
+                client->nb_pending -= 1;
+                memmove(&client->pending[i], &client->pending[i + 1],
+                        sizeof(client->pending[0]) * (client->nb_pending - i));
+                break;
+            }
+        }
+        return;
+    }
+
     case CRM_REQ_ACK_COLD_RESET:
         if (!i_ctx->clients[client_idx].waiting_cold_reset_ack) {
             CLOGE(i_ctx, client_idx, "not waiting for client cold reset ack");
@@ -937,10 +1130,24 @@ static void handle_client_msg(crm_cli_abs_internal_ctx_t *i_ctx, int client_idx,
                   crm_mdmcli_wire_req_to_string(msg->id));
         }
         crm_mdmcli_wire_msg_t to_send_msg = { .id = MDM_DBG_INFO, .msg.debug = msg->msg.debug };
-        void *serialized_msg = i_ctx->wire_ctx->serialize_msg(i_ctx->wire_ctx, &to_send_msg, false);
+        void *serialized_msg = i_ctx->wire_ctx->serialize_msg(i_ctx->wire_ctx, &to_send_msg, NULL);
         notify_cli_event_all(i_ctx, MDM_DBG_INFO, serialized_msg);
         break;
     }
+
+    /* Completion is reported once the effect of the request is visible to the clients. See
+     * check_pending_requests */
+    if (req.corr_id != 0 && (i_ctx->to_clean & (1u << client_idx)) == 0) {
+        crm_client_t *client = &i_ctx->clients[client_idx];
+        if (rejected) {
+            send_completion(i_ctx, client_idx, &req, -1);
+        } else if (client->nb_pending == CRM_MDMCLI_MAX_PENDING) {
+            CLOGE(i_ctx, client_idx, "too many pending requests");
+            send_completion(i_ctx, client_idx, &req, -1);
+        } else {
+            client->pending[client->nb_pending++] = req;
+        }
+    }
 }
 
 static void update_client_list(crm_cli_abs_internal_ctx_t *i_ctx)
@@ -975,6 +1182,8 @@ static void *main_loop(crm_thread_ctx_t *thread_ctx, void *arg)
     int ipc_fd = i_ctx->ipc_ctx->get_poll_fd(i_ctx->ipc_ctx);
     bool running = true;
     errno = 0;
+    /* Socket is already listened by the daemon: connection requests received during CRM boot are
+     * pending in the socket backlog */
     const char *socket_name = i_ctx->wire_ctx->get_socket_name(i_ctx->wire_ctx);
     int server_sock = crm_socket_create(socket_name, MAX_CLIENTS);
     DASSERT(server_sock >= 0, "get control socket (%s) failed (%s)", socket_name,
@@ -999,17 +1208,30 @@ static void *main_loop(crm_thread_ctx_t *thread_ctx, void *arg)
         if ((timeout == -1) && i_ctx->wakelock->is_held_by_module(i_ctx->wakelock, WAKELOCK_CLA))
             i_ctx->wakelock->release(i_ctx->wakelock, WAKELOCK_CLA);
 
-        int ret = poll(i_ctx->pfd, 2 + i_ctx->num_clients, timeout);
+        /* The state page heartbeat does not need the wakelock: it only matters while CRM runs */
+        int poll_timeout = timeout;
+        int refresh = i_ctx->state_ctx ? i_ctx->state_ctx->refresh(i_ctx->state_ctx) : -1;
+        if ((refresh >= 0) && ((timeout < 0) || (refresh < timeout)))
+            poll_timeout = refresh;
+
+        int ret = poll(i_ctx->pfd, 2 + i_ctx->num_clients, poll_timeout);
         /**
          * @TODO add EINTR + error handling
          */
+        if ((ret == 0) && (poll_timeout != timeout))
+            continue;
+
         if (ret == 0) {
             ASSERT(idx != 0);
             ASSERT(i_ctx->wakelock->is_held_by_module(i_ctx->wakelock, WAKELOCK_CLA) == true);
 
+            i_ctx->to_clean = 0;
             if (TIMEOUT_BOOT_IDX & idx)
                 i_ctx->timer_boot_armed = crm_time_get_remain_ms(&i_ctx->timer_boot_end) > 0;
 
+            if (TIMEOUT_COALESCE_IDX & idx)
+                handle_coalescing_timeout(i_ctx);
+
             if (TIMEOUT_ACK_IDX & idx) {
                 for (int i = 0; i < i_ctx->num_clients; i++) {
                     if (i_ctx->clients[i].waiting_cold_reset_ack) {
@@ -1026,8 +1248,12 @@ static void *main_loop(crm_thread_ctx_t *thread_ctx, void *arg)
                 i_ctx->fsm_ctx->notify_event(i_ctx->fsm_ctx, EV_CLI_ACKED, NULL);
             }
 
-            if (!i_ctx->timer_boot_armed && i_ctx->num_waiting_cold_reset_ack == 0 &&
-                i_ctx->num_waiting_shutdown_ack == 0)
+            /* Time-outs may change the modem state seen by the clients */
+            check_pending_requests(i_ctx);
+            update_client_list(i_ctx);
+
+            if (!i_ctx->timer_boot_armed && !i_ctx->timer_coalesce_armed &&
+                i_ctx->num_waiting_cold_reset_ack == 0 && i_ctx->num_waiting_shutdown_ack == 0)
                 i_ctx->wakelock->release(i_ctx->wakelock, WAKELOCK_CLA);
         } else {
             i_ctx->to_clean = 0;
@@ -1102,6 +1328,7 @@ static void *main_loop(crm_thread_ctx_t *thread_ctx, void *arg)
                 if (evt != EV_NONE)
                     i_ctx->fsm_ctx->notify_event(i_ctx->fsm_ctx, evt, NULL);
             }
+            check_pending_requests(i_ctx);
             update_client_list(i_ctx);
         }
     }
@@ -1111,12 +1338,19 @@ static void *main_loop(crm_thread_ctx_t *thread_ctx, void *arg)
 
 static void state_trans(int prev_state, int new_state, int evt, void *fsm_param, void *evt_param)
 {
-    (void)fsm_param;  // UNUSED
+    crm_cli_abs_internal_ctx_t *i_ctx = fsm_param;
+
     (void)evt_param;  // UNUSED
     (void)evt;        // UNUSED
-    (void)prev_state; // UNUSED
 
+    ASSERT(i_ctx != NULL);
     ASSERT(new_state != ST_INITIAL);
+
+    /* Clients are accepted while CRM is starting. Their requests are kept until control reports
+     * the first modem state */
+    if (prev_state == ST_INITIAL)
+        LOGD("first modem state received. %d client(s) connected during boot",
+             i_ctx->num_clients);
 }
 
 /**
@@ -1134,6 +1368,7 @@ crm_cli_abs_ctx_t *crm_cli_abs_init(int inst_id, bool sanity_mode, tcs_ctx_t *tc
     i_ctx->control_ctx = control;
     i_ctx->ipc_ctx = crm_ipc_init(CRM_IPC_THREAD);
     i_ctx->wire_ctx = crm_mdmcli_wire_init(CRM_SERVER_TO_CLIENT, inst_id);
+    i_ctx->state_ctx = crm_mdmcli_state_init(true, inst_id);
     i_ctx->fsm_ctx = crm_fsm_init(cla_fsm_array, EV_NUM, ST_NUM, ST_INITIAL, NULL, state_trans,
                                   failsafe, i_ctx, CRM_MODULE_TAG, get_state_txt, get_event_txt);
     ASSERT(i_ctx->control_ctx);
@@ -1153,6 +1388,11 @@ crm_cli_abs_ctx_t *crm_cli_abs_init(int inst_id, bool sanity_mode, tcs_ctx_t *tc
 
     ASSERT(tcs->select_group(tcs, ".client_abstraction") == 0);
     ASSERT(tcs->get_bool(tcs, "enable_fmmo", &i_ctx->enable_fmmo) == 0);
+    ASSERT(tcs->get_int(tcs, "coalescing_window", &i_ctx->coalescing_window) == 0);
+    int msg_pool_size;
+    ASSERT(tcs->get_int(tcs, "msg_pool_size", &msg_pool_size) == 0);
+    i_ctx->msg_pool = crm_msg_pool_init(i_ctx->wire_ctx->get_msg_size_max(i_ctx->wire_ctx),
+                                        msg_pool_size);
 
     if (!i_ctx->enable_fmmo)
         i_ctx->num_acquired = 1;
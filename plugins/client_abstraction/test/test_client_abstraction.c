@@ -39,10 +39,12 @@
 #include "utils/logs.h"
 #include "utils/common.h"
 #include "utils/ipc.h"
+#include "utils/socket.h"
 #include "utils/wakelock.h"
 #include "test/test_utils.h"
 #include "plugins/client_abstraction.h"
 #include "plugins/control.h"
+#include "plugins/mdmcli_state.h"
 #include "plugins/mdmcli_wire.h"
 
 crm_ipc_ctx_t *ipc;
@@ -329,9 +331,7 @@ static void wait_multiple_client_plus(int *evts, int num_fds, int *fds)
 
 static void send_register(int sock, int evt_bitmap, const char *name)
 {
-    crm_mdmcli_wire_msg_t msg;
-
-    msg.id = CRM_REQ_REGISTER;
+    crm_mdmcli_wire_msg_t msg = { .id = CRM_REQ_REGISTER };
     msg.msg.register_client.events_bitmap = evt_bitmap;
     msg.msg.register_client.name = name;
     ASSERT(wire->send_msg(wire, &msg, sock) == 0);
@@ -340,9 +340,7 @@ static void send_register(int sock, int evt_bitmap, const char *name)
 static void send_restart(int sock, crm_ctrl_restart_type_t type,
                          const mdm_cli_dbg_info_t *dbg_info)
 {
-    crm_mdmcli_wire_msg_t msg;
-
-    msg.id = CRM_REQ_RESTART;
+    crm_mdmcli_wire_msg_t msg = { .id = CRM_REQ_RESTART };
     msg.msg.restart.cause = get_cause(type);
     msg.msg.restart.debug = dbg_info;
     ASSERT(wire->send_msg(wire, &msg, sock) == 0);
@@ -350,21 +348,51 @@ static void send_restart(int sock, crm_ctrl_restart_type_t type,
 
 static void send_notify_dbg(int sock, const mdm_cli_dbg_info_t *dbg_info)
 {
-    crm_mdmcli_wire_msg_t msg;
-
-    msg.id = CRM_REQ_NOTIFY_DBG;
+    crm_mdmcli_wire_msg_t msg = { .id = CRM_REQ_NOTIFY_DBG };
     msg.msg.debug = dbg_info;
     ASSERT(wire->send_msg(wire, &msg, sock) == 0);
 }
 
 static void send_simple_msg(int sock, int evt)
 {
-    crm_mdmcli_wire_msg_t msg;
+    crm_mdmcli_wire_msg_t msg = { .id = evt };
+    ASSERT(wire->send_msg(wire, &msg, sock) == 0);
+}
+
+static void send_request(int sock, int evt, int corr_id)
+{
+    crm_mdmcli_wire_msg_t msg = { .id = evt, .corr_id = corr_id };
 
-    msg.id = evt;
+    if (evt == CRM_REQ_RESTART)
+        msg.msg.restart.cause = RESTART_MDM_ERR;
     ASSERT(wire->send_msg(wire, &msg, sock) == 0);
 }
 
+static void wait_completion(int sock, int corr_id, int status)
+{
+    struct pollfd p = { .fd = sock, .events = POLLIN };
+
+    ASSERT(poll(&p, 1, 1000) == 1);
+    crm_mdmcli_wire_msg_t *r_msg = wire->recv_msg(wire, sock);
+    ASSERT(r_msg != NULL);
+    ASSERT(r_msg->id == CRM_RSP_DONE);
+    ASSERT(r_msg->corr_id == corr_id);
+    ASSERT(r_msg->msg.response.status == status);
+    ASSERT(r_msg->msg.response.crm_time >= 0);
+}
+
+/* Modem state page follows the state events notified to the clients */
+static void check_state_page(mdm_cli_event_t expected)
+{
+    crm_mdmcli_state_ctx_t *state_ctx = crm_mdmcli_state_init(false, 0);
+    crm_mdmcli_state_t state;
+
+    ASSERT(state_ctx != NULL);
+    ASSERT(state_ctx->read(state_ctx, &state) == 0);
+    ASSERT(state.state == expected);
+    state_ctx->dispose(state_ctx);
+}
+
 /* Useful for conditional breakpoints in GDB :) */
 int test_step = 0;
 
@@ -383,6 +411,13 @@ int main(void)
 
     crm_wakelock_t *wakelock = crm_wakelock_init("test");
 
+    /* Socket is listened by the daemon before plugins are started: client can connect and send
+     * its request before client abstraction is started */
+    LOGD("========== Test early connection");
+    ASSERT(crm_socket_create(wire->get_socket_name(wire), CRM_MDMCLI_MAX_CLIENTS) >= 0);
+    int cl1 = connect_to_server(wire->get_socket_name(wire));
+    send_register(cl1, 1 << MDM_DOWN, "Client1");
+
     client_abs = crm_cli_abs_init(0, false, tcs, &control, wakelock);
     ASSERT(client_abs != NULL);
 
@@ -390,13 +425,11 @@ int main(void)
     ASSERT(ipc != NULL);
     add_fd(ipc->get_poll_fd(ipc));
 
-    int cl1 = connect_to_server(wire->get_socket_name(wire));
     add_fd(cl1);
+    wait_evt(50, 0, NULL);
 
     /* Test multiple register of a client */
     LOGD("========== Test multiple register error case");
-    send_register(cl1, 1 << MDM_DOWN, "Client1");
-    wait_evt(50, 0, NULL);
 
     send_register(cl1, 1 << MDM_DOWN, "Client1");
     wait_single(EVT_CLIENT, -1, cl1);
@@ -442,10 +475,12 @@ int main(void)
     client_abs->notify_modem_state(client_abs, MDM_STATE_READY);
     wait_single(EVT_CLIENT, MDM_UP, cl1);
     wait_evt(50, 0, NULL);
+    check_state_page(MDM_UP);
 
     send_simple_msg(cl1, CRM_REQ_RELEASE);
     wait_single(EVT_CLIENT, MDM_SHUTDOWN, cl1);
     wait_single(EVT_CLIENT, MDM_DOWN, cl1);
+    check_state_page(MDM_DOWN);
     send_simple_msg(cl1, CRM_REQ_ACK_SHUTDOWN);
     wait_single(EVT_CTRL, CLA_REQ_STOP, 0);
     wait_evt(50, 0, NULL);
@@ -1127,7 +1162,57 @@ int main(void)
     }
     wait_evt(50, 0, NULL);
 
-    LOGD("========== Test OOS ...");
+    LOGD("========== Test request completion");
+    /* Modem is up and still used by cl1: cl2 requests are completed immediately */
+    send_request(cl2, CRM_REQ_ACQUIRE, 1);
+    wait_completion(cl2, 1, 0);
+    send_request(cl2, CRM_REQ_RELEASE, 2);
+    wait_completion(cl2, 2, 0);
+
+    send_request(cl1, CRM_REQ_RESTART, 3);
+    {
+        int fds[] = { cl1, cl1, cl2 };
+        int evts[] = { MDM_DOWN, MDM_COLD_RESET, MDM_DOWN };
+        wait_multiple_client_plus(evts, 3, fds);
+    }
+    /* Second restart is rejected */
+    send_request(cl2, CRM_REQ_RESTART, 4);
+    wait_completion(cl2, 4, -1);
+    send_simple_msg(cl1, CRM_REQ_ACK_COLD_RESET);
+    {
+        evt_wait_t w[] = {
+            { .type = EVT_CTRL,
+              .ctrl = { .req = CLA_REQ_RESTART,
+                        .info = { .type = CTRL_MODEM_RESTART,
+                                  .dbg_info_present = false } } }
+        };
+        wait_evt(1000, ARRAY_SIZE(w), w);
+    }
+    client_abs->notify_modem_state(client_abs, MDM_STATE_BUSY);
+    wait_evt(50, 0, NULL);
+    /* Restart is completed once modem is up again */
+    client_abs->notify_modem_state(client_abs, MDM_STATE_READY);
+    client_abs->notify_operation_result(client_abs, 0);
+    {
+        int fds[] = { cl1, cl1, cl2, cl3 };
+        int evts[] = { MDM_UP, CRM_RSP_DONE, MDM_UP, MDM_UP };
+        wait_multiple_client_plus(evts, 4, fds);
+    }
+    wait_evt(50, 0, NULL);
+
+    LOGD("========== Test OOS ( + modem state coalescing) ...");
+    int cl4 = connect_to_server(wire->get_socket_name(wire));
+    add_fd(cl4);
+    send_register(cl4, (1u << MDM_DOWN) | (1u << MDM_ON) | (1u << MDM_UP) | (1u << MDM_OOS) |
+                  CRM_MDMCLI_REGISTER_COALESCE, "Client4");
+    wait_single(EVT_CLIENT, MDM_UP, cl4);
+
+    /* First state is notified at once to the coalescing client and opens the coalescing window */
+    client_abs->notify_client(client_abs, MDM_ON, 0, NULL);
+    {
+        int fds[] = { cl1, cl4 };
+        wait_multiple_client(MDM_ON, 2, fds);
+    }
     client_abs->notify_modem_state(client_abs, MDM_STATE_BUSY);
     client_abs->notify_modem_state(client_abs, MDM_STATE_UNRESP);
     {
@@ -1140,6 +1225,10 @@ int main(void)
         int fds[] = { cl1, cl2 };
         wait_multiple_client(MDM_OOS, 2, fds);
     }
+    /* MDM_DOWN is skipped: only the latest state is notified when the window expires */
+    wait_single(EVT_CLIENT, MDM_OOS, cl4);
+    close(cl4);
+    del_fd(cl4);
 
     send_simple_msg(cl2, CRM_REQ_RELEASE);
     wait_evt(50, 0, NULL);
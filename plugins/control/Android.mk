@@ -56,4 +56,21 @@ CRM_DISABLE_ANDROID_TARGET := true
 CRM_TARGET := $(BUILD_EXECUTABLE)
 include $(LOCAL_PATH)/../../makefiles/crm_c_make.mk
 
+##############################################################
+include $(LOCAL_PATH)/../../makefiles/crm_clear.mk
+CRM_NAME := crm_test_loader
+
+CRM_SRC := test/loader_test.c src/loader.c
+CRM_INCS := $(LOCAL_PATH)/src
+
+CRM_REQUIRED_MODULES := libmdmcli
+
+CRM_SHARED_LIBS_ANDROID_ONLY := libc
+CRM_SHARED_LIBS := libcrm_utils libtcs2
+CRM_STATIC_LIBS_HOST_ONLY := libcrm_host_test_utils
+
+CRM_DISABLE_ANDROID_TARGET := true
+CRM_TARGET := $(BUILD_EXECUTABLE)
+include $(LOCAL_PATH)/../../makefiles/crm_c_make.mk
+
 endif
@@ -32,8 +32,10 @@
 
 #include "libmdmcli/mdm_cli.h"
 
+#include "utils/msg_pool.h"
 #include "utils/plugins.h"
 #include "utils/thread.h"
+#include "utils/timer_wheel.h"
 #include "utils/wakelock.h"
 #include "plugins/control.h"
 #include "plugins/client_abstraction.h"
@@ -44,15 +46,19 @@
 #include "plugins/dump.h"
 #include "plugins/escalation.h"
 
+#include "teljavabridge/tel_java_bridge.h"
+
+#include "watchdog.h"
+
 enum ctrl_plugins {
+    PLUGIN_WAKELOCK, // first: the watchdog is started with it
     PLUGIN_CLIENTS,
+    PLUGIN_DUMP,
     PLUGIN_HAL,
     PLUGIN_FW_UPLOAD,
     PLUGIN_FW_ELECTOR,
     PLUGIN_CUSTOMIZATION,
     PLUGIN_ESCALATION,
-    PLUGIN_WAKELOCK,
-    PLUGIN_DUMP,
     PLUGIN_NB
 };
 
@@ -73,6 +79,7 @@ typedef enum ctrl_events {
 
     EV_NVM_SUCCESS,
     EV_FW_SUCCESS,
+    EV_FW_PROGRESS,
     EV_DUMP_SUCCESS,
     EV_FAILURE,
     EV_TIMEOUT,
@@ -123,6 +130,7 @@ typedef struct crm_control_ctx_internal {
 
     /* internal variables */
     crm_ipc_ctx_t *ipc;
+    crm_msg_pool_t *msg_pool; // data of the events sent through ipc
     crm_thread_ctx_t *watchdog;
     crm_ctrl_state_t state;
 
@@ -131,11 +139,15 @@ typedef struct crm_control_ctx_internal {
     int inst_id;
     int watch_id;
     int timeout;
+    watchdog_heartbeat_t heartbeat;
 
     crm_ctrl_dbg_info_t dbg_info;
 
-    bool timer_armed;
-    struct timespec timer_end;
+    crm_timer_wheel_t *timers; // owned by the event loop
+    int timer_id;
+
+    tel_java_bridge_ctx_t *bridge; // owned by the event loop
+    int bridge_timer_id;           // wakes up the event loop to reconnect to the bridge
 } crm_control_ctx_internal_t;
 
 #endif /* __CRM_CONTROL_COMMON_HEADER__ */
@@ -24,6 +24,7 @@
  * limitations under the License.
  */
 
+#include <errno.h>
 #include <poll.h>
 #include <string.h>
 #include <unistd.h>
@@ -34,16 +35,18 @@
 #include "utils/common.h"
 #include "utils/logs.h"
 #include "utils/fsm.h"
-#include "utils/time.h"
+#include "utils/timer_wheel.h"
 #include "utils/string_helpers.h"
 #include "plugins/client_abstraction.h"
-#include "teljavabridge/tel_java_bridge.h"
 
 #include "common.h"
+#include "utils.h"
 #include "watchdog.h"
 
 // The time CTRL waits for a HAL reset before acting on the CLA reset request
 #define MAX_RESET_TIMEOUT 100 // time in ms
+#define TIMER_GRANULARITY 10  // time in ms
+#define BRIDGE_RETRY_TIMEOUT 1000 // time in ms
 
 typedef enum ctrl_states {
     ST_INITIAL = 0,
@@ -76,6 +79,7 @@ static const char *get_event_txt(int evt)
 
     case EV_NVM_SUCCESS:          return "OP : nvm ok";
     case EV_FW_SUCCESS:           return "OP : fw ok";
+    case EV_FW_PROGRESS:          return "OP : fw progress";
     case EV_DUMP_SUCCESS:         return "OP : dump ok";
     case EV_FAILURE:              return "OP : err";
     case EV_TIMEOUT:              return "OP : timeout";
@@ -101,25 +105,30 @@ static const char *get_state_txt(int state)
 static void start_timer(crm_control_ctx_internal_t *i_ctx, int timeout)
 {
     ASSERT(i_ctx != NULL);
-    ASSERT(i_ctx->timer_armed == false);
+    ASSERT(i_ctx->timers->is_armed(i_ctx->timers, i_ctx->timer_id) == false);
     ASSERT(timeout >= 0);
 
-    i_ctx->timer_armed = true;
-    crm_time_add_ms(&i_ctx->timer_end, timeout);
+    i_ctx->timers->arm(i_ctx->timers, i_ctx->timer_id, timeout);
 }
 
-static int get_timeout(crm_control_ctx_internal_t *i_ctx)
+static void notify_timeout(void *param)
 {
-    ASSERT(i_ctx != NULL);
-    if (i_ctx->timer_armed == false)
-        return -1;
+    crm_fsm_ctx_t *fsm = param;
+
+    fsm->notify_event(fsm, EV_TIMEOUT, NULL);
+}
+
+static void notify_bridge_retry(void *param)
+{
+    (void)param;  // UNUSED
 
-    return crm_time_get_remain_ms(&i_ctx->timer_end);
+    /* Nothing to do: the event loop reconnects to the bridge when it wakes up */
+    LOGD("retrying connection to the java bridge");
 }
 
 static void clear_internal_state(crm_control_ctx_internal_t *i_ctx)
 {
-    free(i_ctx->state.hal_evt);
+    i_ctx->msg_pool->free(i_ctx->msg_pool, i_ctx->state.hal_evt);
     memset(&i_ctx->state, 0, sizeof(i_ctx->state));
 }
 
@@ -156,7 +165,7 @@ static int mdm_flash(crm_control_ctx_internal_t *i_ctx)
         ASSERT(i_ctx->state.hal_evt->type == HAL_MDM_FLASH);
         i_ctx->upload->flash(i_ctx->upload, i_ctx->state.hal_evt->nodes);
 
-        free(i_ctx->state.hal_evt);
+        i_ctx->msg_pool->free(i_ctx->msg_pool, i_ctx->state.hal_evt);
         i_ctx->state.hal_evt = NULL;
         i_ctx->state.fw_ready = false;
 
@@ -256,6 +265,18 @@ static int flash_success_evt(void *fsm_param, void *evt_param)
     return mdm_cfg(i_ctx);
 }
 
+static int flash_progress(void *fsm_param, void *evt_param)
+{
+    crm_control_ctx_internal_t *i_ctx = (crm_control_ctx_internal_t *)fsm_param;
+
+    ASSERT(i_ctx != NULL);
+    (void)evt_param;  // unused
+
+    /* Large firmwares can take longer than the timeout: only a stalled upload must trigger it */
+    watchdog_start(i_ctx, i_ctx->timeout);
+    return -1;
+}
+
 static int mdm_stop(void *fsm_param, void *evt_param)
 {
     crm_control_ctx_internal_t *i_ctx = (crm_control_ctx_internal_t *)fsm_param;
@@ -268,31 +289,21 @@ static int mdm_stop(void *fsm_param, void *evt_param)
     return ST_WAITING;
 }
 
-static void free_dbg_info(mdm_cli_dbg_info_t *dbg_info)
-{
-    if (dbg_info) {
-        for (size_t i = 0; i < dbg_info->nb_data; i++)
-            free((char *)dbg_info->data[i]);
-
-        free(dbg_info->data);
-        free(dbg_info);
-    }
-}
-
-static void store_dbg_info(mdm_cli_dbg_info_t **dest, void *evt_param, bool overwrite)
+static void store_dbg_info(crm_msg_pool_t *pool, mdm_cli_dbg_info_t **dest, void *evt_param,
+                           bool overwrite)
 {
     mdm_cli_dbg_info_t **src = (mdm_cli_dbg_info_t **)evt_param;
 
     if (src && *src) {
         ASSERT(dest);
         if (*dest && overwrite) {
-            free_dbg_info(*dest);
+            pool->free(pool, *dest);
             *dest = NULL;
         }
         if (!*dest)
             *dest = *src;
         else
-            free_dbg_info(*src);
+            pool->free(pool, *src);
         *src = NULL;
     }
 }
@@ -306,9 +317,7 @@ static void notify_dbg_info(crm_control_ctx_internal_t *i_ctx, bool report)
             mdm_cli_dbg_info_t dbg_info_apimr = { DBG_TYPE_APIMR, DBG_DEFAULT_LOG_SIZE,
                                                   DBG_DEFAULT_NO_LOG, DBG_DEFAULT_NO_LOG, 0, NULL };
 
-            i_ctx->dbg_info.evt = malloc(sizeof(mdm_cli_dbg_info_t));
-            ASSERT(i_ctx->dbg_info.evt);
-            *i_ctx->dbg_info.evt = dbg_info_apimr;
+            i_ctx->dbg_info.evt = copy_dbg_info(i_ctx->msg_pool, &dbg_info_apimr);
         }
 
         ASSERT(i_ctx->dbg_info.evt);
@@ -319,7 +328,7 @@ static void notify_dbg_info(crm_control_ctx_internal_t *i_ctx, bool report)
     i_ctx->dbg_info.do_not_report = false;
     i_ctx->dbg_info.reset_initiated_by_cla = false;
 
-    free_dbg_info(i_ctx->dbg_info.evt);
+    i_ctx->msg_pool->free(i_ctx->msg_pool, i_ctx->dbg_info.evt);
     i_ctx->dbg_info.evt = NULL;
 }
 
@@ -333,8 +342,8 @@ static int mdm_restart(crm_control_ctx_internal_t *i_ctx, bool report_dbg_info,
 
     i_ctx->hal->reset(i_ctx->hal, backup ? RESET_BACKUP : RESET_COLD);
 
-    tel_java_brige_broadcast_intent("com.intel.action.MODEM_COLD_RESET", "instId%d",
-                                    i_ctx->inst_id);
+    i_ctx->bridge->broadcast_intent_async(i_ctx->bridge, "com.intel.action.MODEM_COLD_RESET",
+                                         "instId%d", i_ctx->inst_id);
 
     return ST_PACKAGING;
 }
@@ -350,8 +359,8 @@ static int set_oos(crm_control_ctx_internal_t *i_ctx)
     notify_op_result_if_needed(i_ctx, -1);
     i_ctx->is_mdm_oos = true;
 
-    tel_java_brige_broadcast_intent("com.intel.action.MODEM_OUT_OF_SERVICE", "instId%d",
-                                    i_ctx->inst_id);
+    i_ctx->bridge->broadcast_intent_async(i_ctx->bridge, "com.intel.action.MODEM_OUT_OF_SERVICE",
+                                         "instId%d", i_ctx->inst_id);
 
     return ST_DOWN;
 }
@@ -360,7 +369,7 @@ static int fw_flash_failure(void *fsm_param, void *evt_param)
 {
     crm_control_ctx_internal_t *i_ctx = (crm_control_ctx_internal_t *)fsm_param;
 
-    store_dbg_info(&i_ctx->dbg_info.evt, evt_param, true);
+    store_dbg_info(i_ctx->msg_pool, &i_ctx->dbg_info.evt, evt_param, true);
 
     return set_oos(i_ctx);
 }
@@ -379,9 +388,12 @@ static int platform_reboot(crm_control_ctx_internal_t *i_ctx)
     notify_op_result_if_needed(i_ctx, -1);
     i_ctx->is_mdm_oos = true;
 
-    tel_java_brige_broadcast_intent("com.intel.action.PLATFORM_REBOOT", "instId%d", i_ctx->inst_id);
+    /* Synchronous API: previously queued intents are sent before */
+    i_ctx->bridge->broadcast_intent(i_ctx->bridge, "com.intel.action.PLATFORM_REBOOT", "instId%d",
+                                    i_ctx->inst_id);
 
-    while (!tel_java_brige_broadcast_intent("android.intent.action.REBOOT", "nowait%d", 1))
+    while (!i_ctx->bridge->broadcast_intent(i_ctx->bridge, "android.intent.action.REBOOT",
+                                            "nowait%d", 1))
         usleep(500 * 1000);
 
     return ST_DOWN;
@@ -394,7 +406,7 @@ static int escalation(void *fsm_param, void *evt_param)
 
     ASSERT(i_ctx != NULL);
 
-    store_dbg_info(&i_ctx->dbg_info.evt, evt_param, true);
+    store_dbg_info(i_ctx->msg_pool, &i_ctx->dbg_info.evt, evt_param, true);
 
     crm_escalation_next_step_t step = i_ctx->escalation->get_next_step(i_ctx->escalation);
 
@@ -424,7 +436,7 @@ static int requested_operation(void *fsm_param, void *evt_param)
 
     ASSERT(i_ctx != NULL);
 
-    store_dbg_info(&i_ctx->dbg_info.evt, evt_param, true);
+    store_dbg_info(i_ctx->msg_pool, &i_ctx->dbg_info.evt, evt_param, true);
 
     if (REQ_NONE == i_ctx->state.client_request)
         return ST_WAITING;
@@ -489,7 +501,7 @@ static int request_reset(void *fsm_param, void *evt_param)
 
     ASSERT(i_ctx != NULL);
 
-    store_dbg_info(&i_ctx->dbg_info.evt, evt_param, false);
+    store_dbg_info(i_ctx->msg_pool, &i_ctx->dbg_info.evt, evt_param, false);
 
     ASSERT(i_ctx->state.client_request == REQ_NONE);
     i_ctx->state.client_request = REQ_RESET;
@@ -506,7 +518,7 @@ static int request_reset_timer(void *fsm_param, void *evt_param)
 
     ASSERT(i_ctx != NULL);
 
-    store_dbg_info(&i_ctx->dbg_info.evt, evt_param, false);
+    store_dbg_info(i_ctx->msg_pool, &i_ctx->dbg_info.evt, evt_param, false);
 
     ASSERT(i_ctx->state.client_request == REQ_NONE);
     i_ctx->state.client_request = REQ_RESET;
@@ -567,8 +579,8 @@ static int reset_after_tlv(void *fsm_param, void *evt_param)
     ASSERT(i_ctx != NULL);
     (void)evt_param;  // UNUSED
 
-    tel_java_brige_broadcast_intent("com.intel.action.MODEM_TLV_APPLY_SUCCESS", "instId%d",
-                                    i_ctx->inst_id);
+    i_ctx->bridge->broadcast_intent_async(i_ctx->bridge, "com.intel.action.MODEM_TLV_APPLY_SUCCESS",
+                                         "instId%d", i_ctx->inst_id);
 
     i_ctx->elector->notify_tlv_applied(i_ctx->elector, 0);
 
@@ -599,8 +611,8 @@ static int custo_failure(void *fsm_param, void *evt_param)
     ASSERT(i_ctx != NULL);
     (void)evt_param;  // UNUSED
 
-    tel_java_brige_broadcast_intent("com.intel.action.MODEM_TLV_APPLY_ERROR", "instId%d",
-                                    i_ctx->inst_id);
+    i_ctx->bridge->broadcast_intent_async(i_ctx->bridge, "com.intel.action.MODEM_TLV_APPLY_ERROR",
+                                         "instId%d", i_ctx->inst_id);
 
     LOGD("Customization failure");
     //@TODO: fix the failure here
@@ -644,7 +656,7 @@ static int notify_unresp(void *fsm_param, void *evt_param)
 
     ASSERT(i_ctx);
 
-    store_dbg_info(&i_ctx->dbg_info.evt, evt_param, true);
+    store_dbg_info(i_ctx->msg_pool, &i_ctx->dbg_info.evt, evt_param, true);
 
     crm_escalation_next_step_t last_step = i_ctx->escalation->get_last_step(i_ctx->escalation);
     if (STEP_PLATFORM_REBOOT == last_step)
@@ -683,8 +695,8 @@ static int dump_start(void *fsm_param, void *evt_param)
                                     DBG_DEFAULT_NO_LOG, 0, NULL };
     i_ctx->clients->notify_client(i_ctx->clients, MDM_DBG_INFO, sizeof(dbg_info), &dbg_info);
 
-    tel_java_brige_broadcast_intent("com.intel.action.CORE_DUMP_WARNING", "instId%d",
-                                    i_ctx->inst_id);
+    i_ctx->bridge->broadcast_intent_async(i_ctx->bridge, "com.intel.action.CORE_DUMP_WARNING",
+                                         "instId%d", i_ctx->inst_id);
 
     ASSERT(i_ctx->dump);
     i_ctx->dump->read(i_ctx->dump, (*dump_evt_ptr)->nodes,
@@ -699,8 +711,8 @@ static int dump_end(void *fsm_param, void *evt_param)
 
     ASSERT(i_ctx);
 
-    tel_java_brige_broadcast_intent("com.intel.action.CORE_DUMP_COMPLETE", "instId%d",
-                                    i_ctx->inst_id);
+    i_ctx->bridge->broadcast_intent_async(i_ctx->bridge, "com.intel.action.CORE_DUMP_COMPLETE",
+                                         "instId%d", i_ctx->inst_id);
 
     return requested_operation(fsm_param, evt_param);
 }
@@ -767,8 +779,8 @@ static void state_trans(int prev_state, int new_state, int evt, void *fsm_param,
     if ((ST_UP == prev_state) || (ST_DOWN == prev_state))
         watchdog_start(i_ctx, i_ctx->timeout);
 
-    if (ST_UP == prev_state && i_ctx->timer_armed)
-        i_ctx->timer_armed = false;
+    if (ST_UP == prev_state)
+        i_ctx->timers->cancel(i_ctx->timers, i_ctx->timer_id);
 
     /* Handling of 'enter state' */
     if ((ST_UP == new_state) || (ST_DOWN == new_state))
@@ -823,6 +835,7 @@ static const crm_fsm_ops_t g_fsm_array[EV_NUM * ST_NUM] = {
 
 /*EV_NVM_SUCCESS*/         {-1,assert},         {-1,todo},         {-1,todo},         {-1,todo},             {-1,todo},           {-1,todo},               {-1,todo},               {-1,assert},
 /*EV_FW_SUCCESS*/          {-1,assert},         {-1,todo},         {-1,fw_ready_evt}, {-1,flash_success_evt},{-1,reset_after_tlv},{-1,todo},               {-1,todo},               {-1,assert},
+/*EV_FW_PROGRESS*/         {-1,assert},         {-1,NULL},         {-1,NULL},         {-1,flash_progress},   {-1,NULL},           {-1,NULL},               {-1,NULL},               {-1,NULL},
 /*EV_DUMP_SUCCESS*/        {-1,assert},         {-1,todo},         {-1,todo},         {-1,todo},             {-1,todo},           {-1,todo},               {-1,todo},               {-1,dump_end},
 
 /*EV_FAILURE*/             {-1,assert},         {-1,failsafe},     {-1,pack_failure}, {-1,flash_failure},    {-1,custo_failure},  {-1,failsafe},           {-1,failsafe},           {-1,requested_operation},
@@ -843,9 +856,17 @@ void event_loop(crm_ctrl_ctx_t *ctx)
                                       failsafe, i_ctx, CRM_MODULE_TAG, get_state_txt,
                                       get_event_txt);
 
+    i_ctx->timers = crm_timer_wheel_init(2, TIMER_GRANULARITY);
+    i_ctx->timer_id = i_ctx->timers->add(i_ctx->timers, notify_timeout, fsm);
+    i_ctx->bridge_timer_id = i_ctx->timers->add(i_ctx->timers, notify_bridge_retry, NULL);
+
+    i_ctx->bridge = tel_java_bridge_init();
+
     struct pollfd pfd[] = {
         { .fd = i_ctx->ipc->get_poll_fd(i_ctx->ipc), .events = POLLIN },
         { .fd = i_ctx->watchdog->get_poll_fd(i_ctx->watchdog), .events = POLLIN },
+        { .fd = i_ctx->timers->get_poll_fd(i_ctx->timers), .events = POLLIN },
+        { .fd = -1 }, // java bridge: connected on demand
     };
 
     /* Start watchdog to not stay indefinitely in INITIAL state */
@@ -853,40 +874,60 @@ void event_loop(crm_ctrl_ctx_t *ctx)
 
     bool running = true;
     while (running) {
-        int ret = poll(pfd, ARRAY_SIZE(pfd), get_timeout(i_ctx));
+        pfd[3].events = i_ctx->bridge->get_poll_events(i_ctx->bridge);
+        pfd[3].fd = i_ctx->bridge->get_poll_fd(i_ctx->bridge);
+
+        /* Intents are queued but the daemon is not reachable: retry later */
+        if (!pfd[3].events &&
+            !i_ctx->timers->is_armed(i_ctx->timers, i_ctx->bridge_timer_id))
+            i_ctx->timers->arm(i_ctx->timers, i_ctx->bridge_timer_id, BRIDGE_RETRY_TIMEOUT);
+
+        if (poll(pfd, ARRAY_SIZE(pfd), -1) < 0) {
+            DASSERT(errno == EINTR, "poll failed. errno: %d/%s", errno, strerror(errno));
+            continue;
+        }
+        watchdog_heartbeat_begin(&i_ctx->heartbeat);
 
-        for (size_t i = 0; i < ARRAY_SIZE(pfd); i++) {
+        for (size_t i = 0; i < ARRAY_SIZE(pfd) - 1; i++) {
             if (pfd[i].revents & (POLLERR | POLLHUP | POLLNVAL))
                 DASSERT(0, "error in control socket %zu", i);
         }
 
-        if (ret == 0) {
-            ASSERT(i_ctx->timer_armed == true);
-            fsm->notify_event(fsm, EV_TIMEOUT, NULL);
-        } else {
-            if (pfd[0].revents & POLLIN) {
-                crm_ipc_msg_t msg;
-                while (i_ctx->ipc->get_msg(i_ctx->ipc, &msg)) {
-                    if (-1 == msg.scalar) {
-                        running = false;
-                        continue;
-                    } else {
-                        void *msg_ptr = msg.data_size > 0 ? msg.data : NULL;
-                        fsm->notify_event(fsm, msg.scalar, &msg_ptr);
-                        free(msg_ptr);
-                    }
-                }
-            } else if (pfd[1].revents & POLLIN) {
-                crm_ipc_msg_t msg;
-                while (i_ctx->watchdog->get_msg(i_ctx->watchdog, &msg)) {
-                    enum watchdog_requests request = watchdog_get_request(msg.scalar);
-                    int id = watchdog_get_id(msg.scalar);
-                    ASSERT(CRM_WATCH_PING == request);
-
-                    msg.scalar = watchdog_gen_scalar(CRM_WATCH_PONG, 0, id);
-                    i_ctx->watchdog->send_msg(i_ctx->watchdog, &msg);
+        /* Queued intents are sent without blocking. Disconnections are handled by the library */
+        if (pfd[3].revents)
+            i_ctx->bridge->handle_poll_event(i_ctx->bridge, pfd[3].revents);
+
+        if (pfd[2].revents & POLLIN)
+            i_ctx->timers->process(i_ctx->timers);
+
+        if (pfd[0].revents & POLLIN) {
+            crm_ipc_msg_t msg;
+            while (i_ctx->ipc->get_msg(i_ctx->ipc, &msg)) {
+                if (-1 == msg.scalar) {
+                    running = false;
+                    continue;
+                } else {
+                    void *msg_ptr = msg.data_size > 0 ? msg.data : NULL;
+                    fsm->notify_event(fsm, msg.scalar, &msg_ptr);
+                    i_ctx->msg_pool->free(i_ctx->msg_pool, msg_ptr);
                 }
             }
+        } else if (pfd[1].revents & POLLIN) {
+            crm_ipc_msg_t msg;
+            while (i_ctx->watchdog->get_msg(i_ctx->watchdog, &msg)) {
+                enum watchdog_requests request = watchdog_get_request(msg.scalar);
+                int id = watchdog_get_id(msg.scalar);
+                ASSERT(CRM_WATCH_PING == request);
+
+                msg.scalar = watchdog_gen_scalar(CRM_WATCH_PONG, 0, id);
+                i_ctx->watchdog->send_msg(i_ctx->watchdog, &msg);
+            }
         }
+        watchdog_heartbeat_end(&i_ctx->heartbeat);
     }
+
+    i_ctx->timers->dispose(i_ctx->timers);
+    i_ctx->timers = NULL;
+    i_ctx->bridge->dispose(i_ctx->bridge);
+    i_ctx->bridge = NULL;
 }
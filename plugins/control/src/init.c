@@ -25,6 +25,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define CRM_MODULE_TAG "CTRL"
@@ -36,40 +37,115 @@
 #include "utils/debug.h"
 
 #include "common.h"
+#include "utils.h"
 #include "fsm_ctrl.h"
+#include "loader.h"
 #include "notify.h"
 #include "request.h"
 #include "watchdog.h"
 
-static void load_plugins(crm_control_ctx_internal_t *i_ctx, tcs_ctx_t *tcs)
+typedef struct plugins_param {
+    crm_control_ctx_internal_t *i_ctx;
+    crm_process_factory_ctx_t *factory;
+    bool load_hw_stub;
+    bool sanity_mode;
+    bool dump_enabled; // set by the dump task
+    bool host_debug;
+    int ping_period;
+    int heartbeat_timeout;
+} plugins_param_t;
+
+/* Plugins are loaded and initialized concurrently:
+ *  - the watchdog is started with the wakelock plugin, that the clients plugin needs as well
+ *  - HAL needs to know if the dump plugin is available */
+static const crm_ctrl_task_t g_plugin_tasks[PLUGIN_NB] = {
+    [PLUGIN_WAKELOCK] = { "wakelock", 0 },
+    [PLUGIN_CLIENTS] = { "clients", 1u << PLUGIN_WAKELOCK },
+    [PLUGIN_DUMP] = { "dump", 0 },
+    [PLUGIN_HAL] = { "hal", 1u << PLUGIN_DUMP },
+    [PLUGIN_FW_UPLOAD] = { "fw_upload", 0 },
+    [PLUGIN_FW_ELECTOR] = { "fw_elector", 0 },
+    [PLUGIN_CUSTOMIZATION] = { "customization", 0 },
+    [PLUGIN_ESCALATION] = { "escalation", 0 },
+};
+
+#ifdef HOST_BUILD
+/* On host, properties are environment variables: setenv and getenv are not thread safe */
+#define SEQUENTIAL_INIT true
+#else
+#define SEQUENTIAL_INIT false
+#endif
+
+static void start_watchdog(crm_control_ctx_internal_t *i_ctx, int ping_period,
+                           int heartbeat_timeout)
 {
-    ASSERT(i_ctx != NULL);
-    ASSERT(tcs);
+    watchdog_param_t *cfg_watch = calloc(1, sizeof(watchdog_param_t));
 
-    char value[CRM_PROPERTY_VALUE_MAX];
-    crm_property_get(CRM_KEY_DBG_LOAD_STUB, value, "false");
-    bool load_hw_stub = strcmp(value, "true") == 0;
+    ASSERT(cfg_watch != NULL);
+    cfg_watch->wakelock = i_ctx->wakelock;
+    cfg_watch->ping_period = ping_period;
+    cfg_watch->heartbeat_timeout = heartbeat_timeout;
+    i_ctx->heartbeat.name = "control";
+    cfg_watch->heartbeats[cfg_watch->nb_heartbeats++] = &i_ctx->heartbeat;
 
-    ASSERT(tcs->select_group(tcs, ".control.plugins") == 0);
+    i_ctx->watchdog = crm_thread_init(crm_watchdog_loop, cfg_watch, true, false);
+}
+
+static void start_plugin(int id, tcs_ctx_t *tcs, void *arg)
+{
+    plugins_param_t *p = arg;
+
+    ASSERT(p != NULL);
+    ASSERT(tcs);
 
-    if (!load_hw_stub)
-        ASSERT(!crm_plugin_load(tcs, "hal", CRM_HAL_INIT, &i_ctx->plugins[PLUGIN_HAL]));
-    else
-        ASSERT(!crm_plugin_load(tcs, "hal_stub", CRM_HAL_INIT, &i_ctx->plugins[PLUGIN_HAL]));
-
-    ASSERT(!crm_plugin_load(tcs, "clients", CRM_CLI_ABS_INIT, &i_ctx->plugins[PLUGIN_CLIENTS]));
-    ASSERT(!crm_plugin_load(tcs, "fw_upload", CRM_FW_UPLOAD_INIT,
-                            &i_ctx->plugins[PLUGIN_FW_UPLOAD]));
-    ASSERT(!crm_plugin_load(tcs, "fw_elector", CRM_FW_ELECTOR_INIT,
-                            &i_ctx->plugins[PLUGIN_FW_ELECTOR]));
-    ASSERT(!crm_plugin_load(tcs, "customization", CRM_CUSTOMIZATION_INIT,
-                            &i_ctx->plugins[PLUGIN_CUSTOMIZATION]));
-    ASSERT(!crm_plugin_load(tcs, "wakelock", CRM_WAKELOCK_INIT, &i_ctx->plugins[PLUGIN_WAKELOCK]));
-    ASSERT(!crm_plugin_load(tcs, "escalation", CRM_ESCALATION_INIT,
-                            &i_ctx->plugins[PLUGIN_ESCALATION]));
-
-    /* Dump plugin is optional: no ASSERT */
-    crm_plugin_load(tcs, "dump", CRM_DUMP_INIT, &i_ctx->plugins[PLUGIN_DUMP]);
+    crm_control_ctx_internal_t *i_ctx = p->i_ctx;
+    crm_plugin_t *plugin = &i_ctx->plugins[id];
+
+    switch (id) {
+    case PLUGIN_CLIENTS:
+        ASSERT(!crm_plugin_load(tcs, "clients", CRM_CLI_ABS_INIT, plugin));
+        i_ctx->clients = ((crm_cli_abs_init_t)plugin->init)
+                             (i_ctx->inst_id, p->sanity_mode, tcs, &i_ctx->ctx, i_ctx->wakelock);
+        break;
+    case PLUGIN_HAL:
+        ASSERT(!crm_plugin_load(tcs, p->load_hw_stub ? "hal_stub" : "hal", CRM_HAL_INIT, plugin));
+        i_ctx->hal = ((crm_hal_init_t)plugin->init)
+                         (i_ctx->inst_id, p->host_debug, p->dump_enabled, tcs, &i_ctx->ctx);
+        break;
+    case PLUGIN_FW_UPLOAD:
+        ASSERT(!crm_plugin_load(tcs, "fw_upload", CRM_FW_UPLOAD_INIT, plugin));
+        i_ctx->upload = ((crm_fw_upload_init_t)plugin->init)
+                            (i_ctx->inst_id, true, tcs, &i_ctx->ctx, p->factory);
+        break;
+    case PLUGIN_FW_ELECTOR:
+        ASSERT(!crm_plugin_load(tcs, "fw_elector", CRM_FW_ELECTOR_INIT, plugin));
+        i_ctx->elector = ((crm_fw_elector_init_t)plugin->init)(tcs, i_ctx->inst_id);
+        break;
+    case PLUGIN_CUSTOMIZATION:
+        ASSERT(!crm_plugin_load(tcs, "customization", CRM_CUSTOMIZATION_INIT, plugin));
+        i_ctx->customization = ((crm_customization_init_t)plugin->init)(tcs, &i_ctx->ctx);
+        break;
+    case PLUGIN_ESCALATION:
+        ASSERT(!crm_plugin_load(tcs, "escalation", CRM_ESCALATION_INIT, plugin));
+        i_ctx->escalation = ((crm_escalation_init_t)plugin->init)(p->sanity_mode, tcs);
+        break;
+    case PLUGIN_WAKELOCK: {
+        ASSERT(!crm_plugin_load(tcs, "wakelock", CRM_WAKELOCK_INIT, plugin));
+        char wakelock_name[5];
+        snprintf(wakelock_name, sizeof(wakelock_name), "crm%d", i_ctx->inst_id);
+        i_ctx->wakelock = ((crm_wakelock_init_t)plugin->init)(wakelock_name);
+        start_watchdog(i_ctx, p->ping_period, p->heartbeat_timeout);
+        break;
+    }
+    case PLUGIN_DUMP:
+        /* Dump plugin is optional: no ASSERT */
+        if (!crm_plugin_load(tcs, "dump", CRM_DUMP_INIT, plugin))
+            i_ctx->dump = ((crm_dump_init_t)plugin->init)
+                              (tcs, &i_ctx->ctx, p->factory, p->host_debug);
+        p->dump_enabled = i_ctx->dump != NULL;
+        break;
+    default: ASSERT(0);
+    }
 }
 
 static void unload_plugins(crm_control_ctx_internal_t *i_ctx)
@@ -82,7 +158,8 @@ static void unload_plugins(crm_control_ctx_internal_t *i_ctx)
     }
 }
 
-static void start_plugins(crm_control_ctx_internal_t *i_ctx, int ping_period, tcs_ctx_t *tcs,
+static void start_plugins(crm_control_ctx_internal_t *i_ctx, int ping_period,
+                          int heartbeat_timeout, tcs_ctx_t *tcs,
                           crm_process_factory_ctx_t *factory)
 {
     ASSERT(i_ctx);
@@ -92,41 +169,26 @@ static void start_plugins(crm_control_ctx_internal_t *i_ctx, int ping_period, tc
     /* === STATIC PLUGINS === */
     i_ctx->ipc = crm_ipc_init(CRM_IPC_THREAD); /* Better to init IPC first */
 
-    /* === INTERNAL SERVICES === */
-    char wakelock_name[5];
-    snprintf(wakelock_name, sizeof(wakelock_name), "crm%d", i_ctx->inst_id);
-    i_ctx->wakelock = ((crm_wakelock_init_t)i_ctx->plugins[PLUGIN_WAKELOCK].init)(wakelock_name);
+    plugins_param_t param = { .i_ctx = i_ctx, .factory = factory, .ping_period = ping_period,
+                              .heartbeat_timeout = heartbeat_timeout };
+    param.sanity_mode = crm_is_in_sanity_test_mode();
 
-    watchdog_param_t *cfg_watch = malloc(sizeof(watchdog_param_t));
-    ASSERT(cfg_watch != NULL);
-    cfg_watch->wakelock = i_ctx->wakelock;
-    cfg_watch->ping_period = ping_period;
+    char value[CRM_PROPERTY_VALUE_MAX];
+    crm_property_get(CRM_KEY_DBG_LOAD_STUB, value, "false");
+    param.load_hw_stub = strcmp(value, "true") == 0;
 
-    i_ctx->watchdog = crm_thread_init(crm_watchdog_loop, cfg_watch, true, false);
+    crm_property_get(CRM_KEY_DBG_HOST, value, "false");
+    param.host_debug = strcmp(value, "true") == 0;
 
-    /* === DYNAMIC PLUGINS === */
-    bool sanity_mode = crm_is_in_sanity_test_mode();
-    bool dump_enabled = i_ctx->plugins[PLUGIN_DUMP].init != NULL;
+    ASSERT(tcs->select_group(tcs, ".control.plugins") == 0);
 
-    char value[CRM_PROPERTY_VALUE_MAX];
-    crm_property_get(CRM_KEY_DBG_HOST, value, "false");
-    bool host_debug = strcmp(value, "true") == 0;
-
-    i_ctx->clients = ((crm_cli_abs_init_t)i_ctx->plugins[PLUGIN_CLIENTS].init)
-                         (i_ctx->inst_id, sanity_mode, tcs, &i_ctx->ctx, i_ctx->wakelock);
-    i_ctx->hal = ((crm_hal_init_t)i_ctx->plugins[PLUGIN_HAL].init)
-                     (i_ctx->inst_id, host_debug, dump_enabled, tcs, &i_ctx->ctx);
-    i_ctx->upload = ((crm_fw_upload_init_t)i_ctx->plugins[PLUGIN_FW_UPLOAD].init)
-                        (i_ctx->inst_id, true, tcs, &i_ctx->ctx, factory);
-    i_ctx->elector = ((crm_fw_elector_init_t)i_ctx->plugins[PLUGIN_FW_ELECTOR].init)
-                         (tcs, i_ctx->inst_id);
-    i_ctx->customization = ((crm_customization_init_t)i_ctx->plugins[PLUGIN_CUSTOMIZATION].init)
-                               (tcs, &i_ctx->ctx);
-    i_ctx->escalation = ((crm_escalation_init_t)i_ctx->plugins[PLUGIN_ESCALATION].init)
-                            (sanity_mode, tcs);
-    if (dump_enabled)
-        i_ctx->dump = ((crm_dump_init_t)i_ctx->plugins[PLUGIN_DUMP].init)
-                          (tcs, &i_ctx->ctx, factory, host_debug);
+    /* === DYNAMIC PLUGINS === */
+    /* Plugins init is seen as one event by the watchdog: a plugin stuck in its init is caught
+     * once the watchdog is started */
+    watchdog_heartbeat_begin(&i_ctx->heartbeat);
+    crm_ctrl_run_tasks(g_plugin_tasks, ARRAY_SIZE(g_plugin_tasks), SEQUENTIAL_INIT, tcs,
+                       ".control.plugins", start_plugin, &param);
+    watchdog_heartbeat_end(&i_ctx->heartbeat);
 }
 
 static void stop_plugins(crm_control_ctx_internal_t *i_ctx)
@@ -163,6 +225,7 @@ static void dispose(crm_ctrl_ctx_t *ctx)
 
     stop_plugins(i_ctx);
     unload_plugins(i_ctx);
+    i_ctx->msg_pool->dispose(i_ctx->msg_pool);
     free(ctx);
 }
 
@@ -186,6 +249,7 @@ crm_ctrl_ctx_t *crm_ctrl_init(int inst_id, tcs_ctx_t *tcs, crm_process_factory_c
     i_ctx->ctx.notify_hal_event = notify_hal_event;
     i_ctx->ctx.notify_nvm_status = notify_nvm_status;
     i_ctx->ctx.notify_fw_upload_status = notify_fw_upload_status;
+    i_ctx->ctx.notify_fw_upload_progress = notify_fw_upload_progress;
     i_ctx->ctx.notify_customization_status = notify_customization_status;
     i_ctx->ctx.notify_dump_status = notify_dump_status;
     i_ctx->ctx.notify_client = notify_client;
@@ -193,15 +257,22 @@ crm_ctrl_ctx_t *crm_ctrl_init(int inst_id, tcs_ctx_t *tcs, crm_process_factory_c
     i_ctx->inst_id = inst_id;
     i_ctx->watch_id = -1;
 
-    /* load_plugins() function will change the group. All root parameters are get here then */
+    /* start_plugins() function will change the group. All root parameters are get here then */
     ASSERT(tcs->select_group(tcs, ".control") == 0);
     ASSERT(tcs->get_int(tcs, "watchdog_timeout", &i_ctx->timeout) == 0);
 
     int ping_period;
     ASSERT(tcs->get_int(tcs, "ping_period", &ping_period) == 0);
 
-    load_plugins(i_ctx, tcs);
-    start_plugins(i_ctx, ping_period, tcs, factory);
+    int heartbeat_timeout;
+    ASSERT(tcs->get_int(tcs, "heartbeat_timeout", &heartbeat_timeout) == 0);
+
+    int msg_pool_size;
+    ASSERT(tcs->get_int(tcs, "msg_pool_size", &msg_pool_size) == 0);
+    i_ctx->msg_pool = crm_msg_pool_init(MAX(sizeof(crm_hal_evt_t), DBG_INFO_COPY_SIZE_MAX),
+                                        msg_pool_size);
+
+    start_plugins(i_ctx, ping_period, heartbeat_timeout, tcs, factory);
 
     LOGV("context %p", i_ctx);
     return &i_ctx->ctx;
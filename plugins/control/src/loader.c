@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CRM_MODULE_TAG "CTRL"
+#include "utils/common.h"
+#include "utils/logs.h"
+#include "utils/thread.h"
+#include "utils/time.h"
+
+#include "loader.h"
+
+typedef struct tcs_view {
+    tcs_ctx_t ctx; // Needs to be first
+
+    tcs_ctx_t *tcs;
+    pthread_mutex_t *lock;
+    char *group;
+} tcs_view_t;
+
+typedef struct task_runner task_runner_t;
+
+typedef struct task_ctx {
+    task_runner_t *runner;
+    int id;
+    tcs_view_t *view;
+    crm_thread_ctx_t *thread;
+    int start;    // in ms, since the beginning
+    int duration; // in ms
+} task_ctx_t;
+
+struct task_runner {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned int done;
+
+    pthread_mutex_t tcs_lock;
+    struct timespec begin;
+    void (*run)(int id, tcs_ctx_t *tcs, void *arg);
+    void *arg;
+};
+
+/* Selects the group of the view before accessing TCS. Must be called with the TCS lock held */
+static tcs_ctx_t *view_get_tcs(tcs_view_t *view)
+{
+    if (view->group)
+        view->tcs->select_group(view->tcs, view->group);
+    return view->tcs;
+}
+
+/**
+ * @see tcs.h
+ */
+static int view_select_group(tcs_ctx_t *ctx, const char *group)
+{
+    tcs_view_t *view = (tcs_view_t *)ctx;
+
+    ASSERT(view != NULL);
+    ASSERT(group != NULL);
+
+    ASSERT(pthread_mutex_lock(view->lock) == 0);
+    int ret = view->tcs->select_group(view->tcs, group);
+    if (!ret) {
+        free(view->group);
+        view->group = strdup(group);
+        ASSERT(view->group);
+    }
+    ASSERT(pthread_mutex_unlock(view->lock) == 0);
+
+    return ret;
+}
+
+/**
+ * @see tcs.h
+ */
+static int view_add_group(tcs_ctx_t *ctx, const char *group, bool print)
+{
+    tcs_view_t *view = (tcs_view_t *)ctx;
+
+    ASSERT(view != NULL);
+
+    ASSERT(pthread_mutex_lock(view->lock) == 0);
+    tcs_ctx_t *tcs = view_get_tcs(view);
+    int ret = tcs->add_group(tcs, group, print);
+    ASSERT(pthread_mutex_unlock(view->lock) == 0);
+
+    return ret;
+}
+
+/**
+ * @see tcs.h
+ */
+static char *view_get_string(tcs_ctx_t *ctx, const char *key)
+{
+    tcs_view_t *view = (tcs_view_t *)ctx;
+
+    ASSERT(view != NULL);
+
+    ASSERT(pthread_mutex_lock(view->lock) == 0);
+    tcs_ctx_t *tcs = view_get_tcs(view);
+    char *value = tcs->get_string(tcs, key);
+    ASSERT(pthread_mutex_unlock(view->lock) == 0);
+
+    return value;
+}
+
+/**
+ * @see tcs.h
+ */
+static int view_get_int(tcs_ctx_t *ctx, const char *key, int *value)
+{
+    tcs_view_t *view = (tcs_view_t *)ctx;
+
+    ASSERT(view != NULL);
+
+    ASSERT(pthread_mutex_lock(view->lock) == 0);
+    tcs_ctx_t *tcs = view_get_tcs(view);
+    int ret = tcs->get_int(tcs, key, value);
+    ASSERT(pthread_mutex_unlock(view->lock) == 0);
+
+    return ret;
+}
+
+/**
+ * @see tcs.h
+ */
+static int view_get_bool(tcs_ctx_t *ctx, const char *key, bool *value)
+{
+    tcs_view_t *view = (tcs_view_t *)ctx;
+
+    ASSERT(view != NULL);
+
+    ASSERT(pthread_mutex_lock(view->lock) == 0);
+    tcs_ctx_t *tcs = view_get_tcs(view);
+    int ret = tcs->get_bool(tcs, key, value);
+    ASSERT(pthread_mutex_unlock(view->lock) == 0);
+
+    return ret;
+}
+
+/**
+ * @see tcs.h
+ */
+static char **view_get_string_array(tcs_ctx_t *ctx, const char *key, int *nb)
+{
+    tcs_view_t *view = (tcs_view_t *)ctx;
+
+    ASSERT(view != NULL);
+
+    ASSERT(pthread_mutex_lock(view->lock) == 0);
+    tcs_ctx_t *tcs = view_get_tcs(view);
+    char **value = tcs->get_string_array(tcs, key, nb);
+    ASSERT(pthread_mutex_unlock(view->lock) == 0);
+
+    return value;
+}
+
+/**
+ * @see tcs.h
+ */
+static void view_print(tcs_ctx_t *ctx)
+{
+    tcs_view_t *view = (tcs_view_t *)ctx;
+
+    ASSERT(view != NULL);
+
+    ASSERT(pthread_mutex_lock(view->lock) == 0);
+    view->tcs->print(view->tcs);
+    ASSERT(pthread_mutex_unlock(view->lock) == 0);
+}
+
+/**
+ * @see tcs.h
+ */
+static void view_dispose(tcs_ctx_t *ctx)
+{
+    tcs_view_t *view = (tcs_view_t *)ctx;
+
+    ASSERT(view != NULL);
+
+    free(view->group);
+    free(view);
+}
+
+static tcs_view_t *view_init(tcs_ctx_t *tcs, pthread_mutex_t *lock, const char *group)
+{
+    tcs_view_t *view = calloc(1, sizeof(tcs_view_t));
+
+    ASSERT(view != NULL);
+
+    view->ctx.dispose = view_dispose;
+    view->ctx.print = view_print;
+    view->ctx.select_group = view_select_group;
+    view->ctx.add_group = view_add_group;
+    view->ctx.get_string = view_get_string;
+    view->ctx.get_int = view_get_int;
+    view->ctx.get_bool = view_get_bool;
+    view->ctx.get_string_array = view_get_string_array;
+
+    view->tcs = tcs;
+    view->lock = lock;
+    if (group) {
+        view->group = strdup(group);
+        ASSERT(view->group);
+    }
+
+    return view;
+}
+
+static void *task_routine(crm_thread_ctx_t *thread_ctx, void *arg)
+{
+    task_ctx_t *task = arg;
+
+    (void)thread_ctx; // unused
+    ASSERT(task != NULL);
+
+    task_runner_t *runner = task->runner;
+    struct timespec start;
+    clock_gettime(CLOCK_BOOTTIME, &start);
+
+    runner->run(task->id, &task->view->ctx, runner->arg);
+
+    ASSERT(pthread_mutex_lock(&runner->lock) == 0);
+    task->duration = crm_time_get_elapsed_ms(&start);
+    runner->done |= 1u << task->id;
+    ASSERT(pthread_cond_signal(&runner->cond) == 0);
+    ASSERT(pthread_mutex_unlock(&runner->lock) == 0);
+
+    return NULL;
+}
+
+/**
+ * @see loader.h
+ */
+void crm_ctrl_run_tasks(const crm_ctrl_task_t *tasks, int nb, bool sequential, tcs_ctx_t *tcs,
+                        const char *group, void (*run)(int id, tcs_ctx_t *tcs, void *arg),
+                        void *arg)
+{
+    ASSERT(tasks != NULL);
+    ASSERT(nb > 0 && nb <= CRM_TASK_MAX);
+    ASSERT(tcs != NULL);
+    ASSERT(run != NULL);
+
+    task_runner_t runner = { .done = 0, .run = run, .arg = arg };
+    task_ctx_t ctx[CRM_TASK_MAX];
+    unsigned int all = (nb == CRM_TASK_MAX) ? ~0u : (1u << nb) - 1;
+    unsigned int started = 0;
+
+    ASSERT(pthread_mutex_init(&runner.lock, NULL) == 0);
+    ASSERT(pthread_mutex_init(&runner.tcs_lock, NULL) == 0);
+    ASSERT(pthread_cond_init(&runner.cond, NULL) == 0);
+    clock_gettime(CLOCK_BOOTTIME, &runner.begin);
+
+    ASSERT(pthread_mutex_lock(&runner.lock) == 0);
+    while (runner.done != all) {
+        for (int i = 0; i < nb; i++) {
+            if (sequential && (started & ~runner.done))
+                break;
+            if ((started & (1u << i)) || ((tasks[i].deps & runner.done) != tasks[i].deps))
+                continue;
+
+            ctx[i].runner = &runner;
+            ctx[i].id = i;
+            ctx[i].view = view_init(tcs, &runner.tcs_lock, group);
+            ctx[i].start = crm_time_get_elapsed_ms(&runner.begin);
+            ctx[i].thread = crm_thread_init(task_routine, &ctx[i], false, false);
+            started |= 1u << i;
+        }
+
+        DASSERT((started & ~runner.done) != 0, "tasks dependencies can't be resolved");
+        ASSERT(pthread_cond_wait(&runner.cond, &runner.lock) == 0);
+    }
+    ASSERT(pthread_mutex_unlock(&runner.lock) == 0);
+
+    for (int i = 0; i < nb; i++) {
+        ctx[i].thread->dispose(ctx[i].thread, NULL);
+        ctx[i].view->ctx.dispose(&ctx[i].view->ctx);
+        LOGV("<Task: %-15s> - started at: %4dms - duration: %4dms", tasks[i].name, ctx[i].start,
+             ctx[i].duration);
+    }
+    LOGV("%d tasks completed in %dms", nb, crm_time_get_elapsed_ms(&runner.begin));
+
+    pthread_cond_destroy(&runner.cond);
+    pthread_mutex_destroy(&runner.tcs_lock);
+    pthread_mutex_destroy(&runner.lock);
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CRM_CONTROL_LOADER_HEADER__
+#define __CRM_CONTROL_LOADER_HEADER__
+
+#include <stdbool.h>
+#include "libtcs2/tcs.h"
+
+#define CRM_TASK_MAX 32
+
+typedef struct crm_ctrl_task {
+    const char *name;
+    unsigned int deps; // bitmask of the tasks (index in the tasks array) to be completed first
+} crm_ctrl_task_t;
+
+/**
+ * Runs tasks concurrently. A task is started as soon as all its dependencies are completed.
+ * The function returns when all tasks are completed. Start time and duration of each task are
+ * logged.
+ *
+ * TCS context is not thread safe. Each task is given its own view of the TCS context: a task can
+ * select its groups without disturbing the other tasks. Accesses to TCS are serialized.
+ *
+ * @param [in] tasks      Tasks description
+ * @param [in] nb         Number of tasks
+ * @param [in] sequential Tasks are run one at a time, in dependency order
+ * @param [in] tcs        TCS context
+ * @param [in] group      TCS group selected when a task starts
+ * @param [in] run        Task routine. Called with the index of the task in the tasks array
+ * @param [in] arg        Argument provided to the task routine
+ */
+void crm_ctrl_run_tasks(const crm_ctrl_task_t *tasks, int nb, bool sequential, tcs_ctx_t *tcs,
+                        const char *group, void (*run)(int id, tcs_ctx_t *tcs, void *arg),
+                        void *arg);
+
+#endif /* __CRM_CONTROL_LOADER_HEADER__ */
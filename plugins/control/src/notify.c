@@ -97,7 +97,7 @@ void notify_hal_event(crm_ctrl_ctx_t *ctx, const crm_hal_evt_t *event)
     case HAL_MDM_UNRESPONSIVE:
     {
         crm_ipc_msg_t msg = { .scalar = get_hal_id(event->type) };
-        msg.data = copy_dbg_info(event->dbg_info);
+        msg.data = copy_dbg_info(i_ctx->msg_pool, event->dbg_info);
         msg.data_size = sizeof(event->dbg_info);
         ASSERT(i_ctx->ipc->send_msg(i_ctx->ipc, &msg));
     }
@@ -105,8 +105,7 @@ void notify_hal_event(crm_ctrl_ctx_t *ctx, const crm_hal_evt_t *event)
     case HAL_MDM_FLASH:
     case HAL_MDM_DUMP:
     {
-        crm_hal_evt_t *event_copy = malloc(sizeof(crm_hal_evt_t));
-        ASSERT(event_copy);
+        crm_hal_evt_t *event_copy = i_ctx->msg_pool->alloc(i_ctx->msg_pool);
         *event_copy = *event;
 
         crm_ipc_msg_t msg = { get_hal_id(event->type), sizeof(*event_copy), event_copy };
@@ -144,6 +143,19 @@ void notify_fw_upload_status(crm_ctrl_ctx_t *ctx, int status)
     notify_simple_event(i_ctx->ipc, EV_FW_SUCCESS, status);
 }
 
+/**
+ * @see control.h
+ */
+void notify_fw_upload_progress(crm_ctrl_ctx_t *ctx, size_t offset, size_t size, unsigned int rate)
+{
+    crm_control_ctx_internal_t *i_ctx = (crm_control_ctx_internal_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+
+    LOGD("->%s(%zu/%zu bytes, %u KB/s)", __FUNCTION__, offset, size, rate);
+    notify_simple_event(i_ctx->ipc, EV_FW_PROGRESS, 0);
+}
+
 /**
  * @see control.h
  */
@@ -44,6 +44,11 @@ void notify_nvm_status(crm_ctrl_ctx_t *ctx, int status);
  */
 void notify_fw_upload_status(crm_ctrl_ctx_t *ctx, int status);
 
+/**
+ * @see control.h
+ */
+void notify_fw_upload_progress(crm_ctrl_ctx_t *ctx, size_t offset, size_t size, unsigned int rate);
+
 /**
  * @see control.h
  */
@@ -87,7 +87,7 @@ void crm_ctrl_restart(crm_ctrl_ctx_t *ctx, crm_ctrl_restart_type_t type,
     case CTRL_MODEM_RESTART:
         // default message is EV_CLI_RESET
         if (dbg_info) {
-            msg.data = copy_dbg_info(dbg_info);
+            msg.data = copy_dbg_info(i_ctx->msg_pool, dbg_info);
             msg.data_size = sizeof(dbg_info);
         }
         break;
@@ -32,20 +32,27 @@
 
 #include "utils.h"
 
-mdm_cli_dbg_info_t *copy_dbg_info(const mdm_cli_dbg_info_t *dbg_info)
+mdm_cli_dbg_info_t *copy_dbg_info(crm_msg_pool_t *pool, const mdm_cli_dbg_info_t *dbg_info)
 {
+    ASSERT(pool);
     ASSERT(dbg_info);
 
-    mdm_cli_dbg_info_t *copy = malloc(sizeof(mdm_cli_dbg_info_t));
-    ASSERT(copy);
+    size_t size = sizeof(mdm_cli_dbg_info_t) + dbg_info->nb_data * sizeof(char *);
+    for (size_t i = 0; i < dbg_info->nb_data; i++)
+        size += strlen(dbg_info->data[i]) + 1;
+    DASSERT(size <= DBG_INFO_COPY_SIZE_MAX, "debug information too large (%zu bytes)", size);
 
+    mdm_cli_dbg_info_t *copy = pool->alloc(pool);
     *copy = *dbg_info;
-    copy->data = malloc(dbg_info->nb_data * sizeof(char *));
-    ASSERT(copy->data);
+    const char **data = (const char **)(copy + 1);
+    char *str = (char *)(data + dbg_info->nb_data);
     for (size_t i = 0; i < dbg_info->nb_data; i++) {
-        copy->data[i] = strdup(dbg_info->data[i]);
-        ASSERT(copy->data[i]);
+        size_t len = strlen(dbg_info->data[i]) + 1;
+        memcpy(str, dbg_info->data[i], len);
+        data[i] = str;
+        str += len;
     }
+    copy->data = dbg_info->nb_data ? data : NULL;
 
     return copy;
 }
@@ -29,8 +29,13 @@
 #define __CRM_CONTROL_UTILS_HEADER__
 
 #include "utils/ipc.h"
+#include "utils/msg_pool.h"
 #include "libmdmcli/mdm_cli_dbg.h"
 
-mdm_cli_dbg_info_t *copy_dbg_info(const mdm_cli_dbg_info_t *dbg);
+/* A copy of debug information is stored in a single block: structure, data array, then strings */
+#define DBG_INFO_COPY_SIZE_MAX (sizeof(mdm_cli_dbg_info_t) + \
+                                MDM_CLI_MAX_NB_DATA * (sizeof(char *) + MDM_CLI_MAX_LEN_DATA))
+
+mdm_cli_dbg_info_t *copy_dbg_info(crm_msg_pool_t *pool, const mdm_cli_dbg_info_t *dbg);
 
 #endif
@@ -26,66 +26,114 @@
 
 #include <poll.h>
 #include <string.h>
-#include <time.h>
-#include <limits.h>
 
 #define CRM_MODULE_TAG "CTRL"
 #include "utils/common.h"
 #include "utils/logs.h"
 #include "utils/thread.h"
 #include "utils/wakelock.h"
-#include "utils/time.h"
+#include "utils/timer_wheel.h"
 
 #include "watchdog.h"
 
 
 typedef struct watchdog_timer {
     int id;
-    bool armed;
-    struct timespec end;
+    int timer;         // timer wheel id
     bool waiting_pong; // only used by PING/PONG request
 } watchdog_timer_t;
 
+typedef struct watchdog_ctx {
+    crm_thread_ctx_t *thread_ctx;
+    crm_wakelock_t *wakelock;
+    crm_timer_wheel_t *timers;
+    int ping_period;
+    watchdog_timer_t timer[2];
+
+    /* Heartbeat mode */
+    int heartbeat_timeout;
+    int sample_timer;
+    int nb_heartbeats;
+    watchdog_heartbeat_t *heartbeats[MAX_HEARTBEATS];
+    int latency_reported[MAX_HEARTBEATS];
+} watchdog_ctx_t;
+
 #define PING_IDX 0
 #define REQ_IDX 1
 
-static int get_timeout(watchdog_timer_t *timer, int *idx)
+/* Watchdog time-outs are in seconds: a coarse granularity is enough */
+#define TIMER_GRANULARITY 10 /* ms */
+
+static void ping_timeout(void *param)
 {
-    int timeout = INT_MAX;
-
-    ASSERT(idx != NULL);
-
-    *idx = -1;
-    int i;
-    for (i = 0; i < 2; i++) {
-        if (timer[i].armed) {
-            int remain = crm_time_get_remain_ms(&timer[i].end);
-            if (remain <= 1) {
-                timeout = 0;
-                *idx = i;
-                break;
-            } else if (remain < timeout) {
-                *idx = i;
-                timeout = remain;
-            }
-        }
+    watchdog_ctx_t *ctx = param;
+    watchdog_timer_t *ping = &ctx->timer[PING_IDX];
+
+    if (ping->waiting_pong) {
+        ctx->wakelock->release(ctx->wakelock, WAKELOCK_WATCHDOG_PING);
+        ASSERT(ctx->wakelock->is_held_by_module(ctx->wakelock, WAKELOCK_WATCHDOG_PING) == false);
+        DASSERT(0, "PONG not received. watchdog expiration");
+    } else {
+        ctx->wakelock->acquire(ctx->wakelock, WAKELOCK_WATCHDOG_PING);
+
+        // New PING timer configuration: armed to wait for PING answer
+        ping->id = watchdog_get_new_id(ping->id);
+        ping->waiting_pong = true;
+        ctx->timers->arm(ctx->timers, ping->timer, MAX_PING_ELAPSED);
+
+        crm_ipc_msg_t msg = { .scalar = watchdog_gen_scalar(CRM_WATCH_PING, 0, ping->id) };
+        ctx->thread_ctx->send_msg(ctx->thread_ctx, &msg);
     }
+}
 
-    ASSERT(timeout != INT_MAX);
-    ASSERT(*idx != -1);
+static void req_timeout(void *param)
+{
+    watchdog_ctx_t *ctx = param;
 
-    return timeout;
+    ctx->wakelock->release(ctx->wakelock, WAKELOCK_WATCHDOG_REQ);
+    ASSERT(ctx->wakelock->is_held_by_module(ctx->wakelock, WAKELOCK_WATCHDOG_REQ) == false);
+    DASSERT(0, "Answer not received. watchdog expiration");
 }
 
-static void handle_msg(watchdog_timer_t *timer, crm_ipc_msg_t *msg, int ping_period,
-                       crm_wakelock_t *wakelock)
+/* Heartbeats are sampled once per timeout. If a thread is handling an event, the next sample is
+ * done when this handling reaches the timeout: a stall is detected on time without waking up more
+ * often */
+static void sample_heartbeats(void *param)
+{
+    watchdog_ctx_t *ctx = param;
+    int64_t now = watchdog_get_time_ms();
+    int next = ctx->heartbeat_timeout;
+
+    for (int i = 0; i < ctx->nb_heartbeats; i++) {
+        watchdog_heartbeat_t *heartbeat = ctx->heartbeats[i];
+
+        if (__atomic_load_n(&heartbeat->counter, __ATOMIC_ACQUIRE) & 1) {
+            int elapsed = now - __atomic_load_n(&heartbeat->begin, __ATOMIC_RELAXED);
+            DASSERT(elapsed < ctx->heartbeat_timeout,
+                    "%s thread stalled for %dms. watchdog expiration", heartbeat->name, elapsed);
+            next = MIN(next, ctx->heartbeat_timeout - elapsed);
+        }
+
+        int latency = __atomic_load_n(&heartbeat->latency_max, __ATOMIC_RELAXED);
+        if (latency > ctx->latency_reported[i]) {
+            LOGD("%s thread: max loop latency %dms", heartbeat->name, latency);
+            ctx->latency_reported[i] = latency;
+        }
+    }
+
+    ctx->timers->arm(ctx->timers, ctx->sample_timer, next);
+}
+
+static void handle_msg(watchdog_ctx_t *ctx, crm_ipc_msg_t *msg)
 {
     enum watchdog_requests request = watchdog_get_request(msg->scalar);
     int timeout = watchdog_get_timeout(msg->scalar);
     int id = watchdog_get_id(msg->scalar);
+    watchdog_timer_t *timer = ctx->timer;
+    crm_wakelock_t *wakelock = ctx->wakelock;
 
     switch (request) {
-    case CRM_WATCH_START:
+    case CRM_WATCH_START: {
         /* If a request is already pending, the new one overwrites the previous one */
         if (timer[REQ_IDX].id < MAX_REQ_ID)
             ASSERT(id == (timer[REQ_IDX].id + 1));
@@ -94,17 +142,17 @@ static void handle_msg(watchdog_timer_t *timer, crm_ipc_msg_t *msg, int ping_per
 
         /* Make sure that wakelock is held if timer is armed or not if unarmed */
         bool is_held = wakelock->is_held_by_module(wakelock, WAKELOCK_WATCHDOG_REQ);
-        ASSERT(timer[REQ_IDX].armed == is_held);
+        ASSERT(ctx->timers->is_armed(ctx->timers, timer[REQ_IDX].timer) == is_held);
         if (!is_held)
             wakelock->acquire(wakelock, WAKELOCK_WATCHDOG_REQ);
 
         timer[REQ_IDX].id = id;
-        timer[REQ_IDX].armed = true;
-        crm_time_add_ms(&timer[REQ_IDX].end, timeout);
+        ctx->timers->arm(ctx->timers, timer[REQ_IDX].timer, timeout);
 
         break;
+    }
     case CRM_WATCH_STOP:
-        ASSERT(timer[REQ_IDX].armed == true);
+        ASSERT(ctx->timers->is_armed(ctx->timers, timer[REQ_IDX].timer) == true);
 
         if (timer[REQ_IDX].id != id)
             break;
@@ -112,7 +160,7 @@ static void handle_msg(watchdog_timer_t *timer, crm_ipc_msg_t *msg, int ping_per
         wakelock->release(wakelock, WAKELOCK_WATCHDOG_REQ);
         ASSERT(wakelock->is_held_by_module(wakelock, WAKELOCK_WATCHDOG_REQ) == false);
 
-        timer[REQ_IDX].armed = false;
+        ctx->timers->cancel(ctx->timers, timer[REQ_IDX].timer);
         break;
     case CRM_WATCH_PONG:
         ASSERT(timer[PING_IDX].waiting_pong == true);
@@ -123,7 +171,7 @@ static void handle_msg(watchdog_timer_t *timer, crm_ipc_msg_t *msg, int ping_per
 
         // New PING timer configuration: armed to send the PING request
         timer[PING_IDX].waiting_pong = false;
-        crm_time_add_ms(&timer[PING_IDX].end, ping_period);
+        ctx->timers->arm(ctx->timers, timer[PING_IDX].timer, ctx->ping_period);
         break;
     default: ASSERT(0);
     }
@@ -134,69 +182,72 @@ static void handle_msg(watchdog_timer_t *timer, crm_ipc_msg_t *msg, int ping_per
  */
 void *crm_watchdog_loop(crm_thread_ctx_t *thread_ctx, void *param)
 {
-    watchdog_timer_t timer[2];
-    struct pollfd pfd = { .fd = thread_ctx->get_poll_fd(thread_ctx), .events = POLLIN };
-
+    watchdog_ctx_t ctx = { .thread_ctx = thread_ctx };
     watchdog_param_t *cfg = (watchdog_param_t *)param;
 
     ASSERT(cfg != NULL);
 
-    int ping_period = cfg->ping_period;
-    crm_wakelock_t *wakelock = cfg->wakelock;
-    ASSERT(ping_period > 0);
-    ASSERT(wakelock != NULL);
+    ctx.ping_period = cfg->ping_period;
+    ctx.wakelock = cfg->wakelock;
+    ctx.heartbeat_timeout = cfg->heartbeat_timeout;
+    ctx.nb_heartbeats = cfg->nb_heartbeats;
+    for (int i = 0; i < cfg->nb_heartbeats; i++)
+        ctx.heartbeats[i] = cfg->heartbeats[i];
+    ASSERT(ctx.ping_period > 0);
+    ASSERT(ctx.wakelock != NULL);
+    ASSERT(ctx.heartbeat_timeout >= 0);
+    ASSERT(ctx.nb_heartbeats >= 0 && ctx.nb_heartbeats <= MAX_HEARTBEATS);
 
     free(cfg);
     cfg = NULL;
 
-    timer[PING_IDX].id = -1;
-    timer[PING_IDX].armed = true;
-    timer[PING_IDX].waiting_pong = false;
-    crm_time_add_ms(&timer[PING_IDX].end, ping_period);
+    ctx.timers = crm_timer_wheel_init(ARRAY_SIZE(ctx.timer) + 1, TIMER_GRANULARITY);
+    ctx.timer[PING_IDX].timer = ctx.timers->add(ctx.timers, ping_timeout, &ctx);
+    ctx.timer[REQ_IDX].timer = ctx.timers->add(ctx.timers, req_timeout, &ctx);
+    ctx.sample_timer = ctx.timers->add(ctx.timers, sample_heartbeats, &ctx);
+
+    ctx.timer[PING_IDX].id = -1;
+    ctx.timer[PING_IDX].waiting_pong = false;
+    if (ctx.heartbeat_timeout > 0) {
+        LOGD("heartbeat mode: %d thread(s), timeout %dms", ctx.nb_heartbeats,
+             ctx.heartbeat_timeout);
+        ctx.timers->arm(ctx.timers, ctx.sample_timer, ctx.heartbeat_timeout);
+    } else {
+        ctx.timers->arm(ctx.timers, ctx.timer[PING_IDX].timer, ctx.ping_period);
+    }
+
+    ctx.timer[REQ_IDX].id = -1;
 
-    timer[REQ_IDX].id = -1;
-    timer[REQ_IDX].armed = false;
+    struct pollfd pfd[] = {
+        { .fd = thread_ctx->get_poll_fd(thread_ctx), .events = POLLIN },
+        { .fd = ctx.timers->get_poll_fd(ctx.timers), .events = POLLIN },
+    };
 
     bool run = true;
     while (run) {
-        int idx;
-        int err = poll(&pfd, 1, get_timeout(timer, &idx));
-        if ((-1 == err) || (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)))
+        int err = poll(pfd, ARRAY_SIZE(pfd), -1);
+        if (-1 == err)
             DASSERT(0, "error in control socket");
+        for (size_t i = 0; i < ARRAY_SIZE(pfd); i++) {
+            if (pfd[i].revents & (POLLERR | POLLHUP | POLLNVAL))
+                DASSERT(0, "error in control socket");
+        }
 
-        if (0 == err) {
-            if (PING_IDX == idx) {
-                if (timer[PING_IDX].waiting_pong) {
-                    wakelock->release(wakelock, WAKELOCK_WATCHDOG_PING);
-                    ASSERT(wakelock->is_held_by_module(wakelock, WAKELOCK_WATCHDOG_PING) == false);
-                    DASSERT(0, "PONG not received. watchdog expiration");
-                } else {
-                    wakelock->acquire(wakelock, WAKELOCK_WATCHDOG_PING);
-
-                    // New PING timer configuration: armed to wait for PING answer
-                    timer[PING_IDX].id = watchdog_get_new_id(timer[PING_IDX].id);
-                    timer[PING_IDX].waiting_pong = true;
-                    crm_time_add_ms(&timer[PING_IDX].end, MAX_PING_ELAPSED);
-
-                    crm_ipc_msg_t msg =
-                    { .scalar = watchdog_gen_scalar(CRM_WATCH_PING, 0, timer[PING_IDX].id) };
-                    thread_ctx->send_msg(thread_ctx, &msg);
-                }
-            } else if (REQ_IDX == idx) {
-                wakelock->release(wakelock, WAKELOCK_WATCHDOG_REQ);
-                ASSERT(wakelock->is_held_by_module(wakelock, WAKELOCK_WATCHDOG_REQ) == false);
-                DASSERT(0, "Answer not received. watchdog expiration");
-            }
-        } else if (pfd.revents & POLLIN) {
+        if (pfd[1].revents & POLLIN)
+            ctx.timers->process(ctx.timers);
+
+        if (pfd[0].revents & POLLIN) {
             crm_ipc_msg_t msg;
             while (thread_ctx->get_msg(thread_ctx, &msg)) {
                 if (msg.scalar == -1)
                     run = false;
                 else
-                    handle_msg(timer, &msg, ping_period, wakelock);
+                    handle_msg(&ctx, &msg);
             }
         }
     }
 
+    ctx.timers->dispose(ctx.timers);
+
     return NULL;
 }
@@ -27,10 +27,14 @@
 #ifndef __CRM_CONTROL_WATCHDOG_HEADER__
 #define __CRM_CONTROL_WATCHDOG_HEADER__
 
+#include <stdint.h>
+#include <time.h>
+
 #include "utils/thread.h"
 #include "utils/wakelock.h"
 
 #define MAX_PING_ELAPSED 10000 /* ms */
+#define MAX_HEARTBEATS 4
 
 /**
  * Watchdog functionality:
@@ -52,6 +56,17 @@
  *   User must answer by sending PONG request with the same ID.
  *
  *   If client answer is received too late, watchdog asserts.
+ *
+ * - HEARTBEAT:
+ *   ---------
+ *   Replaces PING/PONG if a heartbeat timeout is configured. Each monitored thread owns a
+ *   watchdog_heartbeat_t and brackets the handling of its events with watchdog_heartbeat_begin()
+ *   and watchdog_heartbeat_end(). No message is exchanged: the watchdog samples the heartbeats
+ *   once per timeout, and at the deadline of an event being handled.
+ *
+ *   If a thread handles the same event for longer than the timeout, watchdog asserts. A thread
+ *   waiting for events is never considered as stalled.
+ *   The maximum loop latency of each thread is logged each time it increases.
  */
 
 enum watchdog_requests {
@@ -111,9 +126,45 @@ static inline int watchdog_get_new_id(int id)
         return 0;
 }
 
+/* Heartbeat of a monitored thread. Written by the thread, read by the watchdog */
+typedef struct watchdog_heartbeat {
+    const char *name;
+    uint32_t counter;  // odd while the thread handles an event
+    int64_t begin;     // ms (CLOCK_MONOTONIC) when the handling of the current event started
+    int latency_max;   // ms
+} watchdog_heartbeat_t;
+
+/* CLOCK_MONOTONIC does not count suspend: a thread frozen during suspend is not stalled */
+static inline int64_t watchdog_get_time_ms(void)
+{
+    struct timespec now;
+
+    ASSERT(clock_gettime(CLOCK_MONOTONIC, &now) == 0);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static inline void watchdog_heartbeat_begin(watchdog_heartbeat_t *heartbeat)
+{
+    __atomic_store_n(&heartbeat->begin, watchdog_get_time_ms(), __ATOMIC_RELAXED);
+    __atomic_add_fetch(&heartbeat->counter, 1, __ATOMIC_RELEASE);
+}
+
+static inline void watchdog_heartbeat_end(watchdog_heartbeat_t *heartbeat)
+{
+    int latency = watchdog_get_time_ms() - heartbeat->begin;
+
+    if (latency > heartbeat->latency_max)
+        __atomic_store_n(&heartbeat->latency_max, latency, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&heartbeat->counter, 1, __ATOMIC_RELEASE);
+}
+
+/* heartbeat_timeout: in ms. If 0, PING/PONG is used and heartbeats are ignored */
 typedef struct watchdog_param {
     int ping_period;
     crm_wakelock_t *wakelock;
+    int heartbeat_timeout;
+    int nb_heartbeats;
+    watchdog_heartbeat_t *heartbeats[MAX_HEARTBEATS];
 } watchdog_param_t;
 
 /**
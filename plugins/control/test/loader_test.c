@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CRM_MODULE_TAG "LDRT"
+#include "utils/common.h"
+#include "utils/logs.h"
+#include "test/test_utils.h"
+#include "libmdmcli/mdm_cli.h"
+
+#include "loader.h"
+
+enum tasks {
+    TASK_CONTROL,
+    TASK_PLUGINS,
+    TASK_LATE,
+    TASK_NB
+};
+
+typedef struct test_ctx {
+    pthread_mutex_t lock;
+    unsigned int done;
+    int ping_period;
+    int running;
+    int running_max;
+} test_ctx_t;
+
+static void run(int id, tcs_ctx_t *tcs, void *arg)
+{
+    test_ctx_t *ctx = arg;
+
+    ASSERT(ctx != NULL);
+
+    ASSERT(pthread_mutex_lock(&ctx->lock) == 0);
+    ctx->running++;
+    ctx->running_max = MAX(ctx->running_max, ctx->running);
+    ASSERT(pthread_mutex_unlock(&ctx->lock) == 0);
+
+    switch (id) {
+    case TASK_CONTROL:
+        /* waits for the other task to change its group */
+        ASSERT(tcs->select_group(tcs, ".control") == 0);
+        usleep(100000);
+        ASSERT(tcs->get_int(tcs, "ping_period", &ctx->ping_period) == 0);
+        break;
+    case TASK_PLUGINS: {
+        /* group given to crm_ctrl_run_tasks is selected by default */
+        char *hal = tcs->get_string(tcs, "hal");
+        ASSERT(hal != NULL);
+        free(hal);
+        ASSERT(tcs->select_group(tcs, ".control") == 0);
+        break;
+    }
+    case TASK_LATE:
+        ASSERT(pthread_mutex_lock(&ctx->lock) == 0);
+        ASSERT(ctx->done & (1u << TASK_CONTROL));
+        ASSERT(pthread_mutex_unlock(&ctx->lock) == 0);
+        break;
+    default: ASSERT(0);
+    }
+
+    ASSERT(pthread_mutex_lock(&ctx->lock) == 0);
+    ctx->done |= 1u << id;
+    ctx->running--;
+    ASSERT(pthread_mutex_unlock(&ctx->lock) == 0);
+}
+
+int main()
+{
+    const crm_ctrl_task_t tasks[TASK_NB] = {
+        [TASK_CONTROL] = { "control", 0 },
+        [TASK_PLUGINS] = { "plugins", 0 },
+        [TASK_LATE] = { "late", 1u << TASK_CONTROL },
+    };
+    test_ctx_t ctx = { .done = 0, .ping_period = -1 };
+
+    ASSERT(pthread_mutex_init(&ctx.lock, NULL) == 0);
+
+    tcs_ctx_t *tcs = CRM_TEST_tcs_init("host_sofia", MDM_CLI_DEFAULT_INSTANCE);
+    crm_ctrl_run_tasks(tasks, TASK_NB, false, tcs, ".control.plugins", run, &ctx);
+
+    ASSERT(ctx.done == (1u << TASK_NB) - 1);
+    ASSERT(ctx.ping_period > 0);
+    ASSERT(ctx.running_max > 1);
+
+    LOGD("Testing sequential mode");
+    ctx.done = 0;
+    ctx.ping_period = -1;
+    ctx.running_max = 0;
+    crm_ctrl_run_tasks(tasks, TASK_NB, true, tcs, ".control.plugins", run, &ctx);
+    tcs->dispose(tcs);
+
+    ASSERT(ctx.done == (1u << TASK_NB) - 1);
+    ASSERT(ctx.ping_period > 0);
+    ASSERT(ctx.running_max == 1);
+
+    pthread_mutex_destroy(&ctx.lock);
+
+    LOGD("\n");
+    LOGD("done");
+    return 0;
+}
@@ -25,6 +25,8 @@
  */
 
 #include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
 
 #include <unistd.h>
 
@@ -32,12 +34,82 @@
 #include "utils/common.h"
 #include "utils/logs.h"
 #include "utils/thread.h"
+#include "utils/time.h"
 #include "utils/wakelock.h"
 #include "test/test_utils.h"
 #include "libmdmcli/mdm_cli.h"
 
 #include "watchdog.h"
 
+#define HEARTBEAT_TIMEOUT 400
+#define LOOP_LATENCY 50
+
+/* Runs a monitored loop in heartbeat mode: no PING must be received */
+static void test_heartbeat(crm_wakelock_t *wakelock, int ping_period)
+{
+    watchdog_heartbeat_t heartbeat = { .name = "test" };
+    watchdog_param_t *cfg_watch = calloc(1, sizeof(watchdog_param_t));
+
+    ASSERT(cfg_watch != NULL);
+    cfg_watch->wakelock = wakelock;
+    cfg_watch->ping_period = ping_period;
+    cfg_watch->heartbeat_timeout = HEARTBEAT_TIMEOUT;
+    cfg_watch->heartbeats[cfg_watch->nb_heartbeats++] = &heartbeat;
+
+    crm_thread_ctx_t *watchdog = crm_thread_init(crm_watchdog_loop, cfg_watch, true, false);
+    struct pollfd pfd = { .fd = watchdog->get_poll_fd(watchdog), .events = POLLIN };
+
+    for (int i = 0; i < 10; i++) {
+        watchdog_heartbeat_begin(&heartbeat);
+        usleep(LOOP_LATENCY * 1000);
+        watchdog_heartbeat_end(&heartbeat);
+        /* Waiting for events: not a stall, even if longer than the timeout */
+        ASSERT(poll(&pfd, 1, i == 5 ? 2 * HEARTBEAT_TIMEOUT : 10) == 0);
+    }
+    ASSERT(heartbeat.latency_max >= LOOP_LATENCY);
+    ASSERT(wakelock->is_held_by_module(wakelock, WAKELOCK_WATCHDOG_PING) == false);
+
+    crm_ipc_msg_t msg = { .scalar = -1 };
+    watchdog->send_msg(watchdog, &msg);
+    usleep(100000);
+    watchdog->dispose(watchdog, NULL);
+    LOGD("heartbeat test successful");
+}
+
+/* A monitored loop stalls: the watchdog must abort the process once the timeout is reached */
+static void test_heartbeat_stall(int ping_period)
+{
+    struct timespec start;
+
+    crm_time_add_ms(&start, 0);
+    pid_t pid = fork();
+    ASSERT(pid >= 0);
+    if (pid == 0) {
+        watchdog_heartbeat_t heartbeat = { .name = "stall" };
+        watchdog_param_t *cfg_watch = calloc(1, sizeof(watchdog_param_t));
+        ASSERT(cfg_watch != NULL);
+        cfg_watch->wakelock = crm_wakelock_init("stall");
+        cfg_watch->ping_period = ping_period;
+        cfg_watch->heartbeat_timeout = HEARTBEAT_TIMEOUT;
+        cfg_watch->heartbeats[cfg_watch->nb_heartbeats++] = &heartbeat;
+        crm_thread_init(crm_watchdog_loop, cfg_watch, true, false);
+
+        /* let the watchdog sample an idle loop first */
+        usleep(HEARTBEAT_TIMEOUT / 2 * 1000);
+        watchdog_heartbeat_begin(&heartbeat);
+        usleep(4 * HEARTBEAT_TIMEOUT * 1000);
+        exit(0);
+    }
+
+    int status;
+    ASSERT(waitpid(pid, &status, 0) == pid);
+    int elapsed = crm_time_get_elapsed_ms(&start) - HEARTBEAT_TIMEOUT / 2;
+    DASSERT(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT, "watchdog did not fire");
+    DASSERT(elapsed >= HEARTBEAT_TIMEOUT && elapsed < HEARTBEAT_TIMEOUT + 2 * LOOP_LATENCY,
+            "stall detected after %dms", elapsed);
+    LOGD("heartbeat stall test successful: stall detected after %dms", elapsed);
+}
+
 int main()
 {
     int ping_period;
@@ -50,7 +122,10 @@ int main()
     ASSERT(tcs->get_int(tcs, "ping_period", &ping_period) == 0);
     tcs->dispose(tcs);
 
-    watchdog_param_t *cfg_watch = malloc(sizeof(watchdog_param_t));
+    test_heartbeat_stall(ping_period);
+    test_heartbeat(wakelock, ping_period);
+
+    watchdog_param_t *cfg_watch = calloc(1, sizeof(watchdog_param_t));
     ASSERT(cfg_watch != NULL);
     cfg_watch->wakelock = wakelock;
     cfg_watch->ping_period = ping_period;
@@ -59,6 +59,7 @@ typedef struct crm_customization_internal_ctx {
     int tlvs_nb;
     bool op_ongoing;
     char *tlv_node;
+    int pipeline_depth;
 } crm_customization_internal_ctx_t;
 
 static unsigned char *load_tlv_file(const char *path, size_t *len)
@@ -103,6 +104,10 @@ static void *write_tlvs(crm_thread_ctx_t *thread_ctx, void *arg)
     int fd = open(i_ctx->tlv_node, O_RDWR);
     DASSERT(fd >= 0, "open of (%s) failed (%s)", i_ctx->tlv_node, strerror(errno));
 
+    /* Chunks are pipelined: the next chunk is written before the previous one is acknowledged.
+     * On first failure, the remaining chunks are discarded and the execution request is not sent */
+    crm_at_ctx_t *at = crm_at_init(fd, CRM_MODULE_TAG, i_ctx->pipeline_depth, NULL, NULL, NULL);
+
     for (int tlv_idx = 0; (tlv_idx < i_ctx->tlvs_nb) && (err == 0); tlv_idx++) {
         int timeout = 50000; //@TODO: fix a correct timeout
         size_t tlv_len = 0;
@@ -128,12 +133,18 @@ static void *write_tlvs(crm_thread_ctx_t *thread_ctx, void *arg)
             ASSERT(gti_idx < sizeof(gti_cmd));
 
             /* sending TLV customization data */
-            err = crm_send_at(fd, CRM_MODULE_TAG, gti_cmd, timeout, -1);
+            err = at->send(at, gti_cmd, NULL, NULL);
         }
 
+        /* all chunks must be acknowledged before the execution request is sent. A write failure
+         * is also reported by wait */
+        err = at->wait(at, timeout, -1);
+
         /* sending execution request */
         if (err == 0)
-            err = crm_send_at(fd, CRM_MODULE_TAG, "AT@gticom:run_configuration()", timeout, -1);
+            err = at->send(at, "AT@gticom:run_configuration()", NULL, NULL);
+        if (err == 0)
+            err = at->wait(at, timeout, -1);
 
         free(tlv_data);
 
@@ -157,6 +168,7 @@ static void *write_tlvs(crm_thread_ctx_t *thread_ctx, void *arg)
     i_ctx->tlvs = NULL;
     i_ctx->tlvs_nb = 0;
 
+    at->dispose(at);
     DASSERT(close(fd) == 0, "close failed (%s)", strerror(errno));
 
     /* @TODO clean this (configure time ? flush API ? ...) */
@@ -229,6 +241,9 @@ crm_customization_ctx_t *crm_customization_init(tcs_ctx_t *tcs, crm_ctrl_ctx_t *
     ASSERT(tcs->select_group(tcs, ".customization") == 0);
     i_ctx->tlv_node = tcs->get_string(tcs, "node");
     ASSERT(i_ctx->tlv_node != NULL);
+    if (tcs->get_int(tcs, "pipeline_depth", &i_ctx->pipeline_depth))
+        i_ctx->pipeline_depth = 1;
+    ASSERT(i_ctx->pipeline_depth > 0);
 
     i_ctx->control = control;
 
@@ -33,6 +33,7 @@
 #include "utils/common.h"
 #include "utils/logs.h"
 #include "utils/property.h"
+#include "utils/state.h"
 #include "utils/time.h"
 #include "utils/keys.h"
 #include "utils/string_helpers.h"
@@ -73,11 +74,24 @@ static void go_next_step(crm_escalation_ctx_internal_t *i_ctx)
     i_ctx->counter = i_ctx->cfg[i_ctx->cfg_idx];
 }
 
-static void update_reboot_counter(crm_escalation_ctx_internal_t *i_ctx)
+/* Debug: tests can force the reboot counter */
+static void import_debug_reboot_counter(void)
 {
     char value[CRM_PROPERTY_VALUE_MAX];
 
-    crm_property_get(CRM_KEY_REBOOT_COUNTER, value, "0");
+    crm_property_get(CRM_KEY_DBG_REBOOT_COUNTER, value, "");
+    if (value[0] != '\0') {
+        LOGD("reboot counter forced to %s", value);
+        crm_state_set(CRM_STATE_KEY_REBOOT_COUNTER, value);
+        crm_property_set(CRM_KEY_DBG_REBOOT_COUNTER, "");
+    }
+}
+
+static void update_reboot_counter(crm_escalation_ctx_internal_t *i_ctx)
+{
+    char value[CRM_STATE_VALUE_MAX];
+
+    crm_state_get(CRM_STATE_KEY_REBOOT_COUNTER, value, "0");
     errno = 0;
     long reboot_counter = strtol(value, NULL, 0);
     ASSERT(errno == 0);
@@ -88,9 +102,9 @@ static void update_reboot_counter(crm_escalation_ctx_internal_t *i_ctx)
         LOGV("modem OUT OF SERVICE state reached");
         i_ctx->cfg_idx = IDX_OOS;
     } else {
-        char value[CRM_PROPERTY_VALUE_MAX];
+        char value[CRM_STATE_VALUE_MAX];
         snprintf(value, sizeof(value), "%ld", ++reboot_counter);
-        crm_property_set(CRM_KEY_REBOOT_COUNTER, value);
+        crm_state_set(CRM_STATE_KEY_REBOOT_COUNTER, value);
     }
 }
 
@@ -103,6 +117,8 @@ static crm_escalation_next_step_t get_next_step(crm_escalation_ctx_t *ctx)
 
     ASSERT(i_ctx != NULL);
 
+    import_debug_reboot_counter();
+
     if (i_ctx->escalation_disabled) {
         LOGD("->%s() level: %s", __FUNCTION__, crm_escalation_level_to_string(STEP_MDM_COLD_RESET));
         return STEP_MDM_COLD_RESET;
@@ -115,7 +131,7 @@ static crm_escalation_next_step_t get_next_step(crm_escalation_ctx_t *ctx)
 
             i_ctx->cfg_idx = 0;
             i_ctx->counter = i_ctx->cfg[i_ctx->cfg_idx];
-            crm_property_set(CRM_KEY_REBOOT_COUNTER, "0");
+            crm_state_set(CRM_STATE_KEY_REBOOT_COUNTER, "0");
         }
 
         if (i_ctx->counter <= 0)
@@ -149,6 +165,8 @@ static crm_escalation_next_step_t get_last_step(crm_escalation_ctx_t *ctx)
 
     ASSERT(i_ctx != NULL);
 
+    import_debug_reboot_counter();
+
     i_ctx->cfg_idx = IDX_REBOOT;
     update_reboot_counter(i_ctx);
 
@@ -187,6 +205,8 @@ crm_escalation_ctx_t *crm_escalation_init(bool sanity_mode, tcs_ctx_t *tcs)
 
     i_ctx->modem_stability_timeout = -1;
 
+    crm_state_import_property(CRM_STATE_KEY_REBOOT_COUNTER, CRM_KEY_REBOOT_COUNTER);
+
     char value[CRM_PROPERTY_VALUE_MAX];
     crm_property_get(CRM_KEY_DBG_DISABLE_ESCALATION, value, "false");
 
@@ -33,6 +33,7 @@
 #include "utils/logs.h"
 #include "utils/common.h"
 #include "utils/property.h"
+#include "utils/state.h"
 #include "utils/keys.h"
 #include "utils/string_helpers.h"
 #include "test/test_utils.h"
@@ -84,16 +85,16 @@ int main()
     timeout += 10;
 
     crm_property_set(CRM_KEY_DBG_DISABLE_ESCALATION, "false");
-    crm_property_set(CRM_KEY_REBOOT_COUNTER, "0");
+    crm_state_set(CRM_STATE_KEY_REBOOT_COUNTER, "0");
 
     crm_escalation_ctx_t *escalation = crm_escalation_init(false, tcs);
     ASSERT(escalation != NULL);
 
     check_escalation(escalation, cfg, ARRAY_SIZE(cfg), false);
 
-    /* Check that reboot property has been incremented */
-    char value[CRM_PROPERTY_VALUE_MAX];
-    crm_property_get(CRM_KEY_REBOOT_COUNTER, value, "-1");
+    /* Check that reboot counter has been incremented */
+    char value[CRM_STATE_VALUE_MAX];
+    crm_state_get(CRM_STATE_KEY_REBOOT_COUNTER, value, "-1");
     DASSERT(*value == '1', "value is %s", value);
 
     LOGD("waiting %dms to force the reset of the escalation plugin", timeout);
@@ -101,7 +102,7 @@ int main()
 
     /* Check that reboot property has been reinitialized */
     escalation->get_next_step(escalation);
-    crm_property_get(CRM_KEY_REBOOT_COUNTER, value, "-1");
+    crm_state_get(CRM_STATE_KEY_REBOOT_COUNTER, value, "-1");
     DASSERT(*value == '0', "value is %s", value);
 
     LOGD("Checking full escalation recovery");
@@ -113,7 +114,7 @@ int main()
 
         check_escalation(escalation, cfg, ARRAY_SIZE(cfg), i == reboot);
 
-        crm_property_get(CRM_KEY_REBOOT_COUNTER, value, "-1");
+        crm_state_get(CRM_STATE_KEY_REBOOT_COUNTER, value, "-1");
         DASSERT(*value == '1' + i, "value is %c instead of %c", *value, '1' + i);
     }
 
@@ -124,9 +125,9 @@ int main()
         ASSERT(!tcs->get_int(tcs, "timeout_sanity", &timeout));
         escalation = crm_escalation_init(true, tcs);
 
-        crm_property_set(CRM_KEY_REBOOT_COUNTER, "0");
+        crm_state_set(CRM_STATE_KEY_REBOOT_COUNTER, "0");
         check_escalation(escalation, cfg, ARRAY_SIZE(cfg), false);
-        crm_property_get(CRM_KEY_REBOOT_COUNTER, value, "-1");
+        crm_state_get(CRM_STATE_KEY_REBOOT_COUNTER, value, "-1");
         DASSERT(*value == '1', "value is %s", value);
 
         /* dispose and reload the module to simulate a CRM restart */
@@ -135,31 +136,43 @@ int main()
         ASSERT(escalation);
 
         escalation->get_next_step(escalation);
-        crm_property_get(CRM_KEY_REBOOT_COUNTER, value, "-1");
+        crm_state_get(CRM_STATE_KEY_REBOOT_COUNTER, value, "-1");
         DASSERT(*value == '1', "value is %s instead of 1", value);
 
         /* Check that reboot property is not reinitialized */
         usleep((timeout - 10) * 1000);
         escalation->get_next_step(escalation);
-        crm_property_get(CRM_KEY_REBOOT_COUNTER, value, "-1");
+        crm_state_get(CRM_STATE_KEY_REBOOT_COUNTER, value, "-1");
         DASSERT(*value == '1', "value is %s instead of 1", value);
 
         /* Check that reboot property has been reinitialized */
         usleep((timeout + 10) * 1000);
         escalation->get_next_step(escalation);
-        crm_property_get(CRM_KEY_REBOOT_COUNTER, value, "-1");
+        crm_state_get(CRM_STATE_KEY_REBOOT_COUNTER, value, "-1");
         DASSERT(*value == '0', "value is %s", value);
     }
     escalation->dispose(escalation);
 
     LOGD("Checking last step API");
     {
-        crm_property_set(CRM_KEY_REBOOT_COUNTER, "0");
+        crm_state_set(CRM_STATE_KEY_REBOOT_COUNTER, "0");
         for (int i = 0; i < reboot; i++)
             ASSERT(STEP_PLATFORM_REBOOT == escalation->get_last_step(escalation));
         ASSERT(STEP_OOS == escalation->get_last_step(escalation));
     }
 
+    LOGD("Checking reboot counter forced by tests");
+    {
+        escalation = crm_escalation_init(false, tcs);
+        ASSERT(escalation != NULL);
+
+        crm_property_set(CRM_KEY_DBG_REBOOT_COUNTER, "0");
+        ASSERT(STEP_PLATFORM_REBOOT == escalation->get_last_step(escalation));
+        crm_property_get(CRM_KEY_DBG_REBOOT_COUNTER, value, "");
+        ASSERT(value[0] == '\0');
+        escalation->dispose(escalation);
+    }
+
     LOGD("Checking disable escalation mode");
     {
         crm_property_set(CRM_KEY_DBG_DISABLE_ESCALATION, "true");
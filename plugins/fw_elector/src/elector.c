@@ -39,6 +39,7 @@
 #include "utils/common.h"
 #include "utils/keys.h"
 #include "utils/property.h"
+#include "utils/state.h"
 #include "plugins/fw_elector.h"
 #include "utils/file.h"
 
@@ -74,8 +75,8 @@ static bool is_hash_equal(char *hash_key, const char *hash_value)
     ASSERT(hash_key != NULL);
     ASSERT(hash_value != NULL);
 
-    char value[CRM_PROPERTY_VALUE_MAX];
-    crm_property_get(hash_key, value, "");
+    char value[CRM_STATE_VALUE_MAX];
+    crm_state_get(hash_key, value, "");
     return strcmp(value, hash_value) == 0;
 }
 
@@ -238,8 +239,8 @@ static const char *const *get_tlv_list(const crm_fw_elector_ctx_t *ctx, int *nb)
         update_miu_tlvs(i_ctx);
         compute_config_hash(i_ctx);
 
-        if (!is_hash_equal(CRM_KEY_BLOB_HASH, i_ctx->blob_hash_value) ||
-            !is_hash_equal(CRM_KEY_CONFIG_HASH, i_ctx->config_hash_value))
+        if (!is_hash_equal(CRM_STATE_KEY_BLOB_HASH, i_ctx->blob_hash_value) ||
+            !is_hash_equal(CRM_STATE_KEY_CONFIG_HASH, i_ctx->config_hash_value))
             *nb = i_ctx->nb_tlvs + i_ctx->nb_found_tlvs;
     }
 
@@ -266,8 +267,10 @@ static void notify_tlv_applied(const crm_fw_elector_ctx_t *ctx, int status)
     ASSERT(i_ctx != NULL);
 
     if (0 == status && i_ctx->are_hashes_readable) {
-        crm_property_set(CRM_KEY_BLOB_HASH, i_ctx->blob_hash_value);
-        crm_property_set(CRM_KEY_CONFIG_HASH, i_ctx->config_hash_value);
+        /* both hashes are updated at once: a partial update would skip the next flashing */
+        const char *keys[] = { CRM_STATE_KEY_BLOB_HASH, CRM_STATE_KEY_CONFIG_HASH };
+        const char *values[] = { i_ctx->blob_hash_value, i_ctx->config_hash_value };
+        crm_state_set_multi(ARRAY_SIZE(keys), keys, values);
     }
 }
 
@@ -343,6 +346,8 @@ crm_fw_elector_ctx_t *crm_fw_elector_init(tcs_ctx_t *tcs, int inst_id)
 
     if (!strcmp(value, "trigger_restart_framework")) {
         i_ctx->are_hashes_readable = true;
+        crm_state_import_property(CRM_STATE_KEY_BLOB_HASH, CRM_KEY_BLOB_HASH);
+        crm_state_import_property(CRM_STATE_KEY_CONFIG_HASH, CRM_KEY_CONFIG_HASH);
 
         char blob_hash[HASH_SIZE + 1];
         DASSERT(crm_file_read(BLOB_HASH_PATH, blob_hash, sizeof(blob_hash)) == 0,
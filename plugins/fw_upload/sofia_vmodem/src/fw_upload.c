@@ -26,7 +26,6 @@
 
 #include <sys/stat.h>
 #include <fcntl.h>
-#include <sys/sendfile.h>
 #include <errno.h>
 #include <poll.h>
 #include <unistd.h>
@@ -41,37 +40,105 @@
 #include "plugins/fw_upload.h"
 #include "plugins/control.h"
 
+#define MAX_RESUMES 3
+
 typedef struct crm_fw_upload_internal_ctx {
     crm_fw_upload_ctx_t ctx; // Must be first
 
     crm_ctrl_ctx_t *control;
 
+    /* Configuration */
+    size_t chunk_size;
+    size_t progress_step;
+
+    crm_thread_ctx_t *thread;
+    crm_file_stream_t stream;
     bool op_ongoing;
     char *fw_path;
     char *dev_path;
 } crm_fw_upload_internal_ctx_t;
 
+static void notify_progress(void *param, size_t offset, size_t size, unsigned int rate)
+{
+    crm_fw_upload_internal_ctx_t *i_ctx = (crm_fw_upload_internal_ctx_t *)param;
+
+    i_ctx->control->notify_fw_upload_progress(i_ctx->control, offset, size, rate);
+}
+
+/* Returns the crm_file_stream status: 0 if successful, 1 if aborted, -1 otherwise */
+static int stream_firmware(crm_fw_upload_internal_ctx_t *i_ctx)
+{
+    int ret = -1;
+    struct stat st;
+
+    int in_fd = open(i_ctx->fw_path, O_RDONLY);
+    if (in_fd < 0 || fstat(in_fd, &st)) {
+        LOGE("Cannot open firmware (%s), errno = %d [%s]", i_ctx->fw_path, errno,
+             strerror(errno));
+        goto out;
+    }
+
+    i_ctx->stream.method = CRM_FILE_STREAM_AUTO;
+    i_ctx->stream.chunk_size = i_ctx->chunk_size;
+    i_ctx->stream.progress_step = i_ctx->progress_step;
+    i_ctx->stream.progress = notify_progress;
+    i_ctx->stream.progress_param = i_ctx;
+    i_ctx->stream.offset = 0;
+
+    /* Device errors can be transient: the upload is retried. It resumes from the last byte
+     * accepted by the modem only if the destination is seekable (regular file or block device).
+     * A character device such as the vmodem node ignores or rejects the seek: the firmware is
+     * uploaded again from the beginning */
+    for (int i = 0; i <= MAX_RESUMES && ret < 0; i++) {
+        int out_fd = open(i_ctx->dev_path, O_WRONLY | (i == 0 ? O_CREAT | O_TRUNC : 0), 0600);
+        if (out_fd < 0) {
+            LOGE("Cannot open device (%s), errno = %d [%s]", i_ctx->dev_path, errno,
+                 strerror(errno));
+            break;
+        }
+        LOGD("[VMODEM] opened: %s", i_ctx->dev_path);
+
+        if (i_ctx->stream.offset > 0) {
+            struct stat dev_st;
+            if (fstat(out_fd, &dev_st) || !(S_ISREG(dev_st.st_mode) || S_ISBLK(dev_st.st_mode))) {
+                LOGD("device not seekable, restarting upload");
+                i_ctx->stream.offset = 0;
+            } else if (lseek(out_fd, i_ctx->stream.offset, SEEK_SET) !=
+                       (off_t)i_ctx->stream.offset) {
+                /* Writing the tail at the wrong position would corrupt the flashed image */
+                LOGE("Cannot resume upload, restarting it. errno = %d [%s]", errno,
+                     strerror(errno));
+                i_ctx->stream.offset = 0;
+            } else {
+                LOGD("resuming upload at %zu/%zu", i_ctx->stream.offset, (size_t)st.st_size);
+            }
+        }
+
+        ret = crm_file_stream(in_fd, out_fd, st.st_size, &i_ctx->stream);
+        if (close(out_fd) && ret == 0) {
+            LOGE("Error while closing %s: %d [%s]", i_ctx->dev_path, errno, strerror(errno));
+            ret = -1;
+        }
+        LOGD("[VMODEM] closed: %s", i_ctx->dev_path);
+    }
+
+out:
+    if (in_fd >= 0)
+        close(in_fd);
+    return ret;
+}
+
 static void *write_firmware(crm_thread_ctx_t *thread_ctx, void *arg)
 {
     crm_fw_upload_internal_ctx_t *i_ctx = (crm_fw_upload_internal_ctx_t *)arg;
 
     ASSERT(i_ctx != NULL);
     ASSERT(thread_ctx != NULL);
+    ASSERT(i_ctx->op_ongoing == true);
 
-    ASSERT(i_ctx->op_ongoing == false);
-    i_ctx->op_ongoing = true;
-
-    LOGD("[VMODEM] opened: %s", i_ctx->dev_path);
-    int err = crm_file_copy(i_ctx->fw_path, i_ctx->dev_path, false, false, 0);
-    LOGD("[VMODEM] closed: %s", i_ctx->dev_path);
-    int status = 0;
-    if (!err)
+    int ret = stream_firmware(i_ctx);
+    if (!ret)
         LOGD("firmware flashed successfully");
-    else
-        status = -1;
-
-    /* detached thread: Memory must be cleaned before thread termination */
-    thread_ctx->dispose(thread_ctx, NULL);
 
     free(i_ctx->fw_path);
     free(i_ctx->dev_path);
@@ -81,7 +148,9 @@ static void *write_firmware(crm_thread_ctx_t *thread_ctx, void *arg)
 
     i_ctx->op_ongoing = false;
 
-    i_ctx->control->notify_fw_upload_status(i_ctx->control, status);
+    /* An upload is only aborted when the module is disposed: nothing to report */
+    if (ret != 1)
+        i_ctx->control->notify_fw_upload_status(i_ctx->control, ret == 0 ? 0 : -1);
 
     return NULL;
 }
@@ -94,7 +163,11 @@ static void dispose(crm_fw_upload_ctx_t *ctx)
     crm_fw_upload_internal_ctx_t *i_ctx = (crm_fw_upload_internal_ctx_t *)ctx;
 
     ASSERT(i_ctx != NULL);
-    ASSERT(i_ctx->op_ongoing == false);
+
+    if (i_ctx->thread) {
+        __atomic_store_n(&i_ctx->stream.abort, true, __ATOMIC_RELAXED);
+        i_ctx->thread->dispose(i_ctx->thread, NULL);
+    }
 
     free(i_ctx->fw_path);
     free(i_ctx->dev_path);
@@ -140,7 +213,14 @@ static void flash(crm_fw_upload_ctx_t *ctx, const char *node)
     i_ctx->dev_path = strdup(node);
     ASSERT(i_ctx->dev_path != NULL);
 
-    crm_thread_init(write_firmware, i_ctx, false, true);
+    /* Previous upload is over: its thread returns immediately */
+    if (i_ctx->thread)
+        i_ctx->thread->dispose(i_ctx->thread, NULL);
+
+    i_ctx->op_ongoing = true;
+    i_ctx->stream.abort = false;
+    i_ctx->thread = crm_thread_init(write_firmware, i_ctx, false, false);
+    ASSERT(i_ctx->thread != NULL);
 }
 
 /**
@@ -153,7 +233,6 @@ crm_fw_upload_ctx_t *crm_fw_upload_init(int inst_id, bool flashless, tcs_ctx_t *
 
     ASSERT(i_ctx != NULL);
     ASSERT(control != NULL);
-    (void)tcs;       // UNUSED
     (void)inst_id;   // UNUSED
     (void)flashless; // UNUSED
     (void)factory;   // UNUSED
@@ -164,6 +243,17 @@ crm_fw_upload_ctx_t *crm_fw_upload_init(int inst_id, bool flashless, tcs_ctx_t *
 
     i_ctx->control = control;
 
+    /* Optional tuning of the upload, in KB. 0 selects the stream default */
+    int chunk_size = 0;
+    int progress_step = 0;
+    if (tcs && !tcs->select_group(tcs, ".firmware_upload")) {
+        tcs->get_int(tcs, "chunk_size", &chunk_size);
+        tcs->get_int(tcs, "progress_step", &progress_step);
+    }
+    ASSERT(chunk_size >= 0 && progress_step >= 0);
+    i_ctx->chunk_size = (size_t)chunk_size * 1024;
+    i_ctx->progress_step = (size_t)progress_step * 1024;
+
     LOGV("context %p", i_ctx);
     return &i_ctx->ctx;
 }
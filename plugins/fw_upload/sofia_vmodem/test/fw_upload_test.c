@@ -43,7 +43,10 @@
 #define FW_PATH "/tmp/fake_fw.fls"
 #define DEVICE_PATH "/tmp/modem_flash"
 
+#define FW_SIZE (3 * 1024 * 1024)
+
 crm_ipc_ctx_t *g_ipc = NULL;
+size_t g_progress = 0;
 
 static void notify_fw_upload_status(crm_ctrl_ctx_t *ctx, int status)
 {
@@ -54,11 +57,23 @@ static void notify_fw_upload_status(crm_ctrl_ctx_t *ctx, int status)
     g_ipc->send_msg(g_ipc, &msg);
 }
 
+static void notify_fw_upload_progress(crm_ctrl_ctx_t *ctx, size_t offset, size_t size,
+                                      unsigned int rate)
+{
+    (void)ctx;   // UNUSED
+    (void)rate;  // UNUSED
+
+    ASSERT(size == FW_SIZE);
+    ASSERT(offset > g_progress);
+    g_progress = offset;
+}
+
 int main()
 {
     /* Fake control context, just for testing */
     crm_ctrl_ctx_t control = {
         .notify_fw_upload_status = notify_fw_upload_status,
+        .notify_fw_upload_progress = notify_fw_upload_progress,
     };
 
     tcs_ctx_t *tcs = CRM_TEST_tcs_init("host_sofia", MDM_CLI_DEFAULT_INSTANCE);
@@ -85,7 +100,7 @@ int main()
     /* create fake fw */
     int fw_fd = open(FW_PATH, O_WRONLY | O_CREAT, 0666);
     ASSERT(fw_fd >= 0);
-    write(fw_fd, "1234", 4);
+    ASSERT(ftruncate(fw_fd, FW_SIZE) == 0);
     close(fw_fd);
 
     /* create empty file */
@@ -99,6 +114,11 @@ int main()
     msg.scalar = -1;
     g_ipc->get_msg(g_ipc, &msg);
     ASSERT(0 == msg.scalar);
+    ASSERT(g_progress == FW_SIZE);
+
+    struct stat st;
+    ASSERT(stat(DEVICE_PATH, &st) == 0);
+    ASSERT(st.st_size == FW_SIZE);
 
     fw->dispose(fw);
     g_ipc->dispose(g_ipc, NULL);
@@ -24,4 +24,28 @@ CRM_DISABLE_ANDROID_TARGET := true
 CRM_TARGET := $(BUILD_EXECUTABLE)
 include $(LOCAL_PATH)/../../../makefiles/crm_c_make.mk
 
+include $(LOCAL_PATH)/../../../makefiles/crm_clear.mk
+CRM_NAME := crm_test_hal_ping
+
+CRM_SRC := src/ping.c test/test_ping.c
+CRM_INCS := $(LOCAL_PATH)/src
+
+CRM_SHARED_LIBS := libcrm_utils
+
+CRM_DISABLE_ANDROID_TARGET := true
+CRM_TARGET := $(BUILD_EXECUTABLE)
+include $(LOCAL_PATH)/../../../makefiles/crm_c_make.mk
+
+include $(LOCAL_PATH)/../../../makefiles/crm_clear.mk
+CRM_NAME := crm_test_hal_uevent
+
+CRM_SRC := src/uevent.c test/test_uevent.c
+CRM_INCS := $(LOCAL_PATH)/src
+
+CRM_SHARED_LIBS := libcrm_utils
+
+CRM_DISABLE_ANDROID_TARGET := true
+CRM_TARGET := $(BUILD_EXECUTABLE)
+include $(LOCAL_PATH)/../../../makefiles/crm_c_make.mk
+
 endif
@@ -25,11 +25,15 @@
  */
 
 #include <errno.h>
+#include <stdio.h>
 #include <string.h>
 #include <fcntl.h>
 #include <poll.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <libgen.h>
 #include <termios.h>
+#include <sys/inotify.h>
 
 #define CRM_MODULE_TAG "HAL"
 #include "utils/at.h"
@@ -39,54 +43,197 @@
 
 #include "ping.h"
 
+#define PING_RETRY_MIN 10    // in ms
+#define PING_RETRY_MAX 500   // in ms
+#define PING_ANSWER_TIMEOUT 500 // in ms
+
+typedef struct ping_node {
+    const char *path;
+    int fd;
+    crm_at_ctx_t *at;
+    int status;              // status of ATE0. 1 while pending
+    int retry;               // current retry interval
+    struct timespec timer;   // next retry if fd < 0, answer timeout otherwise
+    int attempts;            // ATE0 probes, failed opens are not counted
+    int open_failures;
+} ping_node_t;
+
+static void ping_answer(int status, void *data)
+{
+    *(int *)data = status;
+}
+
+static void close_node(ping_node_t *node)
+{
+    if (node->at) {
+        node->at->dispose(node->at);
+        node->at = NULL;
+    }
+    if (node->fd >= 0) {
+        close(node->fd);
+        node->fd = -1;
+    }
+}
+
+static void schedule_retry(ping_node_t *node)
+{
+    close_node(node);
+    crm_time_add_ms(&node->timer, node->retry);
+    node->retry = MIN(node->retry * 2, PING_RETRY_MAX);
+}
+
+static void watch_node(int fd_notify, const char *path)
+{
+    char tmp[256];
+
+    if (fd_notify < 0)
+        return;
+
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    /* the same watch descriptor is returned if the folder is already watched */
+    if (inotify_add_watch(fd_notify, dirname(tmp), IN_CREATE | IN_ATTRIB | IN_MOVED_TO) < 0)
+        LOGE("failed to watch (%s). errno: %d/%s", tmp, errno, strerror(errno));
+}
+
+static void open_node(ping_node_t *node, int fd_notify, bool is_tty)
+{
+    node->fd = open(node->path, O_RDWR | O_NONBLOCK);
+    if (node->fd < 0) {
+        int err = errno;
+        if (node->open_failures++ == 0)
+            LOGE("failed to open ping node (%s). errno: %d/%s", node->path, err, strerror(err));
+        else
+            LOGD("failed to open ping node (%s). errno: %d/%s", node->path, err, strerror(err));
+        if (err == ENOENT)
+            watch_node(fd_notify, node->path);
+        schedule_retry(node);
+        return;
+    }
+
+    if (is_tty) {
+        struct termios tio;
+        ASSERT(!tcgetattr(node->fd, &tio));
+        cfmakeraw(&tio);
+        ASSERT(!tcsetattr(node->fd, TCSANOW, &tio));
+    }
+
+    node->attempts++;
+    node->status = 1;
+    node->at = crm_at_init(node->fd, CRM_MODULE_TAG, 1, NULL, NULL, NULL);
+    if (node->at->send(node->at, "ATE0", ping_answer, &node->status))
+        schedule_retry(node);
+    else
+        crm_time_add_ms(&node->timer, PING_ANSWER_TIMEOUT);
+}
+
 /**
  * @see ping.h
  */
-int crm_hal_ping_modem(const char *ping_node, int ping_timeout, int fd_abort, bool is_tty)
+int crm_hal_ping_modem(const char *const *nodes, int nb_nodes, int ping_timeout, int fd_abort,
+                       bool is_tty, crm_hal_ping_stats_t *stats)
 {
-    ASSERT(ping_node);
+    ASSERT(nodes);
+    ASSERT(nb_nodes > 0);
     ASSERT(ping_timeout > 0);
 
+    struct timespec timer_start;
     struct timespec timer_end;
+    crm_time_add_ms(&timer_start, 0);
     crm_time_add_ms(&timer_end, ping_timeout);
-    LOGD("node: %s", ping_node);
 
-    int fd;
-    for (;; ) {
-        fd = open(ping_node, O_RDWR | O_NONBLOCK);
-        if (fd >= 0) {
-            if (is_tty) {
-                struct termios tio;
-                ASSERT(!tcgetattr(fd, &tio));
-                cfmakeraw(&tio);
-                ASSERT(!tcsetattr(fd, TCSANOW, &tio));
-            }
+    ping_node_t *node = calloc(nb_nodes, sizeof(ping_node_t));
+    /* poll fds: abort, inotify, then one per node */
+    struct pollfd *pfd = calloc(nb_nodes + 2, sizeof(struct pollfd));
+    ASSERT(node && pfd);
 
-            int err = crm_send_at(fd, CRM_MODULE_TAG, "ATE0", 500, fd_abort);
-            if (!err)
-                return fd;
-            else if (-2 == err)
-                return -2;
-            close(fd);
-        } else {
-            LOGE("failed to open ping node (%s). errno: %d/%s", ping_node, errno, strerror(errno));
-        }
+    int fd_notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd_notify < 0)
+        LOGE("inotify not available. errno: %d/%s", errno, strerror(errno));
 
+    for (int i = 0; i < nb_nodes; i++) {
+        ASSERT(nodes[i]);
+        LOGD("node: %s", nodes[i]);
+        node[i].path = nodes[i];
+        node[i].fd = -1;
+        node[i].retry = PING_RETRY_MIN;
+        crm_time_add_ms(&node[i].timer, 0);
+    }
+
+    int ret = -1;
+    while (ret == -1) {
         int timeout = crm_time_get_remain_ms(&timer_end);
-        if (timeout <= 0)
+        if (timeout <= 0) {
+            LOGE("Timeout. failed to ping modem");
             break;
+        }
+
+        for (int i = 0; i < nb_nodes; i++) {
+            if (crm_time_get_remain_ms(&node[i].timer) <= 0) {
+                if (node[i].fd >= 0)
+                    schedule_retry(&node[i]); // no answer
+                else
+                    open_node(&node[i], fd_notify, is_tty);
+            }
+            timeout = MIN(timeout, crm_time_get_remain_ms(&node[i].timer));
 
-        struct pollfd pfd = { .fd = fd_abort, .events = POLLIN };
-        poll(&pfd, 1, 500); // retry every 500ms
+            pfd[i + 2].fd = node[i].fd;
+            pfd[i + 2].events = POLLIN;
+            pfd[i + 2].revents = 0;
+        }
+
+        pfd[0] = (struct pollfd){ .fd = fd_abort, .events = POLLIN };
+        pfd[1] = (struct pollfd){ .fd = fd_notify, .events = POLLIN };
+        poll(pfd, nb_nodes + 2, timeout);
 
         /* something is received only if the loop needs to be stopped */
-        if (pfd.revents) {
+        if (pfd[0].revents) {
             LOGD("aborted");
-            return -2;
+            ret = -2;
+            break;
+        }
+
+        if (pfd[1].revents & POLLIN) {
+            char events[512];
+            while (read(fd_notify, events, sizeof(events)) > 0) ;
+
+            /* a node may have been created: unopened nodes are probed immediately */
+            for (int i = 0; i < nb_nodes; i++) {
+                if (node[i].fd < 0) {
+                    node[i].retry = PING_RETRY_MIN;
+                    crm_time_add_ms(&node[i].timer, 0);
+                }
+            }
+        }
+
+        for (int i = 0; (i < nb_nodes) && (ret == -1); i++) {
+            if (!pfd[i + 2].revents)
+                continue;
+
+            if ((pfd[i + 2].revents & (POLLERR | POLLHUP | POLLNVAL)) ||
+                node[i].at->process(node[i].at) || (node[i].status < 0)) {
+                schedule_retry(&node[i]);
+            } else if (node[i].status == 0) {
+                int elapsed = crm_time_get_elapsed_ms(&timer_start);
+                LOGI("[PING] %s answered. attempts: %d, time to first OK: %dms", node[i].path,
+                     node[i].attempts, elapsed);
+                if (stats) {
+                    stats->attempts = node[i].attempts;
+                    stats->time_ms = elapsed;
+                }
+                node[i].at->dispose(node[i].at);
+                node[i].at = NULL;
+                ret = node[i].fd;
+                node[i].fd = -1;
+            }
         }
     }
 
-    LOGE("Timeout. failed to ping modem");
+    for (int i = 0; i < nb_nodes; i++)
+        close_node(&node[i]);
+    if (fd_notify >= 0)
+        close(fd_notify);
+    free(node);
+    free(pfd);
 
-    return -1;
+    return ret;
 }
@@ -29,19 +29,30 @@
 
 #include <stdbool.h>
 
+typedef struct crm_hal_ping_stats {
+    int attempts;  // number of ATE0 sent to the node which answered
+    int time_ms;   // time to first OK, in milliseconds
+} crm_hal_ping_stats_t;
+
 /**
- * Sends PING request to modem every 500ms until modem responds or timeout
+ * Pings the modem until it responds or timeout. Candidate nodes are probed in parallel and the
+ * first node answering is selected.
+ * Retries start with a short interval which is increased exponentially. If a node does not exist
+ * yet, its creation is detected with inotify and the node is probed immediately.
  * Function can be aborted by writing in fd_abort file descriptor
  *
- * @param [in] ping_node    Node to be used
+ * @param [in] nodes        Candidate nodes
+ * @param [in] nb_nodes     Number of candidate nodes
  * @param [in] ping_timeout in milliseconds
  * @param [in] fd_abort     File descriptor used to abort this function
- * @param [in] is_tty       Set to true if ping_node points to a TTY instead of a char device
+ * @param [in] is_tty       Set to true if nodes point to TTYs instead of char devices
+ * @param [out] stats       Filled in case of success. Can be NULL
  *
  * @return >=0 in case of success. Opened file descriptor is returned
  * @return -1 in case of error
  * @return -2 if aborted
  */
-int crm_hal_ping_modem(const char *ping_node, int ping_timeout, int fd_abort, bool is_tty);
+int crm_hal_ping_modem(const char *const *nodes, int nb_nodes, int ping_timeout, int fd_abort,
+                       bool is_tty, crm_hal_ping_stats_t *stats);
 
 #endif /* __CRM_HAL_COMMON_PING_HEADER__ */
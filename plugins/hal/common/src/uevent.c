@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include <linux/netlink.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CRM_MODULE_TAG "HAL"
+#include "utils/common.h"
+#include "utils/logs.h"
+
+#include "uevent.h"
+
+#define UEVENT_FILTER_MAX 128 // in instructions
+
+/**
+ * @see uevent.h
+ */
+int crm_hal_uevent_set_filter(int fd, const char *header)
+{
+    struct sock_filter code[UEVENT_FILTER_MAX];
+    size_t nb = 0;
+
+    ASSERT(header != NULL);
+
+    /* header is compared by words of 4, 2 or 1 byte(s). Loaded values are in network order */
+    size_t len = strlen(header) + 1;
+    for (size_t off = 0; off < len; ) {
+        size_t size = (len - off >= 4) ? 4 : ((len - off >= 2) ? 2 : 1);
+        uint32_t k = 0;
+        for (size_t i = 0; i < size; i++)
+            k = (k << 8) | (unsigned char)header[off + i];
+
+        DASSERT(nb + 4 <= ARRAY_SIZE(code), "header too long: %s", header);
+        int mode = (size == 4) ? BPF_W : ((size == 2) ? BPF_H : BPF_B);
+        code[nb++] = (struct sock_filter)BPF_STMT(BPF_LD | mode | BPF_ABS, off);
+        code[nb++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, k, 0, 0);
+        off += size;
+    }
+
+    /* all mismatches jump to the reject instruction */
+    for (size_t i = 1; i < nb; i += 2)
+        code[i].jf = nb + 1 - (i + 1);
+    code[nb++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0xFFFFFFFF);
+    code[nb++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0);
+
+    struct sock_fprog prog = { .len = nb, .filter = code };
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog))) {
+        LOGE("failed to attach socket filter (%s)", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @see uevent.h
+ */
+int crm_hal_uevent_open(const char *header)
+{
+    errno = 0;
+    int fd = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_KOBJECT_UEVENT);
+    DASSERT(fd >= 0, "Failed to open netlink socket (%s)", strerror(errno));
+
+    /* filter is attached before bind to not receive any unexpected event */
+    if (crm_hal_uevent_set_filter(fd, header))
+        LOGE("uevents not filtered");
+
+    struct sockaddr_nl sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.nl_family = AF_NETLINK;
+    sa.nl_pid = 0; // assigned by the kernel: several instances can run in the same process
+    sa.nl_groups = NETLINK_KOBJECT_UEVENT;
+
+    DASSERT(bind(fd, (struct sockaddr *)&sa, sizeof(sa)) == 0, "Failed to bind socket (%s)",
+            strerror(errno));
+
+    return fd;
+}
+
+/**
+ * @see uevent.h
+ */
+void crm_hal_uevent_parse(char *buffer, size_t len, crm_hal_uevent_t *evt)
+{
+    ASSERT(buffer != NULL);
+    ASSERT(evt != NULL);
+
+    buffer[len] = '\0';
+    evt->header = buffer;
+    evt->nb_keys = 0;
+
+    /* uevent format: header\0key1=value1\0key2=value2\0... */
+    for (char *cur = buffer + strlen(buffer) + 1; (cur < buffer + len) &&
+         (evt->nb_keys < CRM_HAL_UEVENT_MAX_KEYS); cur += strlen(cur) + 1) {
+        char *sep = strchr(cur, '=');
+        if (!sep)
+            continue;
+
+        *sep = '\0';
+        evt->keys[evt->nb_keys].key = cur;
+        evt->keys[evt->nb_keys].value = sep + 1;
+        evt->nb_keys++;
+        cur = sep + 1;
+    }
+}
+
+/**
+ * @see uevent.h
+ */
+const char *crm_hal_uevent_get(const crm_hal_uevent_t *evt, const char *key)
+{
+    ASSERT(evt != NULL);
+    ASSERT(key != NULL);
+
+    for (int i = 0; i < evt->nb_keys; i++)
+        if (!strcmp(evt->keys[i].key, key))
+            return evt->keys[i].value;
+
+    return NULL;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CRM_HAL_COMMON_UEVENT_HEADER__
+#define __CRM_HAL_COMMON_UEVENT_HEADER__
+
+#include <stddef.h>
+
+#define CRM_HAL_UEVENT_MAX_KEYS 16
+
+/**
+ * Parsed kernel uevent. Strings point to the received buffer
+ */
+typedef struct crm_hal_uevent {
+    const char *header; // action@devpath
+    int nb_keys;
+    struct {
+        const char *key;
+        const char *value;
+    } keys[CRM_HAL_UEVENT_MAX_KEYS];
+} crm_hal_uevent_t;
+
+/**
+ * Opens a kernel uevent netlink socket. A socket filter is attached to it: only uevents whose
+ * header is equal to 'header' are received by the process
+ *
+ * @param [in] header Header of the uevents to receive (action@devpath)
+ *
+ * @return file descriptor
+ */
+int crm_hal_uevent_open(const char *header);
+
+/**
+ * Attaches a socket filter to the socket. Only messages starting with 'header' (including its
+ * \0 terminating character) are received
+ *
+ * @param [in] fd     Socket file descriptor
+ * @param [in] header Expected header
+ *
+ * @return 0 if successful
+ */
+int crm_hal_uevent_set_filter(int fd, const char *header);
+
+/**
+ * Parses an uevent. The 'key=value' pairs following the header are split in place.
+ * Extra keys are ignored if the event contains more than CRM_HAL_UEVENT_MAX_KEYS keys
+ *
+ * @param [in]  buffer Received buffer. It is modified by this function
+ * @param [in]  len    Length of received data. buffer must be at least len + 1 bytes long
+ * @param [out] evt    Parsed event
+ */
+void crm_hal_uevent_parse(char *buffer, size_t len, crm_hal_uevent_t *evt);
+
+/**
+ * Gets the value of a key
+ *
+ * @param [in] evt Parsed event
+ * @param [in] key
+ *
+ * @return the value or NULL if the key is not found
+ */
+const char *crm_hal_uevent_get(const crm_hal_uevent_t *evt, const char *key);
+
+#endif /* __CRM_HAL_COMMON_UEVENT_HEADER__ */
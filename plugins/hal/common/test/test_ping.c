@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE // posix_openpt, ptsname
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CRM_MODULE_TAG "HALPT"
+#include "utils/common.h"
+#include "utils/logs.h"
+#include "utils/time.h"
+
+#include "ping.h"
+
+#define NODE_MISSING "/tmp/crm_test_ping_missing"
+#define NODE_LATE "/tmp/crm_test_ping_late"
+
+/* Fake modem: the node appears after 300ms and answers OK to each command */
+static pid_t start_fake_modem(void)
+{
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+    ASSERT(fd >= 0);
+    ASSERT(grantpt(fd) == 0);
+    ASSERT(unlockpt(fd) == 0);
+
+    pid_t pid = fork();
+    ASSERT(pid >= 0);
+    if (pid == 0) {
+        usleep(300000);
+        ASSERT(symlink(ptsname(fd), NODE_LATE) == 0);
+
+        for (;; ) {
+            char buffer[64];
+            ssize_t len = read(fd, buffer, sizeof(buffer));
+            if (len <= 0)
+                break;
+            for (ssize_t i = 0; i < len; i++)
+                if (buffer[i] == '\n')
+                    write(fd, "\r\nOK\r\n", 6);
+        }
+        exit(0);
+    }
+
+    close(fd);
+    return pid;
+}
+
+int main()
+{
+    const char *nodes[] = { NODE_MISSING, NODE_LATE };
+
+    unlink(NODE_MISSING);
+    unlink(NODE_LATE);
+
+    /* timeout */
+    ASSERT(crm_hal_ping_modem(nodes, 1, 200, -1, true, NULL) == -1);
+
+    /* abort */
+    int fds[2];
+    ASSERT(pipe(fds) == 0);
+    ASSERT(write(fds[1], "", 1) == 1);
+    ASSERT(crm_hal_ping_modem(nodes, ARRAY_SIZE(nodes), 5000, fds[0], true, NULL) == -2);
+    close(fds[0]);
+    close(fds[1]);
+
+    /* the late node is detected by inotify and selected */
+    pid_t pid = start_fake_modem();
+    struct timespec start;
+    crm_time_add_ms(&start, 0);
+    crm_hal_ping_stats_t stats = { 0, 0 };
+    int fd = crm_hal_ping_modem(nodes, ARRAY_SIZE(nodes), 5000, -1, true, &stats);
+    ASSERT(fd >= 0);
+    int elapsed = crm_time_get_elapsed_ms(&start);
+    DASSERT(elapsed < 500, "modem detected too late: %dms", elapsed);
+    DASSERT(stats.attempts == 1 && stats.time_ms <= elapsed, "wrong stats: %d attempts, %dms",
+            stats.attempts, stats.time_ms);
+    close(fd);
+
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    unlink(NODE_LATE);
+
+    LOGD("success");
+    return 0;
+}
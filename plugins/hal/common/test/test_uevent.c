@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/socket.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CRM_MODULE_TAG "HALUT"
+#include "utils/common.h"
+#include "utils/logs.h"
+
+#include "uevent.h"
+
+#define VMODEM "change@/devices/virtual/misc/vmodem"
+
+static void send_evt(int fd, const char *header, const char *keys, size_t keys_len)
+{
+    char buffer[256];
+    size_t len = strlen(header) + 1;
+
+    ASSERT(len + keys_len <= sizeof(buffer));
+    memcpy(buffer, header, len);
+    memcpy(&buffer[len], keys, keys_len);
+    ASSERT(send(fd, buffer, len + keys_len, 0) == (ssize_t)(len + keys_len));
+}
+
+int main()
+{
+    int fds[2];
+
+    ASSERT(socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) == 0);
+    ASSERT(crm_hal_uevent_set_filter(fds[1], VMODEM) == 0);
+
+    const char keys[] = "ACTION=change\0DEVPATH=/devices/virtual/misc/vmodem\0SUBSYSTEM=misc";
+    send_evt(fds[0], "add@/devices/virtual/misc/vmodem", keys, sizeof(keys));
+    send_evt(fds[0], VMODEM "2", keys, sizeof(keys));
+    send_evt(fds[0], "change@/devices/virtual/misc/vmode", keys, sizeof(keys));
+    send_evt(fds[0], VMODEM, keys, sizeof(keys));
+
+    /* only the last event passes the filter */
+    char buffer[256];
+    ssize_t len = recv(fds[1], buffer, sizeof(buffer) - 1, MSG_DONTWAIT);
+    ASSERT(len > 0);
+    ASSERT(recv(fds[1], buffer, sizeof(buffer) - 1, MSG_DONTWAIT) < 0);
+
+    crm_hal_uevent_t evt;
+    crm_hal_uevent_parse(buffer, len, &evt);
+    ASSERT(!strcmp(evt.header, VMODEM));
+    ASSERT(evt.nb_keys == 3);
+    ASSERT(!strcmp(crm_hal_uevent_get(&evt, "ACTION"), "change"));
+    ASSERT(!strcmp(crm_hal_uevent_get(&evt, "SUBSYSTEM"), "misc"));
+    ASSERT(crm_hal_uevent_get(&evt, "MAJOR") == NULL);
+
+    /* events sent by the host debug socket only contain the header */
+    char header[] = VMODEM;
+    crm_hal_uevent_parse(header, strlen(header), &evt);
+    ASSERT(!strcmp(evt.header, VMODEM));
+    ASSERT(evt.nb_keys == 0);
+
+    close(fds[0]);
+    close(fds[1]);
+
+    LOGD("success");
+    return 0;
+}
@@ -32,10 +32,12 @@
 #include <time.h>
 
 #include "utils/thread.h"
+#include "utils/timer_wheel.h"
 #include "plugins/hal.h"
 #include "plugins/control.h"
 
 #include "daemons.h"
+#include "ping.h"
 
 #define NVM_FILE_PERMISSION (S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH)
 
@@ -111,7 +113,10 @@ typedef struct crm_hal_ctx_internal {
     int mdm_state;
     bool timer_armed;
     bool first_expiration;
-    struct timespec timer_end;
+    crm_timer_wheel_t *timers; // owned by the FSM thread
+    int timer_id;
+    crm_hal_ping_stats_t ping_modem_stats; // filled by the configuration thread
+    crm_hal_ping_stats_t ping_mux_stats;
 
     ctrl_request_t request;
     bool backup;
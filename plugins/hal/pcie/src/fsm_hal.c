@@ -38,6 +38,7 @@
 #include "utils/fsm.h"
 #include "utils/file.h"
 #include "utils/time.h"
+#include "utils/timer_wheel.h"
 #include "utils/property.h"
 #include "utils/keys.h"
 
@@ -48,7 +49,8 @@
 #include "daemons.h"
 #include "nvm_manager.h"
 
-#define FSM_HAL_FDS_TO_POLL 5
+#define FSM_HAL_FDS_TO_POLL 6
+#define TIMER_GRANULARITY 10  // time in ms
 
 typedef enum hal_pcie_states {
     ST_OFF,
@@ -125,15 +127,22 @@ static void timer_start(crm_hal_ctx_internal_t *i_ctx, int ms, bool update)
         ASSERT(update);
 
     i_ctx->timer_armed = true;
-    crm_time_add_ms(&i_ctx->timer_end, ms);
+    i_ctx->timers->arm(i_ctx->timers, i_ctx->timer_id, ms);
 }
 
-static int get_timeout(crm_hal_ctx_internal_t *i_ctx)
+static void timer_stop(crm_hal_ctx_internal_t *i_ctx)
 {
-    if (i_ctx->timer_armed == false)
-        return -1;
+    ASSERT(i_ctx != NULL);
 
-    return crm_time_get_remain_ms(&i_ctx->timer_end);
+    i_ctx->timer_armed = false;
+    i_ctx->timers->cancel(i_ctx->timers, i_ctx->timer_id);
+}
+
+static void timer_expired(void *param)
+{
+    crm_fsm_ctx_t *fsm = param;
+
+    fsm->notify_event(fsm, EV_TIMEOUT, NULL);
 }
 
 static void stop_daemons(crm_hal_ctx_internal_t *i_ctx)
@@ -153,7 +162,7 @@ static int cfg_modem(void *fsm_param, void *evt_param)
         ASSERT(!i_ctx->thread_cfg);
         crm_property_set(CRM_KEY_SERVICE_WWAN, "ready");
         i_ctx->request = REQ_NONE;
-        i_ctx->timer_armed = false;
+        timer_stop(i_ctx);
         i_ctx->thread_cfg = crm_thread_init(crm_hal_cfg_modem, i_ctx, true, false);
 
         return ST_CONFIGURING;
@@ -233,7 +242,7 @@ static int reset_or_stop(void *fsm_param, void *evt_param)
         i_ctx->control->notify_client(i_ctx->control, MDM_DBG_INFO, sizeof(dbg_info), &dbg_info);
     }
 
-    i_ctx->timer_armed = false;
+    timer_stop(i_ctx);
 
     switch (i_ctx->request) {
     case REQ_RESET:
@@ -265,7 +274,7 @@ static int timeout_daemons(void *fsm_param, void *evt_param)
         i_ctx->first_expiration = false;
         ASSERT(i_ctx->nvm_daemon_connected);
         crm_hal_nvm_on_manager_crash(i_ctx);
-        i_ctx->timer_armed = false;
+        timer_stop(i_ctx);
         return reset_or_stop(fsm_param, evt_param);
     }
 
@@ -288,7 +297,7 @@ static int mdm_off_evt(void *fsm_param, void *evt_param)
         crm_hal_stop_modem(i_ctx);
         notify_ctrl_event_only(i_ctx->control, HAL_MDM_OFF);
 
-        i_ctx->timer_armed = false;
+        timer_stop(i_ctx);
         i_ctx->request = REQ_NONE;
         return ST_OFF;
     }
@@ -402,7 +411,7 @@ static int notify_flash(void *fsm_param, void *evt_param)
     (void)evt_param; // UNUSED
 
     ASSERT(i_ctx->timer_armed);
-    i_ctx->timer_armed = false;
+    timer_stop(i_ctx);
 
     notify_ctrl_event_only(i_ctx->control, HAL_MDM_BUSY);
 
@@ -413,6 +422,23 @@ static int notify_flash(void *fsm_param, void *evt_param)
     return ST_FLASHING;
 }
 
+static void notify_ping_stats(crm_hal_ctx_internal_t *i_ctx)
+{
+    char modem[64];
+    char mux[64];
+
+    snprintf(modem, sizeof(modem), "modem ping: %d attempt(s), %dms",
+             i_ctx->ping_modem_stats.attempts, i_ctx->ping_modem_stats.time_ms);
+    snprintf(mux, sizeof(mux), "mux ping: %d attempt(s), %dms",
+             i_ctx->ping_mux_stats.attempts, i_ctx->ping_mux_stats.time_ms);
+    LOGD("%s / %s", modem, mux);
+
+    const char *data[] = { modem, mux };
+    mdm_cli_dbg_info_t dbg_info = { DBG_TYPE_STATS, DBG_DEFAULT_NO_LOG, DBG_DEFAULT_NO_LOG,
+                                    DBG_DEFAULT_NO_LOG, ARRAY_SIZE(data), data };
+    i_ctx->control->notify_client(i_ctx->control, MDM_DBG_INFO, sizeof(dbg_info), &dbg_info);
+}
+
 static int start_daemons(void *fsm_param, void *evt_param)
 {
     crm_hal_ctx_internal_t *i_ctx = (crm_hal_ctx_internal_t *)fsm_param;
@@ -420,6 +446,8 @@ static int start_daemons(void *fsm_param, void *evt_param)
     (void)evt_param; // UNUSED
     ASSERT(i_ctx);
 
+    notify_ping_stats(i_ctx);
+
     ASSERT(!i_ctx->timer_armed);
     timer_start(i_ctx, 5000, false); // @TODO: fix timeout
 
@@ -438,7 +466,7 @@ static int notify_run(void *fsm_param, void *evt_param)
     ASSERT(i_ctx);
 
     ASSERT(i_ctx->timer_armed);
-    i_ctx->timer_armed = false;
+    timer_stop(i_ctx);
 
     notify_ctrl_event_only(i_ctx->control, HAL_MDM_RUN);
 
@@ -691,6 +719,9 @@ void *crm_hal_pcie_fsm(crm_thread_ctx_t *thread_ctx, void *param)
                                       modem_dead, i_ctx, CRM_MODULE_TAG, get_state_txt,
                                       get_event_txt);
 
+    i_ctx->timers = crm_timer_wheel_init(1, TIMER_GRANULARITY);
+    i_ctx->timer_id = i_ctx->timers->add(i_ctx->timers, timer_expired, fsm);
+
     bool running = true;
     while (running) {
         int c_fd = -1;
@@ -709,10 +740,12 @@ void *crm_hal_pcie_fsm(crm_thread_ctx_t *thread_ctx, void *param)
             // INOTIFY - RPC Daemon event listener
             //@TODO: { .fd = crm_hal_rpcd_get_fd(i_ctx), .events = POLLIN },
             { .fd = -1, .events = POLLIN },
+            // TIMER - FSM time-out
+            { .fd = i_ctx->timers->get_poll_fd(i_ctx->timers), .events = POLLIN },
         };
         int num_socks = FSM_HAL_FDS_TO_POLL + crm_hal_daemon_get_sockets(&i_ctx->daemon_ctx,
                                                                          &pfd[FSM_HAL_FDS_TO_POLL]);
-        int err = poll(pfd, num_socks, get_timeout(i_ctx));
+        poll(pfd, num_socks, -1);
 
         for (int i = 0; i < FSM_HAL_FDS_TO_POLL; i++) {
             if (pfd[i].revents & (POLLERR | POLLHUP | POLLNVAL))
@@ -720,10 +753,8 @@ void *crm_hal_pcie_fsm(crm_thread_ctx_t *thread_ctx, void *param)
                 DASSERT(i == 3, "error on fd: %d", i);
         }
 
-        if (0 == err) {
-            ASSERT(i_ctx->timer_armed);
-            crm_ipc_msg_t msg = { .scalar = EV_TIMEOUT };
-            fsm->notify_event(fsm, msg.scalar, NULL);
+        if (pfd[5].revents & POLLIN) {
+            i_ctx->timers->process(i_ctx->timers);
         } else if (pfd[0].revents & POLLIN) {
             crm_ipc_msg_t msg;
             while (i_ctx->ipc->get_msg(i_ctx->ipc, &msg)) {
@@ -784,6 +815,8 @@ void *crm_hal_pcie_fsm(crm_thread_ctx_t *thread_ctx, void *param)
         //@TODO: handle EINTR errors
     }
 
+    i_ctx->timers->dispose(i_ctx->timers);
+    i_ctx->timers = NULL;
     fsm->dispose(fsm);
 
     return NULL;
@@ -120,7 +120,7 @@ static int open_netlink(void)
     struct sockaddr_nl sa;
     memset(&sa, 0, sizeof(sa));
     sa.nl_family = AF_NETLINK;
-    sa.nl_pid = getpid();
+    sa.nl_pid = 0; // assigned by the kernel: several instances can run in the same process
     sa.nl_groups = -1;
 
     DASSERT(bind(fd, (struct sockaddr *)&sa, sizeof(sa)) == 0, "failed to bind socket (%s)",
@@ -421,13 +421,16 @@ void *crm_hal_cfg_modem(crm_thread_ctx_t *thread_ctx, void *param)
     int fd_abort = thread_ctx->get_poll_fd(thread_ctx);
     ASSERT(fd_abort >= 0);
 
-    int fd = crm_hal_ping_modem(i_ctx->modem_node, i_ctx->ping_timeout, fd_abort, false);
+    int fd = crm_hal_ping_modem((const char *const *)&i_ctx->modem_node, 1, i_ctx->ping_timeout,
+                                fd_abort, false, &i_ctx->ping_modem_stats);
     if (fd >= 0) {
         i_ctx->mux_fd = fd;
         int err = mount_mux(i_ctx->mux_fd);
         if (!err) {
             /* @TODO: is it needed to check that all DLC exists before pinging the modem ? */
-            fd = crm_hal_ping_modem(i_ctx->ping_mux_node, i_ctx->ping_timeout, fd_abort, true);
+            fd = crm_hal_ping_modem((const char *const *)&i_ctx->ping_mux_node, 1,
+                                    i_ctx->ping_timeout, fd_abort, true,
+                                    &i_ctx->ping_mux_stats);
             if (fd >= 0)
                 close(fd); /* success case */
             else
@@ -31,9 +31,12 @@
 #include <time.h>
 
 #include "utils/thread.h"
+#include "utils/timer_wheel.h"
 #include "plugins/hal.h"
 #include "plugins/control.h"
 
+#include "ping.h"
+
 typedef enum hal_events {
     /* control requests */
     EV_POWER,
@@ -70,7 +73,8 @@ typedef struct crm_hal_ctx_internal {
     char *uevent_vmodem;
     char *vmodem_sysfs_mdm_state;
     char *vmodem_sysfs_mdm_ctrl;
-    char *ping_node;
+    char **ping_nodes;
+    int nb_ping_nodes;
     char *dump_node;
     char *flash_node;
     bool dump_enabled;
@@ -78,13 +82,18 @@ typedef struct crm_hal_ctx_internal {
     int ping_timeout;
     bool secvm_flash;
     bool support_mdm_up_on_start;
+    bool sysfs_notify;
 
     /* variables */
     int s_fd; // socket (uevent) file descriptor
+    int uevent_discarded;
+    int sysfs_state_fd; // kept opened. Not used on host
     bool stopping;
     bool timer_armed;
-    struct timespec timer_end;
+    crm_timer_wheel_t *timers; // owned by the FSM thread
+    int timer_id;
     int mdm_state;
+    crm_hal_ping_stats_t ping_stats; // filled by the ping thread
 
     /* RPC Daemon management */
     int rpcd_inotify_socket;
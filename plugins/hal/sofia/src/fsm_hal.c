@@ -37,6 +37,7 @@
 #include "utils/keys.h"
 #include "utils/property.h"
 #include "utils/time.h"
+#include "utils/timer_wheel.h"
 
 #include "common.h"
 #include "fsm_hal.h"
@@ -45,6 +46,8 @@
 
 #include "libmdmcli/mdm_cli_dbg.h"
 
+#define TIMER_GRANULARITY 10  // time in ms
+
 typedef enum hal_sofia_states {
     ST_INITIAL,
     ST_OFF,
@@ -107,15 +110,22 @@ static void timer_start(crm_hal_ctx_internal_t *i_ctx, int ms)
     ASSERT(i_ctx->timer_armed == false);
 
     i_ctx->timer_armed = true;
-    crm_time_add_ms(&i_ctx->timer_end, ms);
+    i_ctx->timers->arm(i_ctx->timers, i_ctx->timer_id, ms);
 }
 
-static int get_timeout(crm_hal_ctx_internal_t *i_ctx)
+static void timer_stop(crm_hal_ctx_internal_t *i_ctx)
 {
-    if (i_ctx->timer_armed == false)
-        return -1;
+    ASSERT(i_ctx != NULL);
 
-    return crm_time_get_remain_ms(&i_ctx->timer_end);
+    i_ctx->timer_armed = false;
+    i_ctx->timers->cancel(i_ctx->timers, i_ctx->timer_id);
+}
+
+static void timer_expired(void *param)
+{
+    crm_fsm_ctx_t *fsm = param;
+
+    fsm->notify_event(fsm, EV_TIMEOUT, NULL);
 }
 
 static int notify_run(void *fsm_param, void *evt_param)
@@ -393,6 +403,20 @@ static int assert(void *fsm_param, void *evt_param)
     ASSERT(0);
 }
 
+static void notify_ping_stats(crm_hal_ctx_internal_t *i_ctx)
+{
+    char stats[64];
+
+    snprintf(stats, sizeof(stats), "ping: %d attempt(s), %dms", i_ctx->ping_stats.attempts,
+             i_ctx->ping_stats.time_ms);
+    LOGD("%s", stats);
+
+    const char *data[] = { stats };
+    mdm_cli_dbg_info_t dbg_info = { DBG_TYPE_STATS, DBG_DEFAULT_NO_LOG, DBG_DEFAULT_NO_LOG,
+                                    DBG_DEFAULT_NO_LOG, ARRAY_SIZE(data), data };
+    i_ctx->control->notify_client(i_ctx->control, MDM_DBG_INFO, sizeof(dbg_info), &dbg_info);
+}
+
 static int start_rpcd(void *fsm_param, void *evt_param)
 {
     (void)evt_param; // UNUSED
@@ -400,6 +424,7 @@ static int start_rpcd(void *fsm_param, void *evt_param)
     crm_hal_ctx_internal_t *i_ctx = (crm_hal_ctx_internal_t *)fsm_param;
 
     ASSERT(i_ctx != NULL);
+    notify_ping_stats(i_ctx);
     crm_hal_rpcd_start(i_ctx);
     timer_start(i_ctx, TIMEOUT_RPCD_START);
 
@@ -419,7 +444,7 @@ static void state_trans(int prev_state, int new_state, int evt, void *fsm_param,
     case ST_STOPPING:
     case ST_BOOTING:
         ASSERT(i_ctx->timer_armed == true);
-        i_ctx->timer_armed = false;
+        timer_stop(i_ctx);
         break;
 
     case ST_PINGING:
@@ -436,7 +461,7 @@ static void state_trans(int prev_state, int new_state, int evt, void *fsm_param,
 
     case ST_WAITING_RPC:
         ASSERT(i_ctx->timer_armed == true);
-        i_ctx->timer_armed = false;
+        timer_stop(i_ctx);
         if (new_state != ST_RUN)
             crm_hal_rpcd_stop(i_ctx);
         break;
@@ -497,6 +522,9 @@ void *crm_hal_sofia_fsm(crm_thread_ctx_t *thread_ctx, void *param)
                                       request_stop, i_ctx, CRM_MODULE_TAG, get_state_txt,
                                       get_event_txt);
 
+    i_ctx->timers = crm_timer_wheel_init(1, TIMER_GRANULARITY);
+    i_ctx->timer_id = i_ctx->timers->add(i_ctx->timers, timer_expired, fsm);
+
     ASSERT(i_ctx->mdm_state == EV_MDM_OFF || i_ctx->mdm_state == EV_MDM_ON);
     fsm->notify_event(fsm, i_ctx->mdm_state, NULL);
 
@@ -515,19 +543,21 @@ void *crm_hal_sofia_fsm(crm_thread_ctx_t *thread_ctx, void *param)
             { .fd = p_fd, .events = POLLIN },
             // INOTIFY - RPC Daemon event listener
             { .fd = crm_hal_rpcd_get_fd(i_ctx), .events = POLLIN },
+            // TIMER - FSM time-out
+            { .fd = i_ctx->timers->get_poll_fd(i_ctx->timers), .events = POLLIN },
+            // SYSFS - modem state notification. Must be last: POLLERR is set with POLLPRI
+            { .fd = i_ctx->sysfs_notify ? i_ctx->sysfs_state_fd : -1, .events = POLLPRI },
         };
 
-        int err = poll(pfd, ARRAY_SIZE(pfd), get_timeout(i_ctx));
+        poll(pfd, ARRAY_SIZE(pfd), -1);
 
-        for (size_t i = 0; i < ARRAY_SIZE(pfd); i++) {
+        for (size_t i = 0; i < ARRAY_SIZE(pfd) - 1; i++) {
             if (pfd[i].revents & (POLLERR | POLLHUP | POLLNVAL))
                 DASSERT(0, "error on fd: %zu", i);
         }
 
-        if (0 == err) {
-            ASSERT(i_ctx->timer_armed);
-            crm_ipc_msg_t msg = { .scalar = EV_TIMEOUT };
-            fsm->notify_event(fsm, msg.scalar, NULL);
+        if (pfd[4].revents & POLLIN) {
+            i_ctx->timers->process(i_ctx->timers);
         } else if (pfd[0].revents & POLLIN) {
             crm_ipc_msg_t msg;
             while (i_ctx->ipc->get_msg(i_ctx->ipc, &msg)) {
@@ -564,11 +594,19 @@ void *crm_hal_sofia_fsm(crm_thread_ctx_t *thread_ctx, void *param)
             int evt = crm_hal_rpcd_event(i_ctx);
             if (evt != -1)
                 fsm->notify_event(fsm, evt, NULL);
+        } else if (pfd[5].revents & POLLPRI) {
+            int evt = crm_hal_get_notified_mdm_state(i_ctx);
+            if (evt != -1) {
+                i_ctx->mdm_state = evt;
+                fsm->notify_event(fsm, evt, NULL);
+            }
         } else {
             ASSERT(0);
         }
     }
 
+    i_ctx->timers->dispose(i_ctx->timers);
+    i_ctx->timers = NULL;
     fsm->dispose(fsm);
 
     return NULL;
@@ -62,10 +62,14 @@ static void dispose(crm_hal_ctx_t *ctx)
     shutdown(i_ctx->s_fd, SHUT_RDWR);
     close(i_ctx->s_fd);
 
+    if (i_ctx->sysfs_state_fd >= 0)
+        close(i_ctx->sysfs_state_fd);
     free(i_ctx->vmodem_sysfs_mdm_state);
     free(i_ctx->vmodem_sysfs_mdm_ctrl);
     free(i_ctx->uevent_vmodem);
-    free(i_ctx->ping_node);
+    for (int i = 0; i < i_ctx->nb_ping_nodes; i++)
+        free(i_ctx->ping_nodes[i]);
+    free(i_ctx->ping_nodes);
     free(i_ctx->dump_node);
     free(i_ctx->flash_node);
 
@@ -97,14 +101,22 @@ crm_hal_ctx_t *crm_hal_init(int inst_id, bool host_debug, bool dump_enabled, tcs
     i_ctx->vmodem_sysfs_mdm_state = tcs->get_string(tcs, "vmodem_sysfs_mdm_state");
     i_ctx->vmodem_sysfs_mdm_ctrl = tcs->get_string(tcs, "vmodem_sysfs_mdm_ctrl");
     i_ctx->uevent_vmodem = tcs->get_string(tcs, "uevent_vmodem_filter");
-    i_ctx->ping_node = tcs->get_string(tcs, "ping_node");
     i_ctx->dump_node = tcs->get_string(tcs, "dump_node");
     ASSERT(i_ctx->vmodem_sysfs_mdm_state != NULL);
     ASSERT(i_ctx->vmodem_sysfs_mdm_ctrl != NULL);
     ASSERT(i_ctx->uevent_vmodem != NULL);
-    ASSERT(i_ctx->ping_node != NULL);
     ASSERT(i_ctx->dump_node != NULL);
 
+    /* Optional list of candidate nodes probed in parallel. Defaults to ping_node */
+    i_ctx->ping_nodes = tcs->get_string_array(tcs, "ping_nodes", &i_ctx->nb_ping_nodes);
+    if (!i_ctx->ping_nodes) {
+        i_ctx->nb_ping_nodes = 1;
+        i_ctx->ping_nodes = malloc(sizeof(char *));
+        ASSERT(i_ctx->ping_nodes != NULL);
+        i_ctx->ping_nodes[0] = tcs->get_string(tcs, "ping_node");
+        ASSERT(i_ctx->ping_nodes[0] != NULL);
+    }
+
     /* sanity check: is the size of node buffer in crm_hal_evt_t structure big enough to
      * store the path of link? */
     crm_hal_evt_t tmp;
@@ -129,7 +141,7 @@ crm_hal_ctx_t *crm_hal_init(int inst_id, bool host_debug, bool dump_enabled, tcs
         ASSERT(host_dbg_socket);
     }
 
-    i_ctx->s_fd = crm_hal_get_poll_mdm_fd(host_dbg_socket);
+    i_ctx->s_fd = crm_hal_get_poll_mdm_fd(i_ctx->uevent_vmodem, host_dbg_socket);
     free(host_dbg_socket);
 
     (void)dump_enabled;  // @TODO: use it once this hack is removed
@@ -146,6 +158,14 @@ crm_hal_ctx_t *crm_hal_init(int inst_id, bool host_debug, bool dump_enabled, tcs
     ASSERT(tcs->get_int(tcs, "ping_timeout", &i_ctx->ping_timeout) == 0);
     ASSERT(tcs->get_bool(tcs, "support_modem_up_at_start", &i_ctx->support_mdm_up_on_start) == 0);
 
+    /* Optional: set to true if the vmodem driver notifies the modem state sysfs attribute */
+    if (tcs->get_bool(tcs, "vmodem_sysfs_notify", &i_ctx->sysfs_notify))
+        i_ctx->sysfs_notify = false;
+#ifdef HOST_BUILD
+    i_ctx->sysfs_notify = false;
+#endif
+    i_ctx->sysfs_state_fd = -1;
+
     i_ctx->ipc = crm_ipc_init(CRM_IPC_THREAD);
     i_ctx->thread_fsm = crm_thread_init(crm_hal_sofia_fsm, i_ctx, false, false);
 
@@ -24,16 +24,14 @@
  * limitations under the License.
  */
 
-#ifdef HOST_BUILD
-#define _GNU_SOURCE // needed for strcasestr
-#endif
 #include <sys/socket.h>
 #include <sys/un.h>
-#include <linux/netlink.h>
 
 #include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
+#include <strings.h>
 #include <poll.h>
 #include <stdio.h>
 
@@ -48,6 +46,7 @@
 #include "common.h"
 #include "modem.h"
 #include "ping.h"
+#include "uevent.h"
 
 #define RECV_BUFFER 1024
 
@@ -76,50 +75,52 @@ static int open_debug_socket(const char *name)
     return fd;
 }
 
-static int open_uevent_netlink(void)
+static int read_sysfs_state(crm_hal_ctx_internal_t *i_ctx, char *value, size_t size)
 {
-    errno = 0;
-    int fd = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_KOBJECT_UEVENT);
-    DASSERT(fd >= 0, "Failed to open netlink socket (%s)", strerror(errno));
-
-    struct sockaddr_nl sa;
-    memset(&sa, 0, sizeof(sa));
-    sa.nl_family = AF_NETLINK;
-    sa.nl_pid = getpid();
-    sa.nl_groups = NETLINK_KOBJECT_UEVENT;
-
-    DASSERT(bind(fd, (struct sockaddr *)&sa, sizeof(sa)) == 0, "Failed to bind socket (%s)",
-            strerror(errno));
-
-    return fd;
+#ifdef HOST_BUILD
+    /* sysfs is emulated by a PTY on host: pread is not supported */
+    return crm_file_read(i_ctx->vmodem_sysfs_mdm_state, value, size);
+#else
+    /* the attribute is kept opened. Reading it also acknowledges the sysfs notification */
+    ssize_t len = pread(i_ctx->sysfs_state_fd, value, size - 1, 0);
+    if (len < 0) {
+        LOGE("Failed to read (%s) file. (%s)", i_ctx->vmodem_sysfs_mdm_state, strerror(errno));
+        return -1;
+    }
+    value[len] = '\0';
+    return 0;
+#endif
 }
 
-static int get_mdm_state_from_sysfs(const char *vmodem_sysfs_mdm_state)
+static int get_mdm_state_from_sysfs(crm_hal_ctx_internal_t *i_ctx)
 {
-    int ret = -1;
-    int err = -1;
+    static const struct {
+        const char *value;
+        int evt;
+    } states[] = {
+        { "off", EV_MDM_OFF },
+        { "on", EV_MDM_ON },
+        { "trap", EV_MDM_TRAP },
+        { "verify-fail", EV_MDM_FW_FAIL },
+        /* transitional states are not reported */
+        { "turning_on", -1 },
+        { "shutting_down", -1 },
+    };
+
+    ASSERT(i_ctx != NULL);
 
-    ASSERT(vmodem_sysfs_mdm_state != NULL);
     char tmp[15];
-    err = crm_file_read(vmodem_sysfs_mdm_state, tmp, sizeof(tmp));
+    int err = read_sysfs_state(i_ctx, tmp, sizeof(tmp));
     DASSERT(err == 0, "Failed to read SYSFS modem state value");
-    LOGD("[VMODEM] sysfs (%s) read: %s", vmodem_sysfs_mdm_state, tmp);
-
-    if (!err) {
-        if (strcasestr(tmp, "trap"))
-            ret = EV_MDM_TRAP;
-        else if (strcasestr(tmp, "turning_on") || strcasestr(tmp, "shutting_down"))
-            ret = -1;
-        else if (strcasestr(tmp, "on"))
-            ret = EV_MDM_ON;
-        else if (strcasestr(tmp, "off"))
-            ret = EV_MDM_OFF;
-        else if (strcasestr(tmp, "verify-fail"))
-            ret = EV_MDM_FW_FAIL;
-        else
-            DASSERT(0, "unknown sysfs value: %s", tmp);
-    }
-    return ret;
+    LOGD("[VMODEM] sysfs (%s) read: %s", i_ctx->vmodem_sysfs_mdm_state, tmp);
+
+    tmp[strcspn(tmp, " \r\n")] = '\0';
+    for (size_t i = 0; i < ARRAY_SIZE(states); i++)
+        if (!strcasecmp(tmp, states[i].value))
+            return states[i].evt;
+
+    DASSERT(0, "unknown sysfs value: %s", tmp);
+    return -1;
 }
 
 static bool is_modem_event(crm_hal_ctx_internal_t *i_ctx)
@@ -137,12 +138,20 @@ static bool is_modem_event(crm_hal_ctx_internal_t *i_ctx)
 
     if (pfd.revents & POLLIN) {
         char tmp[RECV_BUFFER];
-        ssize_t len = recv(i_ctx->s_fd, tmp, sizeof(tmp), 0);
+        ssize_t len = recv(i_ctx->s_fd, tmp, sizeof(tmp) - 1, 0);
         if (len > 0) {
-            tmp[len] = '\0';
-            if (0 == strcmp(tmp, i_ctx->uevent_vmodem)) {
-                LOGD("[VMODEM] UEVENT event: %s", i_ctx->uevent_vmodem);
+            crm_hal_uevent_t evt;
+            crm_hal_uevent_parse(tmp, len, &evt);
+            if (0 == strcmp(evt.header, i_ctx->uevent_vmodem)) {
+                const char *action = crm_hal_uevent_get(&evt, "ACTION");
+                LOGD("[VMODEM] UEVENT event: %s (action: %s)", i_ctx->uevent_vmodem,
+                     action ? action : "none");
                 ret = true;
+            } else {
+                /* Only the debug socket is not filtered by the kernel */
+                i_ctx->uevent_discarded++;
+                LOGV("[VMODEM] UEVENT discarded: %s. %d event(s) discarded", evt.header,
+                     i_ctx->uevent_discarded);
             }
         }
     }
@@ -157,8 +166,9 @@ void *crm_hal_ping_modem_thread(crm_thread_ctx_t *thread_ctx, void *param)
     ASSERT(i_ctx != NULL);
     ASSERT(thread_ctx != NULL);
 
-    int fd = crm_hal_ping_modem(i_ctx->ping_node, i_ctx->ping_timeout,
-                                thread_ctx->get_poll_fd(thread_ctx), false);
+    int fd = crm_hal_ping_modem((const char *const *)i_ctx->ping_nodes, i_ctx->nb_ping_nodes,
+                                i_ctx->ping_timeout, thread_ctx->get_poll_fd(thread_ctx), false,
+                                &i_ctx->ping_stats);
     /* ping operation can be aborted by writing in thread poll fd.
      * in that case, returned value is -2 */
     if (fd > -2) {
@@ -205,7 +215,14 @@ void crm_hal_init_modem(crm_hal_ctx_internal_t *i_ctx, bool force_stop)
         LOGV("modem silent reset ENABLED");
     }
 
-    i_ctx->mdm_state = get_mdm_state_from_sysfs(i_ctx->vmodem_sysfs_mdm_state);
+#ifndef HOST_BUILD
+    errno = 0;
+    i_ctx->sysfs_state_fd = open(i_ctx->vmodem_sysfs_mdm_state, O_RDONLY);
+    DASSERT(i_ctx->sysfs_state_fd >= 0, "open of (%s) failed (%s)",
+            i_ctx->vmodem_sysfs_mdm_state, strerror(errno));
+#endif
+
+    i_ctx->mdm_state = get_mdm_state_from_sysfs(i_ctx);
 
     bool stop_modem = force_stop || !i_ctx->support_mdm_up_on_start ||
                       i_ctx->mdm_state == EV_MDM_TRAP ||
@@ -230,7 +247,7 @@ void crm_hal_init_modem(crm_hal_ctx_internal_t *i_ctx, bool force_stop)
             if (0 == err) {
                 break;
             } else if (pfd.revents & POLLIN) {
-                int evt = crm_hal_get_mdm_state(i_ctx);
+                int evt = is_modem_event(i_ctx) ? get_mdm_state_from_sysfs(i_ctx) : -1;
                 if (evt != -1) {
                     i_ctx->mdm_state = evt;
                     if ((EV_MDM_OFF == i_ctx->mdm_state) || (EV_MDM_TRAP == i_ctx->mdm_state))
@@ -244,10 +261,10 @@ void crm_hal_init_modem(crm_hal_ctx_internal_t *i_ctx, bool force_stop)
 /**
  * @see modem.h
  */
-int crm_hal_get_poll_mdm_fd(const char *host_socket_name)
+int crm_hal_get_poll_mdm_fd(const char *uevent_filter, const char *host_socket_name)
 {
     if (!host_socket_name)
-        return open_uevent_netlink();
+        return crm_hal_uevent_open(uevent_filter);
     else
         return open_debug_socket(host_socket_name);
 }
@@ -257,8 +274,20 @@ int crm_hal_get_poll_mdm_fd(const char *host_socket_name)
  */
 int crm_hal_get_mdm_state(crm_hal_ctx_internal_t *i_ctx)
 {
-    if (is_modem_event(i_ctx))
-        return get_mdm_state_from_sysfs(i_ctx->vmodem_sysfs_mdm_state);
+    /* if sysfs notification is supported, uevents are redundant: they are only flushed */
+    if (is_modem_event(i_ctx) && !i_ctx->sysfs_notify)
+        return get_mdm_state_from_sysfs(i_ctx);
     else
         return -1;
 }
+
+/**
+ * @see modem.h
+ */
+int crm_hal_get_notified_mdm_state(crm_hal_ctx_internal_t *i_ctx)
+{
+    ASSERT(i_ctx != NULL);
+    ASSERT(i_ctx->sysfs_notify);
+
+    return get_mdm_state_from_sysfs(i_ctx);
+}
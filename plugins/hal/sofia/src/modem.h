@@ -40,13 +40,15 @@
 /**
  * Returns the file descriptor that needs to be polled (READ) to receive a message notification
  * This file descriptor can only be used to receive events. It cannot be used to read, write.
+ * Uevents not matching uevent_filter are dropped by the kernel.
  *
+ * @param [in] uevent_filter    Header of the modem uevent (action@devpath)
  * @param [in] host_socket_name Socket path. Used in HOST debug mode only
  *
  * @return file descriptor
  * @return -1 in case of error
  */
-int crm_hal_get_poll_mdm_fd(const char *host_socket_name);
+int crm_hal_get_poll_mdm_fd(const char *uevent_filter, const char *host_socket_name);
 
 /**
  * Returns the modem state. Must be called when an event is notified by the polled FD
@@ -55,6 +57,14 @@ int crm_hal_get_poll_mdm_fd(const char *host_socket_name);
  */
 int crm_hal_get_mdm_state(crm_hal_ctx_internal_t *i_ctx);
 
+/**
+ * Returns the modem state. Must be called when the sysfs modem state attribute is notified
+ * (POLLPRI). Only used if sysfs notification is enabled
+ *
+ * @return -1 if the state is transitional
+ */
+int crm_hal_get_notified_mdm_state(crm_hal_ctx_internal_t *i_ctx);
+
 /**
  * Sends a PING AT command to check if modem is running. This function notifies EV_MDM_RUN or
  * EV_TIMEOUT
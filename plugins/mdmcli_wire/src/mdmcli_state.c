@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) Intel 2015
+ *
+ * CRM has been designed by:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Erwan Bracq <erwan.bracq@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *  - Marc Bellanger <marc.bellanger@intel.com>
+ *
+ * Original CRM contributors are:
+ *  - Cesar De Oliveira <cesar.de.oliveira@intel.com>
+ *  - Lionel Ulmer <lionel.ulmer@intel.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CRM_MODULE_TAG "CLIS"
+#include "utils/common.h"
+#include "utils/logs.h"
+#include "plugins/mdmcli_state.h"
+
+/* The page is kept in tmpfs: it does not outlive the boot */
+#ifdef HOST_BUILD
+#define STATE_PAGE "/tmp/crm%d.state"
+#else
+#define STATE_PAGE "/dev/socket/crm%d.state"
+#endif
+
+#define STATE_MAGIC 0x53524d43 // 'CRMS'
+#define STATE_VERSION 3
+
+/* Bounds the time spent by a reader while the writer is in the middle of an update */
+#define MAX_READ_RETRIES 10000
+
+/* Layout of the page shared between CRM and its clients */
+typedef struct state_page {
+    uint32_t magic; // written last by the writer once the page is valid
+    uint32_t version;
+    uint32_t seq; // sequence lock: odd while the page is being updated
+    uint32_t state;
+    uint32_t sequence;
+    uint32_t reserved;
+    int64_t timestamp;
+    int64_t crm_start;
+    int64_t heartbeat; // CLOCK_MONOTONIC of the last writer refresh, in ms. Out of the lock
+} state_page_t;
+
+typedef struct crm_mdmcli_state_internal_ctx {
+    crm_mdmcli_state_ctx_t ctx; // Needs to be first
+
+    state_page_t *page;
+    bool writer;
+} crm_mdmcli_state_internal_ctx_t;
+
+static int64_t get_time_ms(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Only one writer (CRM) updates the page: its own reads of the page are not racy */
+static void write_page(state_page_t *page, mdm_cli_event_t state, int64_t crm_start)
+{
+    int64_t now = get_time_ms(CLOCK_BOOTTIME);
+
+    __atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&page->state, (uint32_t)state, __ATOMIC_RELAXED);
+    __atomic_store_n(&page->sequence, page->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&page->timestamp, now, __ATOMIC_RELAXED);
+    __atomic_store_n(&page->crm_start, crm_start, __ATOMIC_RELAXED);
+    __atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&page->heartbeat, get_time_ms(CLOCK_MONOTONIC), __ATOMIC_RELEASE);
+}
+
+/**
+ * @see mdmcli_state.h
+ */
+static void publish(crm_mdmcli_state_ctx_t *ctx, mdm_cli_event_t state)
+{
+    crm_mdmcli_state_internal_ctx_t *i_ctx = (crm_mdmcli_state_internal_ctx_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+    ASSERT(i_ctx->writer);
+    ASSERT(state == MDM_DOWN || state == MDM_ON || state == MDM_UP || state == MDM_OOS);
+
+    if (i_ctx->page->state != (uint32_t)state)
+        write_page(i_ctx->page, state, i_ctx->page->crm_start);
+}
+
+/**
+ * @see mdmcli_state.h
+ */
+static int refresh(crm_mdmcli_state_ctx_t *ctx)
+{
+    crm_mdmcli_state_internal_ctx_t *i_ctx = (crm_mdmcli_state_internal_ctx_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+    ASSERT(i_ctx->writer);
+
+    /* Readers do not check the heartbeat of a modem down */
+    if (i_ctx->page->state == MDM_DOWN)
+        return -1;
+
+    int64_t now = get_time_ms(CLOCK_MONOTONIC);
+    int64_t elapsed = now - i_ctx->page->heartbeat;
+    if (elapsed >= CRM_MDMCLI_STATE_HEARTBEAT_PERIOD) {
+        __atomic_store_n(&i_ctx->page->heartbeat, now, __ATOMIC_RELEASE);
+        elapsed = 0;
+    }
+
+    return CRM_MDMCLI_STATE_HEARTBEAT_PERIOD - elapsed;
+}
+
+/**
+ * @see mdmcli_state.h
+ */
+static int read_page(const crm_mdmcli_state_ctx_t *ctx, crm_mdmcli_state_t *state)
+{
+    const crm_mdmcli_state_internal_ctx_t *i_ctx = (const crm_mdmcli_state_internal_ctx_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+    ASSERT(state != NULL);
+
+    state_page_t *page = i_ctx->page;
+    for (int i = 0; i < MAX_READ_RETRIES; i++) {
+        uint32_t seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+            continue;
+
+        state->state = __atomic_load_n(&page->state, __ATOMIC_RELAXED);
+        state->sequence = __atomic_load_n(&page->sequence, __ATOMIC_RELAXED);
+        state->timestamp = __atomic_load_n(&page->timestamp, __ATOMIC_RELAXED);
+        state->crm_start = __atomic_load_n(&page->crm_start, __ATOMIC_RELAXED);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) != seq)
+            continue;
+
+        /* CRM stopped refreshing the page without publishing MDM_DOWN: it was killed.
+         * clock_gettime is served by the vDSO */
+        int64_t heartbeat = __atomic_load_n(&page->heartbeat, __ATOMIC_ACQUIRE);
+        if (state->state != MDM_DOWN &&
+            get_time_ms(CLOCK_MONOTONIC) - heartbeat > CRM_MDMCLI_STATE_HEARTBEAT_TIMEOUT)
+            state->state = MDM_DOWN;
+        return 0;
+    }
+
+    return -1;
+}
+
+/**
+ * @see mdmcli_state.h
+ */
+static void dispose(crm_mdmcli_state_ctx_t *ctx)
+{
+    crm_mdmcli_state_internal_ctx_t *i_ctx = (crm_mdmcli_state_internal_ctx_t *)ctx;
+
+    ASSERT(i_ctx != NULL);
+
+    if (i_ctx->writer)
+        publish(ctx, MDM_DOWN);
+    munmap(i_ctx->page, sizeof(state_page_t));
+    free(i_ctx);
+}
+
+static state_page_t *map_page(bool writer, const char *path)
+{
+    int fd;
+
+    if (writer) {
+        fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        /* Permissions are set explicitly as the file is created according to the umask */
+        if (fd >= 0 && (fchmod(fd, 0644) || ftruncate(fd, sizeof(state_page_t)))) {
+            close(fd);
+            fd = -1;
+        }
+    } else {
+        struct stat st;
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0 && (fstat(fd, &st) || st.st_size < (off_t)sizeof(state_page_t))) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd < 0)
+        return NULL;
+
+    void *map = mmap(NULL, sizeof(state_page_t), writer ? PROT_READ | PROT_WRITE : PROT_READ,
+                     MAP_SHARED, fd, 0);
+    close(fd);
+
+    return map == MAP_FAILED ? NULL : map;
+}
+
+/**
+ * @see mdmcli_state.h
+ */
+crm_mdmcli_state_ctx_t *crm_mdmcli_state_init(bool writer, int instance_id)
+{
+    char path[64];
+
+    snprintf(path, sizeof(path), STATE_PAGE, instance_id);
+
+    state_page_t *page = map_page(writer, path);
+    if (writer && page == NULL) {
+        LOGE("failed to map state page (%s). errno: %d/%s", path, errno, strerror(errno));
+    } else if (writer) {
+        if (page->magic != STATE_MAGIC || page->version != STATE_VERSION) {
+            memset(page, 0, sizeof(*page));
+            page->version = STATE_VERSION;
+        }
+        /* Previous instance of CRM may have been killed in the middle of an update */
+        if (page->seq & 1)
+            page->seq++;
+        write_page(page, MDM_DOWN, get_time_ms(CLOCK_BOOTTIME));
+        __atomic_store_n(&page->magic, STATE_MAGIC, __ATOMIC_RELEASE);
+        LOGD("state page (%s) published. sequence: %u", path, page->sequence);
+    } else if (page != NULL && (__atomic_load_n(&page->magic, __ATOMIC_ACQUIRE) != STATE_MAGIC ||
+                                page->version != STATE_VERSION)) {
+        munmap(page, sizeof(state_page_t));
+        page = NULL;
+    }
+
+    if (page == NULL)
+        return NULL;
+
+    crm_mdmcli_state_internal_ctx_t *i_ctx = calloc(1, sizeof(*i_ctx));
+    ASSERT(i_ctx != NULL);
+
+    i_ctx->page = page;
+    i_ctx->writer = writer;
+
+    i_ctx->ctx.dispose = dispose;
+    i_ctx->ctx.publish = publish;
+    i_ctx->ctx.refresh = refresh;
+    i_ctx->ctx.read = read_page;
+
+    return &i_ctx->ctx;
+}
@@ -46,7 +46,7 @@
 
 /* The maximum message size is for a 'restart' message that contains:
  * - HEADER
- *   - Event/Request ID : 'sizeof(uint32_t) bytes'
+ *   - Event/Request ID : 'sizeof(uint32_t) bytes'. The 16 MSb are the correlation id
  *   - data len         : 'sizeof(uint32_t) bytes'
  * - RESTART CAUSE
  *   - restart cause    : 'sizeof(uint32_t) bytes'
@@ -64,6 +64,8 @@
  */
 
 #define MSG_HEADER_SIZE (2 * sizeof(uint32_t))
+#define MSG_ID_MASK 0xFFFF
+#define MSG_CORR_ID_SHIFT 16
 #define MSG_RESTART_CAUSE (1 * sizeof(uint32_t))
 #define MSG_DBG_DATA_FIXED_SIZE (5 * sizeof(uint32_t))
 #define MSG_DBG_DATA_DYNAMIC_SIZE_MAX (MDM_CLI_MAX_NB_DATA * \
@@ -196,27 +198,23 @@ static char *deserialize_string(const unsigned char **buffer, size_t *remaining_
  * @see mdmcli_wire.h
  */
 static void *serialize_msg(crm_mdmcli_wire_ctx_t *ctx, const crm_mdmcli_wire_msg_t *msg,
-                           bool allocate)
+                           void *dest)
 {
     ASSERT(ctx != NULL);
     ASSERT(msg != NULL);
     crm_mdmcli_wire_ctx_internal_t *i_ctx = (crm_mdmcli_wire_ctx_internal_t *)ctx;
 
-    ASSERT(((msg->id < MDM_NUM_EVENTS) && (i_ctx->direction == CRM_SERVER_TO_CLIENT)) ||
-           ((msg->id >= CRM_REQ_REGISTER) && (i_ctx->direction == CRM_CLIENT_TO_SERVER)));
-
-    unsigned char *buf;
-    size_t remaining;
-    if (allocate) {
-        buf = malloc(MSG_SIZE_MAX);
-        remaining = MSG_SIZE_MAX;
-    } else {
-        buf = i_ctx->snd_buf;
-        remaining = sizeof(i_ctx->snd_buf);
-    }
+    ASSERT(((msg->id < MDM_NUM_EVENTS || msg->id == CRM_RSP_DONE) &&
+            (i_ctx->direction == CRM_SERVER_TO_CLIENT)) ||
+           ((msg->id >= CRM_REQ_REGISTER && msg->id != CRM_RSP_DONE) &&
+            (i_ctx->direction == CRM_CLIENT_TO_SERVER)));
+    ASSERT(msg->corr_id >= 0 && msg->corr_id <= CRM_MDMCLI_CORR_ID_MAX);
+
+    unsigned char *buf = dest ? dest : i_ctx->snd_buf;
+    size_t remaining = MSG_SIZE_MAX;
     unsigned char *ret_buf = buf;
 
-    serialize_uint32(msg->id, &buf, &remaining);
+    serialize_uint32(msg->id | ((uint32_t)msg->corr_id << MSG_CORR_ID_SHIFT), &buf, &remaining);
     unsigned char *size_buf = buf;
     size_t size_remaining = remaining;
     /* Serialize a place holder for the message size (it will be overwritten once size is known). */
@@ -226,6 +224,9 @@ static void *serialize_msg(crm_mdmcli_wire_ctx_t *ctx, const crm_mdmcli_wire_msg
         /* In case of register, serialize events bitmap and client name */
         serialize_uint32(msg->msg.register_client.events_bitmap, &buf, &remaining);
         serialize_string(msg->msg.register_client.name, &buf, &remaining);
+    } else if (msg->id == CRM_RSP_DONE) {
+        serialize_uint32(msg->msg.response.status, &buf, &remaining);
+        serialize_uint32(msg->msg.response.crm_time, &buf, &remaining);
     } else if ((msg->id == CRM_REQ_RESTART) || (msg->id == CRM_REQ_NOTIFY_DBG) ||
                (msg->id == MDM_DBG_INFO)) {
         const mdm_cli_dbg_info_t *dbg_ptr;
@@ -257,6 +258,15 @@ static void *serialize_msg(crm_mdmcli_wire_ctx_t *ctx, const crm_mdmcli_wire_msg
     return ret_buf;
 }
 
+/**
+ * @see mdmcli_wire.h
+ */
+static size_t get_msg_size_max(crm_mdmcli_wire_ctx_t *ctx)
+{
+    (void)ctx;  // UNUSED
+    return MSG_SIZE_MAX;
+}
+
 /**
  * @see mdmcli_wire.h
  */
@@ -286,7 +296,7 @@ static int send_serialized_msg(crm_mdmcli_wire_ctx_t *ctx, const void *msg, int
  */
 static int send_msg(crm_mdmcli_wire_ctx_t *ctx, const crm_mdmcli_wire_msg_t *msg, int socket)
 {
-    const void *data = serialize_msg(ctx, msg, false);
+    const void *data = serialize_msg(ctx, msg, NULL);
 
     return send_serialized_msg(ctx, data, socket);
 }
@@ -326,7 +336,9 @@ static crm_mdmcli_wire_msg_t *recv_msg(crm_mdmcli_wire_ctx_t *ctx, int socket)
     size_t remaining_data = MSG_HEADER_SIZE;
     bool error;
 
-    msg->id = deserialize_uint32(&buf, &remaining_data, &error);
+    uint32_t id = deserialize_uint32(&buf, &remaining_data, &error);
+    msg->id = id & MSG_ID_MASK;
+    msg->corr_id = id >> MSG_CORR_ID_SHIFT;
     size_t msg_size = deserialize_uint32(&buf, &remaining_data, &error);
     if (error) {
         LOGE("failed to read message header");
@@ -354,6 +366,14 @@ static crm_mdmcli_wire_msg_t *recv_msg(crm_mdmcli_wire_ctx_t *ctx, int socket)
             LOGE("failed to read REGISTER message");
             return NULL;
         }
+    } else if (msg->id == CRM_RSP_DONE) {
+        msg->msg.response.status = deserialize_uint32(&buf, &remaining_data, &error);
+        if (!error)
+            msg->msg.response.crm_time = deserialize_uint32(&buf, &remaining_data, &error);
+        if (error) {
+            LOGE("failed to read DONE message");
+            return NULL;
+        }
     } else if ((msg->id == CRM_REQ_RESTART) || (msg->id == CRM_REQ_NOTIFY_DBG) ||
                (msg->id == MDM_DBG_INFO)) {
         const mdm_cli_dbg_info_t **dbg_info_storage;
@@ -420,6 +440,7 @@ crm_mdmcli_wire_ctx_t *crm_mdmcli_wire_init(crm_mdmcli_wire_direction_t directio
     i_ctx->ctx.send_msg = send_msg;
     i_ctx->ctx.recv_msg = recv_msg;
     i_ctx->ctx.serialize_msg = serialize_msg;
+    i_ctx->ctx.get_msg_size_max = get_msg_size_max;
     i_ctx->ctx.send_serialized_msg = send_serialized_msg;
 
     return &i_ctx->ctx;
@@ -50,7 +50,7 @@ int main(void)
     ASSERT(strcmp(ctx[0]->get_socket_name(ctx[0]), "crm0") == 0);
     ASSERT(strcmp(ctx[1]->get_socket_name(ctx[1]), "crm5") == 0);
 
-    crm_mdmcli_wire_msg_t s_msg;
+    crm_mdmcli_wire_msg_t s_msg = { .corr_id = 0 };
     crm_mdmcli_wire_msg_t *r_msg;
 
     /* Test REGISTER message */
@@ -191,6 +191,26 @@ int main(void)
 
     ASSERT(r_msg->id == s_msg.id);
 
+    /* Testing request correlation id and 'DONE' response */
+    LOGD("Testing correlation id and DONE message");
+    s_msg.id = CRM_REQ_ACQUIRE;
+    s_msg.corr_id = CRM_MDMCLI_CORR_ID_MAX;
+    ctx[1]->send_msg(ctx[1], &s_msg, p_fd[1]);
+    r_msg = ctx[0]->recv_msg(ctx[0], p_fd[0]);
+    ASSERT(r_msg->id == s_msg.id);
+    ASSERT(r_msg->corr_id == s_msg.corr_id);
+
+    s_msg.id = CRM_RSP_DONE;
+    s_msg.msg.response.status = -1;
+    s_msg.msg.response.crm_time = 1234;
+    ctx[0]->send_msg(ctx[0], &s_msg, p_fd[1]);
+    r_msg = ctx[1]->recv_msg(ctx[1], p_fd[0]);
+    ASSERT(r_msg->id == s_msg.id);
+    ASSERT(r_msg->corr_id == s_msg.corr_id);
+    ASSERT(r_msg->msg.response.status == s_msg.msg.response.status);
+    ASSERT(r_msg->msg.response.crm_time == s_msg.msg.response.crm_time);
+    s_msg.corr_id = 0;
+
     /* Testing 'DBG_INFO' message */
     LOGD("Testing DBG_INFO messages (no debug info, not a real use case :) )");
     s_msg.id = MDM_DBG_INFO;
@@ -245,7 +265,7 @@ int main(void)
     s_msg.msg.register_client.events_bitmap = 0x12345678;
     s_msg.msg.register_client.name = "TEST ME !!!";
 
-    const void *serialized_msg = ctx[1]->serialize_msg(ctx[1], &s_msg, false);
+    const void *serialized_msg = ctx[1]->serialize_msg(ctx[1], &s_msg, NULL);
     ctx[1]->send_serialized_msg(ctx[1], serialized_msg, p_fd[1]);
     r_msg = ctx[0]->recv_msg(ctx[0], p_fd[0]);
 
@@ -254,7 +274,9 @@ int main(void)
     ASSERT(r_msg->msg.register_client.events_bitmap == s_msg.msg.register_client.events_bitmap);
     ASSERT(strcmp(r_msg->msg.register_client.name, s_msg.msg.register_client.name) == 0);
 
-    serialized_msg = ctx[1]->serialize_msg(ctx[1], &s_msg, true);
+    void *buf = malloc(ctx[1]->get_msg_size_max(ctx[1]));
+    serialized_msg = ctx[1]->serialize_msg(ctx[1], &s_msg, buf);
+    ASSERT(serialized_msg == buf);
     ctx[1]->send_serialized_msg(ctx[1], serialized_msg, p_fd[1]);
     r_msg = ctx[0]->recv_msg(ctx[0], p_fd[0]);
 
@@ -263,7 +285,7 @@ int main(void)
     ASSERT(r_msg->msg.register_client.events_bitmap == s_msg.msg.register_client.events_bitmap);
     ASSERT(strcmp(r_msg->msg.register_client.name, s_msg.msg.register_client.name) == 0);
 
-    free((void *)serialized_msg);
+    free(buf);
 
     /* Testing error scenarios */
     LOGD("Testing invalid message lengths");
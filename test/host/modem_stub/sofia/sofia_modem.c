@@ -833,12 +833,11 @@ static void loop_event(sofia_mdm_ctx_t *ctx)
         } else if (pfd[7].revents & POLLIN) { // streamline node
             char tmp[1124];                   //look at fw_upload.c
 
-            ssize_t len = read(s_fd, tmp, sizeof(tmp));
+            ssize_t len = read(s_fd, tmp, sizeof(tmp) - 1);
 
             if (len < 0)
                 len = 0;
 
-            ASSERT((size_t)len < sizeof(tmp));
             tmp[len] = '\0';
 
             /* @TODO: simulate streamline errors here */
@@ -846,7 +845,8 @@ static void loop_event(sofia_mdm_ctx_t *ctx)
              * - index script value
              * - commands received (config_script vs run_configuration)
              */
-            if (strstr(tmp, "\r\n"))
+            /* commands can be pipelined: one answer per command */
+            for (char *eol = tmp; (eol = strchr(eol, '\n')) != NULL; eol++)
                 write(s_fd, "OK\r\n", 4);
         }
 
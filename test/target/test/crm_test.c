@@ -34,7 +34,9 @@
 
 #define CRM_MODULE_TAG "CRMT"
 #include "utils/logs.h"
+#include "utils/instance.h"
 #include "utils/property.h"
+#include "utils/state.h"
 #include "utils/string_helpers.h"
 #include "utils/keys.h"
 #include "utils/ipc.h"
@@ -212,7 +214,7 @@ static void check_reset_counter(mdm_cli_hdle_t *mdm, crm_ipc_ctx_t *ipc, int reb
 
     char value[CRM_PROPERTY_VALUE_MAX];
     snprintf(value, sizeof(value), "%d", reboot + 1);
-    crm_property_set(CRM_KEY_REBOOT_COUNTER, value);
+    crm_property_set(CRM_KEY_DBG_REBOOT_COUNTER, value);
 
     timeout += 10;
     KLOG("Waiting for reset delay of: %d milliseconds", timeout);
@@ -223,8 +225,12 @@ static void check_reset_counter(mdm_cli_hdle_t *mdm, crm_ipc_ctx_t *ipc, int reb
     wait_evt(ipc, MDM_DBG_INFO, DBG_TYPE_STATS);
     wait_evt(ipc, MDM_UP, -1);
 
-    /* System reboot property is reset to 0, so providing default value as 1. */
-    crm_property_get(CRM_KEY_REBOOT_COUNTER, value, "1");
+    /* Reboot counter is reset to 0, so providing default value as 1. */
+    char state_store[64];
+    snprintf(state_store, sizeof(state_store), CRM_STATE_STORE, crm_instance_get());
+    crm_state_init(state_store, CRM_STATE_READ_ONLY);
+    crm_state_get(CRM_STATE_KEY_REBOOT_COUNTER, value, "1");
+    crm_state_dispose();
     errno = 0;
     long reboot_counter = strtol(value, NULL, 0);
     ASSERT(errno == 0);
@@ -405,19 +411,19 @@ int main(int argc, char *argv[])
         /* cold reset done once in stability timeout, decrement cold reset by 1  */
         check_cold_reset(mdm, ipc, cold_reset - 1);
 
-        /* Set system reboot property to max reboot value to move to OOS state directly */
+        /* Set reboot counter to max reboot value to move to OOS state directly */
         KLOG("escalation OOS");
         char value[CRM_PROPERTY_VALUE_MAX];
         snprintf(value, sizeof(value), "%d", reboot + 1);
-        crm_property_set(CRM_KEY_REBOOT_COUNTER, value);
+        crm_property_set(CRM_KEY_DBG_REBOOT_COUNTER, value);
 
         ASSERT(mdm_cli_restart(mdm, RESTART_MDM_ERR, &g_dbg_info) == 0);
         wait_evt(ipc, MDM_DOWN, -1);
         wait_evt(ipc, MDM_DBG_INFO, -1);
         wait_evt(ipc, MDM_OOS, -1);
 
-        /* Reset system reboot property value to 0 */
-        crm_property_set(CRM_KEY_REBOOT_COUNTER, "0");
+        /* Reset reboot counter to 0 */
+        crm_property_set(CRM_KEY_DBG_REBOOT_COUNTER, "0");
 
         ASSERT(mdm_cli_disconnect(mdm) == 0);
     }